@@ -1,4 +1,5 @@
 #include <string.h>
+#include <stdio.h>
 
 const char HEADER[] = "HTTP/1.1 200 OK\r\n" \
                       "Access-Control-Allow-Origin: *\r\n" \
@@ -9,7 +10,32 @@ const int hdrLen = strlen(HEADER);
 const int bdrLen = strlen(BOUNDARY);
 const int cntLen = strlen(CTNTTYPE);
 
+// Chunked variant: the same multipart body, carried in HTTP/1.1 chunks (one chunk per frame)
+const char CHEADER[] = "HTTP/1.1 200 OK\r\n" \
+                       "Access-Control-Allow-Origin: *\r\n" \
+                       "Content-Type: multipart/x-mixed-replace; boundary=123456789000000000000987654321\r\n" \
+                       "Transfer-Encoding: chunked\r\n\r\n";
+const char CBOUNDARY[] = "\r\n--123456789000000000000987654321\r\n\r\n"; // BOUNDARY plus the chunk's trailing CRLF
+const int chdLen = strlen(CHEADER);
+const int cbdLen = strlen(CBOUNDARY);
+
 const char JHEADER[] = "HTTP/1.1 200 OK\r\n" \
                        "Content-disposition: inline; filename=capture.jpg\r\n" \
                        "Content-type: image/jpeg\r\n\r\n";
-const int jhdLen = strlen(JHEADER);
\ No newline at end of file
+const int jhdLen = strlen(JHEADER);
+
+// Builds a frame's part header in place (CTNTTYPE + length + blank line), prefixed with the chunk
+// size line in chunked mode. The frame then goes out as header, JPEG, BOUNDARY/CBOUNDARY.
+static inline int mjpegPartHeader(char *buf, size_t size, size_t frameLen, bool chunked)
+{
+  char len[16];
+  int lenLen = snprintf(len, sizeof(len), "%u\r\n\r\n", (unsigned)frameLen);
+  int off = 0;
+  if (chunked)
+    off = snprintf(buf, size, "%X\r\n", (unsigned)(cntLen + lenLen + frameLen + bdrLen));
+  if (off < 0 || off + cntLen + lenLen > (int)size)
+    return 0;
+  memcpy(buf + off, CTNTTYPE, cntLen);
+  memcpy(buf + off + cntLen, len, lenLen);
+  return off + cntLen + lenLen;
+}
@@ -0,0 +1,172 @@
+// Generated by tools/embed_assets.py from web/, do not edit
+#ifndef WEB_ASSETS_H_
+#define WEB_ASSETS_H_
+
+#include <StaticAsset.h>
+
+static const uint8_t asset_login_html[] = {
+  0x1f,0x8b,0x08,0x00,0x00,0x00,0x00,0x00,0x02,0x03,0x75,0x53,0x4d,0x8b,0xdb,0x30,0x10,0xbd,0xfb,0x57,
+  0xa8,0x2e,0x6c,0x12,0x58,0xdb,0x4d,0xb6,0x0b,0x8b,0xbf,0x2e,0xdd,0x14,0x0a,0x85,0x0d,0xb4,0x3d,0xf4,
+  0xa8,0x58,0xe3,0x44,0x60,0x7d,0x20,0x8d,0x9d,0xa4,0x4b,0xfe,0x7b,0x47,0x76,0xb2,0x65,0xd9,0xed,0x49,
+  0x9a,0x27,0xcd,0x9b,0x79,0x6f,0xa4,0xf2,0xc3,0xe3,0xd3,0x97,0x9f,0xbf,0x37,0x6b,0xb6,0x47,0xd5,0xd5,
+  0x51,0x39,0x2e,0xe5,0x1e,0xb8,0xa0,0x40,0x01,0x72,0xd6,0xec,0xb9,0xf3,0x80,0x55,0xdc,0x63,0x9b,0x3c,
+  0xc4,0x57,0x58,0x73,0x05,0x55,0x3c,0x48,0x38,0x58,0xe3,0x30,0x66,0x8d,0xd1,0x08,0x9a,0xae,0x1d,0xa4,
+  0xc0,0x7d,0x25,0x60,0x90,0x0d,0x24,0x63,0x70,0xcb,0xa4,0x96,0x28,0x79,0x97,0xf8,0x86,0x77,0x50,0x2d,
+  0x03,0x09,0x4a,0xec,0xa0,0x5e,0xff,0xd8,0xdc,0xad,0xd8,0x77,0xb3,0x93,0x9a,0x6d,0xf8,0x0e,0xca,0x6c,
+  0xc2,0xa3,0xd2,0xe3,0x89,0xd6,0xad,0x11,0xa7,0xe7,0x96,0xa8,0x93,0x96,0x2b,0xd9,0x9d,0x72,0xcf,0xb5,
+  0x4f,0x3c,0x38,0xd9,0x16,0x8a,0x3b,0x4a,0xcb,0x97,0xa0,0x18,0xef,0xd1,0x50,0x7c,0x9c,0xea,0xe5,0xf7,
+  0x2b,0x50,0x85,0xe5,0x42,0x48,0xbd,0xcb,0x3f,0x31,0xba,0x71,0x6e,0x8d,0x53,0xb7,0xa9,0xe5,0x1a,0xba,
+  0xe7,0xad,0x71,0x02,0x5c,0xbe,0xb4,0x47,0xe6,0x4d,0x27,0x05,0xfb,0xd8,0x34,0x4d,0x31,0xa1,0x89,0xe3,
+  0x42,0xf6,0x3e,0xff,0x6c,0x8f,0xff,0x18,0xd2,0x07,0xe2,0x9b,0xca,0x25,0x5b,0x83,0x68,0x54,0xa8,0x7a,
+  0x2e,0xb3,0xa9,0xc9,0xa8,0xcc,0x46,0xc3,0xca,0xd0,0x2d,0x45,0xa1,0xd6,0xc5,0x9f,0x2e,0x28,0xfb,0x4a,
+  0x71,0x90,0xbc,0xbf,0x7b,0x47,0x2f,0x81,0x64,0x06,0xdf,0x8e,0x3c,0xe8,0xea,0x12,0x45,0xfd,0x8b,0x04,
+  0x86,0xfc,0x9c,0xec,0x10,0x23,0x52,0x4a,0x6d,0x7b,0x64,0x78,0xb2,0x44,0x8a,0x70,0x24,0xc3,0xbd,0xfc,
+  0x43,0xfb,0xd5,0x7d,0x7c,0x29,0xd5,0x07,0x57,0x44,0x5c,0x4f,0x39,0x19,0x51,0xbd,0xf0,0x6d,0xb8,0xf7,
+  0x07,0x92,0xf7,0x1f,0x3e,0x7b,0x39,0x7e,0xcb,0x69,0x0f,0xef,0x13,0xbe,0x4a,0xf7,0xfd,0x56,0x49,0x6a,
+  0x68,0xe0,0x5d,0x4f,0xe1,0x28,0xee,0x75,0x56,0x76,0xd5,0x97,0x05,0x6b,0xc2,0x70,0x1b,0x27,0x2d,0xd6,
+  0x91,0x30,0x4d,0xaf,0xe8,0xd5,0xa4,0x01,0xf7,0xe9,0x8b,0x5b,0xa9,0xd1,0x13,0x2b,0xab,0x58,0xdb,0xeb,
+  0x06,0xa5,0xd1,0x6c,0x0e,0x0b,0xf6,0x1c,0x41,0x6a,0x1d,0x0c,0x94,0xf3,0x08,0x2d,0xef,0x3b,0x9c,0x2f,
+  0x8a,0x68,0xe0,0x8e,0x8d,0xa6,0x57,0x0c,0x52,0xa4,0x39,0x01,0x16,0x91,0x6c,0xd9,0x3c,0x80,0xe9,0x64,
+  0x4c,0x3a,0xb6,0xc7,0xaa,0x8a,0xcd,0xb8,0x50,0x52,0xcf,0xd8,0xcd,0xcd,0x98,0x94,0x92,0xc8,0x37,0x87,
+  0x8b,0xe8,0x20,0xb5,0x30,0x87,0xd4,0x58,0xd0,0xf3,0x59,0x46,0x14,0x03,0xb8,0x6f,0x5a,0xc0,0x71,0x46,
+  0x05,0xa1,0xf3,0x10,0xd1,0x53,0x76,0x38,0x9f,0xad,0x9d,0x33,0x8e,0x5d,0x2d,0x66,0xb4,0xbf,0x8e,0x2f,
+  0xdc,0x3c,0x17,0xa4,0xfa,0x2a,0xb7,0xcc,0xc6,0x17,0x42,0x43,0x1f,0x3f,0xdb,0x5f,0x10,0xee,0x2f,0xc7,
+  0x7d,0x03,0x00,0x00};
+
+static const uint8_t asset_update_html[] = {
+  0x1f,0x8b,0x08,0x00,0x00,0x00,0x00,0x00,0x02,0x03,0x7d,0x55,0xef,0x6f,0xdb,0x36,0x10,0xfd,0xae,0xbf,
+  0xe2,0xaa,0x22,0x93,0xdc,0xd9,0xb2,0xd3,0xae,0x40,0x61,0x4b,0x2e,0xb0,0x36,0xc3,0x5a,0xac,0x4b,0xb0,
+  0xa4,0x40,0x87,0x61,0x18,0x68,0xf1,0x64,0x71,0x90,0x48,0x95,0xa4,0xfc,0x63,0x69,0xfe,0xf7,0xdd,0x51,
+  0xb6,0x93,0xb4,0x40,0xbf,0x58,0x22,0xef,0xe9,0xdd,0xbb,0x77,0x47,0x3a,0x7f,0xf2,0xf6,0xf2,0xcd,0xcd,
+  0x9f,0x57,0x17,0x50,0xfb,0xb6,0x59,0x46,0x79,0x78,0xe4,0x35,0x0a,0x49,0x8b,0x16,0xbd,0x80,0xb2,0x16,
+  0xd6,0xa1,0x2f,0xe2,0xde,0x57,0x93,0x57,0xf1,0x71,0x5b,0x8b,0x16,0x8b,0x78,0xa3,0x70,0xdb,0x19,0xeb,
+  0x63,0x28,0x8d,0xf6,0xa8,0x09,0xb6,0x55,0xd2,0xd7,0x85,0xc4,0x8d,0x2a,0x71,0x12,0x16,0x63,0x50,0x5a,
+  0x79,0x25,0x9a,0x89,0x2b,0x45,0x83,0xc5,0x39,0x93,0x78,0xe5,0x1b,0x5c,0x5e,0x5c,0x5f,0xbd,0x78,0x0e,
+  0x1f,0x3b,0x29,0x3c,0xe6,0xd3,0x61,0x2f,0xca,0x9d,0xdf,0xd3,0x73,0x65,0xe4,0xfe,0xb6,0x22,0xda,0x49,
+  0x25,0x5a,0xd5,0xec,0xe7,0x4e,0x68,0x37,0x71,0x68,0x55,0xb5,0x68,0x85,0x5d,0x2b,0x3d,0x3f,0xc7,0x16,
+  0x44,0xef,0x0d,0xad,0x77,0x43,0xae,0xf9,0xcb,0xe7,0xd8,0x2e,0x3a,0x21,0xa5,0xd2,0xeb,0xf9,0x0c,0x08,
+  0x71,0x57,0x19,0xdb,0x8e,0xb3,0x4e,0x68,0x6c,0x6e,0x57,0xc6,0x4a,0xb4,0xf3,0xf3,0x6e,0x07,0xce,0x34,
+  0x4a,0xc2,0xd3,0xb2,0x2c,0x17,0xc3,0xee,0xc4,0x0a,0xa9,0x7a,0x37,0xff,0xa9,0xdb,0xdd,0x33,0x64,0xaf,
+  0x88,0x6f,0x48,0x37,0x59,0x19,0xef,0x4d,0xcb,0x59,0xef,0xf2,0xe9,0x20,0x32,0xca,0xa7,0xc1,0xac,0x9c,
+  0xd5,0xd2,0x8a,0x73,0x81,0x92,0xe4,0x56,0xd7,0x18,0x21,0xff,0xe1,0x35,0x97,0x5b,0xbf,0x58,0xfe,0xa2,
+  0x6c,0xbb,0x15,0x16,0xa1,0x3f,0x94,0x4b,0x7b,0x51,0xae,0x74,0xd7,0x7b,0xf0,0xfb,0x8e,0xdc,0xac,0x54,
+  0x83,0xf1,0xc1,0xd9,0x01,0x14,0x7f,0x85,0x70,0xfd,0xaa,0x55,0xe4,0xf6,0x46,0x34,0x3d,0x2d,0x3f,0x9e,
+  0x40,0x53,0x4e,0x44,0x4f,0xa9,0x36,0x50,0x36,0xc2,0xb9,0x22,0x0e,0x05,0xc7,0xcb,0xbc,0xb3,0x66,0x6d,
+  0xd1,0xb9,0x20,0x6b,0x25,0x6c,0x0c,0xe4,0x56,0x11,0x9f,0xcf,0x66,0x27,0x1e,0x7a,0x0b,0xe5,0x1c,0xba,
+  0x37,0x07,0x0a,0x9e,0xd1,0xa7,0xd3,0xe3,0xb7,0xcb,0x40,0xcc,0x04,0x9d,0x5d,0xc7,0xcb,0xe3,0xf6,0x1c,
+  0x66,0x67,0xf9,0x94,0x42,0xcb,0xe1,0x97,0x5a,0x57,0x5a,0xd5,0xf9,0x65,0xb4,0x11,0x16,0x82,0x17,0x05,
+  0x48,0x53,0xf6,0x2d,0x8d,0x46,0xb6,0x46,0x7f,0xd1,0x20,0xbf,0xfe,0xbc,0x7f,0x27,0xd3,0xe4,0x81,0x45,
+  0xc9,0x68,0x0c,0xc4,0xfc,0x3d,0x34,0x85,0x09,0x15,0x51,0x01,0xdf,0x43,0x51,0x98,0xb9,0xd8,0xc9,0x31,
+  0x58,0xf4,0x56,0xa1,0x5b,0x44,0x55,0xaf,0x4b,0xaf,0x8c,0x06,0x57,0x9b,0x6d,0xea,0x71,0xe7,0x29,0x5d,
+  0xe9,0x47,0x70,0x1b,0x11,0x6d,0xc6,0x1b,0x6f,0x86,0xf9,0x25,0x6e,0x5e,0x2d,0x22,0x55,0x41,0x4a,0x10,
+  0x78,0x52,0x14,0xd0,0x6b,0x89,0x95,0xd2,0x28,0x47,0x40,0xfc,0x59,0x30,0x8d,0x80,0x14,0x5e,0x44,0x77,
+  0x0f,0xc8,0x51,0xcb,0x54,0x04,0x56,0x2e,0x7f,0x57,0xb3,0x52,0x8d,0x5b,0xf8,0xf4,0xe1,0xb7,0x5f,0xbd,
+  0xef,0xfe,0xc0,0xcf,0x3d,0x3a,0x9f,0x8e,0x16,0x11,0xc5,0x32,0xd3,0xa1,0x4e,0x93,0xab,0xcb,0xeb,0x9b,
+  0x64,0x0c,0xc9,0xd4,0x78,0xf1,0xda,0xa9,0xff,0xb0,0x48,0xe0,0xc7,0xa0,0x3f,0xe3,0x15,0xbd,0x27,0x3f,
+  0x98,0xaa,0xe2,0x13,0xc8,0x01,0xa2,0x1f,0xbe,0x1e,0xcc,0xcb,0x8c,0x3e,0xb5,0xb7,0x80,0x93,0x92,0x14,
+  0x37,0x27,0x19,0x5c,0x44,0x01,0x1f,0x84,0xaf,0x33,0x6b,0xa8,0x92,0x94,0x24,0x12,0x11,0x21,0x32,0x66,
+  0xe0,0xa2,0xa6,0x0f,0xf2,0x3d,0xe3,0xde,0x53,0x8e,0xe0,0x54,0x72,0xdf,0x68,0x4e,0xce,0x54,0xa4,0xe7,
+  0x2c,0x19,0xdc,0xa3,0xe2,0x0f,0x95,0x68,0x66,0x7a,0x24,0xe0,0x98,0x9d,0x65,0xbd,0xbf,0xbe,0xfc,0x9d,
+  0x8e,0x1f,0xdd,0x22,0x29,0xa3,0x89,0xaf,0x33,0xda,0xe1,0x0d,0xf9,0x7c,0x4c,0xe4,0x32,0xe7,0x69,0x92,
+  0x81,0xcc,0x4e,0xa4,0xd1,0x98,0xc0,0x6b,0x48,0x36,0x7c,0xd4,0x15,0x4a,0x6e,0xe4,0xca,0x18,0x4f,0xe7,
+  0x31,0x81,0x39,0x1c,0xb1,0xa4,0x64,0x90,0x45,0x5f,0x5b,0xac,0x7a,0x87,0x12,0xbe,0x7c,0xa1,0x30,0x5a,
+  0x6b,0xec,0xe8,0xa1,0xbc,0xb0,0xf3,0x8d,0x3e,0x6e,0xf1,0x61,0x44,0x26,0x13,0x58,0xc2,0x6c,0x14,0x91,
+  0xcd,0x37,0xaa,0x45,0xd3,0xfb,0xf4,0x31,0xb6,0x42,0x5f,0xd6,0x69,0xe8,0x52,0x32,0xca,0x7c,0x4d,0xad,
+  0xbb,0x07,0x58,0x42,0xf0,0xb0,0xf5,0x56,0x83,0xcd,0xfe,0x75,0x46,0x53,0x8f,0xe1,0xee,0x1b,0x9c,0x63,
+  0x5c,0x98,0x12,0x56,0x5c,0xa2,0xda,0x90,0xfb,0x0c,0x24,0xa9,0x63,0xf6,0x7d,0x76,0x2f,0x3a,0xc0,0x86,
+  0xb6,0x34,0x74,0x93,0xf2,0x5c,0x8d,0xc2,0xb4,0xd1,0x69,0xa1,0x8a,0x86,0x8b,0xe0,0x71,0xcf,0x59,0x27,
+  0x66,0x9d,0xc5,0x0d,0x0d,0xf2,0x5b,0xac,0x44,0xdf,0x84,0x61,0x63,0x16,0x46,0xf2,0x97,0xc3,0xb5,0x92,
+  0xf1,0x96,0xfb,0x6b,0xf6,0xf7,0x22,0x3a,0x18,0x40,0xf1,0x97,0xc3,0xd0,0x73,0x68,0x34,0xa8,0x3c,0xc8,
+  0xa1,0xbb,0xee,0x70,0xaa,0xf3,0x69,0xb8,0xe6,0xe8,0xea,0x0a,0xff,0x16,0xff,0x03,0x30,0xba,0x42,0x57,
+  0x3e,0x06,0x00,0x00};
+
+static const uint8_t asset_dash_html[] = {
+  0x1f,0x8b,0x08,0x00,0x00,0x00,0x00,0x00,0x02,0x03,0x8d,0x57,0xeb,0x73,0xd3,0x38,0x10,0xff,0x9e,0xbf,
+  0x42,0x98,0xb9,0xb1,0x73,0x24,0xb6,0x93,0x86,0xd2,0xe6,0x35,0x03,0x6d,0x03,0xdc,0xc1,0xd0,0xa3,0x85,
+  0xbb,0x1b,0xb8,0xc9,0xc8,0xb6,0x9c,0x08,0x64,0xcb,0x27,0xc9,0x79,0x5c,0xe9,0xff,0x7e,0xbb,0xb2,0xf3,
+  0xe8,0x0b,0xf8,0x52,0x47,0xab,0xdf,0x3e,0xb4,0xbf,0xdd,0x95,0x3a,0x7c,0x74,0xfa,0xee,0xe4,0xf2,0xef,
+  0xf3,0x33,0x32,0x37,0x99,0x18,0x37,0x86,0xf6,0x33,0x9c,0x33,0x9a,0xc0,0x22,0x63,0x86,0x92,0x78,0x4e,
+  0x95,0x66,0x66,0xe4,0x94,0x26,0x6d,0x1f,0x39,0x1b,0x71,0x4e,0x33,0x36,0x72,0x16,0x9c,0x2d,0x0b,0xa9,
+  0x8c,0x43,0x62,0x99,0x1b,0x96,0x03,0x6c,0xc9,0x13,0x33,0x1f,0x25,0x6c,0xc1,0x63,0xd6,0xb6,0x8b,0x16,
+  0xe1,0x39,0x37,0x9c,0x8a,0xb6,0x8e,0xa9,0x60,0xa3,0x0e,0x1a,0x31,0xdc,0x08,0x36,0x3e,0xbb,0x38,0x3f,
+  0xe8,0xb6,0x4f,0x9e,0xbf,0x25,0xa7,0x54,0xcf,0x23,0x49,0x55,0x32,0x0c,0xaa,0xad,0xc6,0x50,0x9b,0x35,
+  0x7c,0x23,0x99,0xac,0xaf,0x52,0xb0,0xde,0x4e,0x69,0xc6,0xc5,0xba,0xaf,0x69,0xae,0xdb,0x9a,0x29,0x9e,
+  0x0e,0x32,0xaa,0x66,0x3c,0xef,0x77,0x58,0x46,0x68,0x69,0x24,0xac,0x57,0x95,0xcb,0xfe,0xd3,0x2e,0xcb,
+  0x06,0x05,0x4d,0x12,0x9e,0xcf,0xfa,0x21,0x01,0xc4,0x75,0x2a,0x55,0xd6,0xf2,0x0b,0x9a,0x33,0x71,0x15,
+  0x49,0x95,0x30,0xd5,0xef,0x14,0x2b,0xa2,0xa5,0xe0,0x09,0x79,0x1c,0xc7,0xf1,0xa0,0x92,0xb6,0x15,0x4d,
+  0x78,0xa9,0xfb,0xbd,0x62,0xb5,0xb3,0xe0,0x1f,0x81,0xbd,0xca,0x5d,0x3b,0x92,0xc6,0xc8,0x0c,0xbd,0x5e,
+  0xf3,0x6c,0x76,0x95,0x70,0x5d,0x08,0xba,0xee,0x47,0x42,0xc6,0x5f,0x07,0x95,0xfb,0x4e,0x18,0xfe,0x72,
+  0x0f,0xdc,0xd7,0x86,0x1a,0xbd,0xd5,0x98,0x29,0x9e,0x0c,0xf0,0x4f,0xdb,0xb0,0x0c,0x24,0x86,0xb5,0x63,
+  0x29,0xca,0x2c,0xd7,0x7d,0xc5,0x0a,0x46,0x8d,0x87,0xa7,0x6a,0xa7,0x5c,0x88,0x56,0xc6,0x73,0x38,0x9d,
+  0x77,0xcc,0xb2,0x56,0x27,0x55,0xcd,0xe6,0x60,0x46,0x0b,0x08,0xeb,0xe9,0xd6,0x2a,0x89,0x6e,0x45,0x62,
+  0x73,0xa6,0xf9,0x7f,0xac,0xdf,0xf1,0x0f,0x00,0x36,0x0c,0xaa,0x84,0x36,0x86,0x81,0xe5,0x77,0x88,0x99,
+  0x45,0xca,0x0f,0xee,0xa7,0x01,0xe4,0x8d,0x21,0x1c,0x90,0x68,0x15,0x8f,0x9c,0x20,0xfb,0x52,0xb0,0x99,
+  0x43,0xa8,0x00,0x8e,0x05,0x5f,0x30,0xa2,0x8d,0x62,0x34,0x43,0x2e,0x13,0xbe,0x20,0xb1,0xa0,0x5a,0x8f,
+  0x1c,0x9b,0x5e,0x62,0x03,0x72,0x08,0x4f,0x46,0x4e,0xf5,0x73,0x2c,0x24,0xc5,0x44,0x56,0x3b,0xbe,0xef,
+  0x0f,0x03,0x50,0x02,0x55,0x24,0xc5,0xe2,0xe2,0x74,0x66,0xcb,0x82,0x46,0x36,0x44,0xa3,0xc6,0x43,0x93,
+  0x8c,0xdf,0x33,0xa0,0xa7,0x34,0x5c,0xe6,0x7d,0xa8,0x8b,0xc4,0xca,0x86,0x9a,0x09,0x16,0x9b,0xba,0x02,
+  0x53,0x05,0x1f,0x3c,0x25,0x6a,0xcb,0x02,0xa1,0x64,0x41,0x45,0x09,0x5b,0x4f,0x9d,0xf1,0x1f,0x1f,0x5f,
+  0x3e,0x27,0x07,0xdd,0x70,0xd5,0xed,0x85,0xc3,0xa0,0xda,0xbe,0x83,0x3b,0x74,0xc6,0x27,0xaf,0x27,0xa4,
+  0x17,0x02,0xec,0xf8,0xf0,0x41,0xd8,0x33,0x67,0xfc,0x0a,0xcd,0xf5,0x8e,0xc2,0x15,0x98,0x7c,0x10,0x07,
+  0x3d,0x82,0xb0,0xc3,0x5e,0xb8,0x02,0xe8,0x83,0xb0,0x63,0x67,0x7c,0x81,0xb8,0x23,0x70,0x7b,0x18,0x3e,
+  0x8c,0xeb,0x84,0xce,0xf8,0x2f,0xc0,0x75,0xc2,0x6e,0x6f,0xf5,0xec,0xf0,0xe8,0x61,0x20,0xf4,0xd5,0xab,
+  0x53,0xd2,0xe9,0x42,0x7c,0xcf,0xbe,0x13,0x5f,0xa7,0x0b,0x9e,0xad,0x45,0x44,0xa2,0xd9,0x87,0xa1,0x07,
+  0xce,0xf8,0x83,0x85,0x42,0x84,0xab,0x4e,0xf7,0x46,0x98,0x41,0xc5,0xc3,0xb8,0x22,0x26,0x00,0xc6,0xb6,
+  0xb4,0xfd,0x76,0x7e,0xf6,0x92,0xfc,0x5b,0x52,0xc1,0xcd,0x9a,0x78,0xbd,0xf6,0xe1,0x41,0x8b,0x08,0xb9,
+  0x64,0x8a,0x70,0xa8,0x53,0x66,0x0c,0x53,0xcd,0x3d,0x42,0x79,0x5e,0x94,0x86,0x98,0x75,0x01,0x2e,0xf3,
+  0x32,0x8b,0x98,0x72,0x6a,0x76,0x6b,0x1b,0x0e,0x81,0xf2,0x1f,0x39,0x3d,0xf8,0xd2,0x15,0x10,0x06,0x61,
+  0xdd,0xe3,0x75,0x82,0xa5,0x40,0xa2,0x32,0x4d,0x99,0xd2,0x3f,0x65,0x3e,0x8d,0xa6,0xb1,0x2c,0x73,0x53,
+  0xdb,0xef,0xd4,0xf6,0xef,0x37,0x7f,0xc3,0x8e,0x2e,0xa3,0x8c,0x83,0x5e,0x9d,0xa8,0xe7,0x45,0x21,0xd6,
+  0x1b,0x2d,0x93,0x6c,0x2b,0xbf,0xd4,0x37,0x4d,0x05,0x9b,0xfa,0x0e,0xb0,0xf0,0x71,0xc6,0xc5,0x8a,0x17,
+  0x66,0xdc,0x58,0x50,0x45,0x52,0x32,0x22,0x89,0x8c,0xcb,0x0c,0xe6,0xa8,0x3f,0x63,0xe6,0x4c,0x30,0xfc,
+  0xf9,0x62,0xfd,0x3a,0xf1,0x5c,0xe8,0x0f,0xb7,0xd9,0x82,0xfe,0xf9,0x1e,0xa8,0x72,0x59,0xe1,0x70,0x24,
+  0xfc,0x00,0x0a,0xc8,0x41,0x23,0x2d,0xf3,0xd8,0x72,0xae,0xe7,0x72,0xe9,0xc5,0x4d,0x72,0x45,0x52,0x7f,
+  0xdb,0x55,0xbe,0x3d,0x20,0x18,0x8a,0x77,0xb2,0x01,0x00,0x6a,0x62,0xf6,0xb6,0x6b,0x09,0x6e,0x6e,0xd2,
+  0xba,0xaf,0x5c,0x8b,0x06,0xe4,0xba,0x91,0x32,0x13,0xcf,0x3d,0x37,0x50,0x0c,0x2e,0x8d,0x94,0xc3,0xb9,
+  0x7c,0x33,0x67,0xb9,0xb7,0x8d,0xc4,0x53,0x18,0x85,0x62,0xa6,0x54,0x39,0x51,0xfe,0x17,0x2d,0x73,0xaf,
+  0x09,0x9a,0x35,0x0e,0x03,0xc5,0xc0,0x7d,0x99,0x57,0x34,0x80,0x87,0x9d,0x2e,0x03,0xdd,0x06,0xf3,0x0b,
+  0xc5,0x16,0x70,0xd8,0x53,0x96,0xd2,0x52,0x18,0x50,0x6f,0x68,0xe3,0x1b,0xb6,0x32,0x27,0xd5,0x45,0x05,
+  0x3a,0xae,0x65,0x0d,0xa6,0x12,0xcc,0x23,0x77,0x70,0x37,0xac,0x16,0x04,0x01,0x77,0xdd,0x5c,0x26,0x7d,
+  0xe2,0x9e,0xbf,0xbb,0xb8,0x04,0x09,0xce,0xcc,0x3e,0xc9,0xd9,0x92,0x7c,0x78,0xff,0xe6,0x82,0x51,0x15,
+  0xcf,0xcf,0x29,0x24,0x46,0x7b,0x28,0x9b,0x00,0xa9,0xa7,0xd4,0x50,0x2f,0x6d,0x36,0x21,0xdc,0xc6,0xcf,
+  0x9e,0xeb,0x0e,0x10,0x69,0x68,0xf0,0x14,0x7e,0xf8,0xf2,0x2b,0x2a,0xd5,0xe4,0x0c,0xc8,0xdd,0x53,0x5c,
+  0x2c,0x39,0x04,0xce,0xa0,0xe8,0x72,0xe2,0x92,0x27,0x90,0x6c,0x23,0x0d,0x15,0xd3,0x4c,0xc3,0xc2,0x25,
+  0xf0,0xf1,0x2a,0x71,0x26,0x13,0x86,0xa2,0xa6,0x8b,0x2c,0x30,0xa1,0xd9,0x3d,0xd6,0x26,0x94,0x0b,0x86,
+  0x07,0xb6,0x2a,0x4c,0x29,0xa9,0x06,0x8d,0x6b,0x48,0xdf,0xf5,0xc0,0x16,0x29,0x8c,0x79,0xc4,0xe5,0xa5,
+  0x10,0x7b,0xb5,0x03,0x69,0x52,0x3c,0xd6,0x1e,0x1a,0xc3,0xd0,0x11,0x99,0x01,0xec,0x0a,0xb4,0x50,0xe6,
+  0xc3,0xc5,0xc4,0x8d,0xe7,0x7e,0xce,0x81,0x6c,0x28,0xfd,0x33,0x0a,0xa9,0xde,0x1d,0x57,0xf0,0x9c,0x6d,
+  0x4e,0xfc,0x08,0x17,0xe4,0xdb,0x37,0x82,0xdf,0x4f,0xe1,0x3f,0x64,0x04,0x51,0x3d,0x76,0x9b,0x75,0xde,
+  0xaa,0x28,0x74,0x01,0xc6,0x11,0xe0,0x63,0x3c,0xaf,0xf3,0x84,0xad,0xde,0xa5,0x70,0x4c,0x2c,0x7d,0x6c,
+  0xed,0xcd,0xae,0x16,0xf0,0x0a,0xf1,0x8e,0xa1,0x1f,0x8a,0xa6,0x0f,0x77,0xaa,0xa0,0xb0,0x0c,0x3e,0x5f,
+  0xf9,0xbf,0x7e,0xbe,0x0e,0x5a,0xc4,0xc5,0x06,0xc8,0x3e,0xa1,0x06,0xf8,0x21,0xde,0xe6,0x27,0x78,0x0f,
+  0x9b,0x90,0x80,0x02,0x9f,0x3e,0x13,0xb8,0xbb,0x8c,0xb7,0x67,0x0e,0x9c,0x3f,0x21,0x9d,0x66,0xb3,0xca,
+  0x4b,0x4d,0x67,0x06,0xab,0x5d,0x3e,0x0c,0x24,0xd1,0x13,0x34,0x62,0xa2,0x55,0x8d,0x88,0x3d,0xe2,0x5d,
+  0xbc,0x2f,0xc7,0x98,0x5f,0x0b,0x40,0x46,0x86,0x91,0x5d,0x57,0xed,0x82,0xeb,0x20,0x1a,0x57,0x37,0xa4,
+  0xa5,0x6a,0x6b,0xb6,0x90,0x42,0x78,0x98,0xa8,0x4d,0xad,0xd6,0x79,0xff,0x51,0x07,0x21,0x05,0xfb,0x1d,
+  0xb4,0xc3,0xdd,0x26,0xec,0x06,0x91,0x90,0x4b,0xb9,0x04,0x21,0x94,0x34,0xf3,0xe1,0xa7,0x07,0x92,0xb4,
+  0xc0,0xb1,0xe2,0xb6,0xa1,0x17,0xbe,0x46,0x9b,0xdf,0x03,0xcb,0x1c,0x52,0xb1,0xb1,0x85,0x1b,0x1e,0x6a,
+  0xb7,0x6d,0xc5,0xf8,0xb0,0x11,0xc0,0x15,0x16,0x86,0x50,0x34,0x56,0xcb,0xf3,0xb2,0x7a,0xa2,0x4c,0x63,
+  0x5a,0x40,0x9c,0x2c,0x99,0xda,0xba,0xdd,0x68,0x3c,0xb0,0x8d,0x76,0x34,0x1c,0x43,0x4e,0xf8,0x8a,0x25,
+  0x5e,0x07,0x18,0xa8,0xe3,0x40,0x8b,0xd5,0x9b,0x64,0x1a,0xad,0x0d,0x28,0xde,0x32,0x77,0x77,0xcf,0xda,
+  0xb2,0x71,0x75,0x7b,0x3b,0x93,0x21,0x12,0xdb,0xa8,0xeb,0xfc,0x8a,0x98,0x3e,0x66,0xa1,0x45,0xb2,0x3e,
+  0x24,0xe8,0x1a,0xc7,0x08,0xbe,0x60,0x78,0x9e,0x33,0xf5,0xea,0xf2,0xed,0x1b,0xc0,0x58,0xb2,0xdd,0x8f,
+  0xf0,0x14,0x86,0x7b,0x07,0xf2,0xb2,0x75,0x15,0x0b,0x0e,0x5d,0xa5,0xb7,0xe5,0x54,0x01,0x4f,0xaa,0xf3,
+  0x60,0x26,0x5d,0x9b,0x4f,0xd8,0x6a,0x54,0x5b,0x17,0xd8,0x84,0xbf,0xbf,0x08,0x74,0x9d,0xdd,0x9d,0xd2,
+  0x05,0xcc,0x5d,0x88,0xb4,0x1e,0xb2,0xfb,0x4e,0xb6,0x63,0xd9,0x76,0x7b,0x60,0x1b,0x77,0xbb,0x59,0xe3,
+  0x77,0x1e,0x4e,0x95,0x2c,0x0a,0x98,0x15,0x95,0x96,0xb5,0x53,0xa7,0x39,0xa9,0x76,0xea,0xac,0xdd,0x0c,
+  0xf9,0xad,0xb4,0xd5,0x62,0x27,0x6a,0xa5,0x94,0x59,0xc9,0xb4,0x92,0xdc,0xd4,0xa9,0x3d,0x4d,0x14,0x63,
+  0x04,0x1e,0x9a,0x05,0x1c,0x08,0x54,0x90,0x1d,0x5c,0x41,0xbc,0x8c,0x55,0x24,0xd4,0x0a,0x77,0xf3,0xbf,
+  0x73,0xfc,0x27,0x9f,0x70,0x92,0xbc,0xc8,0xac,0xcf,0x25,0x4f,0xf9,0x54,0x69,0xcd,0xa7,0x49,0x94,0xd9,
+  0xee,0xf3,0x63,0x6a,0x6e,0x0c,0x12,0x3b,0x2a,0x2d,0x41,0xb7,0xc6,0x5a,0x75,0x1f,0x96,0x39,0x5d,0xc0,
+  0x7c,0xc3,0x3b,0xd8,0xbd,0x77,0xee,0x5a,0x7d,0x66,0x2e,0x79,0xc6,0x64,0x69,0x3c,0xec,0xb7,0x16,0x81,
+  0x67,0x4f,0x68,0x9b,0x07,0xeb,0xa2,0x6a,0xc1,0x01,0x3e,0x7f,0xea,0xab,0x1b,0x9a,0x15,0x1f,0xd2,0xf0,
+  0x60,0xb6,0xff,0x42,0xfd,0x0f,0x05,0x92,0x61,0xe5,0x53,0x0d,0x00,0x00};
+
+static const StaticAsset webAssets[] = {
+  {"/", "text/html", asset_login_html, sizeof(asset_login_html), 893, "\"6165ea661e9c6fe8\""},
+  {"/serverIndex", "text/html", asset_update_html, sizeof(asset_update_html), 1598, "\"fa88028f1c953bf2\""},
+  {"/dash", "text/html", asset_dash_html, sizeof(asset_dash_html), 3411, "\"086efec1b061eec1\""},
+};
+#define WEB_ASSET_COUNT (sizeof(webAssets) / sizeof(webAssets[0]))
+
+#endif // WEB_ASSETS_H_
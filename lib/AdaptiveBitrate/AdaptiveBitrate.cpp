@@ -0,0 +1,182 @@
+#include "AdaptiveBitrate.h"
+#include <string.h>
+
+AdaptiveBitrate::AdaptiveBitrate(const AbrLevel *ladder, uint8_t levels) : _ladder(ladder), _levels(levels)
+{
+  _ceiling = 0;
+  _qualityFloor = 0;
+  _level = 0;
+  _enabled = true;
+  _targetFps = 15;
+  _window_us = 2000000;
+  _windowStart = 0;
+  _downStreak = _upStreak = _hold = 0;
+  _lastFps = _lastBusy = 0;
+  _changes = 0;
+  _apply = NULL;
+  _applyCtx = NULL;
+  memset(_clients, 0, sizeof(_clients));
+}
+
+void AdaptiveBitrate::configure(float targetFps, uint32_t window_ms)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  _targetFps = targetFps;
+  _window_us = window_ms * 1000;
+}
+
+void AdaptiveBitrate::onApply(ApplyFn apply, void *ctx)
+{
+  _apply = apply;
+  _applyCtx = ctx;
+}
+
+void AdaptiveBitrate::setCeiling(uint8_t best)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  _ceiling = best < _levels ? best : _levels - 1;
+  if (_level < _ceiling)
+    _level = _ceiling;
+}
+
+void AdaptiveBitrate::setQualityFloor(uint8_t quality)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  _qualityFloor = quality;
+}
+
+AbrLevel AdaptiveBitrate::current(void) const
+{
+  AbrLevel l = _ladder[_level];
+  if (l.quality < _qualityFloor)
+    l.quality = _qualityFloor;
+  return l;
+}
+
+void AdaptiveBitrate::setLevel(uint8_t level)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  if (level >= _levels)
+    level = _levels - 1;
+  _level = level < _ceiling ? _ceiling : level;
+  _downStreak = _upStreak = 0;
+  _hold = ABR_HOLD_WINDOWS;
+}
+
+void AdaptiveBitrate::setEnabled(bool enabled)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  _enabled = enabled;
+  _downStreak = _upStreak = 0;
+}
+
+AdaptiveBitrate::Client *AdaptiveBitrate::find(const void *client, bool create)
+{
+  Client *empty = NULL;
+  for (int i = 0; i < ABR_MAX_CLIENTS; i++)
+  {
+    if (_clients[i].key == client)
+      return &_clients[i];
+    if (!_clients[i].key && !empty)
+      empty = &_clients[i];
+  }
+  if (create && empty)
+  {
+    memset(empty, 0, sizeof(*empty));
+    empty->key = client;
+  }
+  return create ? empty : NULL;
+}
+
+void AdaptiveBitrate::frameSent(const void *client, size_t bytes, uint32_t busy_us)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  Client *c = find(client, true);
+  if (!c)
+    return;
+  c->frames++;
+  c->bytes += bytes;
+  c->busy_us += busy_us;
+}
+
+void AdaptiveBitrate::clientGone(const void *client)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  Client *c = find(client, false);
+  if (c)
+    memset(c, 0, sizeof(*c));
+}
+
+void AdaptiveBitrate::step(int delta)
+{
+  int next = (int)_level + delta;
+  if (next < _ceiling || next >= _levels)
+    return;
+  _level = next;
+  _changes++;
+  _hold = ABR_HOLD_WINDOWS;
+  _downStreak = _upStreak = 0;
+  if (_apply)
+    _apply(current(), _applyCtx);
+}
+
+bool AdaptiveBitrate::tick(uint64_t now_us)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  if (!_windowStart)
+    _windowStart = now_us;
+  uint64_t elapsed = now_us - _windowStart;
+  if (elapsed < _window_us)
+    return false;
+  _windowStart = now_us;
+
+  // Judge by the worst attached client: lowest fps, busiest link
+  float worstFps = 1e9f, worstBusy = 0, worstLoad = 0;
+  bool any = false;
+  for (int i = 0; i < ABR_MAX_CLIENTS; i++)
+  {
+    Client &c = _clients[i];
+    if (!c.key)
+      continue;
+    any = true;
+    float fps = c.frames * 1e6f / elapsed;
+    float busy = (float)c.busy_us / elapsed;
+    if (fps < worstFps)
+      worstFps = fps;
+    // A sensor running faster than the target keeps the link busier than the target needs;
+    // what counts for stepping up is the share the target rate would take at this level
+    float load = c.frames ? busy * _targetFps / fps : busy;
+    if (busy > worstBusy)
+      worstBusy = busy;
+    if (load > worstLoad)
+      worstLoad = load;
+    c.frames = 0;
+    c.bytes = 0;
+    c.busy_us = 0;
+  }
+  if (!any)
+    return false;
+  _lastFps = worstFps;
+  _lastBusy = worstBusy;
+  if (!_enabled)
+    return false;
+  if (_hold)
+  {
+    _hold--;
+    return false;
+  }
+
+  uint8_t before = _level;
+  // Both conditions: a low fps on an idle link is the sensor's doing, a busy link at full
+  // rate is only well used
+  bool congested = worstFps < _targetFps * ABR_DOWN_FPS && worstBusy > ABR_DOWN_BUSY;
+  bool headroom = worstFps >= _targetFps * ABR_UP_FPS && worstLoad < ABR_UP_BUSY;
+  // Between the two bands nothing moves, which is what keeps the loop from oscillating
+  _downStreak = congested ? _downStreak + 1 : 0;
+  _upStreak = headroom ? _upStreak + 1 : 0;
+  if (_downStreak >= ABR_DOWN_WINDOWS)
+    step(+1);
+  else if (_upStreak >= ABR_UP_WINDOWS)
+    step(-1);
+  return _level != before;
+}
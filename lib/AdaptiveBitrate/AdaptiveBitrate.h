@@ -0,0 +1,89 @@
+#ifndef ADAPTIVE_BITRATE_H_
+#define ADAPTIVE_BITRATE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <mutex>
+
+#define ABR_MAX_CLIENTS     8
+#define ABR_DOWN_FPS        0.85f // below this share of the target fps...
+#define ABR_DOWN_BUSY       0.80f // ...with the link this busy, the link is the bottleneck
+#define ABR_UP_FPS          0.95f // step up only while the target is met...
+#define ABR_UP_BUSY         0.45f // ...and the target rate alone would leave the link idle over half the time
+#define ABR_DOWN_WINDOWS    2     // consecutive windows before stepping down
+#define ABR_UP_WINDOWS      5     // slower to step up than down
+#define ABR_HOLD_WINDOWS    2     // settle time after any change
+
+// One rung of the quality ladder. framesize is the esp32-camera framesize_t value,
+// quality the sensor's jpeg_quality (0-63, lower is better)
+struct AbrLevel
+{
+  uint8_t framesize;
+  uint8_t quality;
+};
+
+// Closed-loop controller: streams report what each frame cost them on the wire, tick()
+// turns the worst client's fps and link utilisation into ladder steps. Index 0 is the best level.
+// It steps down when the fps misses ABR_DOWN_FPS and the link is over ABR_DOWN_BUSY at once, and
+// up when the target is met and its rate would keep the link under ABR_UP_BUSY.
+class AdaptiveBitrate
+{
+public:
+  typedef void (*ApplyFn)(const AbrLevel &level, void *ctx);
+
+  AdaptiveBitrate(const AbrLevel *ladder, uint8_t levels);
+
+  void configure(float targetFps, uint32_t window_ms);
+  void onApply(ApplyFn apply, void *ctx);
+  void setCeiling(uint8_t best); // never go above this rung (e.g. what the buffers were sized for)
+  void setQualityFloor(uint8_t quality); // never stream a better (lower) jpeg_quality, e.g. the preset's
+  void setLevel(uint8_t level);  // jump without applying, e.g. to match the boot config
+  void setEnabled(bool enabled); // once disabled, no apply is running or will start
+
+  // Called per sent frame; busy_us is how long the socket had data queued for it
+  void frameSent(const void *client, size_t bytes, uint32_t busy_us);
+  void clientGone(const void *client);
+
+  // Evaluates a finished window and applies a step when warranted, true on a change
+  bool tick(uint64_t now_us);
+
+  uint8_t level(void) const { return _level; }
+  AbrLevel current(void) const; // the rung with the quality floor applied, what the sensor gets
+  float lastFps(void) const { return _lastFps; }
+  float lastBusy(void) const { return _lastBusy; }
+  uint32_t changes(void) const { return _changes; }
+
+private:
+  struct Client
+  {
+    const void *key;
+    uint32_t frames;
+    uint64_t bytes;
+    uint64_t busy_us;
+  };
+
+  Client *find(const void *client, bool create);
+  void step(int delta);
+
+  const AbrLevel *_ladder;
+  uint8_t _levels;
+  uint8_t _ceiling;
+  uint8_t _qualityFloor;
+  uint8_t _level;
+  bool _enabled;
+  float _targetFps;
+  uint32_t _window_us;
+  uint64_t _windowStart;
+  uint8_t _downStreak;
+  uint8_t _upStreak;
+  uint8_t _hold;
+  float _lastFps;
+  float _lastBusy;
+  uint32_t _changes;
+  ApplyFn _apply;
+  void *_applyCtx;
+  Client _clients[ABR_MAX_CLIENTS];
+  std::mutex _lock;
+};
+
+#endif // ADAPTIVE_BITRATE_H_
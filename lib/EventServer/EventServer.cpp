@@ -0,0 +1,840 @@
+#include "EventServer.h"
+#include "Multipart.h"
+#include "SocketCompat.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <chrono>
+
+static uint64_t now_us(void)
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static uint32_t now_ms(void)
+{
+  return (uint32_t)(now_us() / 1000);
+}
+
+static const char *reason_phrase(int code)
+{
+  switch (code)
+  {
+  case 200: return "OK";
+  case 204: return "No Content";
+  case 304: return "Not Modified";
+  case 400: return "Bad Request";
+  case 404: return "Not Found";
+  case 409: return "Conflict";
+  case 413: return "Payload Too Large";
+  case 422: return "Unprocessable Entity";
+  case 426: return "Upgrade Required";
+  case 431: return "Request Header Fields Too Large";
+  case 500: return "Internal Server Error";
+  case 503: return "Service Unavailable";
+  default:  return "Unknown";
+  }
+}
+
+// Decodes %XX and '+' from a query/form value
+static void url_decode(const char *src, size_t len, char *out, size_t outLen)
+{
+  size_t o = 0;
+  for (size_t i = 0; i < len && o + 1 < outLen; i++)
+  {
+    char ch = src[i];
+    if (ch == '+')
+      ch = ' ';
+    else if (ch == '%' && i + 2 < len)
+    {
+      char hex[3] = {src[i + 1], src[i + 2], 0};
+      ch = (char)strtol(hex, NULL, 16);
+      i += 2;
+    }
+    out[o++] = ch;
+  }
+  out[o] = 0;
+}
+
+// Looks name up in an a=1&b=2 style list
+static bool find_arg(const char *list, size_t listLen, const char *name, char *out, size_t outLen)
+{
+  size_t n = strlen(name);
+  const char *p = list, *end = list + listLen;
+  while (p < end)
+  {
+    const char *amp = (const char *)memchr(p, '&', end - p);
+    const char *stop = amp ? amp : end;
+    const char *eq = (const char *)memchr(p, '=', stop - p);
+    const char *keyEnd = eq ? eq : stop;
+    if ((size_t)(keyEnd - p) == n && !strncmp(p, name, n))
+    {
+      if (eq)
+        url_decode(eq + 1, stop - eq - 1, out, outLen);
+      else if (outLen)
+        out[0] = 0;
+      return true;
+    }
+    p = stop + 1;
+  }
+  return false;
+}
+
+static uint8_t count_args(const char *list, size_t listLen)
+{
+  uint8_t count = 0;
+  for (size_t i = 0; i < listLen; i++)
+    if (list[i] == '&')
+      count++;
+  return listLen ? count + 1 : 0;
+}
+
+//////////////////////////
+//    HttpConnection    //
+//////////////////////////
+
+HttpConnection::HttpConnection()
+{
+  _state = FREE;
+  _fd = -1;
+  _multipart = NULL;
+  _streamer = NULL;
+  _keepAlive = false;
+  _lastActivity = 0;
+  _writes = 0;
+  _bytesSent = 0;
+  _busyUs = 0;
+  reset();
+  _state = FREE;
+}
+
+void HttpConnection::open(int fd, uint32_t now)
+{
+  _fd = fd;
+  _lastActivity = now;
+  _writes = 0;
+  _bytesSent = 0;
+  _busyUs = 0;
+  reset();
+}
+
+void HttpConnection::reset(void)
+{
+  _state = READING_HEAD;
+  _closing = false;
+  _responded = false;
+  _headLen = 0;
+  _bodyInHead = 0;
+  _method = METHOD_OTHER;
+  _path = "";
+  _query = "";
+  _contentLength = 0;
+  _bodyRead = 0;
+  _route = -1;
+  _upload = NULL;
+  _gate = NULL;
+  _gateCtx = NULL;
+  _headers = "";
+  _formLen = 0;
+  delete _multipart;
+  _multipart = NULL;
+  _uploadTotal = 0;
+  _extraLen = 0;
+  _extraHeaders[0] = 0;
+  _scratchLen = 0;
+  _owned.clear();
+  _segCount = _segSent = 0;
+  _segOffset = 0;
+  delete _streamer;
+  _streamer = NULL;
+}
+
+void HttpConnection::release(void)
+{
+  reset();
+  sock_close(_fd);
+  _fd = -1;
+  _state = FREE;
+}
+
+bool HttpConnection::parseHead(void)
+{
+  char *end = NULL;
+  for (size_t i = 3; i < _headLen; i++)
+  {
+    if (_head[i - 3] == '\r' && _head[i - 2] == '\n' && _head[i - 1] == '\r' && _head[i] == '\n')
+    {
+      end = _head + i + 1;
+      break;
+    }
+  }
+  if (!end)
+    return false;
+  _bodyInHead = _headLen - (end - _head);
+  end[-2] = 0; // terminate the header block, keep one CRLF for line scanning
+
+  // Request line: METHOD SP target SP version CRLF
+  char *line = _head;
+  char *eol = strstr(line, "\r\n");
+  *eol = 0; // there is at least the terminating CRLF
+  char *sp1 = strchr(line, ' ');
+  char *sp2 = sp1 ? strchr(sp1 + 1, ' ') : NULL;
+  if (!sp1 || !sp2)
+  {
+    _path = "";
+    return true;
+  }
+  *sp1 = *sp2 = 0;
+  _method = !strcmp(line, "GET") ? METHOD_GET : !strcmp(line, "POST") ? METHOD_POST : METHOD_OTHER;
+  _path = sp1 + 1;
+  char *q = strchr(sp1 + 1, '?');
+  if (q)
+  {
+    *q = 0;
+    _query = q + 1;
+  }
+  _keepAlive = !strcmp(sp2 + 1, "HTTP/1.1");
+  *eol = '\r';
+  _headers = eol; // header lines are scanned from here on
+
+  char value[24];
+  if (header("Connection", value, sizeof(value)))
+  {
+    if (!strcasecmp(value, "close"))
+      _keepAlive = false;
+    else if (!strcasecmp(value, "keep-alive"))
+      _keepAlive = true;
+  }
+  _contentLength = header("Content-Length", value, sizeof(value)) ? strtoul(value, NULL, 10) : 0;
+  return true;
+}
+
+bool HttpConnection::header(const char *name, char *out, size_t outLen) const
+{
+  size_t n = strlen(name);
+  const char *p = _headers;
+  while (p && p[0] == '\r' && p[1] == '\n')
+  {
+    p += 2;
+    const char *eol = strstr(p, "\r\n");
+    const char *stop = eol ? eol : p + strlen(p);
+    if ((size_t)(stop - p) > n && p[n] == ':' && !strncasecmp(p, name, n))
+    {
+      const char *v = p + n + 1;
+      while (v < stop && (*v == ' ' || *v == '\t'))
+        v++;
+      size_t len = stop - v;
+      if (len >= outLen)
+        len = outLen - 1;
+      memcpy(out, v, len);
+      out[len] = 0;
+      return true;
+    }
+    p = eol;
+  }
+  return false;
+}
+
+bool HttpConnection::arg(const char *name, char *out, size_t outLen) const
+{
+  if (find_arg(_query, strlen(_query), name, out, outLen))
+    return true;
+  return find_arg(_form, _formLen, name, out, outLen);
+}
+
+uint8_t HttpConnection::argCount(void) const
+{
+  return count_args(_query, strlen(_query)) + count_args(_form, _formLen);
+}
+
+void HttpConnection::sendHeader(const char *name, const char *value)
+{
+  if (!strcasecmp(name, "Connection"))
+  {
+    // Framing is ours to decide, just honour an explicit close
+    if (!strcasecmp(value, "close"))
+      _keepAlive = false;
+    return;
+  }
+  int n = snprintf(_extraHeaders + _extraLen, sizeof(_extraHeaders) - _extraLen, "%s: %s\r\n", name, value);
+  if (n > 0 && _extraLen + n < sizeof(_extraHeaders))
+    _extraLen += n;
+  else
+    _extraHeaders[_extraLen] = 0;
+}
+
+void HttpConnection::respond(int code, const char *type, const uint8_t *body, size_t len)
+{
+  char head[EVS_SCRATCH_SIZE];
+  char length[32] = "";
+  if (code != 204 && code != 304) // no body, and no length claim about one
+    snprintf(length, sizeof(length), "Content-Length: %u\r\n", (unsigned)len);
+  int n = snprintf(head, sizeof(head),
+                   "HTTP/1.1 %d %s\r\n"
+                   "Content-Type: %s\r\n"
+                   "%s"
+                   "%s"
+                   "Connection: %s\r\n\r\n",
+                   code, reason_phrase(code), type, length, _extraHeaders, _keepAlive ? "keep-alive" : "close");
+  if (n < 0 || (size_t)n >= sizeof(head))
+    n = 0;
+  queueCopy(head, n);
+  queue(body, len);
+  _responded = true;
+}
+
+void HttpConnection::send(int code, const char *type, const char *body)
+{
+  respond(code, type, (const uint8_t *)body, body ? strlen(body) : 0);
+}
+
+void HttpConnection::send(int code, const char *type, const uint8_t *body, size_t len)
+{
+  respond(code, type, body, len);
+}
+
+void HttpConnection::sendCopy(int code, const char *type, const char *body, size_t len)
+{
+  _owned.assign(body, len);
+  respond(code, type, (const uint8_t *)_owned.data(), _owned.size());
+}
+
+void HttpConnection::stream(Streamer *streamer)
+{
+  delete _streamer;
+  _streamer = streamer;
+  _responded = true;
+}
+
+bool HttpConnection::queue(const void *data, size_t len)
+{
+  if (idle())
+  {
+    _segCount = _segSent = 0;
+    _segOffset = 0;
+    _scratchLen = 0;
+  }
+  if (!len)
+    return true;
+  if (_segCount >= EVS_MAX_SEGMENTS)
+    return false;
+  if (idle())
+    _busySince = now_us();
+  _segs[_segCount].data = (const uint8_t *)data;
+  _segs[_segCount].len = len;
+  _segCount++;
+  return true;
+}
+
+bool HttpConnection::queueCopy(const void *data, size_t len)
+{
+  if (idle())
+    _scratchLen = 0;
+  if (_scratchLen + len > sizeof(_scratch))
+    return false;
+  char *dst = _scratch + _scratchLen;
+  memcpy(dst, data, len);
+  if (!queue(dst, len))
+    return false;
+  _scratchLen += len;
+  return true;
+}
+
+size_t HttpConnection::pending(void) const
+{
+  size_t total = 0;
+  for (uint8_t i = _segSent; i < _segCount; i++)
+    total += _segs[i].len;
+  return total - _segOffset;
+}
+
+size_t HttpConnection::socketBacklog(void) const
+{
+  return _fd >= 0 ? sock_unacked(_fd) : 0;
+}
+
+bool HttpConnection::flush(void)
+{
+  while (_segSent < _segCount)
+  {
+    // Everything pending leaves in one gathered write, so a frame's header, payload and
+    // boundary share TCP segments instead of costing a send each
+    struct iovec iov[EVS_MAX_SEGMENTS];
+    int count = 0;
+    for (uint8_t i = _segSent; i < _segCount; i++, count++)
+    {
+      size_t skip = (i == _segSent) ? _segOffset : 0;
+      iov[count].iov_base = (void *)(_segs[i].data + skip);
+      iov[count].iov_len = _segs[i].len - skip;
+    }
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = count;
+    ssize_t n = sendmsg(_fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+    _writes++;
+    if (n < 0 && sock_would_block())
+      return true;
+    if (n <= 0)
+      return false;
+    _bytesSent += n;
+
+    size_t left = n;
+    while (left && _segSent < _segCount)
+    {
+      size_t avail = _segs[_segSent].len - _segOffset;
+      if (left < avail)
+      {
+        _segOffset += left;
+        break;
+      }
+      left -= avail;
+      _segSent++;
+      _segOffset = 0;
+    }
+  }
+  _busyUs += now_us() - _busySince;
+  return true;
+}
+
+//////////////////////////
+//      HttpServer      //
+//////////////////////////
+
+HttpServer::HttpServer()
+{
+  _listenFd = _wakeFd = -1;
+  _port = _wakePort = 0;
+  _routeCount = 0;
+  _notFound = NULL;
+  _busyUs = 0;
+}
+
+HttpServer::~HttpServer()
+{
+  stop();
+}
+
+bool HttpServer::begin(uint16_t port)
+{
+  _listenFd = socket(AF_INET, SOCK_STREAM, 0);
+  if (_listenFd < 0)
+    return false;
+  int one = 1;
+  setsockopt(_listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if (bind(_listenFd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(_listenFd, EVS_MAX_CONNECTIONS) < 0)
+  {
+    stop();
+    return false;
+  }
+  sock_set_nonblocking(_listenFd);
+  socklen_t len = sizeof(addr);
+  getsockname(_listenFd, (struct sockaddr *)&addr, &len);
+  _port = ntohs(addr.sin_port);
+
+  // Loopback datagram socket other tasks poke to cut a select() short
+  _wakeFd = socket(AF_INET, SOCK_DGRAM, 0);
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;
+  if (_wakeFd >= 0 && bind(_wakeFd, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+  {
+    len = sizeof(addr);
+    getsockname(_wakeFd, (struct sockaddr *)&addr, &len);
+    _wakePort = ntohs(addr.sin_port);
+    sock_set_nonblocking(_wakeFd);
+  }
+  return true;
+}
+
+void HttpServer::stop(void)
+{
+  for (int i = 0; i < EVS_MAX_CONNECTIONS; i++)
+    if (_conns[i]._state != HttpConnection::FREE)
+      _conns[i].release();
+  sock_close(_listenFd);
+  sock_close(_wakeFd);
+  _listenFd = _wakeFd = -1;
+}
+
+void HttpServer::on(const char *path, RequestMethod method, RequestHandler handler, UploadHandler upload)
+{
+  if (_routeCount >= EVS_MAX_ROUTES)
+    return;
+  Route &r = _routes[_routeCount++];
+  r.path = path;
+  r.method = method;
+  r.handler = handler;
+  r.upload = upload;
+}
+
+void HttpServer::wake(void)
+{
+  if (_wakeFd < 0)
+    return;
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(_wakePort);
+  char b = 1;
+  sendto(_wakeFd, &b, 1, MSG_DONTWAIT, (struct sockaddr *)&addr, sizeof(addr));
+}
+
+uint8_t HttpServer::connectionCount(void) const
+{
+  uint8_t n = 0;
+  for (int i = 0; i < EVS_MAX_CONNECTIONS; i++)
+    if (_conns[i]._state != HttpConnection::FREE)
+      n++;
+  return n;
+}
+
+int HttpServer::findRoute(const HttpConnection &c) const
+{
+  for (uint8_t i = 0; i < _routeCount; i++)
+  {
+    const Route &r = _routes[i];
+    if (!strcmp(r.path, c._path) && (r.method == METHOD_ANY || r.method == c._method))
+      return i;
+  }
+  return -1;
+}
+
+void HttpServer::closeConnection(HttpConnection &c)
+{
+  // Let an upload handler know its body will never complete (raw bodies start with the headers,
+  // multipart ones with the first file part)
+  if (c._state == HttpConnection::READING_BODY && c._upload && (c._uploadTotal || !c._multipart))
+  {
+    Upload u = {UPLOAD_ABORTED, "", NULL, 0, c._uploadTotal};
+    c._upload(c, u);
+  }
+  c.release();
+}
+
+void HttpServer::acceptAll(uint32_t now)
+{
+  for (;;)
+  {
+    int fd = accept(_listenFd, NULL, NULL);
+    if (fd < 0)
+      return;
+    HttpConnection *slot = NULL;
+    for (int i = 0; i < EVS_MAX_CONNECTIONS && !slot; i++)
+      if (_conns[i]._state == HttpConnection::FREE)
+        slot = &_conns[i];
+    if (!slot)
+    {
+      static const char busy[] = "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+      ::send(fd, busy, sizeof(busy) - 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+      sock_close(fd);
+      continue;
+    }
+    sock_set_nonblocking(fd);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    slot->open(fd, now);
+  }
+}
+
+void HttpServer::multipartSink(void *ctx, UploadStatus status, const char *filename, const uint8_t *data, size_t len)
+{
+  HttpConnection &c = *(HttpConnection *)ctx;
+  c._uploadTotal += len;
+  Upload u = {status, filename, data, len, c._uploadTotal};
+  c._upload(c, u);
+}
+
+void HttpServer::startBody(HttpConnection &c)
+{
+  c._state = HttpConnection::READING_BODY;
+  c._upload = c._route >= 0 ? _routes[c._route].upload : NULL;
+  if (!c._upload)
+    return; // small forms are collected for arg(), anything else is drained
+
+  char type[128];
+  const char *b = NULL;
+  if (c.header("Content-Type", type, sizeof(type)) && !strncasecmp(type, "multipart/form-data", 19))
+    b = strstr(type, "boundary=");
+  if (b)
+  {
+    b += 9;
+    if (*b == '"')
+    {
+      b++;
+      char *q = strchr((char *)b, '"');
+      if (q)
+        *q = 0;
+    }
+    c._multipart = new MultipartParser(b, multipartSink, &c);
+  }
+  else
+  {
+    // Raw body (e.g. application/octet-stream) goes to the handler as-is
+    Upload u = {UPLOAD_START, "", NULL, 0, 0};
+    c._upload(c, u);
+  }
+}
+
+void HttpServer::onBody(HttpConnection &c, const uint8_t *data, size_t len)
+{
+  size_t remaining = c._contentLength - c._bodyRead;
+  if (len > remaining)
+    len = remaining;
+  c._bodyRead += len;
+
+  if (c._multipart)
+  {
+    if (!c._multipart->feed(data, len))
+    {
+      c.send(400, "text/plain", "Malformed multipart body");
+      c._keepAlive = false;
+      c._state = HttpConnection::RESPONDING;
+      return;
+    }
+  }
+  else if (c._upload)
+  {
+    if (len)
+    {
+      c._uploadTotal += len;
+      Upload u = {UPLOAD_WRITE, "", data, len, c._uploadTotal};
+      c._upload(c, u);
+    }
+  }
+  else if (c._formLen + len <= sizeof(c._form))
+  {
+    memcpy(c._form + c._formLen, data, len);
+    c._formLen += len;
+  }
+
+  if (c._bodyRead < c._contentLength)
+    return;
+  if (c._upload && !c._multipart)
+  {
+    Upload u = {UPLOAD_END, "", NULL, 0, c._uploadTotal};
+    c._upload(c, u);
+  }
+  else if (c._multipart && !c._multipart->finished())
+  {
+    Upload u = {UPLOAD_ABORTED, "", NULL, 0, c._uploadTotal};
+    c._upload(c, u);
+  }
+  dispatch(c);
+}
+
+void HttpServer::dispatch(HttpConnection &c)
+{
+  c._state = HttpConnection::RESPONDING;
+  if (c._route >= 0)
+    _routes[c._route].handler(c);
+  else if (_notFound)
+    _notFound(c);
+  else
+    c.send(404, "text/plain", "Not found");
+
+  if (c._streamer)
+  {
+    c._state = HttpConnection::STREAMING;
+    c._keepAlive = c._keepAlive && c._streamer->keepAlive();
+  }
+  else if (!c._responded)
+  {
+    c.send(500, "text/plain", "No response");
+  }
+}
+
+void HttpServer::afterOutput(HttpConnection &c)
+{
+  if (!c.idle())
+    return;
+  if (c._state == HttpConnection::STREAMING)
+  {
+    while (c._state == HttpConnection::STREAMING && !c._closing && c._streamer->ready())
+    {
+      if (!c._streamer->pump(c))
+        c._state = HttpConnection::RESPONDING; // finished, ends like a one-shot response
+      if (c.idle())
+        break; // nothing queued, wait for the next wake-up
+      if (!c.flush())
+      {
+        closeConnection(c);
+        return;
+      }
+      if (!c.idle())
+        return; // socket full, select() tells us when to continue
+    }
+    if (c._state == HttpConnection::STREAMING)
+    {
+      if (c._closing && c.idle())
+        closeConnection(c);
+      return;
+    }
+  }
+  if (c._state == HttpConnection::RESPONDING)
+  {
+    if (c._closing || !c._keepAlive)
+      closeConnection(c);
+    else
+      c.reset();
+  }
+}
+
+void HttpServer::onReadable(HttpConnection &c, uint32_t now)
+{
+  uint8_t buf[EVS_BODY_CHUNK];
+  if (c._state == HttpConnection::READING_HEAD)
+  {
+    ssize_t n = recv(c._fd, c._head + c._headLen, sizeof(c._head) - 1 - c._headLen, 0);
+    if (n < 0 && sock_would_block())
+      return;
+    if (n <= 0)
+    {
+      closeConnection(c);
+      return;
+    }
+    c._lastActivity = now;
+    c._headLen += n;
+    c._head[c._headLen] = 0;
+    if (!c.parseHead())
+    {
+      if (c._headLen >= sizeof(c._head) - 1)
+      {
+        c._state = HttpConnection::RESPONDING;
+        c._keepAlive = false;
+        c.send(431, "text/plain", "Request headers too large");
+      }
+      return;
+    }
+    c._route = findRoute(c);
+    if (c._contentLength)
+    {
+      startBody(c);
+      onBody(c, (const uint8_t *)c._head + c._headLen - c._bodyInHead, c._bodyInHead);
+    }
+    else
+    {
+      dispatch(c);
+    }
+    return;
+  }
+
+  ssize_t n = recv(c._fd, buf, sizeof(buf), 0);
+  if (n < 0 && sock_would_block())
+    return;
+  if (n <= 0)
+  {
+    closeConnection(c);
+    return;
+  }
+  c._lastActivity = now;
+  if (c._state == HttpConnection::READING_BODY)
+    onBody(c, buf, n);
+  else if (c._state == HttpConnection::STREAMING)
+    c._streamer->received(c, buf, n);
+  // Anything a client sends while we respond is ignored
+}
+
+void HttpServer::poll(uint32_t timeout_ms)
+{
+  uint64_t started = now_us();
+  uint64_t slept = turn(timeout_ms);
+  _busyUs.fetch_add(now_us() - started - slept, std::memory_order_relaxed);
+}
+
+uint64_t HttpServer::turn(uint32_t timeout_ms)
+{
+  fd_set rd, wr;
+  FD_ZERO(&rd);
+  FD_ZERO(&wr);
+  int maxFd = -1;
+  uint32_t now = now_ms();
+
+  if (_listenFd >= 0)
+  {
+    FD_SET(_listenFd, &rd);
+    maxFd = _listenFd;
+  }
+  if (_wakeFd >= 0)
+  {
+    FD_SET(_wakeFd, &rd);
+    if (_wakeFd > maxFd)
+      maxFd = _wakeFd;
+  }
+  for (int i = 0; i < EVS_MAX_CONNECTIONS; i++)
+  {
+    HttpConnection &c = _conns[i];
+    if (c._state == HttpConnection::STREAMING)
+      afterOutput(c); // streams get their pump before we go to sleep
+    if (c._state == HttpConnection::FREE)
+      continue;
+    if (c._state == HttpConnection::READING_BODY && c._gate && !c._gate(c._gateCtx))
+    {
+      c._lastActivity = now; // waiting on us, not on the peer
+      continue;
+    }
+    if ((c._state == HttpConnection::READING_HEAD || c._state == HttpConnection::READING_BODY) &&
+        now - c._lastActivity > EVS_IDLE_TIMEOUT_MS)
+    {
+      closeConnection(c);
+      continue;
+    }
+    FD_SET(c._fd, &rd);
+    if (!c.idle())
+      FD_SET(c._fd, &wr);
+    if (c._fd > maxFd)
+      maxFd = c._fd;
+  }
+  if (maxFd < 0)
+    return 0;
+
+  struct timeval tv;
+  tv.tv_sec = timeout_ms / 1000;
+  tv.tv_usec = (timeout_ms % 1000) * 1000;
+  uint64_t asleep = now_us();
+  int ready = select(maxFd + 1, &rd, &wr, NULL, &tv);
+  asleep = now_us() - asleep;
+  if (ready <= 0)
+    return asleep;
+  now = now_ms();
+
+  if (_wakeFd >= 0 && FD_ISSET(_wakeFd, &rd))
+  {
+    char drain[16];
+    while (recv(_wakeFd, drain, sizeof(drain), 0) > 0)
+      ;
+  }
+  if (_listenFd >= 0 && FD_ISSET(_listenFd, &rd))
+    acceptAll(now);
+
+  for (int i = 0; i < EVS_MAX_CONNECTIONS; i++)
+  {
+    HttpConnection &c = _conns[i];
+    if (c._state == HttpConnection::FREE || c._fd < 0 || c._fd > maxFd)
+      continue;
+    int fd = c._fd;
+    if (FD_ISSET(fd, &rd))
+      onReadable(c, now);
+    if (c._state != HttpConnection::FREE && c._fd == fd && FD_ISSET(fd, &wr) && !c.idle())
+    {
+      if (!c.flush())
+      {
+        closeConnection(c);
+        continue;
+      }
+      c._lastActivity = now;
+    }
+    if (c._state != HttpConnection::FREE && c._fd == fd)
+      afterOutput(c);
+  }
+  return asleep;
+}
@@ -0,0 +1,238 @@
+#ifndef EVENT_SERVER_H_
+#define EVENT_SERVER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+// Sized for the ESP32's default lwIP socket budget
+#define EVS_MAX_CONNECTIONS 8
+#define EVS_MAX_ROUTES      24
+#define EVS_HEAD_SIZE       1024 // request line + headers
+#define EVS_FORM_SIZE       512  // small url-encoded bodies kept for arg()
+#define EVS_SCRATCH_SIZE    512  // response headers and other copied pieces
+#define EVS_MAX_SEGMENTS    8
+#define EVS_IDLE_TIMEOUT_MS 10000
+#define EVS_BODY_CHUNK      1024 // most body bytes handed on per read
+
+enum RequestMethod
+{
+  METHOD_GET,
+  METHOD_POST,
+  METHOD_OTHER,
+  METHOD_ANY
+};
+
+// Mirrors the Arduino HTTPUpload life cycle, delivered as body bytes arrive
+enum UploadStatus
+{
+  UPLOAD_START,
+  UPLOAD_WRITE,
+  UPLOAD_END,
+  UPLOAD_ABORTED
+};
+
+struct Upload
+{
+  UploadStatus status;
+  const char *filename; // empty for raw (non multipart) bodies
+  const uint8_t *buf;
+  size_t len;
+  size_t totalSize; // bytes delivered so far
+};
+
+class HttpConnection;
+class MultipartParser;
+
+typedef void (*RequestHandler)(HttpConnection &conn);
+typedef void (*UploadHandler)(HttpConnection &conn, const Upload &upload);
+typedef bool (*BodyGate)(void *ctx);
+
+// Long-lived responses (MJPEG, snapshots waiting for a frame...) are driven by the event loop
+// instead of owning it: pump() is called whenever the connection has drained its output.
+class Streamer
+{
+public:
+  virtual ~Streamer() {}
+  virtual bool ready(void) = 0;                // something new to send
+  virtual bool pump(HttpConnection &conn) = 0; // queue the next piece, false ends the response
+  virtual bool keepAlive(void) { return false; } // response carries its own length, connection is reusable
+  // Bytes the client sent while streaming (e.g. WebSocket messages), ignored unless overridden.
+  // Anything to send back waits for the next pump(), so ready() should say so.
+  virtual void received(HttpConnection &conn, const uint8_t *data, size_t len) {}
+};
+
+class HttpConnection
+{
+public:
+  HttpConnection();
+
+  // Request
+  RequestMethod method(void) const { return _method; }
+  const char *path(void) const { return _path; }
+  const char *query(void) const { return _query; }
+  size_t contentLength(void) const { return _contentLength; }
+  bool header(const char *name, char *out, size_t outLen) const;
+  bool arg(const char *name, char *out, size_t outLen) const; // query string or url-encoded form
+  uint8_t argCount(void) const;
+
+  // One-shot responses. send() references body (flash/static data), sendCopy() keeps its own copy
+  void sendHeader(const char *name, const char *value);
+  void send(int code, const char *type, const char *body);
+  void send(int code, const char *type, const uint8_t *body, size_t len);
+  void sendCopy(int code, const char *type, const char *body, size_t len);
+
+  // Streaming responses; the connection owns the streamer and deletes it on close
+  void stream(Streamer *streamer);
+
+  // Upload flow control: while gate(ctx) is false the rest of the body stays in the socket and
+  // TCP holds the sender back. Whoever opens the gate again calls HttpServer::wake().
+  void gateBody(BodyGate gate, void *ctx)
+  {
+    _gate = gate;
+    _gateCtx = ctx;
+  }
+
+  // Output queue used by streamers. queue() references memory that must stay valid until
+  // the connection is idle again, queueCopy() goes through the scratch buffer.
+  bool idle(void) const { return _segCount == _segSent; }
+  bool queue(const void *data, size_t len);
+  bool queueCopy(const void *data, size_t len);
+  size_t pending(void) const;
+  // What the socket itself still holds: taken from our queue, not yet acknowledged by the peer
+  size_t socketBacklog(void) const;
+
+  void close(void) { _closing = true; }
+  int fd(void) const { return _fd; }
+
+  // Wire accounting since the connection was accepted
+  uint32_t writeCount(void) const { return _writes; }
+  uint64_t bytesSent(void) const { return _bytesSent; }
+  uint64_t busyMicros(void) const { return _busyUs; } // time spent with output queued
+
+private:
+  friend class HttpServer;
+
+  enum State
+  {
+    FREE,
+    READING_HEAD,
+    READING_BODY,
+    RESPONDING,
+    STREAMING
+  };
+  struct Segment
+  {
+    const uint8_t *data;
+    size_t len;
+  };
+
+  void open(int fd, uint32_t now);
+  void reset(void);  // back to READING_HEAD for the next keep-alive request
+  void release(void);
+  bool parseHead(void);
+  bool flush(void);  // false when the peer is gone
+  void respond(int code, const char *type, const uint8_t *body, size_t len);
+
+  State _state;
+  int _fd;
+  uint32_t _lastActivity;
+  bool _keepAlive;
+  bool _closing;
+  bool _responded;
+
+  char _head[EVS_HEAD_SIZE];
+  size_t _headLen;
+  size_t _bodyInHead; // body bytes that arrived together with the headers
+  RequestMethod _method;
+  const char *_path;
+  const char *_query;
+  const char *_headers; // CRLF-separated header lines, NUL terminated
+  size_t _contentLength;
+  size_t _bodyRead;
+  int _route;
+  UploadHandler _upload;
+  BodyGate _gate;
+  void *_gateCtx;
+
+  char _form[EVS_FORM_SIZE];
+  size_t _formLen;
+  MultipartParser *_multipart;
+  size_t _uploadTotal;
+
+  char _extraHeaders[EVS_SCRATCH_SIZE / 2];
+  size_t _extraLen;
+  char _scratch[EVS_SCRATCH_SIZE];
+  size_t _scratchLen;
+  std::string _owned;
+  Segment _segs[EVS_MAX_SEGMENTS];
+  uint8_t _segCount;
+  uint8_t _segSent;
+  size_t _segOffset;
+
+  Streamer *_streamer;
+  uint32_t _writes;
+  uint64_t _bytesSent;
+  uint64_t _busyUs;
+  uint64_t _busySince;
+};
+
+// select()-driven HTTP/1.1 server: every connection is a small state machine, so a long
+// stream never holds up OTA uploads or snapshot requests
+class HttpServer
+{
+public:
+  HttpServer();
+  ~HttpServer();
+
+  bool begin(uint16_t port);
+  void stop(void);
+  uint16_t port(void) const { return _port; }
+
+  void on(const char *path, RequestMethod method, RequestHandler handler, UploadHandler upload = NULL);
+  void onNotFound(RequestHandler handler) { _notFound = handler; }
+
+  // One turn of the event loop, returns after at most timeout_ms
+  void poll(uint32_t timeout_ms);
+  // Thread-safe; interrupts a poll() so streamers get pumped right away (e.g. a new frame)
+  void wake(void);
+
+  uint8_t connectionCount(void) const;
+  // Time spent in poll() outside select(): accepting, parsing, handlers and socket writes.
+  // Thread-safe, the housekeeping task samples it
+  uint64_t busyMicros(void) const { return _busyUs.load(std::memory_order_relaxed); }
+
+private:
+  struct Route
+  {
+    const char *path;
+    RequestMethod method;
+    RequestHandler handler;
+    UploadHandler upload;
+  };
+
+  void acceptAll(uint32_t now);
+  void onReadable(HttpConnection &c, uint32_t now);
+  void startBody(HttpConnection &c);
+  void onBody(HttpConnection &c, const uint8_t *data, size_t len);
+  void closeConnection(HttpConnection &c);
+  static void multipartSink(void *ctx, UploadStatus status, const char *filename, const uint8_t *data, size_t len);
+  void dispatch(HttpConnection &c);
+  void afterOutput(HttpConnection &c);
+  uint64_t turn(uint32_t timeout_ms); // returns the time asleep in select()
+  int findRoute(const HttpConnection &c) const;
+
+  int _listenFd;
+  int _wakeFd;
+  uint16_t _port;
+  uint16_t _wakePort;
+  Route _routes[EVS_MAX_ROUTES];
+  uint8_t _routeCount;
+  RequestHandler _notFound;
+  HttpConnection _conns[EVS_MAX_CONNECTIONS];
+  std::atomic<uint64_t> _busyUs;
+};
+
+#endif // EVENT_SERVER_H_
@@ -0,0 +1,110 @@
+#include "Multipart.h"
+#include <string.h>
+#include <algorithm>
+
+#define MULTIPART_MAX_HEADERS 1024
+
+MultipartParser::MultipartParser(const char *boundary, Sink sink, void *ctx) : _sink(sink), _ctx(ctx)
+{
+  _delimiter = "\r\n--";
+  _delimiter += boundary;
+  // The body opens with "--boundary", pretend a CRLF came first so every delimiter looks alike
+  _buf.push_back('\r');
+  _buf.push_back('\n');
+  _state = PREAMBLE;
+  _isFile = false;
+  _filename[0] = 0;
+}
+
+bool MultipartParser::feed(const uint8_t *data, size_t len)
+{
+  if (_state == FAILED)
+    return false;
+  if (_state == DONE)
+    return true; // epilogue
+  _buf.insert(_buf.end(), data, data + len);
+  while (step())
+    ;
+  return _state != FAILED;
+}
+
+bool MultipartParser::step(void)
+{
+  const uint8_t *d = (const uint8_t *)_delimiter.data();
+  size_t dlen = _delimiter.size();
+
+  switch (_state)
+  {
+  case PREAMBLE:
+  case DATA:
+  {
+    std::vector<uint8_t>::iterator hit = std::search(_buf.begin(), _buf.end(), d, d + dlen);
+    size_t upto = hit - _buf.begin();
+    if (hit == _buf.end())
+    {
+      // Keep back anything that could be the start of a split delimiter
+      upto = _buf.size() >= dlen ? _buf.size() - (dlen - 1) : 0;
+      if (_state == DATA && _isFile && upto)
+        _sink(_ctx, UPLOAD_WRITE, _filename, _buf.data(), upto);
+      _buf.erase(_buf.begin(), _buf.begin() + upto);
+      return false;
+    }
+    if (_state == DATA && _isFile)
+    {
+      if (upto)
+        _sink(_ctx, UPLOAD_WRITE, _filename, _buf.data(), upto);
+      _sink(_ctx, UPLOAD_END, _filename, NULL, 0);
+    }
+    _buf.erase(_buf.begin(), _buf.begin() + upto + dlen);
+    _state = AFTER_DELIMITER;
+    return true;
+  }
+  case AFTER_DELIMITER:
+    if (_buf.size() < 2)
+      return false;
+    if (_buf[0] == '-' && _buf[1] == '-')
+    {
+      _state = DONE;
+      _buf.clear();
+      return false;
+    }
+    // Transport padding is allowed before the CRLF
+    while (_buf.size() >= 2 && _buf[0] != '\r')
+      _buf.erase(_buf.begin());
+    if (_buf.size() < 2)
+      return false;
+    _buf.erase(_buf.begin(), _buf.begin() + 2);
+    _state = HEADERS;
+    return true;
+  case HEADERS:
+  {
+    static const uint8_t end[] = {'\r', '\n', '\r', '\n'};
+    std::vector<uint8_t>::iterator hit = std::search(_buf.begin(), _buf.end(), end, end + 4);
+    if (hit == _buf.end())
+    {
+      if (_buf.size() > MULTIPART_MAX_HEADERS)
+        _state = FAILED;
+      return false;
+    }
+    std::string headers(_buf.begin(), hit);
+    _buf.erase(_buf.begin(), hit + 4);
+    _isFile = false;
+    _filename[0] = 0;
+    size_t at = headers.find("filename=\"");
+    if (at != std::string::npos)
+    {
+      at += 10;
+      size_t close = headers.find('"', at);
+      std::string name = headers.substr(at, close == std::string::npos ? std::string::npos : close - at);
+      strncpy(_filename, name.c_str(), sizeof(_filename) - 1);
+      _filename[sizeof(_filename) - 1] = 0;
+      _isFile = true;
+      _sink(_ctx, UPLOAD_START, _filename, NULL, 0);
+    }
+    _state = DATA;
+    return true;
+  }
+  default:
+    return false;
+  }
+}
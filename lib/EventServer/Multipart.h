@@ -0,0 +1,45 @@
+#ifndef MULTIPART_H_
+#define MULTIPART_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include "EventServer.h"
+
+// Incremental multipart/form-data parser: file part bytes are passed on as they arrive,
+// only a delimiter's worth of data is held back between calls
+class MultipartParser
+{
+public:
+  typedef void (*Sink)(void *ctx, UploadStatus status, const char *filename, const uint8_t *data, size_t len);
+
+  MultipartParser(const char *boundary, Sink sink, void *ctx);
+
+  bool feed(const uint8_t *data, size_t len); // false on malformed input
+  bool finished(void) const { return _state == DONE; }
+  bool inFile(void) const { return _state == DATA && _isFile; }
+
+private:
+  enum State
+  {
+    PREAMBLE,
+    AFTER_DELIMITER,
+    HEADERS,
+    DATA,
+    DONE,
+    FAILED
+  };
+
+  bool step(void); // consume what it can from _buf, false when more input is needed
+
+  std::string _delimiter; // "\r\n--" + boundary
+  std::vector<uint8_t> _buf;
+  State _state;
+  bool _isFile;
+  char _filename[64];
+  Sink _sink;
+  void *_ctx;
+};
+
+#endif // MULTIPART_H_
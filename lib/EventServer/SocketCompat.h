@@ -0,0 +1,74 @@
+#ifndef SOCKET_COMPAT_H_
+#define SOCKET_COMPAT_H_
+
+// lwIP on the ESP32 exposes the BSD socket API, so the same code runs against Linux sockets
+#if defined(ARDUINO)
+  #include <lwip/sockets.h>
+  #include <lwip/inet.h>
+  #include <unistd.h>
+  #include <fcntl.h>
+#else
+  #include <sys/socket.h>
+  #include <sys/select.h>
+  #include <sys/uio.h>
+  #include <netinet/in.h>
+  #include <netinet/tcp.h>
+  #include <arpa/inet.h>
+  #include <unistd.h>
+  #include <fcntl.h>
+  #include <sys/ioctl.h>
+  #if defined(__linux__)
+    #include <linux/sockios.h>
+  #endif
+#endif
+#include <errno.h>
+
+#ifndef MSG_NOSIGNAL
+  #define MSG_NOSIGNAL 0
+#endif
+#ifndef MSG_DONTWAIT
+  #define MSG_DONTWAIT 0
+#endif
+
+static inline int sock_set_nonblocking(int fd)
+{
+  int flags = fcntl(fd, F_GETFL, 0);
+  return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+static inline bool sock_would_block(void)
+{
+  return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+}
+
+// Whether sock_unacked() can actually see into the socket. lwIP has no SIOCOUTQ, callers
+// have to estimate there, at most SOCK_SNDBUF bytes sit in its send buffer per connection.
+#if defined(SIOCOUTQ)
+  #define SOCK_HAS_UNACKED 1
+#else
+  #define SOCK_HAS_UNACKED 0
+#endif
+#if defined(TCP_SND_BUF)
+  #define SOCK_SNDBUF TCP_SND_BUF
+#else
+  #define SOCK_SNDBUF 5744 // lwIP's default, 4 * TCP_MSS
+#endif
+
+// Bytes the socket has taken but the peer has not acknowledged yet; 0 where the stack cannot tell
+static inline size_t sock_unacked(int fd)
+{
+#if SOCK_HAS_UNACKED
+  int n = 0;
+  if (ioctl(fd, SIOCOUTQ, &n) == 0 && n > 0)
+    return n;
+#endif
+  return 0;
+}
+
+static inline void sock_close(int fd)
+{
+  if (fd >= 0)
+    close(fd);
+}
+
+#endif // SOCKET_COMPAT_H_
@@ -0,0 +1,25 @@
+#include "StaticAsset.h"
+#include <string.h>
+
+const StaticAsset *findAsset(const StaticAsset *assets, size_t count, const char *path)
+{
+  for (size_t i = 0; i < count; i++)
+    if (!strcmp(assets[i].path, path))
+      return &assets[i];
+  return NULL;
+}
+
+void sendAsset(HttpConnection &conn, const StaticAsset &asset)
+{
+  char match[96];
+  conn.sendHeader("ETag", asset.etag);
+  conn.sendHeader("Cache-Control", ASSET_CACHE_CONTROL);
+  if (conn.header("If-None-Match", match, sizeof(match)) && (strstr(match, asset.etag) || !strcmp(match, "*")))
+  {
+    conn.send(304, asset.type, "");
+    return;
+  }
+  // Every browser takes gzip; there is no uncompressed copy to fall back to
+  conn.sendHeader("Content-Encoding", "gzip");
+  conn.send(200, asset.type, asset.data, asset.len);
+}
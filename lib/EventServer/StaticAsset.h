@@ -0,0 +1,29 @@
+#ifndef STATIC_ASSET_H_
+#define STATIC_ASSET_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "EventServer.h"
+
+// Kept by the browser, but checked against the ETag before each use: the pages live at fixed
+// URLs, and a max-age would keep showing the old firmware's pages after an update
+#define ASSET_CACHE_CONTROL "no-cache"
+
+// A file built into the firmware, gzip-compressed (tools/embed_assets.py writes the table)
+struct StaticAsset
+{
+  const char *path;
+  const char *type;
+  const uint8_t *data; // gzip
+  size_t len;
+  size_t rawLen;       // before compression
+  const char *etag;    // quoted, a digest of the content
+};
+
+const StaticAsset *findAsset(const StaticAsset *assets, size_t count, const char *path);
+
+// Answers from flash without a copy: 304 when the client's If-None-Match holds the ETag,
+// otherwise the compressed bytes with Content-Encoding: gzip. A revisit costs a header.
+void sendAsset(HttpConnection &conn, const StaticAsset &asset);
+
+#endif // STATIC_ASSET_H_
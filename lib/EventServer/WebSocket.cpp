@@ -0,0 +1,298 @@
+#include "WebSocket.h"
+#include "EventServer.h"
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+static const char WS_GUID[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+//////////////////////////
+// Handshake
+
+static inline uint32_t rol(uint32_t x, int n) { return (x << n) | (x >> (32 - n)); }
+
+static void sha1_block(uint32_t h[5], const uint8_t *p)
+{
+  uint32_t w[80];
+  for (int i = 0; i < 16; i++)
+    w[i] = (uint32_t)p[4 * i] << 24 | (uint32_t)p[4 * i + 1] << 16 | (uint32_t)p[4 * i + 2] << 8 | p[4 * i + 3];
+  for (int i = 16; i < 80; i++)
+    w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+  uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+  for (int i = 0; i < 80; i++)
+  {
+    uint32_t f, k;
+    if (i < 20)
+    {
+      f = (b & c) | (~b & d);
+      k = 0x5a827999;
+    }
+    else if (i < 40)
+    {
+      f = b ^ c ^ d;
+      k = 0x6ed9eba1;
+    }
+    else if (i < 60)
+    {
+      f = (b & c) | (b & d) | (c & d);
+      k = 0x8f1bbcdc;
+    }
+    else
+    {
+      f = b ^ c ^ d;
+      k = 0xca62c1d6;
+    }
+    uint32_t t = rol(a, 5) + f + e + k + w[i];
+    e = d;
+    d = c;
+    c = rol(b, 30);
+    b = a;
+    a = t;
+  }
+  h[0] += a;
+  h[1] += b;
+  h[2] += c;
+  h[3] += d;
+  h[4] += e;
+}
+
+// SHA-1 (FIPS 180-4) of a short message, all the handshake needs it for
+static void sha1(const uint8_t *data, size_t len, uint8_t digest[20])
+{
+  uint32_t h[5] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+  size_t i = 0;
+  for (; i + 64 <= len; i += 64)
+    sha1_block(h, data + i);
+  uint8_t tail[128];
+  size_t rest = len - i;
+  memcpy(tail, data + i, rest);
+  tail[rest] = 0x80;
+  size_t blocks = rest + 9 > 64 ? 2 : 1;
+  memset(tail + rest + 1, 0, blocks * 64 - rest - 1);
+  uint64_t bits = (uint64_t)len * 8;
+  for (int b = 0; b < 8; b++)
+    tail[blocks * 64 - 1 - b] = (uint8_t)(bits >> (8 * b));
+  for (size_t b = 0; b < blocks; b++)
+    sha1_block(h, tail + 64 * b);
+  for (int j = 0; j < 5; j++)
+  {
+    digest[4 * j] = h[j] >> 24;
+    digest[4 * j + 1] = h[j] >> 16;
+    digest[4 * j + 2] = h[j] >> 8;
+    digest[4 * j + 3] = h[j];
+  }
+}
+
+void wsAcceptKey(const char *key, char accept[WS_ACCEPT_SIZE])
+{
+  static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  uint8_t buf[64 + sizeof(WS_GUID)];
+  size_t n = strlen(key);
+  if (n > 64)
+    n = 64;
+  memcpy(buf, key, n);
+  memcpy(buf + n, WS_GUID, sizeof(WS_GUID) - 1);
+  uint8_t d[21];
+  sha1(buf, n + sizeof(WS_GUID) - 1, d);
+  d[20] = 0;
+
+  // 20 bytes: six whole groups and one with two bytes, padded with a single '='
+  char *o = accept;
+  for (int i = 0; i < 21; i += 3)
+  {
+    uint32_t v = (uint32_t)d[i] << 16 | (uint32_t)d[i + 1] << 8 | (i + 2 < 20 ? d[i + 2] : 0);
+    *o++ = alphabet[(v >> 18) & 63];
+    *o++ = alphabet[(v >> 12) & 63];
+    *o++ = alphabet[(v >> 6) & 63];
+    *o++ = i + 2 < 20 ? alphabet[v & 63] : '=';
+  }
+  *o = 0;
+}
+
+bool wsAccept(HttpConnection &conn, char accept[WS_ACCEPT_SIZE])
+{
+  char value[64];
+  bool upgrade = false;
+  if (conn.method() == METHOD_GET && conn.header("Upgrade", value, sizeof(value)))
+  {
+    for (char *p = value; *p; p++)
+      *p = tolower((unsigned char)*p);
+    upgrade = strstr(value, "websocket") != NULL;
+  }
+  if (!upgrade)
+  {
+    conn.send(400, "text/plain", "WebSocket upgrade expected");
+    return false;
+  }
+  if (!conn.header("Sec-WebSocket-Version", value, sizeof(value)) || strcmp(value, "13"))
+  {
+    conn.sendHeader("Sec-WebSocket-Version", "13");
+    conn.send(426, "text/plain", "WebSocket version 13 only");
+    return false;
+  }
+  if (!conn.header("Sec-WebSocket-Key", value, sizeof(value)) || strlen(value) != 24)
+  {
+    conn.send(400, "text/plain", "Bad Sec-WebSocket-Key");
+    return false;
+  }
+  wsAcceptKey(value, accept);
+  return true;
+}
+
+size_t wsUpgradeResponse(char *out, size_t outLen, const char *accept)
+{
+  int n = snprintf(out, outLen,
+                   "HTTP/1.1 101 Switching Protocols\r\n"
+                   "Upgrade: websocket\r\n"
+                   "Connection: Upgrade\r\n"
+                   "Sec-WebSocket-Accept: %s\r\n"
+                   "\r\n",
+                   accept);
+  return n > 0 && (size_t)n < outLen ? n : 0;
+}
+
+//////////////////////////
+// Framing
+
+size_t wsFrameHeader(uint8_t *out, WsOpcode opcode, uint64_t len)
+{
+  out[0] = 0x80 | opcode; // FIN, never fragmented
+  if (len < 126)
+  {
+    out[1] = (uint8_t)len;
+    return 2;
+  }
+  if (len <= 0xFFFF)
+  {
+    out[1] = 126;
+    out[2] = len >> 8;
+    out[3] = len;
+    return 4;
+  }
+  out[1] = 127;
+  for (int i = 0; i < 8; i++)
+    out[2 + i] = (uint8_t)(len >> (56 - 8 * i));
+  return 10;
+}
+
+WsReader::WsReader()
+{
+  _headLen = 0;
+  _headNeed = 2;
+  _remaining = 0;
+  _maskPos = 0;
+  _fin = false;
+  _control = false;
+  _opcode = WS_CONTINUATION;
+  _msgLen = 0;
+  _inMessage = false;
+  _messageOpcode = WS_BINARY;
+  _ctlLen = 0;
+  _closeCode = 0;
+  _failed = false;
+}
+
+size_t WsReader::fail(uint16_t code, size_t len, Event &event)
+{
+  _failed = true;
+  _closeCode = code;
+  event = ERROR;
+  return len; // nothing after this is worth reading
+}
+
+WsReader::Event WsReader::finishFrame(void)
+{
+  _headLen = 0;
+  _headNeed = 2;
+  if (_control)
+  {
+    if (_opcode == WS_PING)
+      return PING;
+    if (_opcode == WS_PONG)
+      return PONG;
+    _closeCode = _ctlLen >= 2 ? (uint16_t)(_ctl[0] << 8 | _ctl[1]) : WS_CLOSE_NORMAL;
+    return CLOSE;
+  }
+  if (!_fin)
+    return NONE;
+  _inMessage = false;
+  return MESSAGE;
+}
+
+size_t WsReader::feed(const uint8_t *data, size_t len, Event &event)
+{
+  event = NONE;
+  if (_failed)
+    return fail(_closeCode, len, event);
+  size_t used = 0;
+  while (used < len)
+  {
+    if (_headLen < _headNeed)
+    {
+      _head[_headLen++] = data[used++];
+      if (_headLen == 2)
+      {
+        _fin = _head[0] & 0x80;
+        _opcode = (WsOpcode)(_head[0] & 0x0F);
+        _control = _opcode & 0x8;
+        uint8_t len7 = _head[1] & 0x7F;
+        // Reserved bits (no extensions were agreed) and unmasked client frames are fatal
+        if ((_head[0] & 0x70) || !(_head[1] & 0x80))
+          return fail(WS_CLOSE_PROTOCOL, len, event);
+        if (_control && (_opcode > WS_PONG || !_fin || len7 > WS_CONTROL_SIZE))
+          return fail(WS_CLOSE_PROTOCOL, len, event);
+        if (!_control && (_opcode > WS_BINARY || (_opcode == WS_CONTINUATION) != _inMessage))
+          return fail(WS_CLOSE_PROTOCOL, len, event);
+        _headNeed = 2 + (len7 == 126 ? 2 : len7 == 127 ? 8 : 0) + 4;
+      }
+      if (_headLen < _headNeed)
+        continue;
+
+      uint8_t len7 = _head[1] & 0x7F;
+      uint8_t ext = len7 == 126 ? 2 : len7 == 127 ? 8 : 0;
+      _remaining = len7;
+      if (ext)
+      {
+        _remaining = 0;
+        for (uint8_t i = 0; i < ext; i++)
+          _remaining = _remaining << 8 | _head[2 + i];
+      }
+      memcpy(_mask, _head + 2 + ext, 4);
+      _maskPos = 0;
+      if (_control)
+      {
+        _ctlLen = 0;
+      }
+      else
+      {
+        if (_opcode != WS_CONTINUATION)
+        {
+          _inMessage = true;
+          _messageOpcode = _opcode;
+          _msgLen = 0;
+        }
+        if (_remaining > WS_MESSAGE_SIZE - _msgLen)
+          return fail(WS_CLOSE_TOO_BIG, len, event);
+      }
+      if (!_remaining && (event = finishFrame()) != NONE)
+        return used;
+      continue;
+    }
+
+    size_t n = len - used;
+    if (n > _remaining)
+      n = (size_t)_remaining;
+    uint8_t *dst = _control ? _ctl + _ctlLen : _msg + _msgLen;
+    for (size_t i = 0; i < n; i++)
+      dst[i] = data[used + i] ^ _mask[_maskPos++ & 3];
+    if (_control)
+      _ctlLen += n;
+    else
+      _msgLen += n;
+    used += n;
+    _remaining -= n;
+    if (!_remaining && (event = finishFrame()) != NONE)
+      return used;
+  }
+  return used;
+}
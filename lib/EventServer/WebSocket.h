@@ -0,0 +1,92 @@
+#ifndef WEB_SOCKET_H_
+#define WEB_SOCKET_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define WS_ACCEPT_SIZE      29  // Sec-WebSocket-Accept, base64 SHA-1 plus the NUL
+#define WS_UPGRADE_SIZE     160 // the 101 response wsUpgradeResponse() writes
+#define WS_MAX_FRAME_HEADER 10  // server frames are never masked
+#define WS_CONTROL_SIZE     125 // longest ping, pong or close payload (RFC 6455 5.5)
+#define WS_MESSAGE_SIZE     128 // longest data message we take from a client
+
+enum WsOpcode
+{
+  WS_CONTINUATION = 0x0,
+  WS_TEXT = 0x1,
+  WS_BINARY = 0x2,
+  WS_CLOSE = 0x8,
+  WS_PING = 0x9,
+  WS_PONG = 0xA
+};
+
+// Close codes (RFC 6455 7.4.1)
+#define WS_CLOSE_NORMAL    1000
+#define WS_CLOSE_PROTOCOL  1002
+#define WS_CLOSE_TOO_BIG   1009
+
+class HttpConnection;
+
+// Checks that conn is a WebSocket upgrade (GET, Upgrade: websocket, version 13, a key) and
+// writes the Sec-WebSocket-Accept answer into accept. Otherwise answers 400 (426 for another
+// version) and returns false.
+bool wsAccept(HttpConnection &conn, char accept[WS_ACCEPT_SIZE]);
+// The Sec-WebSocket-Accept value for a client's Sec-WebSocket-Key
+void wsAcceptKey(const char *key, char accept[WS_ACCEPT_SIZE]);
+// The 101 Switching Protocols response, returns its length
+size_t wsUpgradeResponse(char *out, size_t outLen, const char *accept);
+// Header of an unfragmented server frame carrying len payload bytes, returns its length
+size_t wsFrameHeader(uint8_t *out, WsOpcode opcode, uint64_t len);
+
+// Incremental parser for what a client sends: masked frames, fragmented data messages put back
+// together, control frames in between. Messages are small here (acknowledgements, pings), so
+// the payload is kept in place and anything longer than WS_MESSAGE_SIZE is an error.
+class WsReader
+{
+public:
+  enum Event
+  {
+    NONE,    // needs more bytes
+    MESSAGE, // a whole text or binary message, see opcode()
+    PING,
+    PONG,
+    CLOSE,
+    ERROR // see closeCode(); the connection should be closed with it
+  };
+
+  WsReader();
+
+  // Consumes bytes up to the end of the next frame that completes something, so call it
+  // again with the rest while it returns less than len
+  size_t feed(const uint8_t *data, size_t len, Event &event);
+
+  WsOpcode opcode(void) const { return _messageOpcode; } // WS_TEXT or WS_BINARY after MESSAGE
+  const uint8_t *payload(void) const { return _control ? _ctl : _msg; }
+  size_t payloadLen(void) const { return _control ? _ctlLen : _msgLen; }
+  uint16_t closeCode(void) const { return _closeCode; }
+
+private:
+  Event finishFrame(void);
+  size_t fail(uint16_t code, size_t len, Event &event);
+
+  uint8_t _head[14];
+  uint8_t _headLen;
+  uint8_t _headNeed;
+  uint64_t _remaining; // payload bytes of the current frame still to come
+  uint8_t _mask[4];
+  uint8_t _maskPos;
+  bool _fin;
+  bool _control;
+  WsOpcode _opcode;
+
+  uint8_t _msg[WS_MESSAGE_SIZE];
+  size_t _msgLen;
+  bool _inMessage;
+  WsOpcode _messageOpcode;
+  uint8_t _ctl[WS_CONTROL_SIZE];
+  size_t _ctlLen;
+  uint16_t _closeCode;
+  bool _failed;
+};
+
+#endif // WEB_SOCKET_H_
@@ -0,0 +1,93 @@
+#include "EventClip.h"
+#include <chrono>
+#include <MJPEG_Streaming.h>
+
+static uint64_t steady_us(void)
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+ClipRecorder::ClipRecorder(MJPEGBroadcaster &broadcaster, FrameRing &ring) : _broadcaster(broadcaster), _ring(ring)
+{
+  _lastSeq = 0;
+  _skipped = 0;
+}
+
+void ClipRecorder::run(void)
+{
+  _broadcaster.attach();
+  while (step())
+    ;
+  _broadcaster.detach();
+}
+
+bool ClipRecorder::step(void)
+{
+  FrameRef frame;
+  if (!_broadcaster.acquire(frame, _lastSeq))
+    return false;
+  if (_lastSeq && frame.getSeq() > _lastSeq + 1)
+    _skipped += frame.getSeq() - _lastSeq - 1;
+  _lastSeq = frame.getSeq();
+  _ring.store(frame.getBuf(), frame.getSize(), frame.getTimestamp());
+  return true;
+}
+
+ClipStreamer::ClipStreamer(FrameRing &ring, bool paced) : _ring(ring)
+{
+  _started = 0;
+  _firstTs = 0;
+  _index = 0;
+  _paced = paced;
+  _headerSent = false;
+  _opened = _ring.openClip();
+}
+
+ClipStreamer::~ClipStreamer()
+{
+  if (_opened)
+    _ring.closeClip();
+}
+
+ClipStatus ClipStreamer::next(void)
+{
+  ClipStatus status = _ring.clipFrame(_index, _frame);
+  if (status == CLIP_FRAME && _paced && _index && steady_us() - _started < _frame.timestamp_us - _firstTs)
+    return CLIP_WAIT; // not due yet
+  return status;
+}
+
+bool ClipStreamer::ready(void)
+{
+  return !_headerSent || next() != CLIP_WAIT;
+}
+
+bool ClipStreamer::pump(HttpConnection &conn)
+{
+  if (!_headerSent)
+  {
+    _headerSent = true;
+    conn.queue(HEADER, hdrLen);
+    conn.queue(BOUNDARY, bdrLen);
+    return true;
+  }
+  ClipStatus status = next();
+  if (status == CLIP_END)
+    return false;
+  if (status == CLIP_WAIT)
+    return true;
+  if (!_index)
+  {
+    _started = steady_us();
+    _firstTs = _frame.timestamp_us;
+  }
+  _index++;
+  // The clip is pinned while this streamer has it open, the arena bytes go out as they are
+  char buf[64];
+  int n = mjpegPartHeader(buf, sizeof(buf), _frame.len, false);
+  conn.queueCopy(buf, n);
+  conn.queue(_frame.buf, _frame.len);
+  conn.queue(BOUNDARY, bdrLen);
+  return true;
+}
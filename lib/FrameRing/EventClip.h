@@ -0,0 +1,58 @@
+#ifndef EVENT_CLIP_H_
+#define EVENT_CLIP_H_
+
+#include <stdint.h>
+#include <EventServer.h>
+#include <MJPEGBroadcaster.h>
+#include "FrameRing.h"
+
+// Copies every published frame into the ring, as one more reader of the broadcaster on a
+// task of its own. The copy is the only work per frame, so it keeps up with the producer
+// and hands each frame back to the driver right after.
+class ClipRecorder
+{
+public:
+  ClipRecorder(MJPEGBroadcaster &broadcaster, FrameRing &ring);
+
+  // Task body. Stays attached while it runs, so there is always history to cut a clip from;
+  // returns once the broadcaster shuts down.
+  void run(void);
+  bool step(void); // one frame, false on shutdown
+
+  uint32_t skipped(void) const { return _skipped; } // published while the previous copy ran
+
+private:
+  MJPEGBroadcaster &_broadcaster;
+  FrameRing &_ring;
+  uint32_t _lastSeq;
+  uint32_t _skipped;
+};
+
+// Streams the ring's clip as MJPEG, frames leaving straight from the arena. A clip that is
+// still recording is followed until its post window closes. Paced streams keep the capture
+// timing (re-checked whenever the server wakes, i.e. on every publish); unpaced ones go
+// out as fast as the socket takes them.
+class ClipStreamer : public Streamer
+{
+public:
+  ClipStreamer(FrameRing &ring, bool paced);
+  ~ClipStreamer();
+
+  bool opened(void) const { return _opened; } // false when there was no clip to stream
+  bool ready(void);
+  bool pump(HttpConnection &conn);
+
+private:
+  ClipStatus next(void); // looks up the frame at _index into _frame
+
+  FrameRing &_ring;
+  RingFrame _frame;
+  uint64_t _started;  // steady clock when the first frame went out
+  uint64_t _firstTs;  // its capture timestamp
+  uint32_t _index;
+  bool _opened;
+  bool _paced;
+  bool _headerSent;
+};
+
+#endif // EVENT_CLIP_H_
@@ -0,0 +1,288 @@
+#include "FrameRing.h"
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#if defined(ARDUINO)
+  #include "esp_heap_caps.h"
+#endif
+
+typedef std::chrono::steady_clock Clock;
+
+// 10 us .. 25 ms: a VGA frame is a ~25 KB copy into PSRAM
+static const uint32_t STORE_BUCKETS_US[] = {10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000};
+
+RingMetrics ringMetrics;
+
+RingMetrics::RingMetrics() : store(STORE_BUCKETS_US, sizeof(STORE_BUCKETS_US) / sizeof(STORE_BUCKETS_US[0]))
+{
+}
+
+void writeRingMetrics(PromWriter &w)
+{
+  RingMetrics &m = ringMetrics;
+  w.histogram("esp32cam_ring_store_seconds", "Per frame, eviction and copy into the event ring", m.store, 1e-6);
+  w.counter("esp32cam_ring_frames_total", "Frames stored in the event ring", m.frames.value());
+  w.counter("esp32cam_ring_bytes_total", "Bytes stored in the event ring", m.bytes.value());
+  w.counter("esp32cam_ring_evicted_total", "Frames overwritten or aged out of the event ring", m.evicted.value());
+  w.counter("esp32cam_ring_dropped_total", "Frames not stored because a pinned clip filled the ring", m.dropped.value());
+  w.counter("esp32cam_ring_clips_total", "Event clips started", m.clips.value());
+  w.counter("esp32cam_ring_clips_truncated_total", "Event clips cut short for lack of space", m.truncated.value());
+  w.counter("esp32cam_ring_clips_released_total", "Finished, unread event clips given up to make room for new frames",
+            m.released.value());
+}
+
+FrameRing::FrameRing()
+{
+  _arena = NULL;
+  _index = NULL;
+  _data = NULL;
+  _dataSize = 0;
+  _maxFrames = 0;
+  _oldest = _next = 0;
+  _head = 0;
+  _used = 0;
+  _onClipFrame = NULL;
+  _onClipFrameCtx = NULL;
+  _clip = false;
+  _clipRecording = false;
+  _clipFirst = _clipEnd = 0;
+  _clipUntil = _clipLast = 0;
+  _readers = 0;
+  configure(RING_PRE_MS, RING_POST_MS, RING_HOLD_MS);
+}
+
+FrameRing::~FrameRing()
+{
+  free(_arena);
+}
+
+bool FrameRing::begin(size_t bytes, uint16_t maxFrames)
+{
+  size_t indexBytes = ((size_t)maxFrames * sizeof(Entry) + 7) & ~(size_t)7;
+  if (_arena || !maxFrames || bytes <= indexBytes)
+    return false;
+#if defined(ARDUINO)
+  _arena = (uint8_t *)heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+#else
+  _arena = (uint8_t *)malloc(bytes);
+#endif
+  if (!_arena)
+    return false;
+  // Index first, frames after it, everything in the one allocation
+  _index = (Entry *)_arena;
+  _data = _arena + indexBytes;
+  _dataSize = (bytes - indexBytes) & ~(size_t)3;
+  _maxFrames = maxFrames;
+  return true;
+}
+
+void FrameRing::configure(uint32_t pre_ms, uint32_t post_ms, uint32_t hold_ms)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  _pre_us = pre_ms * 1000ULL;
+  _post_us = post_ms * 1000ULL;
+  _hold_us = hold_ms * 1000ULL;
+}
+
+void FrameRing::onClipFrame(void (*callback)(void *ctx), void *ctx)
+{
+  _onClipFrame = callback;
+  _onClipFrameCtx = ctx;
+}
+
+bool FrameRing::evictOldest(bool reclaim)
+{
+  if (_clip && (int32_t)(_oldest - _clipFirst) >= 0 && (int32_t)(_oldest - _clipEnd) < 0)
+  {
+    // Pinned while recording or read; a finished clip nobody reads only keeps what space allows
+    if (!reclaim || _clipRecording || _readers)
+      return false;
+    _clip = false;
+    ringMetrics.released.add();
+  }
+  _used -= entry(_oldest).len;
+  _oldest++;
+  ringMetrics.evicted.add();
+  return true;
+}
+
+void FrameRing::finishClip(bool truncated)
+{
+  _clipRecording = false;
+  if (truncated)
+    ringMetrics.truncated.add();
+}
+
+bool FrameRing::store(const uint8_t *buf, size_t len, uint64_t timestamp_us)
+{
+  Clock::time_point started = Clock::now();
+  size_t need = (len + 3) & ~(size_t)3; // keeps every frame word aligned for the copy
+  bool notify = false;
+  bool fits;
+  size_t pos;
+  {
+    std::lock_guard<std::mutex> guard(_lock);
+    if (!_data || !len || need > _dataSize / 2)
+    {
+      ringMetrics.dropped.add();
+      return false;
+    }
+    if (_clip && !_clipRecording && !_readers && timestamp_us >= _clipLast + _hold_us)
+      _clip = false;
+    if (_clipRecording && timestamp_us > _clipUntil)
+    {
+      finishClip(false);
+      notify = true;
+    }
+
+    // History older than the pre-trigger window is never part of a clip
+    while (_next != _oldest && entry(_oldest).timestamp_us + _pre_us < timestamp_us && evictOldest(false))
+      ;
+    fits = _next - _oldest < _maxFrames || evictOldest(true);
+    pos = _head;
+    if (fits && pos + need > _dataSize)
+    {
+      // Wrap: whatever still sits between the head and the end is older than the frames at the start
+      while (fits && _next != _oldest && entry(_oldest).offset >= pos)
+        fits = evictOldest(true);
+      pos = 0;
+    }
+    while (fits && _next != _oldest && entry(_oldest).offset >= pos && entry(_oldest).offset < pos + need)
+      fits = evictOldest(true);
+    if (!fits)
+    {
+      ringMetrics.dropped.add();
+      if (_clipRecording)
+      {
+        finishClip(true); // a gap would make the rest of it misleading
+        notify = true;
+      }
+    }
+  }
+  if (!fits)
+  {
+    if (_onClipFrame && notify)
+      _onClipFrame(_onClipFrameCtx);
+    return false;
+  }
+
+  // The reserved range only held evicted frames, nobody reads it, so copy without the lock
+  memcpy(_data + pos, buf, len);
+
+  {
+    std::lock_guard<std::mutex> guard(_lock);
+    Entry &e = entry(_next);
+    e.offset = pos;
+    e.len = len;
+    e.timestamp_us = timestamp_us;
+    _next++;
+    _head = pos + need;
+    _used += len;
+    if (_clipRecording)
+    {
+      _clipEnd = _next;
+      notify = true;
+    }
+  }
+  ringMetrics.frames.add();
+  ringMetrics.bytes.add(len);
+  ringMetrics.store.observe(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - started).count());
+  if (_onClipFrame && notify)
+    _onClipFrame(_onClipFrameCtx);
+  return true;
+}
+
+bool FrameRing::trigger(void)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  if (_next == _oldest)
+    return false;
+  uint64_t now = entry(_next - 1).timestamp_us;
+  if (_clipRecording)
+  {
+    _clipLast = now;
+    _clipUntil = now + _post_us;
+    return true;
+  }
+  if (_clip && _readers)
+    return false;
+
+  // Reach back through the pre window, leaving the post window its share of the arena
+  uint64_t window = _pre_us + _post_us;
+  size_t budget = window ? (size_t)(_dataSize * (double)_pre_us / window) : _dataSize;
+  uint32_t first = _next - 1;
+  size_t bytes = entry(first).len;
+  while (first != _oldest)
+  {
+    const Entry &e = entry(first - 1);
+    if (e.timestamp_us + _pre_us < now || bytes + e.len > budget)
+      break;
+    first--;
+    bytes += e.len;
+  }
+  _clip = true;
+  _clipRecording = true;
+  _clipFirst = first;
+  _clipEnd = _next;
+  _clipLast = now;
+  _clipUntil = now + _post_us;
+  ringMetrics.clips.add();
+  return true;
+}
+
+bool FrameRing::openClip(void)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  if (!_clip)
+    return false;
+  _readers++;
+  return true;
+}
+
+ClipStatus FrameRing::clipFrame(uint32_t index, RingFrame &out)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  if (!_clip)
+    return CLIP_END;
+  uint32_t seq = _clipFirst + index;
+  if ((int32_t)(seq - _clipEnd) >= 0)
+    return _clipRecording ? CLIP_WAIT : CLIP_END;
+  const Entry &e = entry(seq);
+  out.buf = _data + e.offset;
+  out.len = e.len;
+  out.timestamp_us = e.timestamp_us;
+  return CLIP_FRAME;
+}
+
+void FrameRing::closeClip(void)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  if (_readers)
+    _readers--;
+}
+
+bool FrameRing::recording(void)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  return _clipRecording;
+}
+
+size_t FrameRing::used(void)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  return _used;
+}
+
+uint16_t FrameRing::frameCount(void)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  return _next - _oldest;
+}
+
+uint32_t FrameRing::spanMs(void)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  if (_next == _oldest)
+    return 0;
+  return (entry(_next - 1).timestamp_us - entry(_oldest).timestamp_us) / 1000;
+}
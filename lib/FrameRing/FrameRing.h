@@ -0,0 +1,131 @@
+#ifndef FRAME_RING_H_
+#define FRAME_RING_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <mutex>
+#include <Metrics.h>
+
+#define RING_ARENA_BYTES (2 * 1024 * 1024) // PSRAM kept for recent frames
+#define RING_MAX_FRAMES  512   // index entries, allocated with the arena
+#define RING_PRE_MS      5000  // history kept before a trigger
+#define RING_POST_MS     5000  // frames added to a clip after its last trigger
+#define RING_HOLD_MS     60000 // a finished clip stays available this long after its last trigger
+
+// Ring instruments
+struct RingMetrics
+{
+  RingMetrics();
+
+  Histogram store;   // per frame: reservation, eviction and copy into the arena
+  Counter frames;    // frames stored
+  Counter bytes;
+  Counter evicted;   // frames overwritten or aged out
+  Counter dropped;   // frames that did not fit without overwriting a pinned clip
+  Counter clips;     // clips started
+  Counter truncated; // clips cut short because the arena ran out of unpinned space
+  Counter released;  // finished, unread clips given up to make room for new frames
+};
+
+extern RingMetrics ringMetrics;
+
+void writeRingMetrics(PromWriter &w);
+
+// One stored frame as handed to clip readers. buf points into the arena and stays valid
+// while the reader keeps the clip open.
+struct RingFrame
+{
+  const uint8_t *buf;
+  size_t len;
+  uint64_t timestamp_us;
+};
+
+enum ClipStatus
+{
+  CLIP_FRAME, // out was filled in
+  CLIP_WAIT,  // the clip is still recording, the frame is not captured yet
+  CLIP_END
+};
+
+// Recent JPEG frames in one fixed arena (PSRAM on the device), allocated once by begin().
+// Frames are copied back to back into a circular byte region and found through a circular
+// index of offsets and timestamps, so storing a frame never allocates; the oldest frames
+// are overwritten first and anything older than the pre-trigger window is dropped early.
+//
+// trigger() starts a clip: the frames of the last pre_ms (at most the share of the arena
+// not needed for the post window) plus everything stored until post_ms after the last
+// trigger. While it records, or while a reader has it open, the clip is pinned: new frames
+// only evict older history, and when nothing else is left they are dropped instead. Readers
+// can open the clip while it is still recording and follow it frame by frame. A finished
+// clip stays available for hold_ms, but with nobody reading it, it is given up as soon as new
+// frames need its space, so live frames are never dropped for it.
+//
+// Single producer: store() is only called from one task. Everything else is thread-safe.
+class FrameRing
+{
+public:
+  FrameRing();
+  ~FrameRing();
+
+  bool begin(size_t bytes, uint16_t maxFrames); // false when the arena cannot be allocated
+  void configure(uint32_t pre_ms, uint32_t post_ms, uint32_t hold_ms);
+  // Called after a frame is stored while a clip is recording, e.g. to wake an event loop
+  void onClipFrame(void (*callback)(void *ctx), void *ctx);
+
+  bool store(const uint8_t *buf, size_t len, uint64_t timestamp_us);
+
+  // Starts a clip at the newest stored frame, or extends the one still recording. False
+  // while a finished clip is being read.
+  bool trigger(void);
+
+  // Clip readers. openClip() pins the clip until closeClip(), false when there is none.
+  bool openClip(void);
+  ClipStatus clipFrame(uint32_t index, RingFrame &out);
+  void closeClip(void);
+  bool recording(void);
+
+  // Occupancy
+  size_t capacity(void) const { return _dataSize; }
+  size_t used(void);
+  uint16_t frameCount(void);
+  uint32_t spanMs(void); // oldest to newest stored frame
+
+private:
+  struct Entry
+  {
+    uint32_t offset;
+    uint32_t len;
+    uint64_t timestamp_us;
+  };
+
+  Entry &entry(uint32_t seq) { return _index[seq % _maxFrames]; }
+  bool evictOldest(bool reclaim); // reclaim: an unread finished clip may go
+  void finishClip(bool truncated);
+
+  std::mutex _lock;
+  uint8_t *_arena;
+  Entry *_index;
+  uint8_t *_data;
+  size_t _dataSize;
+  uint16_t _maxFrames;
+  uint32_t _oldest; // seq of the oldest stored frame
+  uint32_t _next;   // seq the next frame gets
+  size_t _head;     // where the next frame goes unless it has to wrap
+  size_t _used;
+
+  uint64_t _pre_us;
+  uint64_t _post_us;
+  uint64_t _hold_us;
+  void (*_onClipFrame)(void *ctx);
+  void *_onClipFrameCtx;
+
+  bool _clip;          // a clip exists (recording or held)
+  bool _clipRecording;
+  uint32_t _clipFirst; // seq of its first frame
+  uint32_t _clipEnd;   // one past its last frame so far
+  uint64_t _clipUntil; // timestamp that ends the post window
+  uint64_t _clipLast;  // last trigger
+  uint8_t _readers;
+};
+
+#endif // FRAME_RING_H_
@@ -0,0 +1,245 @@
+#include "JpegParser.h"
+#include <string.h>
+
+static inline uint16_t be16(const uint8_t *p)
+{
+  return (p[0] << 8) | p[1];
+}
+
+JpegParser::JpegParser()
+{
+  memset(_dc, 0, sizeof(_dc));
+  memset(_ac, 0, sizeof(_ac));
+  memset(_q, 0, sizeof(_q));
+  _frameComps = _ncomp = 0;
+  _width = _height = 0;
+  _restart = 0;
+  _p = _end = NULL;
+  _bits = 0;
+  _count = 0;
+  _marker = false;
+}
+
+bool JpegParser::buildTable(JpegHuffTable &t, const uint8_t *counts, const uint8_t *values, size_t n)
+{
+  // The sensor sends the same tables every frame, only rebuild when they change
+  if (t.defined && !memcmp(t.counts, counts, 16) && !memcmp(t.values, values, n))
+    return true;
+
+  memset(t.fast, 0, sizeof(t.fast));
+  memcpy(t.counts, counts, 16);
+  memcpy(t.values, values, n);
+  uint32_t code = 0;
+  size_t k = 0;
+  for (uint8_t l = 1; l <= 16; l++)
+  {
+    t.valptr[l] = k;
+    t.mincode[l] = code;
+    for (uint8_t i = 0; i < counts[l - 1]; i++, k++, code++)
+    {
+      if (l <= 9)
+      {
+        uint16_t first = code << (9 - l);
+        for (uint16_t j = 0; j < (1u << (9 - l)); j++)
+          t.fast[first + j] = (l << 8) | values[k];
+      }
+    }
+    t.maxcode[l] = counts[l - 1] ? (int32_t)code - 1 : -1;
+    if (code > (1u << l))
+      return false; // over-subscribed
+    code <<= 1;
+  }
+  t.maxcode[17] = 0x7FFFFFFF;
+  t.defined = true;
+  return true;
+}
+
+const uint8_t *JpegParser::parse(const uint8_t *jpg, size_t len)
+{
+  const uint8_t *p = jpg;
+  const uint8_t *end = jpg + len;
+  if (len < 4 || p[0] != 0xFF || p[1] != 0xD8)
+    return NULL;
+  p += 2;
+  _frameComps = _ncomp = 0;
+  _restart = 0;
+
+  while (p + 4 <= end)
+  {
+    if (*p != 0xFF)
+    {
+      p++;
+      continue;
+    }
+    uint8_t marker = p[1];
+    if (marker == 0xFF || marker == 0x00 || (marker >= 0xD0 && marker <= 0xD8))
+    {
+      p++;
+      continue;
+    }
+    if (marker == 0xD9)
+      return NULL; // no scan
+    uint16_t seg = be16(p + 2);
+    const uint8_t *s = p + 4;
+    const uint8_t *next = p + 2 + seg;
+    if (seg < 2 || next > end)
+      return NULL;
+
+    switch (marker)
+    {
+    case 0xC0: // baseline
+    case 0xC1: // extended, Huffman
+      if (seg < 8 || s[0] != 8)
+        return NULL;
+      _height = be16(s + 1);
+      _width = be16(s + 3);
+      _frameComps = s[5];
+      if (_frameComps < 1 || _frameComps > JPEG_MAX_COMPONENTS || seg < 8 + 3 * _frameComps || !_width || !_height)
+        return NULL;
+      for (uint8_t i = 0; i < _frameComps; i++)
+      {
+        JpegComponent &c = _comp[i];
+        c.id = s[6 + 3 * i];
+        c.h = s[7 + 3 * i] >> 4;
+        c.v = s[7 + 3 * i] & 15;
+        c.tq = s[8 + 3 * i] & 3;
+        if (c.h < 1 || c.h > 4 || c.v < 1 || c.v > 4)
+          return NULL;
+      }
+      break;
+    case 0xC4:
+      while (s + 17 <= next)
+      {
+        uint8_t tc = s[0] >> 4, th = s[0] & 3;
+        size_t n = 0;
+        for (uint8_t i = 1; i <= 16; i++)
+          n += s[i];
+        if (n > 256 || s + 17 + n > next || tc > 1)
+          return NULL;
+        if (!buildTable(tc ? _ac[th] : _dc[th], s + 1, s + 17, n))
+          return NULL;
+        s += 17 + n;
+      }
+      break;
+    case 0xDB:
+      while (s + 65 <= next)
+      {
+        uint8_t pq = s[0] >> 4, tq = s[0] & 3;
+        if (s + 1 + 64 * (pq + 1) > next)
+          return NULL;
+        for (uint8_t k = 0; k < 64; k++)
+          _q[tq][k] = pq ? be16(s + 1 + 2 * k) : s[1 + k];
+        s += 1 + 64 * (pq + 1);
+      }
+      break;
+    case 0xDD:
+      if (seg < 4)
+        return NULL;
+      _restart = be16(s);
+      break;
+    case 0xDA:
+    {
+      if (!_frameComps || seg < 6)
+        return NULL;
+      uint8_t ns = s[0];
+      if (ns < 1 || ns > _frameComps || seg < 6 + 2 * ns)
+        return NULL;
+      // Interleaved scans must carry every component; a lone scan has to be the first one
+      if (ns != _frameComps && !(ns == 1 && s[1] == _comp[0].id))
+        return NULL;
+      for (uint8_t i = 0; i < ns; i++)
+      {
+        if (s[1 + 2 * i] != _comp[i].id)
+          return NULL; // scan order must follow the frame header
+        _comp[i].td = s[2 + 2 * i] >> 4 & 3;
+        _comp[i].ta = s[2 + 2 * i] & 3;
+        if (!_dc[_comp[i].td].defined || !_ac[_comp[i].ta].defined)
+          return NULL;
+      }
+      _ncomp = ns;
+      return next;
+    }
+    default:
+      if (marker >= 0xC2 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+        return NULL; // progressive, lossless or arithmetic coded
+      break;
+    }
+    p = next;
+  }
+  return NULL;
+}
+
+void JpegParser::begin(const uint8_t *p, const uint8_t *end)
+{
+  _p = p;
+  _end = end;
+  _bits = 0;
+  _count = 0;
+  _marker = false;
+  for (uint8_t i = 0; i < _ncomp; i++)
+    _comp[i].pred = 0;
+}
+
+void JpegParser::fill(void)
+{
+  while (_count <= 24)
+  {
+    uint32_t b = 0xFF;
+    if (!_marker && _p < _end)
+    {
+      b = *_p;
+      if (b == 0xFF)
+      {
+        if (_p + 1 < _end && _p[1] == 0x00)
+          _p += 2;
+        else
+        {
+          _marker = true; // leave it for restart(), feed ones from here on
+          b = 0xFF;
+        }
+      }
+      else
+        _p++;
+    }
+    _bits = (_bits << 8) | b;
+    _count += 8;
+  }
+}
+
+int JpegParser::decode(const JpegHuffTable &t)
+{
+  if (_count < 16)
+    fill();
+  uint16_t e = t.fast[(_bits >> (_count - 9)) & 0x1FF];
+  if (e)
+  {
+    _count -= e >> 8;
+    return e & 0xFF;
+  }
+  for (uint8_t l = 10; l <= 16; l++)
+  {
+    int32_t code = (_bits >> (_count - l)) & ((1u << l) - 1);
+    if (code <= t.maxcode[l])
+    {
+      _count -= l;
+      return t.values[t.valptr[l] + code - t.mincode[l]];
+    }
+  }
+  return -1;
+}
+
+bool JpegParser::restart(void)
+{
+  // Whatever is still buffered is byte padding; find RSTn and start over with fresh predictors
+  _bits = 0;
+  _count = 0;
+  _marker = false;
+  while (_p + 1 < _end && !(_p[0] == 0xFF && _p[1] >= 0xD0 && _p[1] <= 0xD7))
+    _p++;
+  if (_p + 1 >= _end)
+    return false;
+  _p += 2;
+  for (uint8_t i = 0; i < _ncomp; i++)
+    _comp[i].pred = 0;
+  return true;
+}
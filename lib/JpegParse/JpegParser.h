@@ -0,0 +1,98 @@
+#ifndef JPEG_PARSER_H_
+#define JPEG_PARSER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define JPEG_MAX_COMPONENTS 4
+
+struct JpegHuffTable
+{
+  uint16_t fast[512]; // next 9 bits -> (length << 8) | symbol, 0 when the code is longer
+  int32_t maxcode[18];
+  int32_t valptr[17];
+  uint16_t mincode[17];
+  uint8_t counts[16];
+  uint8_t values[256];
+  bool defined;
+};
+
+struct JpegComponent
+{
+  uint8_t id;
+  uint8_t h;
+  uint8_t v;
+  uint8_t tq;
+  uint8_t td;
+  uint8_t ta;
+  int16_t pred; // DC predictor
+};
+
+// Baseline JPEG front end shared by the motion detector's luma extraction and the scaler:
+// walks the markers up to the first scan, keeping the frame header, Huffman and quantisation
+// tables and the restart interval, then reads the entropy-coded data behind it. Tables are
+// reused between frames. What is done with the coefficients is up to the caller.
+class JpegParser
+{
+public:
+  JpegParser();
+
+  // Headers through SOS. Returns where the entropy-coded data starts, NULL for anything that
+  // is not 8-bit baseline/extended Huffman (e.g. progressive), is truncated, or whose scan
+  // carries neither every component in frame header order nor the first one alone
+  const uint8_t *parse(const uint8_t *jpg, size_t len);
+
+  uint16_t width(void) const { return _width; }
+  uint16_t height(void) const { return _height; }
+  uint8_t frameComponents(void) const { return _frameComps; }
+  uint8_t components(void) const { return _ncomp; } // in the scan, the first ones of the frame
+  JpegComponent &component(uint8_t i) { return _comp[i]; }
+  const uint16_t *quant(uint8_t tq) const { return _q[tq]; } // zigzag order as sent
+  uint16_t restartInterval(void) const { return _restart; }
+
+  // Entropy-coded segment reader with 0xFF00 unstuffing; pads with ones at a marker
+  void begin(const uint8_t *p, const uint8_t *end); // also clears the DC predictors
+  inline uint32_t receive(uint8_t n);
+  int decodeDc(const JpegComponent &c) { return decode(_dc[c.td]); }
+  int decodeAc(const JpegComponent &c) { return decode(_ac[c.ta]); }
+  bool restart(void);
+  bool overrun(void) const { return _p >= _end && !_marker; } // ran off the buffer, the frame is truncated
+
+  // The received bits as a signed coefficient (T.81 F.2.2.1 EXTEND)
+  static inline int32_t extend(uint32_t v, uint8_t n)
+  {
+    return v < (1u << (n - 1)) ? (int32_t)v - (int32_t)((1u << n) - 1) : (int32_t)v;
+  }
+
+private:
+  bool buildTable(JpegHuffTable &t, const uint8_t *counts, const uint8_t *values, size_t n);
+  void fill(void);
+  int decode(const JpegHuffTable &t);
+
+  JpegHuffTable _dc[4];
+  JpegHuffTable _ac[4];
+  uint16_t _q[4][64];
+  JpegComponent _comp[JPEG_MAX_COMPONENTS];
+  uint8_t _frameComps;
+  uint8_t _ncomp;
+  uint16_t _width;
+  uint16_t _height;
+  uint16_t _restart;
+
+  const uint8_t *_p;
+  const uint8_t *_end;
+  uint32_t _bits;
+  uint8_t _count;
+  bool _marker;
+};
+
+// The next n bits, 1 <= n <= 16
+inline uint32_t JpegParser::receive(uint8_t n)
+{
+  if (_count < n)
+    fill();
+  _count -= n;
+  return (_bits >> _count) & ((1u << n) - 1);
+}
+
+#endif // JPEG_PARSER_H_
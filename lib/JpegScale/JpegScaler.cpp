@@ -0,0 +1,552 @@
+#include "JpegScaler.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(ARDUINO)
+  #include "esp_heap_caps.h"
+#endif
+
+#define STRIP_ROWS 16 // 8 pixel rows per block row, at most 2 block rows per MCU (v <= 2)
+
+// Natural (row-major) position of each zigzag index
+static const uint8_t ZIGZAG[64] = {
+   0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+  12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+  35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+  58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63};
+
+// ITU T.81 Annex K tables, natural order
+static const uint8_t LUMA_QUANT[64] = {
+  16, 11, 10, 16,  24,  40,  51,  61,  12, 12, 14, 19,  26,  58,  60,  55,
+  14, 13, 16, 24,  40,  57,  69,  56,  14, 17, 22, 29,  51,  87,  80,  62,
+  18, 22, 37, 56,  68, 109, 103,  77,  24, 35, 55, 64,  81, 104, 113,  92,
+  49, 64, 78, 87, 103, 121, 120, 101,  72, 92, 95, 98, 112, 100, 103,  99};
+static const uint8_t CHROMA_QUANT[64] = {
+  17, 18, 24, 47, 99, 99, 99, 99,  18, 21, 26, 66, 99, 99, 99, 99,
+  24, 26, 56, 99, 99, 99, 99, 99,  47, 66, 99, 99, 99, 99, 99, 99,
+  99, 99, 99, 99, 99, 99, 99, 99,  99, 99, 99, 99, 99, 99, 99, 99,
+  99, 99, 99, 99, 99, 99, 99, 99,  99, 99, 99, 99, 99, 99, 99, 99};
+
+static const uint8_t DC_LUMA_COUNTS[16] = {0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+static const uint8_t DC_CHROMA_COUNTS[16] = {0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0};
+static const uint8_t DC_VALUES[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+static const uint8_t AC_LUMA_COUNTS[16] = {0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7D};
+static const uint8_t AC_LUMA_VALUES[162] = {
+  0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+  0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xA1, 0x08, 0x23, 0x42, 0xB1, 0xC1, 0x15, 0x52, 0xD1, 0xF0,
+  0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0A, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x25, 0x26, 0x27, 0x28,
+  0x29, 0x2A, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+  0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+  0x6A, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+  0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7,
+  0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3, 0xC4, 0xC5,
+  0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA, 0xE1, 0xE2,
+  0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8,
+  0xF9, 0xFA};
+static const uint8_t AC_CHROMA_COUNTS[16] = {0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77};
+static const uint8_t AC_CHROMA_VALUES[162] = {
+  0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+  0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xA1, 0xB1, 0xC1, 0x09, 0x23, 0x33, 0x52, 0xF0,
+  0x15, 0x62, 0x72, 0xD1, 0x0A, 0x16, 0x24, 0x34, 0xE1, 0x25, 0xF1, 0x17, 0x18, 0x19, 0x1A, 0x26,
+  0x27, 0x28, 0x29, 0x2A, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+  0x49, 0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+  0x69, 0x6A, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+  0x88, 0x89, 0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A, 0xA2, 0xA3, 0xA4, 0xA5,
+  0xA6, 0xA7, 0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3,
+  0xC4, 0xC5, 0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA,
+  0xE2, 0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8,
+  0xF9, 0xFA};
+
+// Canonical codes of a counts/values table, indexed by symbol
+void JpegScaler::buildCodes(Code *codes, const uint8_t *counts, const uint8_t *values)
+{
+  uint16_t code = 0;
+  size_t k = 0;
+  for (uint8_t l = 1; l <= 16; l++)
+  {
+    for (uint8_t i = 0; i < counts[l - 1]; i++, k++, code++)
+    {
+      codes[values[k]].bits = code;
+      codes[values[k]].len = l;
+    }
+    code <<= 1;
+  }
+}
+
+JpegScaler::JpegScaler()
+{
+  _ncomp = 0;
+  _idctN = 0;
+  _quality = JPEG_SCALE_QUALITY;
+  _builtQuality = 0;
+  memset(_edc, 0, sizeof(_edc));
+  memset(_eac, 0, sizeof(_eac));
+  buildCodes(_edc[0], DC_LUMA_COUNTS, DC_VALUES);
+  buildCodes(_edc[1], DC_CHROMA_COUNTS, DC_VALUES);
+  buildCodes(_eac[0], AC_LUMA_COUNTS, AC_LUMA_VALUES);
+  buildCodes(_eac[1], AC_CHROMA_COUNTS, AC_CHROMA_VALUES);
+  _strips = NULL;
+  _maxWidth = 0;
+  _outW = _outH = 0;
+}
+
+JpegScaler::~JpegScaler()
+{
+  free(_strips);
+}
+
+bool JpegScaler::begin(uint16_t maxWidth)
+{
+  free(_strips);
+  // A row of output MCUs can reach 15 pixels past the result's width
+  size_t bytes = 3 * (size_t)(maxWidth + 16) * STRIP_ROWS;
+#if defined(ARDUINO)
+  _strips = (uint8_t *)heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+#else
+  _strips = (uint8_t *)malloc(bytes);
+#endif
+  _maxWidth = _strips ? maxWidth : 0;
+  return _strips != NULL;
+}
+
+void JpegScaler::setQuality(uint8_t quality)
+{
+  _quality = quality < 1 ? 1 : quality > 100 ? 100 : quality;
+}
+
+void JpegScaler::buildQuant(void)
+{
+  if (_builtQuality == _quality)
+    return;
+  uint32_t scale = _quality < 50 ? 5000 / _quality : 200 - 2 * _quality;
+  for (uint8_t i = 0; i < 64; i++)
+  {
+    uint32_t l = (LUMA_QUANT[i] * scale + 50) / 100;
+    uint32_t c = (CHROMA_QUANT[i] * scale + 50) / 100;
+    _eq[0][i] = l < 1 ? 1 : l > 255 ? 255 : l;
+    _eq[1][i] = c < 1 ? 1 : c > 255 ? 255 : c;
+  }
+  _builtQuality = _quality;
+}
+
+//////////////////////////
+//        Input         //
+//////////////////////////
+
+size_t JpegScaler::scale(const uint8_t *jpg, size_t len, uint8_t shift, uint8_t *out, size_t cap)
+{
+  if (shift < 1 || shift > 3 || !_strips)
+    return 0;
+  const uint8_t *data = _jpeg.parse(jpg, len);
+  if (!data)
+    return 0;
+  // 1 or 3 components up to 2x2, every one of them in the one scan
+  _ncomp = _jpeg.components();
+  if ((_ncomp != 1 && _ncomp != 3) || _ncomp != _jpeg.frameComponents())
+    return 0;
+  for (uint8_t i = 0; i < _ncomp; i++)
+  {
+    const JpegComponent &c = _jpeg.component(i);
+    if (c.h > 2 || c.v > 2)
+      return 0;
+    // A lone component is coded block by block whatever its factors
+    _plane[i].h = _ncomp > 1 ? c.h : 1;
+    _plane[i].v = _ncomp > 1 ? c.v : 1;
+  }
+  _o = out;
+  _oEnd = out + cap;
+  _acc = 0;
+  _nacc = 0;
+  _overflow = false;
+  if (!scan(data, jpg + len, shift) || _overflow)
+    return 0;
+  return _o - out;
+}
+
+// Every coefficient is walked, only the n x n lowest ones are dequantised and kept
+bool JpegScaler::decodeBlock(JpegComponent &c, int32_t *coef, uint8_t n)
+{
+  int s = _jpeg.decodeDc(c);
+  if (s < 0 || s > 11)
+    return false;
+  if (s)
+    c.pred += JpegParser::extend(_jpeg.receive(s), s);
+  const uint16_t *q = _jpeg.quant(c.tq);
+  memset(coef, 0, sizeof(coef[0]) * n * n);
+  coef[0] = c.pred * q[0];
+  for (uint8_t k = 1; k < 64;)
+  {
+    int rs = _jpeg.decodeAc(c);
+    if (rs < 0)
+      return false;
+    uint8_t run = rs >> 4, size = rs & 15;
+    if (!size)
+    {
+      if (run != 15)
+        break; // end of block
+      k += 16;
+      continue;
+    }
+    k += run;
+    if (k > 63)
+      return false;
+    int32_t v = JpegParser::extend(_jpeg.receive(size), size);
+    if (_keep[k] >= 0)
+    {
+      // Real coefficients stay within +-1024; clamping keeps the transform in 32 bits
+      v *= q[k];
+      coef[_keep[k]] = v < -2048 ? -2048 : v > 2048 ? 2048 : v;
+    }
+    k++;
+  }
+  return true;
+}
+
+// n x n inverse DCT of the block's lowest coefficients, scaled so the n x n pixels keep the
+// 8x8 block's brightness: rows then columns, Q12 table, Q2 in between
+void JpegScaler::reduce(const int32_t *coef, uint8_t n, uint8_t *dst, uint16_t stride)
+{
+  if (n == 1)
+  {
+    int32_t v = ((coef[0] + 4) >> 3) + 128;
+    *dst = v < 0 ? 0 : v > 255 ? 255 : v;
+    return;
+  }
+  int32_t tmp[16];
+  for (uint8_t v = 0; v < n; v++)
+  {
+    for (uint8_t x = 0; x < n; x++)
+    {
+      int32_t sum = 0;
+      for (uint8_t u = 0; u < n; u++)
+        sum += coef[v * n + u] * _idct[x][u];
+      tmp[v * n + x] = (sum + (1 << 9)) >> 10;
+    }
+  }
+  for (uint8_t y = 0; y < n; y++)
+  {
+    for (uint8_t x = 0; x < n; x++)
+    {
+      int32_t sum = 0;
+      for (uint8_t v = 0; v < n; v++)
+        sum += tmp[v * n + x] * _idct[y][v];
+      int32_t px = ((sum + (1 << 13)) >> 14) + 128;
+      dst[y * stride + x] = px < 0 ? 0 : px > 255 ? 255 : px;
+    }
+  }
+}
+
+bool JpegScaler::scan(const uint8_t *p, const uint8_t *end, uint8_t shift)
+{
+  uint8_t n = 8 >> shift;
+  uint8_t s = 1 << shift;
+  _hmax = _vmax = 1;
+  for (uint8_t i = 0; i < _ncomp; i++)
+  {
+    _hmax = _plane[i].h > _hmax ? _plane[i].h : _hmax;
+    _vmax = _plane[i].v > _vmax ? _plane[i].v : _vmax;
+  }
+  uint16_t width = _jpeg.width(), height = _jpeg.height();
+  uint16_t mcux = (width + 8 * _hmax - 1) / (8 * _hmax);
+  uint16_t mcuy = (height + 8 * _vmax - 1) / (8 * _vmax);
+  _outW = (width + s - 1) / s;
+  _outH = (height + s - 1) / s;
+  _mcuOut = (mcux + s - 1) / s;
+  if ((uint32_t)_mcuOut * 8 * _hmax > (uint32_t)_maxWidth + 16)
+    return false;
+
+  for (uint8_t i = 0; i < _ncomp; i++)
+  {
+    Plane &c = _plane[i];
+    c.stride = _mcuOut * 8 * c.h;
+    c.strip = _strips + (size_t)i * (_maxWidth + 16) * STRIP_ROWS;
+    c.pred = 0;
+  }
+  for (uint8_t k = 0; k < 64; k++)
+  {
+    uint8_t z = ZIGZAG[k];
+    _keep[k] = (z >> 3) < n && (z & 7) < n ? (z >> 3) * n + (z & 7) : -1;
+  }
+  if (_idctN != n)
+  {
+    // Orthonormal n-point basis times sqrt(n / 8) per dimension
+    for (uint8_t x = 0; x < n; x++)
+      for (uint8_t u = 0; u < n; u++)
+        _idct[x][u] = lround(4096 * sqrt(n / 8.0) * (u ? sqrt(2.0 / n) : sqrt(1.0 / n)) *
+                             cos((2 * x + 1) * u * M_PI / (2 * n)));
+    _idctN = n;
+  }
+  buildQuant();
+  putHeaders();
+
+  uint16_t interval = _jpeg.restartInterval();
+  _jpeg.begin(p, end);
+
+  int32_t coef[16];
+  uint32_t mcu = 0;
+  for (uint16_t my = 0; my < mcuy; my++)
+  {
+    uint8_t sy = my % s;
+    for (uint16_t mx = 0; mx < mcux; mx++, mcu++)
+    {
+      if (interval && mcu && mcu % interval == 0 && !_jpeg.restart())
+        return false;
+      for (uint8_t ci = 0; ci < _ncomp; ci++)
+      {
+        JpegComponent &c = _jpeg.component(ci);
+        const Plane &pl = _plane[ci];
+        for (uint8_t v = 0; v < pl.v; v++)
+        {
+          for (uint8_t h = 0; h < pl.h; h++)
+          {
+            if (!decodeBlock(c, coef, n))
+              return false;
+            uint16_t x = (mx * pl.h + h) * n;
+            uint16_t y = (sy * pl.v + v) * n;
+            reduce(coef, n, pl.strip + y * pl.stride + x, pl.stride);
+          }
+        }
+      }
+      if (_jpeg.overrun())
+        return false;
+    }
+    if (sy == s - 1 || my == mcuy - 1)
+      encodeStrip(n, mcux, sy + 1);
+    if (_overflow)
+      return false;
+  }
+
+  // Pad the last byte with ones, then EOI
+  if (_nacc)
+    put(0x7F, 8 - _nacc);
+  putByte(0xFF);
+  putByte(0xD9);
+  return true;
+}
+
+//////////////////////////
+//        Output        //
+//////////////////////////
+
+void JpegScaler::putByte(uint8_t b)
+{
+  if (_o < _oEnd)
+    *_o++ = b;
+  else
+    _overflow = true;
+}
+
+// Entropy-coded bits, 0xFF stuffed; len <= 16
+void JpegScaler::put(uint32_t bits, uint8_t len)
+{
+  _acc = (_acc << len) | (bits & ((1u << len) - 1));
+  _nacc += len;
+  while (_nacc >= 8)
+  {
+    _nacc -= 8;
+    uint8_t b = _acc >> _nacc;
+    putByte(b);
+    if (b == 0xFF)
+      putByte(0x00);
+  }
+}
+
+static uint8_t *putTable(uint8_t *o, uint8_t cls, const uint8_t *counts, const uint8_t *values, size_t n)
+{
+  *o++ = cls;
+  memcpy(o, counts, 16);
+  memcpy(o + 16, values, n);
+  return o + 16 + n;
+}
+
+void JpegScaler::putHeaders(void)
+{
+  // SOI, DQT, SOF0, DHT and SOS come to 623 bytes at most
+  if (_oEnd - _o < 640)
+  {
+    _overflow = true;
+    return;
+  }
+  uint8_t *o = _o;
+  uint8_t tables = _ncomp > 1 ? 2 : 1;
+  *o++ = 0xFF; *o++ = 0xD8;
+  *o++ = 0xFF; *o++ = 0xDB;
+  *o++ = 0; *o++ = 2 + 65 * tables;
+  for (uint8_t t = 0; t < tables; t++)
+  {
+    *o++ = t;
+    for (uint8_t k = 0; k < 64; k++)
+      *o++ = _eq[t][ZIGZAG[k]];
+  }
+  *o++ = 0xFF; *o++ = 0xC0;
+  *o++ = 0; *o++ = 8 + 3 * _ncomp;
+  *o++ = 8;
+  *o++ = _outH >> 8; *o++ = _outH & 0xFF;
+  *o++ = _outW >> 8; *o++ = _outW & 0xFF;
+  *o++ = _ncomp;
+  for (uint8_t i = 0; i < _ncomp; i++)
+  {
+    *o++ = i + 1;
+    *o++ = _plane[i].h << 4 | _plane[i].v;
+    *o++ = i ? 1 : 0;
+  }
+  uint16_t dht = 2 + 2 * (17 + 12) + 2 * (17 + 162);
+  if (tables == 1)
+    dht = 2 + 17 + 12 + 17 + 162;
+  *o++ = 0xFF; *o++ = 0xC4;
+  *o++ = dht >> 8; *o++ = dht & 0xFF;
+  o = putTable(o, 0x00, DC_LUMA_COUNTS, DC_VALUES, 12);
+  o = putTable(o, 0x10, AC_LUMA_COUNTS, AC_LUMA_VALUES, 162);
+  if (tables == 2)
+  {
+    o = putTable(o, 0x01, DC_CHROMA_COUNTS, DC_VALUES, 12);
+    o = putTable(o, 0x11, AC_CHROMA_COUNTS, AC_CHROMA_VALUES, 162);
+  }
+  *o++ = 0xFF; *o++ = 0xDA;
+  *o++ = 0; *o++ = 6 + 2 * _ncomp;
+  *o++ = _ncomp;
+  for (uint8_t i = 0; i < _ncomp; i++)
+  {
+    *o++ = i + 1;
+    *o++ = i ? 0x11 : 0x00;
+  }
+  *o++ = 0; *o++ = 63; *o++ = 0;
+  _o = o;
+}
+
+// Fills what the input did not cover (the last input MCU column and row of a strip that ran
+// out) by repeating the edge, then codes the strip's output MCUs
+void JpegScaler::encodeStrip(uint8_t n, uint16_t mcux, uint8_t rows)
+{
+  for (uint8_t ci = 0; ci < _ncomp; ci++)
+  {
+    Plane &c = _plane[ci];
+    uint16_t filled = mcux * c.h * n;
+    uint16_t filledRows = rows * c.v * n;
+    for (uint16_t y = 0; y < filledRows; y++)
+    {
+      uint8_t *row = c.strip + y * c.stride;
+      memset(row + filled, row[filled - 1], c.stride - filled);
+    }
+    for (uint16_t y = filledRows; y < 8 * c.v; y++)
+      memcpy(c.strip + y * c.stride, c.strip + (filledRows - 1) * c.stride, c.stride);
+  }
+  for (uint16_t ox = 0; ox < _mcuOut; ox++)
+  {
+    for (uint8_t ci = 0; ci < _ncomp; ci++)
+    {
+      Plane &c = _plane[ci];
+      for (uint8_t v = 0; v < c.v; v++)
+        for (uint8_t h = 0; h < c.h; h++)
+          encodeBlock(c.strip + v * 8 * c.stride + (ox * c.h + h) * 8, c.stride, ci ? 1 : 0, c.pred);
+    }
+  }
+}
+
+// Integer forward DCT (the LLM factorisation as in IJG's jfdctint), output scaled up by 8
+#define FDCT_CONST_BITS 13
+#define FDCT_PASS1_BITS 2
+#define DESCALE(x, n) (((x) + (1 << ((n) - 1))) >> (n))
+
+static void fdct(int32_t *d)
+{
+  for (int pass = 0; pass < 2; pass++)
+  {
+    for (int i = 0; i < 8; i++)
+    {
+      int32_t *p = pass ? d + i : d + 8 * i;
+      int step = pass ? 8 : 1;
+      int32_t tmp0 = p[0] + p[7 * step], tmp7 = p[0] - p[7 * step];
+      int32_t tmp1 = p[step] + p[6 * step], tmp6 = p[step] - p[6 * step];
+      int32_t tmp2 = p[2 * step] + p[5 * step], tmp5 = p[2 * step] - p[5 * step];
+      int32_t tmp3 = p[3 * step] + p[4 * step], tmp4 = p[3 * step] - p[4 * step];
+
+      int32_t tmp10 = tmp0 + tmp3, tmp13 = tmp0 - tmp3;
+      int32_t tmp11 = tmp1 + tmp2, tmp12 = tmp1 - tmp2;
+      int out = pass ? FDCT_CONST_BITS + FDCT_PASS1_BITS : FDCT_CONST_BITS - FDCT_PASS1_BITS;
+      if (pass)
+      {
+        p[0] = DESCALE(tmp10 + tmp11, FDCT_PASS1_BITS);
+        p[4 * step] = DESCALE(tmp10 - tmp11, FDCT_PASS1_BITS);
+      }
+      else
+      {
+        p[0] = (tmp10 + tmp11) << FDCT_PASS1_BITS;
+        p[4 * step] = (tmp10 - tmp11) << FDCT_PASS1_BITS;
+      }
+      int32_t z1 = (tmp12 + tmp13) * 4433;
+      p[2 * step] = DESCALE(z1 + tmp13 * 6270, out);
+      p[6 * step] = DESCALE(z1 - tmp12 * 15137, out);
+
+      z1 = tmp4 + tmp7;
+      int32_t z2 = tmp5 + tmp6, z3 = tmp4 + tmp6, z4 = tmp5 + tmp7;
+      int32_t z5 = (z3 + z4) * 9633;
+      tmp4 *= 2446;
+      tmp5 *= 16819;
+      tmp6 *= 25172;
+      tmp7 *= 12299;
+      z1 *= -7373;
+      z2 *= -20995;
+      z3 = z3 * -16069 + z5;
+      z4 = z4 * -3196 + z5;
+      p[7 * step] = DESCALE(tmp4 + z1 + z3, out);
+      p[5 * step] = DESCALE(tmp5 + z2 + z4, out);
+      p[3 * step] = DESCALE(tmp6 + z2 + z3, out);
+      p[step] = DESCALE(tmp7 + z1 + z4, out);
+    }
+  }
+}
+
+static inline uint8_t bitLength(uint32_t v)
+{
+  return v ? 32 - __builtin_clz(v) : 0;
+}
+
+void JpegScaler::encodeBlock(const uint8_t *src, uint16_t stride, uint8_t table, int16_t &pred)
+{
+  int32_t d[64];
+  for (uint8_t y = 0; y < 8; y++)
+    for (uint8_t x = 0; x < 8; x++)
+      d[y * 8 + x] = src[y * stride + x] - 128;
+  fdct(d);
+
+  const uint16_t *q = _eq[table];
+  int16_t zz[64];
+  for (uint8_t k = 0; k < 64; k++)
+  {
+    uint8_t i = ZIGZAG[k];
+    int32_t div = q[i] << 3;
+    int32_t v = d[i];
+    zz[k] = v < 0 ? -((-v + (div >> 1)) / div) : (v + (div >> 1)) / div;
+  }
+
+  int32_t diff = zz[0] - pred;
+  pred = zz[0];
+  uint8_t nbits = bitLength(diff < 0 ? -diff : diff);
+  put(_edc[table][nbits].bits, _edc[table][nbits].len);
+  if (nbits)
+    put(diff < 0 ? diff - 1 : diff, nbits);
+
+  const Code *ac = _eac[table];
+  uint8_t run = 0;
+  for (uint8_t k = 1; k < 64; k++)
+  {
+    int32_t v = zz[k];
+    if (!v)
+    {
+      run++;
+      continue;
+    }
+    while (run > 15)
+    {
+      put(ac[0xF0].bits, ac[0xF0].len);
+      run -= 16;
+    }
+    nbits = bitLength(v < 0 ? -v : v);
+    put(ac[run << 4 | nbits].bits, ac[run << 4 | nbits].len);
+    put(v < 0 ? v - 1 : v, nbits);
+    run = 0;
+  }
+  if (run)
+    put(ac[0x00].bits, ac[0x00].len);
+}
@@ -0,0 +1,94 @@
+#ifndef JPEG_SCALER_H_
+#define JPEG_SCALER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <JpegParser.h>
+
+#define JPEG_SCALE_MAX_WIDTH 1600 // UXGA, the widest frame the sensor makes
+#define JPEG_SCALE_QUALITY   60
+
+// Downscales a baseline JPEG by 2, 4 or 8 in the compressed domain: the entropy data is
+// walked as the motion detector does, but each 8x8 block also keeps its lowest 4x4, 2x2 or
+// 1x1 coefficients, and a reduced inverse transform of just those gives the block's pixels
+// at the new scale (at 1/8 that is the DC coefficient alone, the block mean). Nothing is
+// decoded at full size. The pixels are re-encoded one output MCU row at a time, so memory is
+// a strip of a few rows whatever the frame; chroma keeps the input's subsampling.
+class JpegScaler
+{
+public:
+  JpegScaler();
+  ~JpegScaler();
+
+  // Strip buffers for results up to maxWidth pixels wide, false when out of memory
+  bool begin(uint16_t maxWidth);
+  // Output quality 1..100, the IJG scaling of the standard tables
+  void setQuality(uint8_t quality);
+
+  // shift 1, 2 or 3 for 1/2, 1/4 or 1/8. Returns the result's length in out, 0 when the input
+  // is not baseline/extended Huffman with 1 or 3 components (sampling up to 2x2), is truncated,
+  // is too wide for the strips, or the result does not fit in cap.
+  size_t scale(const uint8_t *jpg, size_t len, uint8_t shift, uint8_t *out, size_t cap);
+
+  // Size of the last result
+  uint16_t width(void) const { return _outW; }
+  uint16_t height(void) const { return _outH; }
+
+private:
+  // Output side of a component
+  struct Plane
+  {
+    uint8_t h;
+    uint8_t v;
+    int16_t pred;   // DC predictor
+    uint8_t *strip; // this component's pixels for the output MCU row being gathered
+    uint16_t stride;
+  };
+  struct Code
+  {
+    uint16_t bits;
+    uint8_t len;
+  };
+
+  static void buildCodes(Code *codes, const uint8_t *counts, const uint8_t *values);
+  bool scan(const uint8_t *p, const uint8_t *end, uint8_t shift);
+  bool decodeBlock(JpegComponent &c, int32_t *coef, uint8_t n);
+  void reduce(const int32_t *coef, uint8_t n, uint8_t *dst, uint16_t stride);
+
+  // Output side
+  void buildQuant(void);
+  void put(uint32_t bits, uint8_t len);
+  void putByte(uint8_t b);
+  void putHeaders(void);
+  void encodeStrip(uint8_t n, uint16_t mcux, uint8_t rows);
+  void encodeBlock(const uint8_t *src, uint16_t stride, uint8_t table, int16_t &pred);
+
+  JpegParser _jpeg;
+  Plane _plane[3];
+  uint8_t _ncomp;
+  uint8_t _hmax;
+  uint8_t _vmax;
+  int8_t _keep[64]; // zigzag index -> slot in the reduced block, -1 for coefficients dropped
+
+  int32_t _idct[4][4]; // reduced inverse transform for the current scale, Q12
+  uint8_t _idctN;
+  uint8_t _quality;
+  uint8_t _builtQuality;
+  uint16_t _eq[2][64]; // output quantisation, natural order
+  Code _edc[2][12];
+  Code _eac[2][256];
+
+  uint8_t *_strips;
+  uint16_t _maxWidth;
+  uint16_t _outW;
+  uint16_t _outH;
+  uint16_t _mcuOut; // output MCUs per row
+
+  uint8_t *_o;
+  uint8_t *_oEnd;
+  uint32_t _acc;
+  uint8_t _nacc;
+  bool _overflow;
+};
+
+#endif // JPEG_SCALER_H_
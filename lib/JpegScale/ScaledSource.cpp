@@ -0,0 +1,115 @@
+#include "ScaledSource.h"
+#include <stdlib.h>
+#if defined(ARDUINO)
+  #include "esp_heap_caps.h"
+#endif
+
+typedef std::chrono::steady_clock Clock;
+
+ScaleMetrics scaleMetrics;
+
+ScaleMetrics::ScaleMetrics() : scale(LATENCY_BUCKETS_US, LATENCY_BUCKET_COUNT)
+{
+}
+
+void writeScaleMetrics(PromWriter &w)
+{
+  ScaleMetrics &m = scaleMetrics;
+  w.histogram("esp32cam_scale_seconds", "Per frame, compressed-domain downscale and re-encode for a scaled tier", m.scale, 1e-6);
+  w.counter("esp32cam_scale_frames_total", "Frames scaled for the low-bandwidth tiers", m.framesScaled.value());
+  w.counter("esp32cam_scale_skipped_total", "Published frames a tier skipped while still scaling the previous one", m.framesSkipped.value());
+  w.counter("esp32cam_scale_failures_total", "Frames a tier could not scale", m.failures.value());
+  w.counter("esp32cam_scale_in_bytes_total", "JPEG bytes read by the tiers", m.bytesIn.value());
+  w.counter("esp32cam_scale_out_bytes_total", "JPEG bytes the tiers produced", m.bytesOut.value());
+}
+
+ScaledSource::ScaledSource(MJPEGBroadcaster &upstream, uint8_t shift, uint8_t quality)
+    : _upstream(upstream), _shift(shift), _capacity(0), _lastSeq(0), _pool(release, this)
+{
+  _scaler.setQuality(quality);
+  for (int i = 0; i < SCALED_BUFFERS; i++)
+  {
+    _buffers[i] = NULL;
+    _busy[i] = false;
+  }
+}
+
+ScaledSource::~ScaledSource()
+{
+  for (int i = 0; i < SCALED_BUFFERS; i++)
+    free(_buffers[i]);
+}
+
+bool ScaledSource::begin(size_t capacity, uint16_t maxWidth)
+{
+  for (int i = 0; i < SCALED_BUFFERS; i++)
+  {
+#if defined(ARDUINO)
+    _buffers[i] = (uint8_t *)heap_caps_malloc(capacity, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+#else
+    _buffers[i] = (uint8_t *)malloc(capacity);
+#endif
+    if (!_buffers[i])
+      return false;
+  }
+  _capacity = capacity;
+  return _scaler.begin((maxWidth + (1 << _shift) - 1) >> _shift);
+}
+
+FrameRef ScaledSource::capture(void)
+{
+  if (!_capacity)
+    return FrameRef();
+
+  // A free buffer first, so the upstream frame is let go of as soon as it is scaled
+  int i = 0;
+  {
+    std::unique_lock<std::mutex> guard(_lock);
+    for (;;)
+    {
+      for (i = 0; i < SCALED_BUFFERS && _busy[i]; i++)
+        ;
+      if (i < SCALED_BUFFERS)
+        break;
+      _returned.wait(guard);
+    }
+    _busy[i] = true;
+  }
+
+  FrameRef frame;
+  _upstream.attach();
+  bool ok = _upstream.acquire(frame, _lastSeq);
+  _upstream.detach();
+  if (!ok)
+  {
+    release(this, &_busy[i]);
+    return FrameRef();
+  }
+  if (_lastSeq && frame.getSeq() > _lastSeq + 1)
+    scaleMetrics.framesSkipped.add(frame.getSeq() - _lastSeq - 1);
+  _lastSeq = frame.getSeq();
+
+  Clock::time_point started = Clock::now();
+  size_t len = _scaler.scale(frame.getBuf(), frame.getSize(), _shift, _buffers[i], _capacity);
+  scaleMetrics.bytesIn.add(frame.getSize());
+  uint64_t timestamp = frame.getTimestamp();
+  frame.reset();
+  if (!len)
+  {
+    scaleMetrics.failures.add();
+    release(this, &_busy[i]);
+    return FrameRef();
+  }
+  scaleMetrics.scale.observe(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - started).count());
+  scaleMetrics.framesScaled.add();
+  scaleMetrics.bytesOut.add(len);
+  return _pool.wrap(_buffers[i], len, _scaler.width(), _scaler.height(), timestamp, &_busy[i]);
+}
+
+void ScaledSource::release(void *ctx, void *opaque)
+{
+  ScaledSource *self = (ScaledSource *)ctx;
+  std::lock_guard<std::mutex> guard(self->_lock);
+  *(bool *)opaque = false;
+  self->_returned.notify_all();
+}
@@ -0,0 +1,64 @@
+#ifndef SCALED_SOURCE_H_
+#define SCALED_SOURCE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <mutex>
+#include <condition_variable>
+#include <Metrics.h>
+#include <FrameRef.h>
+#include <MJPEGBroadcaster.h>
+#include "JpegScaler.h"
+
+// Buffers per tier: the published frame, one a slow client is still sending, one being filled
+#define SCALED_BUFFERS 3
+
+// Scaled tier instruments, every tier together
+struct ScaleMetrics
+{
+  ScaleMetrics();
+
+  Histogram scale; // per frame, compressed-domain downscale and re-encode
+  Counter framesScaled;
+  Counter framesSkipped; // published upstream while the previous one was still being scaled
+  Counter failures;      // frames the scaler refused (format, or the result outgrew its buffer)
+  Counter bytesIn;
+  Counter bytesOut;
+};
+
+extern ScaleMetrics scaleMetrics;
+
+void writeScaleMetrics(PromWriter &w);
+
+// Frames for a second broadcaster, cut from another one's: capture() reads the newest frame
+// upstream like any other reader and downscales it into a buffer of its own, keeping the
+// original's timestamp. The tier's producer runs on a task of its own and only while the
+// tier has clients; it holds an upstream client slot only while it waits for a frame.
+class ScaledSource : public FrameSource
+{
+public:
+  ScaledSource(MJPEGBroadcaster &upstream, uint8_t shift, uint8_t quality = JPEG_SCALE_QUALITY);
+  ~ScaledSource();
+
+  // SCALED_BUFFERS buffers of capacity bytes (PSRAM on the device) and the scaler's strips
+  // for frames up to maxWidth wide, false when out of memory
+  bool begin(size_t capacity, uint16_t maxWidth = JPEG_SCALE_MAX_WIDTH);
+  FrameRef capture(void);
+  bool drain(uint32_t timeout_ms) { return _pool.drain(timeout_ms); }
+
+private:
+  static void release(void *ctx, void *opaque);
+
+  MJPEGBroadcaster &_upstream;
+  JpegScaler _scaler;
+  uint8_t _shift;
+  uint8_t *_buffers[SCALED_BUFFERS];
+  bool _busy[SCALED_BUFFERS];
+  size_t _capacity;
+  uint32_t _lastSeq;
+  std::mutex _lock;
+  std::condition_variable _returned;
+  FramePool _pool;
+};
+
+#endif // SCALED_SOURCE_H_
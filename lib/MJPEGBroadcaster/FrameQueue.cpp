@@ -0,0 +1,102 @@
+#include "FrameQueue.h"
+
+#define FRAME_QUEUE_MASK (FRAME_QUEUE_SLOTS - 1)
+
+FrameQueue::FrameQueue(uint8_t depth) : _head(0), _tail(0), _dropped(0)
+{
+  _depth = depth < 1 ? 1 : depth > FRAME_QUEUE_SLOTS ? FRAME_QUEUE_SLOTS : depth;
+  for (uint32_t i = 0; i < FRAME_QUEUE_SLOTS; i++)
+    _cells[i].seq.store(i, std::memory_order_relaxed);
+}
+
+uint8_t FrameQueue::size(void) const
+{
+  uint32_t tail = _tail.load(std::memory_order_acquire);
+  uint32_t head = _head.load(std::memory_order_acquire);
+  int32_t n = (int32_t)(tail - head);
+  return n < 0 ? 0 : n > FRAME_QUEUE_SLOTS ? FRAME_QUEUE_SLOTS : n;
+}
+
+// A cell is free for position pos when its sequence equals pos, and holds the frame for
+// position pos once it equals pos + 1. Winning the CAS on the index makes the cell ours
+// until the sequence store hands it to the other side.
+bool FrameQueue::tryPush(const FrameRef &frame)
+{
+  uint32_t pos = _tail.load(std::memory_order_relaxed);
+  for (;;)
+  {
+    if ((int32_t)(pos - _head.load(std::memory_order_acquire)) >= _depth)
+      return false;
+    Cell &cell = _cells[pos & FRAME_QUEUE_MASK];
+    int32_t diff = (int32_t)(cell.seq.load(std::memory_order_acquire) - pos);
+    if (diff == 0)
+    {
+      if (_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+      {
+        cell.frame = frame;
+        cell.seq.store(pos + 1, std::memory_order_release);
+        return true;
+      }
+    }
+    else if (diff < 0)
+    {
+      return false; // a pop of that cell is still finishing
+    }
+    else
+    {
+      pos = _tail.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+bool FrameQueue::pop(FrameRef &out)
+{
+  uint32_t pos = _head.load(std::memory_order_relaxed);
+  for (;;)
+  {
+    Cell &cell = _cells[pos & FRAME_QUEUE_MASK];
+    int32_t diff = (int32_t)(cell.seq.load(std::memory_order_acquire) - (pos + 1));
+    if (diff == 0)
+    {
+      if (_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+      {
+        out = cell.frame;
+        cell.frame.reset();
+        cell.seq.store(pos + FRAME_QUEUE_SLOTS, std::memory_order_release);
+        return true;
+      }
+    }
+    else if (diff < 0)
+    {
+      return false; // empty, or a push of that cell is still finishing
+    }
+    else
+    {
+      pos = _head.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+bool FrameQueue::dropOldest(void)
+{
+  FrameRef stale;
+  if (!pop(stale))
+    return false;
+  _dropped.fetch_add(1, std::memory_order_relaxed);
+  return true; // stale goes back to its owner here
+}
+
+bool FrameQueue::push(const FrameRef &frame)
+{
+  bool dropped = false;
+  while (!tryPush(frame))
+    dropped |= dropOldest();
+  return dropped;
+}
+
+void FrameQueue::clear(void)
+{
+  FrameRef stale;
+  while (pop(stale))
+    stale.reset();
+}
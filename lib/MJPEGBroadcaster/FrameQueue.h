@@ -0,0 +1,51 @@
+#ifndef FRAME_QUEUE_H_
+#define FRAME_QUEUE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <FrameRef.h>
+
+// Cells in the ring, a power of two; the usable depth is set per queue and can be smaller
+#define FRAME_QUEUE_SLOTS 4
+
+// Bounded, lock-free hand-off of frame handles between cores (any number of pushers and
+// poppers, one of each in practice). Each cell carries a sequence number that says whose turn
+// it is, so a side only ever waits on its own compare-and-swap, never on the other side.
+// The producer never blocks: when depth frames are already waiting it drops the oldest,
+// which hands its buffer back to the driver for the next capture.
+class FrameQueue
+{
+public:
+  FrameQueue(uint8_t depth = FRAME_QUEUE_SLOTS);
+
+  // Queues frame, dropping the oldest first when full; true when a frame was dropped
+  bool push(const FrameRef &frame);
+  // Oldest waiting frame, false when empty
+  bool pop(FrameRef &out);
+  // Drops the oldest waiting frame, false when empty
+  bool dropOldest(void);
+  void clear(void);
+
+  uint8_t depth(void) const { return _depth; }
+  uint8_t size(void) const;
+  bool full(void) const { return size() >= _depth; }
+  uint32_t dropped(void) const { return _dropped.load(std::memory_order_relaxed); }
+
+private:
+  struct Cell
+  {
+    std::atomic<uint32_t> seq;
+    FrameRef frame;
+  };
+
+  bool tryPush(const FrameRef &frame);
+
+  Cell _cells[FRAME_QUEUE_SLOTS];
+  uint8_t _depth;
+  std::atomic<uint32_t> _head; // next pop
+  std::atomic<uint32_t> _tail; // next push
+  std::atomic<uint32_t> _dropped;
+};
+
+#endif // FRAME_QUEUE_H_
@@ -0,0 +1,264 @@
+#include "MJPEGBroadcaster.h"
+#include "PipelineMetrics.h"
+
+typedef std::chrono::steady_clock Clock;
+
+MJPEGBroadcaster::MJPEGBroadcaster(FrameSource &source) : _source(source)
+{
+  _latestSeq = 0;
+  _frames = 0;
+  _clients = 0;
+  _stopping = false;
+  _onPublish = NULL;
+  _onPublishCtx = NULL;
+  _job = NULL;
+  _jobCtx = NULL;
+  _retain_ms = 0;
+  _publishedWall = 0;
+  _queue = NULL;
+  _counted = true;
+}
+
+MJPEGBroadcaster::~MJPEGBroadcaster()
+{
+  shutdown();
+}
+
+void MJPEGBroadcaster::captureOnce(void)
+{
+  {
+    std::unique_lock<std::mutex> guard(_lock);
+    bool idled = false;
+    for (;;)
+    {
+      if (_stopping)
+        return;
+      if (_job)
+      {
+        // Runs between two captures with the buffers given back, so the source is never used concurrently
+        dropCurrent(guard);
+        if (_queue)
+          _queue->clear();
+        void (*job)(void *) = _job;
+        void *ctx = _jobCtx;
+        guard.unlock();
+        job(ctx);
+        guard.lock();
+        _job = NULL;
+        return;
+      }
+      if (_clients)
+        break;
+      idled = true;
+      if (_current)
+      {
+        // Nobody is watching: keep the last frame for snapshots a little while, then hand the buffer back
+        Clock::time_point expiry = _publishedAt + std::chrono::milliseconds(_retain_ms);
+        if (Clock::now() < expiry)
+          _attached.wait_until(guard, expiry);
+        else
+          dropCurrent(guard);
+        continue;
+      }
+      _attached.wait(guard);
+    }
+    // Back from idle: a retained frame is too old for whoever attached, and frees a buffer
+    if (idled)
+    {
+      dropCurrent(guard);
+      if (_queue)
+        _queue->clear();
+    }
+  }
+
+  // Capture outside the lock so readers keep streaming the current frame meanwhile
+  Clock::time_point started = Clock::now();
+  FrameRef next = _source.capture();
+  if (_counted)
+    pipelineMetrics.captureWait.observe(
+        std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - started).count());
+  if (!next)
+  {
+    if (_counted)
+      pipelineMetrics.captureFailures.add();
+    return;
+  }
+  if (_counted)
+    pipelineMetrics.framesCaptured.add();
+
+  if (_queue)
+  {
+    // With the send stage behind, the oldest waiting frame makes room rather than this one waiting
+    if (_queue->push(next))
+      pipelineMetrics.framesSuperseded.add();
+    next.reset();
+  }
+  else
+  {
+    publish(next);
+  }
+  if (_counted)
+    pipelineMetrics.captureBusy.add(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - started).count());
+  if (_onPublish)
+    _onPublish(_onPublishCtx);
+}
+
+void MJPEGBroadcaster::publish(const FrameRef &next)
+{
+  FrameRef retired;
+  {
+    std::lock_guard<std::mutex> guard(_lock);
+    if (_stopping || _job)
+      return; // a job wants the buffers back, the frame is stale once it has run
+    retired = _current;
+    _current = next;
+    _latestSeq = next.getSeq();
+    _publishedAt = Clock::now();
+    _publishedWall = time(NULL);
+    _frames++;
+    _published.notify_all();
+    _attached.notify_all(); // an idle producer re-arms its retain timer
+  }
+  // retired drops here, outside the lock; the buffer returns once its readers are done
+}
+
+void MJPEGBroadcaster::pipeline(FrameQueue *queue)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  _queue = queue;
+}
+
+void MJPEGBroadcaster::countCaptures(bool on)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  _counted = on;
+}
+
+bool MJPEGBroadcaster::publishQueued(void)
+{
+  FrameRef next;
+  if (!_queue || !_queue->pop(next))
+    return false;
+  publish(next);
+  return true;
+}
+
+bool MJPEGBroadcaster::acquire(FrameRef &out, uint32_t afterSeq)
+{
+  std::unique_lock<std::mutex> guard(_lock);
+  _published.wait(guard, [this, afterSeq] { return _stopping || (!_job && _current && _current.getSeq() > afterSeq); });
+  if (_stopping)
+    return false;
+  out = _current;
+  return true;
+}
+
+bool MJPEGBroadcaster::tryAcquire(FrameRef &out, uint32_t afterSeq)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  if (_stopping || _job || !_current || _current.getSeq() <= afterSeq)
+    return false;
+  out = _current;
+  return true;
+}
+
+bool MJPEGBroadcaster::latest(FrameRef &out, uint32_t maxAge_ms, time_t *modified)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  if (_stopping || _job || !_current)
+    return false;
+  if (Clock::now() - _publishedAt > std::chrono::milliseconds(maxAge_ms))
+    return false;
+  out = _current;
+  if (modified)
+    *modified = _publishedWall;
+  return true;
+}
+
+void MJPEGBroadcaster::retain(uint32_t ms)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  _retain_ms = ms;
+  _attached.notify_all();
+}
+
+void MJPEGBroadcaster::dropCurrent(std::unique_lock<std::mutex> &guard)
+{
+  if (!_current)
+    return;
+  FrameRef stale = _current;
+  _current.reset();
+  guard.unlock();
+  stale.reset(); // may hand the buffer back to the driver, not under our lock
+  guard.lock();
+}
+
+void MJPEGBroadcaster::onPublish(void (*callback)(void *ctx), void *ctx)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  _onPublish = callback;
+  _onPublishCtx = ctx;
+}
+
+bool MJPEGBroadcaster::schedule(void (*job)(void *ctx), void *ctx)
+{
+  FrameRef retired;
+  {
+    std::lock_guard<std::mutex> guard(_lock);
+    if (_job || _stopping)
+      return false;
+    _job = job;
+    _jobCtx = ctx;
+    retired = _current;
+    _current.reset();
+    _attached.notify_all();
+  }
+  return true;
+}
+
+bool MJPEGBroadcaster::paused(void)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  return _job != NULL;
+}
+
+void MJPEGBroadcaster::attach(void)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  _clients++;
+  _attached.notify_all();
+}
+
+void MJPEGBroadcaster::detach(void)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  if (_clients)
+    _clients--;
+}
+
+uint8_t MJPEGBroadcaster::clientCount(void)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  return _clients;
+}
+
+uint32_t MJPEGBroadcaster::latestSeq(void)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  return _latestSeq;
+}
+
+uint32_t MJPEGBroadcaster::framesPublished(void)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  return _frames;
+}
+
+void MJPEGBroadcaster::shutdown(void)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  _stopping = true;
+  _current.reset();
+  _published.notify_all();
+  _attached.notify_all();
+}
@@ -0,0 +1,90 @@
+#ifndef MJPEG_BROADCASTER_H_
+#define MJPEG_BROADCASTER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <FrameRef.h>
+#include "FrameQueue.h"
+
+// Single producer, many readers. The producer publishes one frame at a time and every
+// connected client reads the same bytes, so N viewers cost one capture plus N writes.
+class MJPEGBroadcaster
+{
+public:
+  MJPEGBroadcaster(FrameSource &source);
+  ~MJPEGBroadcaster();
+
+  // Producer step: waits for at least one client, captures the next frame and publishes it.
+  // Readers still writing the previous frame keep it alive through their own FrameRef.
+  void captureOnce(void);
+
+  // Splits the producer in two stages, e.g. one per core: captureOnce() then only captures
+  // into queue, and the sending side publishes with publishQueued(). Set before the producer
+  // starts; NULL publishes from captureOnce() again.
+  void pipeline(FrameQueue *queue);
+  // Send stage: publishes the oldest queued frame, false when none was waiting
+  bool publishQueued(void);
+  // Whether captures count towards the sensor-side pipeline metrics (capture wait, frames
+  // captured, capture busy time). Off for a producer fed from another broadcaster, e.g. a
+  // scaled tier, so the sensor is not counted twice. On by default.
+  void countCaptures(bool on);
+
+  // Reader API: block until a frame newer than afterSeq is published, false on shutdown
+  bool acquire(FrameRef &out, uint32_t afterSeq);
+  // Non-blocking variant for event-driven readers, false when nothing newer is published yet
+  bool tryAcquire(FrameRef &out, uint32_t afterSeq);
+  // Snapshot cache: the current frame if it was published at most maxAge_ms ago, with its
+  // wall-clock publish time for Last-Modified
+  bool latest(FrameRef &out, uint32_t maxAge_ms, time_t *modified = NULL);
+  // How long the producer keeps the last frame once the last client is gone (default 0)
+  void retain(uint32_t ms);
+  // Called from the producer after every publish, or every queued frame when pipelined, e.g.
+  // to wake an event loop
+  void onPublish(void (*callback)(void *ctx), void *ctx);
+
+  // Runs job on the producer with publishing stopped and the current frame dropped, e.g. to
+  // reconfigure the source once its frames have drained. False while another job is pending.
+  bool schedule(void (*job)(void *ctx), void *ctx);
+  // A job is pending or running: readers should let go of their frames
+  bool paused(void);
+
+  // Client bookkeeping, the producer idles while nobody is attached
+  void attach(void);
+  void detach(void);
+  uint8_t clientCount(void);
+
+  uint32_t latestSeq(void);
+  uint32_t framesPublished(void);
+  void shutdown(void); // wakes every waiter, used by the host harness
+
+private:
+  FrameSource &_source;
+  std::mutex _lock;
+  std::condition_variable _published; // readers wait here for a newer frame
+  std::condition_variable _attached;  // the producer idles here without clients
+
+  void (*_onPublish)(void *ctx);
+  void *_onPublishCtx;
+  void (*_job)(void *ctx);
+  void *_jobCtx;
+
+  void dropCurrent(std::unique_lock<std::mutex> &guard);
+  void publish(const FrameRef &next);
+
+  FrameQueue *_queue;
+  bool _counted;
+  FrameRef _current;
+  std::chrono::steady_clock::time_point _publishedAt;
+  time_t _publishedWall;
+  uint32_t _retain_ms;
+  uint32_t _latestSeq;
+  uint32_t _frames;
+  uint8_t _clients;
+  bool _stopping;
+};
+
+#endif // MJPEG_BROADCASTER_H_
@@ -0,0 +1,268 @@
+#include "MJPEGStreamer.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <chrono>
+#include <MJPEG_Streaming.h>
+#include <SocketCompat.h>
+#include "PipelineMetrics.h"
+
+StreamStats MJPEGStreamer::totals = {0, 0, 0};
+StreamObserver *MJPEGStreamer::observer = NULL;
+bool MJPEGStreamer::backpressure = true;
+MJPEGStreamer *MJPEGStreamer::_first = NULL;
+uint32_t SnapshotStreamer::hits = 0;
+uint32_t SnapshotStreamer::misses = 0;
+
+MJPEGStreamer::MJPEGStreamer(MJPEGBroadcaster &broadcaster, bool chunked) : _broadcaster(broadcaster)
+{
+  _lastSeq = 0;
+  _started = false;
+  _chunked = chunked;
+  _stats.frames = 0;
+  _stats.bytes = 0;
+  _stats.writes = 0;
+  _lastBytes = 0;
+  _lastWrites = 0;
+  _lastBusy = 0;
+  _inFlight = false;
+  _caughtUp = true;
+  _peer[0] = 0;
+  _dropped = 0;
+  _backlog = 0;
+  _fps = 0;
+  _lastFrame = 0;
+  _next = _first;
+  _first = this;
+  _broadcaster.attach();
+}
+
+static uint64_t steady_us(void)
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+MJPEGStreamer::~MJPEGStreamer()
+{
+  _frame.reset();
+  _broadcaster.detach();
+  totals.frames += _stats.frames;
+  totals.bytes += _stats.bytes;
+  totals.writes += _stats.writes;
+  for (MJPEGStreamer **p = &_first; *p; p = &(*p)->_next)
+  {
+    if (*p == this)
+    {
+      *p = _next;
+      break;
+    }
+  }
+  if (observer)
+    observer->streamClosed(this);
+}
+
+float MJPEGStreamer::fps(void) const
+{
+  // A stalled client stops updating the average, so cap it by the time since its last frame
+  if (!_lastFrame)
+    return 0;
+  float since = (steady_us() - _lastFrame) / 1e6f;
+  return since > 0 && 1 / since < _fps ? 1 / since : _fps;
+}
+
+void MJPEGStreamer::frameDone(HttpConnection &conn)
+{
+  // The previous frame has fully left by now, charge it everything written since it was queued
+  uint64_t bytes = conn.bytesSent() - _lastBytes;
+  uint32_t writes = conn.writeCount() - _lastWrites;
+  uint32_t busy = conn.busyMicros() - _lastBusy;
+  _stats.frames++;
+  _stats.bytes += bytes;
+  _stats.writes += writes;
+
+  PipelineMetrics &m = pipelineMetrics;
+  m.framesSent.add();
+  m.bytesSent.add(bytes);
+  m.writes.add(writes);
+  m.frameWire.observe(busy);
+
+  uint64_t now = steady_us();
+  if (_lastFrame && now > _lastFrame)
+  {
+    float instant = 1e6f / (now - _lastFrame);
+    _fps = _fps ? _fps + 0.2f * (instant - _fps) : instant;
+  }
+  _lastFrame = now;
+  if (observer)
+    observer->frameSent(this, bytes, busy);
+}
+
+bool MJPEGStreamer::ready(void)
+{
+  // Only asked while the connection is idle, so nothing newer yet means the last frame kept up
+  uint32_t latest = _broadcaster.latestSeq();
+  if (latest <= _lastSeq)
+    _caughtUp = true;
+  return !_started || latest > _lastSeq || (_frame && _broadcaster.paused());
+}
+
+bool MJPEGStreamer::pump(HttpConnection &conn)
+{
+  char buf[64];
+  if (!_started)
+  {
+    _started = true;
+    if (_chunked)
+    {
+      conn.queue(CHEADER, chdLen);
+      conn.queueCopy(buf, snprintf(buf, sizeof(buf), "%X\r\n%s\r\n", (unsigned)bdrLen, BOUNDARY));
+    }
+    else
+    {
+      conn.queue(HEADER, hdrLen);
+      conn.queue(BOUNDARY, bdrLen);
+    }
+    // Label for per-client metrics
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    if (getpeername(conn.fd(), (struct sockaddr *)&addr, &len) == 0)
+      snprintf(_peer, sizeof(_peer), "%s:%u", inet_ntoa(addr.sin_addr), ntohs(addr.sin_port));
+    return true;
+  }
+  // The previous frame is fully sent by now; hand it back while the source is being
+  // reconfigured, otherwise always jump to the newest one
+  if (_broadcaster.paused())
+  {
+    _frame.reset();
+    return true;
+  }
+  if (!_broadcaster.tryAcquire(_frame, _lastSeq))
+    return true;
+  uint32_t skipped = _lastSeq && _frame.getSeq() > _lastSeq + 1 ? _frame.getSeq() - _lastSeq - 1 : 0;
+  _lastSeq = _frame.getSeq();
+  // The socket still holding a whole frame means this one would only wait behind it; skip it,
+  // the next publish finds out whether the client has caught up
+#if SOCK_HAS_UNACKED
+  _backlog = conn.socketBacklog();
+  bool behind = _backlog >= _frame.getSize();
+#else
+  // lwIP cannot tell, but a frame that was still queued when this one was published is behind
+  // by about what its send buffer holds
+  bool behind = _inFlight && !_caughtUp;
+  _backlog = behind ? conn.pending() + SOCK_SNDBUF : 0;
+#endif
+  if (backpressure && behind)
+  {
+    _frame.reset();
+    _caughtUp = true; // idle now, the next publish goes out
+    skipped++;
+  }
+  if (skipped)
+  {
+    _dropped += skipped;
+    pipelineMetrics.framesDropped.add(skipped);
+  }
+  if (!_frame)
+    return true;
+
+  if (_inFlight)
+    frameDone(conn);
+  _lastBytes = conn.bytesSent();
+  _lastWrites = conn.writeCount();
+  _lastBusy = conn.busyMicros();
+  _inFlight = true;
+  _caughtUp = false;
+
+  // Header built in place, then header + JPEG + boundary leave in a single gathered write
+  int n = mjpegPartHeader(buf, sizeof(buf), _frame.getSize(), _chunked);
+  conn.queueCopy(buf, n);
+  conn.queue(_frame.getBuf(), _frame.getSize());
+  if (_chunked)
+    conn.queue(CBOUNDARY, cbdLen);
+  else
+    conn.queue(BOUNDARY, bdrLen);
+  return true;
+}
+
+SnapshotStreamer::SnapshotStreamer(MJPEGBroadcaster &broadcaster, uint32_t maxAge_ms) : _broadcaster(broadcaster)
+{
+  _modified = 0;
+  _sent = false;
+  _skipOne = false;
+  _attached = false;
+  _afterSeq = _broadcaster.latestSeq();
+  if (maxAge_ms && _broadcaster.latest(_frame, maxAge_ms, &_modified))
+  {
+    hits++;
+    return;
+  }
+  misses++;
+  _skipOne = !_broadcaster.clientCount();
+  _attached = true;
+  _broadcaster.attach();
+}
+
+SnapshotStreamer::~SnapshotStreamer()
+{
+  _frame.reset();
+  if (_attached)
+    _broadcaster.detach();
+}
+
+bool SnapshotStreamer::ready(void)
+{
+  return _sent || _frame || _broadcaster.latestSeq() > _afterSeq;
+}
+
+bool SnapshotStreamer::pump(HttpConnection &conn)
+{
+  if (_sent)
+    return false;
+  if (!_frame)
+  {
+    FrameRef next;
+    if (!_broadcaster.latest(next, UINT32_MAX, &_modified) || next.getSeq() <= _afterSeq)
+      return true;
+    _afterSeq = next.getSeq();
+    if (_skipOne)
+    {
+      _skipOne = false;
+      return true;
+    }
+    _frame = next;
+    // Got what we came for, let the producer idle again if nobody else is watching
+    _broadcaster.detach();
+    _attached = false;
+  }
+  respond(conn);
+  _sent = true;
+  return true;
+}
+
+void SnapshotStreamer::respond(HttpConnection &conn)
+{
+  char etag[24], modified[32], match[64];
+  struct tm tm;
+  snprintf(etag, sizeof(etag), "\"%x-%x\"", (unsigned)_frame.getSeq(), (unsigned)_frame.getSize());
+  gmtime_r(&_modified, &tm);
+  strftime(modified, sizeof(modified), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+  conn.sendHeader("ETag", etag);
+  conn.sendHeader("Last-Modified", modified);
+  conn.sendHeader("Cache-Control", "no-cache");
+
+  // If-None-Match wins over If-Modified-Since, which only has one second resolution
+  bool unchanged;
+  if (conn.header("If-None-Match", match, sizeof(match)))
+    unchanged = strstr(match, etag) || !strcmp(match, "*");
+  else
+    unchanged = conn.header("If-Modified-Since", match, sizeof(match)) && !strcmp(match, modified);
+  if (unchanged)
+  {
+    _frame.reset();
+    conn.send(304, "image/jpeg", "");
+    return;
+  }
+  conn.sendHeader("Content-Disposition", "inline; filename=capture.jpg");
+  conn.send(200, "image/jpeg", _frame.getBuf(), _frame.getSize()); // _frame stays alive until sent
+}
@@ -0,0 +1,102 @@
+#ifndef MJPEG_STREAMER_H_
+#define MJPEG_STREAMER_H_
+
+#include <EventServer.h>
+#include "MJPEGBroadcaster.h"
+
+// Wire cost of the frames a stream has sent
+struct StreamStats
+{
+  uint32_t frames; // fully sent frames
+  uint64_t bytes;  // part header + JPEG + boundary (+ chunk framing)
+  uint32_t writes; // socket write calls
+};
+
+// Gets told what every frame of every stream cost on the wire (e.g. a bitrate controller)
+class StreamObserver
+{
+public:
+  virtual ~StreamObserver() {}
+  virtual void frameSent(const void *stream, size_t bytes, uint32_t busy_us) = 0;
+  virtual void streamClosed(const void *stream) = 0;
+};
+
+// /mjpeg as an event-loop streamer: queues the newest published frame whenever the
+// connection has drained the previous one, never blocks the loop. With backpressure on, a
+// frame is also skipped while the socket still holds a whole frame's worth of earlier data,
+// so a slow client's latency is bounded by its socket rather than by its buffers. Where the
+// stack cannot report that (lwIP), a frame is skipped when the previous one had not left the
+// connection's queue before the next was published.
+class MJPEGStreamer : public Streamer
+{
+public:
+  MJPEGStreamer(MJPEGBroadcaster &broadcaster, bool chunked = false);
+  ~MJPEGStreamer();
+  bool ready(void);
+  bool pump(HttpConnection &conn);
+
+  const StreamStats &stats(void) const { return _stats; }
+  static StreamStats totals; // every stream since boot, updated as streams close
+  static StreamObserver *observer;
+  static bool backpressure; // on by default
+
+  // Live streams, for per-client metrics (event-loop thread only)
+  static const MJPEGStreamer *first(void) { return _first; }
+  const MJPEGStreamer *next(void) const { return _next; }
+  const char *peer(void) const { return _peer; }
+  uint32_t dropped(void) const { return _dropped; }
+  size_t backlog(void) const { return _backlog; } // socket backlog when the last frame was due, estimated on lwIP
+  float fps(void) const;
+  const MJPEGBroadcaster &broadcaster(void) const { return _broadcaster; }
+
+private:
+  void frameDone(HttpConnection &conn);
+
+  static MJPEGStreamer *_first;
+  MJPEGStreamer *_next;
+  MJPEGBroadcaster &_broadcaster;
+  FrameRef _frame; // kept alive until the connection has sent it
+  uint32_t _lastSeq;
+  bool _started;
+  bool _chunked;
+  StreamStats _stats;
+  uint64_t _lastBytes;
+  uint32_t _lastWrites;
+  uint64_t _lastBusy;
+  bool _inFlight; // a queued frame not yet accounted for
+  bool _caughtUp; // the queued frame drained before a newer one was published
+  char _peer[24];
+  uint32_t _dropped;
+  size_t _backlog;
+  float _fps;          // smoothed from frame intervals
+  uint64_t _lastFrame; // steady clock, microseconds
+};
+
+// /jpg: answers straight from the latest published frame when it is at most maxAge_ms old,
+// otherwise waits (inside the event loop) for a fresh capture. Frames carry an ETag and
+// Last-Modified, so polling clients get a 304 for a frame they already have.
+class SnapshotStreamer : public Streamer
+{
+public:
+  SnapshotStreamer(MJPEGBroadcaster &broadcaster, uint32_t maxAge_ms = 0);
+  ~SnapshotStreamer();
+  bool ready(void);
+  bool pump(HttpConnection &conn);
+  bool keepAlive(void) { return true; }
+
+  static uint32_t hits;   // answered from the latest frame
+  static uint32_t misses; // had to wait for a capture
+
+private:
+  void respond(HttpConnection &conn);
+
+  MJPEGBroadcaster &_broadcaster;
+  FrameRef _frame;
+  time_t _modified;
+  uint32_t _afterSeq;
+  bool _skipOne; // the producer was idle, the driver's queued frame is stale
+  bool _attached;
+  bool _sent;
+};
+
+#endif // MJPEG_STREAMER_H_
@@ -0,0 +1,57 @@
+#include "PipelineMetrics.h"
+#include "MJPEGStreamer.h"
+#include <stdio.h>
+
+PipelineMetrics pipelineMetrics;
+
+PipelineMetrics::PipelineMetrics()
+    : captureWait(LATENCY_BUCKETS_US, LATENCY_BUCKET_COUNT), frameWire(LATENCY_BUCKETS_US, LATENCY_BUCKET_COUNT)
+{
+}
+
+void writePipelineMetrics(PromWriter &w)
+{
+  PipelineMetrics &m = pipelineMetrics;
+  w.histogram("esp32cam_capture_wait_seconds", "Time spent waiting for the sensor to deliver a frame", m.captureWait, 1e-6);
+  w.counter("esp32cam_frames_captured_total", "Frames captured by the capture task", m.framesCaptured.value());
+  w.counter("esp32cam_capture_failures_total", "Captures that returned no frame", m.captureFailures.value());
+  w.counter("esp32cam_capture_busy_seconds_total", "Time the capture stage spent capturing and handing off frames",
+            m.captureBusy.value() / 1e6);
+  w.counter("esp32cam_frames_superseded_total", "Captured frames dropped from the hand-off queue for a newer one",
+            m.framesSuperseded.value());
+  w.histogram("esp32cam_frame_write_seconds", "Per streamed frame, time from queueing to the socket accepting the last byte",
+              m.frameWire, 1e-6);
+  w.counter("esp32cam_frames_sent_total", "Frames fully written to MJPEG streams", m.framesSent.value());
+  w.counter("esp32cam_frames_dropped_total", "Published frames a stream skipped because it was still sending or its socket was backed up",
+            m.framesDropped.value());
+  w.counter("esp32cam_stream_bytes_total", "Bytes written to MJPEG streams", m.bytesSent.value());
+  w.counter("esp32cam_stream_writes_total", "Socket writes made by MJPEG streams", m.writes.value());
+  w.counter("esp32cam_snapshot_cache_hits_total", "/jpg requests answered from the latest frame", SnapshotStreamer::hits);
+  w.counter("esp32cam_snapshot_cache_misses_total", "/jpg requests that waited for a capture", SnapshotStreamer::misses);
+
+  char labels[48];
+  w.header("esp32cam_client_fps", "gauge", "Recent frame rate delivered to each MJPEG client");
+  for (const MJPEGStreamer *s = MJPEGStreamer::first(); s; s = s->next())
+  {
+    snprintf(labels, sizeof(labels), "client=\"%s\"", s->peer());
+    w.sample("esp32cam_client_fps", labels, s->fps());
+  }
+  w.header("esp32cam_client_frames_total", "counter", "Frames sent to each MJPEG client");
+  for (const MJPEGStreamer *s = MJPEGStreamer::first(); s; s = s->next())
+  {
+    snprintf(labels, sizeof(labels), "client=\"%s\"", s->peer());
+    w.sample("esp32cam_client_frames_total", labels, s->stats().frames);
+  }
+  w.header("esp32cam_client_dropped_total", "counter", "Frames skipped for each MJPEG client");
+  for (const MJPEGStreamer *s = MJPEGStreamer::first(); s; s = s->next())
+  {
+    snprintf(labels, sizeof(labels), "client=\"%s\"", s->peer());
+    w.sample("esp32cam_client_dropped_total", labels, s->dropped());
+  }
+  w.header("esp32cam_client_backlog_bytes", "gauge", "Bytes each MJPEG client's socket still held when its last frame was due");
+  for (const MJPEGStreamer *s = MJPEGStreamer::first(); s; s = s->next())
+  {
+    snprintf(labels, sizeof(labels), "client=\"%s\"", s->peer());
+    w.sample("esp32cam_client_backlog_bytes", labels, s->backlog());
+  }
+}
@@ -0,0 +1,29 @@
+#ifndef PIPELINE_METRICS_H_
+#define PIPELINE_METRICS_H_
+
+#include <Metrics.h>
+
+// Streaming pipeline instruments, shared by every broadcaster and stream
+struct PipelineMetrics
+{
+  PipelineMetrics();
+
+  Histogram captureWait; // time blocked in FrameSource::capture() (esp_camera_fb_get on the device)
+  Histogram frameWire;   // per streamed frame: first byte queued until the socket took the last one
+  Counter framesCaptured;
+  Counter captureFailures;
+  Counter captureBusy;      // us the capture stage spent per frame, sensor wait and hand-off included
+  Counter framesSuperseded; // captured frames dropped from the hand-off queue for a newer one
+  Counter framesSent;
+  Counter framesDropped; // published frames a stream never sent: still busy, or its socket backed up
+  Counter bytesSent;
+  Counter writes;
+};
+
+extern PipelineMetrics pipelineMetrics;
+
+// Appends the pipeline series plus one labelled series per live stream. Streams come and go
+// on the event-loop thread, so call this from a request handler.
+void writePipelineMetrics(PromWriter &w);
+
+#endif // PIPELINE_METRICS_H_
@@ -0,0 +1,245 @@
+#include "WebSocketStreamer.h"
+#include <stdlib.h>
+#include <string.h>
+#if defined(ARDUINO)
+  #include "esp_timer.h"
+#else
+  #include <chrono>
+#endif
+
+WebSocketMetrics wsMetrics;
+uint8_t WebSocketStreamer::_live = 0;
+
+WebSocketMetrics::WebSocketMetrics()
+    : ackWait(LATENCY_BUCKETS_US, LATENCY_BUCKET_COUNT), frameAge(LATENCY_BUCKETS_US, LATENCY_BUCKET_COUNT)
+{
+}
+
+void writeWebSocketMetrics(PromWriter &w)
+{
+  WebSocketMetrics &m = wsMetrics;
+  w.gauge("esp32cam_ws_clients", "Open /ws sessions", WebSocketStreamer::live());
+  w.histogram("esp32cam_ws_ack_wait_seconds", "Per /ws frame, from queueing it to the client acknowledging it", m.ackWait,
+              1e-6);
+  w.histogram("esp32cam_ws_frame_age_seconds", "Per acknowledged /ws frame, from capture to the acknowledgement", m.frameAge,
+              1e-6);
+  w.counter("esp32cam_ws_sessions_total", "WebSocket sessions accepted on /ws", m.sessions.value());
+  w.counter("esp32cam_ws_frames_sent_total", "Frames fully written to /ws sessions", m.framesSent.value());
+  w.counter("esp32cam_ws_frames_skipped_total", "Published frames a /ws session never sent, window full or still sending",
+            m.framesSkipped.value());
+  w.counter("esp32cam_ws_acks_total", "Acknowledgements received from /ws clients", m.acks.value());
+  w.counter("esp32cam_ws_bytes_total", "Bytes written to /ws sessions, framing included", m.bytesSent.value());
+  w.counter("esp32cam_ws_protocol_errors_total", "/ws sessions closed for a malformed frame or oversized message",
+            m.protocolErrors.value());
+}
+
+// Same clock as the capture timestamps
+static uint64_t clock_us(void)
+{
+#if defined(ARDUINO)
+  return esp_timer_get_time();
+#else
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+static void put_be(uint8_t *out, uint64_t v, int bytes)
+{
+  for (int i = 0; i < bytes; i++)
+    out[i] = (uint8_t)(v >> (8 * (bytes - 1 - i)));
+}
+
+uint8_t WebSocketStreamer::inflightArg(const char *text)
+{
+  char *end;
+  long asked = strtol(text, &end, 10);
+  if (end == text || *end)
+    return WS_DEFAULT_INFLIGHT;
+  if (!asked)
+    return 0;
+  return asked < 1 ? 1 : asked > WS_MAX_INFLIGHT ? WS_MAX_INFLIGHT : asked;
+}
+
+WebSocketStreamer::WebSocketStreamer(MJPEGBroadcaster &broadcaster, const char *accept, uint8_t inflight)
+    : _broadcaster(broadcaster)
+{
+  strncpy(_accept, accept, sizeof(_accept) - 1);
+  _accept[sizeof(_accept) - 1] = 0;
+  _started = false;
+  _window = inflight > WS_MAX_INFLIGHT ? WS_MAX_INFLIGHT : inflight;
+  _outstanding = 0;
+  _lastSeq = 0;
+  _dropped = 0;
+  _lastBytes = 0;
+  _replyOpcode = WS_PONG;
+  _replyLen = 0;
+  _replyPending = false;
+  _closing = false;
+  _live++;
+  wsMetrics.sessions.add();
+  _broadcaster.attach();
+}
+
+WebSocketStreamer::~WebSocketStreamer()
+{
+  _frame.reset();
+  _broadcaster.detach();
+  _live--;
+}
+
+void WebSocketStreamer::frameDone(HttpConnection &conn)
+{
+  // Asked only once the connection has drained, so the frame has fully left
+  wsMetrics.framesSent.add();
+  wsMetrics.bytesSent.add(conn.bytesSent() - _lastBytes);
+  _lastBytes = conn.bytesSent();
+  _frame.reset();
+}
+
+bool WebSocketStreamer::ready(void)
+{
+  if (!_started || _frame || _replyPending)
+    return true;
+  if (_closing || _broadcaster.paused())
+    return false;
+  return (!_window || _outstanding < _window) && _broadcaster.latestSeq() > _lastSeq;
+}
+
+bool WebSocketStreamer::pump(HttpConnection &conn)
+{
+  if (!_started)
+  {
+    _started = true;
+    char response[WS_UPGRADE_SIZE];
+    conn.queueCopy(response, wsUpgradeResponse(response, sizeof(response), _accept));
+    return true;
+  }
+  if (_frame)
+    frameDone(conn);
+  if (_replyPending)
+  {
+    uint8_t head[WS_MAX_FRAME_HEADER];
+    conn.queueCopy(head, wsFrameHeader(head, _replyOpcode, _replyLen));
+    conn.queueCopy(_reply, _replyLen);
+    _replyPending = false;
+    if (_replyOpcode == WS_CLOSE)
+      return false; // the close goes out, then the connection does
+  }
+  if (_closing || _broadcaster.paused())
+    return true;
+  if (_window && _outstanding >= _window)
+    return true;
+  // Always the newest frame: whatever was published while the window was full is gone
+  if (!_broadcaster.tryAcquire(_frame, _lastSeq))
+    return true;
+  if (_lastSeq && _frame.getSeq() > _lastSeq + 1)
+  {
+    uint32_t skipped = _frame.getSeq() - _lastSeq - 1;
+    _dropped += skipped;
+    wsMetrics.framesSkipped.add(skipped);
+  }
+  _lastSeq = _frame.getSeq();
+
+  uint64_t now = clock_us();
+  uint64_t captured = _frame.getTimestamp();
+  uint64_t age = now > captured ? now - captured : 0;
+  size_t n = wsFrameHeader(_header, WS_BINARY, WS_FRAME_HEADER + _frame.getSize());
+  put_be(_header + n, _lastSeq, 4);
+  put_be(_header + n + 4, captured, 8);
+  put_be(_header + n + 12, age > 0xFFFFFFFFULL ? 0xFFFFFFFFULL : age, 4);
+  conn.queue(_header, n + WS_FRAME_HEADER);
+  conn.queue(_frame.getBuf(), _frame.getSize());
+  if (_window)
+  {
+    Sent &s = _sent[_outstanding++];
+    s.seq = _lastSeq;
+    s.captured = captured;
+    s.queued = now;
+  }
+  return true;
+}
+
+void WebSocketStreamer::acknowledge(uint32_t seq)
+{
+  wsMetrics.acks.add();
+  uint64_t now = clock_us();
+  uint8_t kept = 0;
+  for (uint8_t i = 0; i < _outstanding; i++)
+  {
+    const Sent &s = _sent[i];
+    if (s.seq > seq)
+    {
+      _sent[kept++] = s;
+      continue;
+    }
+    if (s.seq == seq)
+    {
+      wsMetrics.ackWait.observe(now - s.queued);
+      wsMetrics.frameAge.observe(now > s.captured ? now - s.captured : 0);
+    }
+  }
+  _outstanding = kept;
+}
+
+void WebSocketStreamer::reply(WsOpcode opcode, const uint8_t *payload, size_t len)
+{
+  if (_closing)
+    return;
+  _replyOpcode = opcode;
+  _replyLen = len < sizeof(_reply) ? len : sizeof(_reply);
+  memcpy(_reply, payload, _replyLen);
+  _replyPending = true;
+}
+
+void WebSocketStreamer::closeWith(uint16_t code)
+{
+  uint8_t payload[2] = {(uint8_t)(code >> 8), (uint8_t)code};
+  reply(WS_CLOSE, payload, sizeof(payload));
+  _closing = true;
+}
+
+void WebSocketStreamer::received(HttpConnection &conn, const uint8_t *data, size_t len)
+{
+  while (len && !_closing)
+  {
+    WsReader::Event event;
+    size_t n = _reader.feed(data, len, event);
+    data += n;
+    len -= n;
+    switch (event)
+    {
+    case WsReader::MESSAGE:
+    {
+      const uint8_t *p = _reader.payload();
+      size_t plen = _reader.payloadLen();
+      if (_reader.opcode() == WS_BINARY && plen == 4)
+      {
+        acknowledge((uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3]);
+      }
+      else if (_reader.opcode() == WS_TEXT && plen && plen < 12)
+      {
+        char text[12];
+        memcpy(text, p, plen);
+        text[plen] = 0;
+        char *end;
+        unsigned long seq = strtoul(text, &end, 10);
+        if (end != text && !*end)
+          acknowledge((uint32_t)seq);
+      }
+      break; // anything else is not ours to understand
+    }
+    case WsReader::PING:
+      reply(WS_PONG, _reader.payload(), _reader.payloadLen());
+      break;
+    case WsReader::CLOSE:
+      closeWith(_reader.closeCode());
+      break;
+    case WsReader::ERROR:
+      wsMetrics.protocolErrors.add();
+      closeWith(_reader.closeCode());
+      break;
+    default:
+      break;
+    }
+  }
+}
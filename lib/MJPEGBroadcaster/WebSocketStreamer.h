@@ -0,0 +1,89 @@
+#ifndef WEB_SOCKET_STREAMER_H_
+#define WEB_SOCKET_STREAMER_H_
+
+#include <EventServer.h>
+#include <WebSocket.h>
+#include <Metrics.h>
+#include "MJPEGBroadcaster.h"
+
+#define WS_DEFAULT_INFLIGHT 2  // frames a client may have unacknowledged
+#define WS_MAX_INFLIGHT     8
+#define WS_FRAME_HEADER     16 // seq, capture time and age ahead of every JPEG
+
+// /ws instruments, every session together
+struct WebSocketMetrics
+{
+  WebSocketMetrics();
+
+  Histogram ackWait;  // frame queued until the client acknowledged it (us)
+  Histogram frameAge; // capture until acknowledged: glass-to-glass as far as the device can see (us)
+  Counter sessions;
+  Counter framesSent;
+  Counter framesSkipped; // published frames a session never sent: window full or still sending
+  Counter acks;
+  Counter bytesSent; // frames and control replies, WebSocket framing included
+  Counter protocolErrors; // sessions closed for a malformed frame or an oversized message
+};
+
+extern WebSocketMetrics wsMetrics;
+
+void writeWebSocketMetrics(PromWriter &w);
+
+// /ws: every frame as one binary WebSocket message, a WS_FRAME_HEADER header and the JPEG:
+//   u32 seq, u64 capture time (us, device clock), u32 age at send (us), all big-endian
+// The client acknowledges with the seq of the newest frame it has shown, as a text message
+// ("1234") or a 4-byte big-endian binary one. Acknowledgements are cumulative; with inflight
+// frames outstanding nothing more is sent, and the next one is always the newest published,
+// so a slow client sees fewer frames instead of older ones. inflight 0 turns acknowledgements
+// off and leaves the pacing to TCP, like /mjpeg.
+class WebSocketStreamer : public Streamer
+{
+public:
+  WebSocketStreamer(MJPEGBroadcaster &broadcaster, const char *accept, uint8_t inflight = WS_DEFAULT_INFLIGHT);
+  ~WebSocketStreamer();
+  bool ready(void);
+  bool pump(HttpConnection &conn);
+  void received(HttpConnection &conn, const uint8_t *data, size_t len);
+
+  uint8_t inFlight(void) const { return _outstanding; }
+  uint32_t dropped(void) const { return _dropped; }
+  static uint8_t live(void) { return _live; }
+  // Window for an ?inflight= value: clamped to 1..WS_MAX_INFLIGHT, 0 only when 0 was asked
+  // for, WS_DEFAULT_INFLIGHT for anything that is not a number
+  static uint8_t inflightArg(const char *text);
+
+private:
+  struct Sent
+  {
+    uint32_t seq;
+    uint64_t captured;
+    uint64_t queued;
+  };
+
+  void acknowledge(uint32_t seq);
+  void reply(WsOpcode opcode, const uint8_t *payload, size_t len);
+  void closeWith(uint16_t code);
+  void frameDone(HttpConnection &conn);
+
+  static uint8_t _live;
+  MJPEGBroadcaster &_broadcaster;
+  char _accept[WS_ACCEPT_SIZE];
+  bool _started;
+  uint8_t _window;
+  Sent _sent[WS_MAX_INFLIGHT]; // oldest first
+  uint8_t _outstanding;
+  FrameRef _frame; // kept alive until the connection has sent it
+  uint32_t _lastSeq;
+  uint32_t _dropped;
+  uint64_t _lastBytes;
+  uint8_t _header[WS_MAX_FRAME_HEADER + WS_FRAME_HEADER];
+
+  WsReader _reader;
+  WsOpcode _replyOpcode; // pong or close waiting for the next pump()
+  uint8_t _reply[WS_CONTROL_SIZE];
+  size_t _replyLen;
+  bool _replyPending;
+  bool _closing; // a close is queued or sent, nothing follows it
+};
+
+#endif // WEB_SOCKET_STREAMER_H_
@@ -0,0 +1,121 @@
+#include "Metrics.h"
+#include <stdio.h>
+
+const uint32_t LATENCY_BUCKETS_US[] = {250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000};
+const uint8_t LATENCY_BUCKET_COUNT = sizeof(LATENCY_BUCKETS_US) / sizeof(LATENCY_BUCKETS_US[0]);
+
+//////////////////////////
+//      Histogram       //
+//////////////////////////
+
+Histogram::Histogram(const uint32_t *bounds, uint8_t count) : _bounds(bounds)
+{
+  _count = count > HIST_MAX_BUCKETS ? HIST_MAX_BUCKETS : count;
+  reset();
+}
+
+void Histogram::observe(uint32_t value)
+{
+  uint8_t i = 0;
+  while (i < _count && value > _bounds[i])
+    i++;
+  _buckets[i].fetch_add(1, std::memory_order_relaxed);
+  _sum.fetch_add(value, std::memory_order_relaxed);
+}
+
+void Histogram::reset(void)
+{
+  for (uint8_t i = 0; i <= HIST_MAX_BUCKETS; i++)
+    _buckets[i].store(0, std::memory_order_relaxed);
+  _sum.store(0, std::memory_order_relaxed);
+}
+
+uint64_t Histogram::bucket(uint8_t i) const
+{
+  return i <= _count ? _buckets[i].load(std::memory_order_relaxed) : 0;
+}
+
+uint64_t Histogram::cumulative(uint8_t i) const
+{
+  uint64_t total = 0;
+  for (uint8_t b = 0; b <= i && b <= _count; b++)
+    total += bucket(b);
+  return total;
+}
+
+uint64_t Histogram::count(void) const
+{
+  return cumulative(_count);
+}
+
+uint32_t Histogram::percentile(float p) const
+{
+  uint64_t total = count();
+  if (!total)
+    return 0;
+  uint64_t rank = (uint64_t)(p / 100.0f * total + 0.5f);
+  if (rank < 1)
+    rank = 1;
+  uint64_t seen = 0;
+  for (uint8_t i = 0; i < _count; i++)
+  {
+    seen += bucket(i);
+    if (seen >= rank)
+      return _bounds[i];
+  }
+  return UINT32_MAX; // overflow bucket
+}
+
+//////////////////////////
+//      PromWriter      //
+//////////////////////////
+
+void PromWriter::header(const char *name, const char *type, const char *help)
+{
+  char line[192];
+  snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+  _out += line;
+}
+
+void PromWriter::sample(const char *name, const char *labels, double value)
+{
+  char line[160];
+  if (labels && *labels)
+    snprintf(line, sizeof(line), "%s{%s} %.15g\n", name, labels, value);
+  else
+    snprintf(line, sizeof(line), "%s %.15g\n", name, value);
+  _out += line;
+}
+
+void PromWriter::counter(const char *name, const char *help, double value)
+{
+  header(name, "counter", help);
+  sample(name, NULL, value);
+}
+
+void PromWriter::gauge(const char *name, const char *help, double value)
+{
+  header(name, "gauge", help);
+  sample(name, NULL, value);
+}
+
+void PromWriter::histogram(const char *name, const char *help, const Histogram &h, double scale)
+{
+  char series[64], labels[32];
+  header(name, "histogram", help);
+  snprintf(series, sizeof(series), "%s_bucket", name);
+  // One pass, so the buckets stay consistent with each other while recording goes on
+  uint64_t total = 0;
+  for (uint8_t i = 0; i < h.bounds(); i++)
+  {
+    total += h.bucket(i);
+    snprintf(labels, sizeof(labels), "le=\"%g\"", h.bound(i) * scale);
+    sample(series, labels, (double)total);
+  }
+  total += h.bucket(h.bounds());
+  sample(series, "le=\"+Inf\"", (double)total);
+  snprintf(series, sizeof(series), "%s_sum", name);
+  sample(series, NULL, h.sum() * scale);
+  snprintf(series, sizeof(series), "%s_count", name);
+  sample(series, NULL, (double)total);
+}
@@ -0,0 +1,70 @@
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <string>
+
+#define HIST_MAX_BUCKETS 16
+
+// Monotonic event counter, one relaxed atomic add per record
+class Counter
+{
+public:
+  Counter() : _value(0) {}
+  void add(uint32_t n = 1) { _value.fetch_add(n, std::memory_order_relaxed); }
+  uint64_t value(void) const { return _value.load(std::memory_order_relaxed); }
+
+private:
+  std::atomic<uint64_t> _value;
+};
+
+// Fixed-bucket histogram. bounds are inclusive upper bounds in ascending order, an
+// overflow bucket (+Inf) is implied. Recording is a short scan and two relaxed atomic adds,
+// no locks and no allocation, so it can stay on in production.
+class Histogram
+{
+public:
+  Histogram(const uint32_t *bounds, uint8_t count);
+
+  void observe(uint32_t value);
+  void reset(void);
+
+  uint8_t bounds(void) const { return _count; }
+  uint32_t bound(uint8_t i) const { return _bounds[i]; }
+  uint64_t bucket(uint8_t i) const; // observations in bucket i alone (i == bounds() is +Inf)
+  uint64_t cumulative(uint8_t i) const; // observations <= bound(i), Prometheus' "le"
+  uint64_t count(void) const;
+  uint64_t sum(void) const { return _sum.load(std::memory_order_relaxed); }
+  uint32_t percentile(float p) const; // upper bound of the bucket holding the p-th percentile
+
+private:
+  const uint32_t *_bounds;
+  uint8_t _count;
+  std::atomic<uint32_t> _buckets[HIST_MAX_BUCKETS + 1];
+  std::atomic<uint64_t> _sum;
+};
+
+// 250 us .. 1 s, roughly 1-2.5-5 steps; for latencies recorded in microseconds
+extern const uint32_t LATENCY_BUCKETS_US[];
+extern const uint8_t LATENCY_BUCKET_COUNT;
+
+// Prometheus text exposition format (version 0.0.4)
+class PromWriter
+{
+public:
+  PromWriter(std::string &out) : _out(out) {}
+
+  void header(const char *name, const char *type, const char *help);
+  void sample(const char *name, const char *labels, double value); // labels without braces, or NULL
+  void counter(const char *name, const char *help, double value);
+  void gauge(const char *name, const char *help, double value);
+  // scale converts recorded units to the exported ones, e.g. 1e-6 for microseconds to seconds
+  void histogram(const char *name, const char *help, const Histogram &h, double scale = 1);
+
+private:
+  std::string &_out;
+};
+
+#endif // METRICS_H_
@@ -0,0 +1,109 @@
+#include "LumaGrid.h"
+#include <string.h>
+
+bool LumaExtractor::extract(const uint8_t *jpg, size_t len, LumaGrid &out)
+{
+  const uint8_t *data = _jpeg.parse(jpg, len);
+  return data && scan(data, jpg + len, out);
+}
+
+bool LumaExtractor::scan(const uint8_t *p, const uint8_t *end, LumaGrid &out)
+{
+  uint8_t ncomp = _jpeg.components();
+  uint8_t hmax = 1, vmax = 1;
+  for (uint8_t i = 0; i < ncomp; i++)
+  {
+    hmax = _jpeg.component(i).h > hmax ? _jpeg.component(i).h : hmax;
+    vmax = _jpeg.component(i).v > vmax ? _jpeg.component(i).v : vmax;
+  }
+  const JpegComponent &y = _jpeg.component(0);
+  uint16_t width = _jpeg.width(), height = _jpeg.height();
+  uint16_t bw = ((uint32_t)width * y.h / hmax + 7) / 8;
+  uint16_t bh = ((uint32_t)height * y.v / vmax + 7) / 8;
+
+  // Smallest whole number of blocks per cell that fits the grid
+  uint8_t f = 1;
+  while ((bw + f - 1) / f > LUMA_GRID_MAX_W || (bh + f - 1) / f > LUMA_GRID_MAX_H)
+    f++;
+  if (f > 16)
+    return false; // sums would overflow, far beyond anything the sensor makes
+  uint16_t gw = (bw + f - 1) / f;
+  uint16_t gh = (bh + f - 1) / f;
+  memset(_sum, 0, sizeof(_sum[0]) * gw * gh);
+
+  // A lone scan is laid out block by block, an interleaved one MCU by MCU
+  bool interleaved = ncomp > 1;
+  uint16_t mcux = interleaved ? (width + 8 * hmax - 1) / (8 * hmax) : bw;
+  uint16_t mcuy = interleaved ? (height + 8 * vmax - 1) / (8 * vmax) : bh;
+  int32_t qy = _jpeg.quant(y.tq)[0];
+  uint16_t interval = _jpeg.restartInterval();
+  _jpeg.begin(p, end);
+
+  uint32_t mcu = 0;
+  for (uint16_t my = 0; my < mcuy; my++)
+  {
+    for (uint16_t mx = 0; mx < mcux; mx++, mcu++)
+    {
+      if (interval && mcu && mcu % interval == 0 && !_jpeg.restart())
+        return false;
+      for (uint8_t ci = 0; ci < ncomp; ci++)
+      {
+        JpegComponent &c = _jpeg.component(ci);
+        uint8_t bh_ = interleaved ? c.v : 1;
+        uint8_t bw_ = interleaved ? c.h : 1;
+        for (uint8_t v = 0; v < bh_; v++)
+        {
+          for (uint8_t h = 0; h < bw_; h++)
+          {
+            int s = _jpeg.decodeDc(c);
+            if (s < 0 || s > 11)
+              return false;
+            if (s)
+              c.pred += JpegParser::extend(_jpeg.receive(s), s);
+            // Walk past the AC coefficients without reconstructing them
+            for (uint8_t k = 1; k < 64;)
+            {
+              int rs = _jpeg.decodeAc(c);
+              if (rs < 0)
+                return false;
+              uint8_t run = rs >> 4, size = rs & 15;
+              if (size)
+              {
+                _jpeg.receive(size);
+                k += run + 1;
+              }
+              else if (run == 15)
+                k += 16;
+              else
+                break;
+            }
+            if (ci)
+              continue;
+            uint16_t bx = interleaved ? mx * c.h + h : mx;
+            uint16_t by = interleaved ? my * c.v + v : my;
+            if (bx >= bw || by >= bh)
+              continue;
+            int32_t mean = c.pred * qy / 8 + 128;
+            _sum[(by / f) * gw + bx / f] += mean < 0 ? 0 : mean > 255 ? 255 : mean;
+          }
+        }
+      }
+      if (_jpeg.overrun())
+        return false;
+    }
+  }
+
+  out.width = gw;
+  out.height = gh;
+  out.blocks = f;
+  for (uint16_t cy = 0; cy < gh; cy++)
+  {
+    uint16_t ny = bh - cy * f < f ? bh - cy * f : f;
+    for (uint16_t cx = 0; cx < gw; cx++)
+    {
+      uint16_t nx = bw - cx * f < f ? bw - cx * f : f;
+      out.cells[cy * gw + cx] = _sum[cy * gw + cx] / (nx * ny);
+    }
+  }
+  return true;
+}
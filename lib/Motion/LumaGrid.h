@@ -0,0 +1,38 @@
+#ifndef LUMA_GRID_H_
+#define LUMA_GRID_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <JpegParser.h>
+
+// Largest grid handed to the detector; VGA's 8x8 block means fit exactly
+#define LUMA_GRID_MAX_W 80
+#define LUMA_GRID_MAX_H 60
+#define LUMA_GRID_CELLS (LUMA_GRID_MAX_W * LUMA_GRID_MAX_H)
+
+// Mean brightness of each cell, row-major with width cells per row
+struct LumaGrid
+{
+  uint16_t width;
+  uint16_t height;
+  uint8_t blocks; // 8x8 blocks per cell side, so a cell covers 8 * blocks pixels
+  uint8_t cells[LUMA_GRID_CELLS];
+};
+
+// Pulls the luma plane straight out of a baseline JPEG: every Y block's DC coefficient is
+// its 8x8 mean, so the entropy data is only walked, never inverse transformed. Frames above
+// VGA average neighbouring blocks until the grid fits.
+class LumaExtractor
+{
+public:
+  // False for anything that is not 8-bit baseline/extended Huffman (e.g. progressive) or is truncated
+  bool extract(const uint8_t *jpg, size_t len, LumaGrid &out);
+
+private:
+  bool scan(const uint8_t *p, const uint8_t *end, LumaGrid &out);
+
+  JpegParser _jpeg;
+  uint16_t _sum[LUMA_GRID_CELLS];
+};
+
+#endif // LUMA_GRID_H_
@@ -0,0 +1,168 @@
+#include "MotionDetector.h"
+#include <string.h>
+
+#define LANES_HI   0x80808080u
+#define LANES_LO7  0x7F7F7F7Fu
+#define LANES_ONE  0x01010101u
+
+// Word loads and stores that tolerate a short tail and any alignment
+static inline uint32_t load(const uint8_t *p, size_t n)
+{
+  uint32_t w = 0;
+  if (n == 4)
+    memcpy(&w, p, 4); // one 32-bit load
+  else
+    memcpy(&w, p, n);
+  return w;
+}
+
+static inline void store(uint8_t *p, uint32_t w, size_t n)
+{
+  if (n == 4)
+    memcpy(p, &w, 4);
+  else
+    memcpy(p, &w, n);
+}
+
+// Number of lanes with the high bit set
+static inline uint32_t lanes(uint32_t hi)
+{
+  return ((hi >> 7) * LANES_ONE) >> 24;
+}
+
+MotionDetector::MotionDetector()
+{
+  configure(MOTION_THRESHOLD, MOTION_MIN_BLOB, MOTION_TRIGGER_FRAMES, MOTION_LIGHTING_PCT, MOTION_BG_PERIOD);
+  reset();
+}
+
+void MotionDetector::configure(uint8_t threshold, uint16_t minBlob, uint8_t triggerFrames, uint8_t lightingPct,
+                               uint8_t bgPeriod)
+{
+  _threshold = threshold < 1 ? 1 : threshold > 126 ? 126 : threshold;
+  _minBlob = minBlob ? minBlob : 1;
+  _trigger = triggerFrames ? triggerFrames : 1;
+  _lightingPct = lightingPct;
+  _bgPeriod = bgPeriod ? bgPeriod : 1;
+}
+
+void MotionDetector::reset(void)
+{
+  _width = _height = 0;
+  _frames = 0;
+  _streak = 0;
+}
+
+bool MotionDetector::process(const LumaGrid &grid, MotionResult &out)
+{
+  size_t n = (size_t)grid.width * grid.height;
+  memset(&out, 0, sizeof(out));
+  out.cells = n;
+
+  if (grid.width != _width || grid.height != _height)
+  {
+    // Seed the background from this frame
+    for (size_t i = 0; i < n; i += 4)
+    {
+      size_t k = n - i < 4 ? n - i : 4;
+      store(_bg + i, (load(grid.cells + i, k) >> 1) & LANES_LO7, k);
+    }
+    _width = grid.width;
+    _height = grid.height;
+    _frames = 1;
+    _streak = 0;
+    return false;
+  }
+
+  bool update = ++_frames % _bgPeriod == 0;
+  uint32_t bias = (0x7F - _threshold) * LANES_ONE; // lane + bias reaches the high bit once lane > threshold
+  uint32_t changed = 0;
+  for (size_t i = 0; i < n; i += 4)
+  {
+    size_t k = n - i < 4 ? n - i : 4;
+    uint32_t cur = (load(grid.cells + i, k) >> 1) & LANES_LO7;
+    uint32_t bg = load(_bg + i, k);
+    // Lanes are at most 127, so setting the guard bit keeps every lane's subtraction from borrowing
+    uint32_t up = (cur | LANES_HI) - bg;   // 128 + cur - bg per lane
+    uint32_t down = (bg | LANES_HI) - cur; // 128 + bg - cur per lane
+    uint32_t ge = up & LANES_HI;
+    uint32_t le = down & LANES_HI;
+    uint32_t pick = (ge >> 7) * 0xFF;
+    uint32_t diff = ((up & pick) | (down & ~pick)) & LANES_LO7;
+    uint32_t hit = (diff + bias) & LANES_HI;
+    store(_mask + i, hit, k);
+    changed += lanes(hit);
+    if (update)
+      store(_bg + i, bg + ((ge & ~le) >> 7) - ((le & ~ge) >> 7), k);
+  }
+  out.changed = changed;
+
+  if (changed * 100 > (uint32_t)_lightingPct * n)
+  {
+    // Exposure or a light switched on: judging against the old background would light up everything
+    _width = _height = 0;
+    process(grid, out);
+    out.cells = n;
+    out.changed = changed;
+    out.lighting = true;
+    return false;
+  }
+
+  out.blobs = changed ? countBlobs(grid.width, grid.height, out.largest) : 0;
+  _streak = out.blobs ? (_streak < 255 ? _streak + 1 : 255) : 0;
+  out.motion = _streak >= _trigger;
+  return out.motion;
+}
+
+uint8_t MotionDetector::countBlobs(uint16_t width, uint16_t height, uint16_t &largest)
+{
+  uint8_t blobs = 0;
+  size_t n = (size_t)width * height;
+  largest = 0;
+  for (size_t seed = 0; seed < n; seed++)
+  {
+    if (!(seed & 3) && seed + 4 <= n && !load(_mask + seed, 4))
+    {
+      seed += 3; // four quiet cells at once
+      continue;
+    }
+    if (!_mask[seed])
+      continue;
+    // Flood fill, clearing cells as they are pushed so each one is visited once
+    uint16_t size = 0;
+    size_t top = 0;
+    _mask[seed] = 0;
+    _stack[top++] = seed;
+    while (top)
+    {
+      uint16_t c = _stack[--top];
+      uint16_t x = c % width;
+      size++;
+      if (x > 0 && _mask[c - 1])
+      {
+        _mask[c - 1] = 0;
+        _stack[top++] = c - 1;
+      }
+      if (x + 1 < width && _mask[c + 1])
+      {
+        _mask[c + 1] = 0;
+        _stack[top++] = c + 1;
+      }
+      if (c >= width && _mask[c - width])
+      {
+        _mask[c - width] = 0;
+        _stack[top++] = c - width;
+      }
+      if (c + width < n && _mask[c + width])
+      {
+        _mask[c + width] = 0;
+        _stack[top++] = c + width;
+      }
+    }
+    if (size > largest)
+      largest = size;
+    if (size >= _minBlob && blobs < 255)
+      blobs++;
+  }
+  return blobs;
+}
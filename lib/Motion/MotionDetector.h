@@ -0,0 +1,58 @@
+#ifndef MOTION_DETECTOR_H_
+#define MOTION_DETECTOR_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "LumaGrid.h"
+
+#define MOTION_THRESHOLD      12 // cell change that counts, on the detector's 7-bit scale (x2 for 0-255)
+#define MOTION_MIN_BLOB       4  // cells in a region before it is more than noise
+#define MOTION_TRIGGER_FRAMES 2  // consecutive frames with a region before reporting motion
+#define MOTION_LIGHTING_PCT   60 // this much of the grid changing at once is exposure, not motion
+#define MOTION_BG_PERIOD      4  // background steps one level every this many frames
+
+// What one frame looked like against the background
+struct MotionResult
+{
+  uint16_t cells;   // grid size this frame was judged on
+  uint16_t changed; // cells past the threshold
+  uint8_t blobs;    // 4-connected regions of at least the minimum size
+  uint16_t largest; // cells in the biggest region
+  bool lighting;    // too much changed at once, the background was re-seeded instead
+  bool motion;      // regions seen for the trigger number of frames running
+};
+
+// Background subtraction, thresholding and blob counting on a LumaGrid. The background is a
+// sigma-delta estimate (each cell steps one level towards the frame), kept at 7 bits per cell
+// so four cells share a 32-bit word with a spare guard bit: difference, threshold and
+// background update are all done four cells at a time without carries between lanes.
+// No allocation, every buffer is sized for the largest grid.
+class MotionDetector
+{
+public:
+  MotionDetector();
+
+  void configure(uint8_t threshold, uint16_t minBlob, uint8_t triggerFrames, uint8_t lightingPct, uint8_t bgPeriod);
+  // A new grid size (the camera was reconfigured) starts over from that frame
+  bool process(const LumaGrid &grid, MotionResult &out);
+  void reset(void);
+
+private:
+  uint8_t countBlobs(uint16_t width, uint16_t height, uint16_t &largest);
+
+  uint8_t _threshold;
+  uint16_t _minBlob;
+  uint8_t _trigger;
+  uint8_t _lightingPct;
+  uint8_t _bgPeriod;
+
+  uint16_t _width;
+  uint16_t _height;
+  uint32_t _frames;
+  uint8_t _streak;
+  uint8_t _bg[LUMA_GRID_CELLS];
+  uint8_t _mask[LUMA_GRID_CELLS]; // 0x80 where the cell changed, cleared as blobs are walked
+  uint16_t _stack[LUMA_GRID_CELLS];
+};
+
+#endif // MOTION_DETECTOR_H_
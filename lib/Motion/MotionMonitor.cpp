@@ -0,0 +1,107 @@
+#include "MotionMonitor.h"
+#include <string.h>
+
+typedef std::chrono::steady_clock Clock;
+
+MotionMetrics motionMetrics;
+
+MotionMetrics::MotionMetrics() : analyse(LATENCY_BUCKETS_US, LATENCY_BUCKET_COUNT)
+{
+}
+
+void writeMotionMetrics(PromWriter &w)
+{
+  MotionMetrics &m = motionMetrics;
+  w.histogram("esp32cam_motion_analyse_seconds", "Per frame, luma extraction plus motion detection", m.analyse, 1e-6);
+  w.counter("esp32cam_motion_frames_total", "Frames run through motion detection", m.framesAnalysed.value());
+  w.counter("esp32cam_motion_skipped_total", "Published frames motion detection skipped while busy", m.framesSkipped.value());
+  w.counter("esp32cam_motion_decode_failures_total", "Frames whose luma could not be extracted", m.decodeFailures.value());
+  w.counter("esp32cam_motion_lighting_resets_total", "Background re-seeded after a global brightness change", m.lightingResets.value());
+  w.counter("esp32cam_motion_events_total", "Motion events reported", m.events.value());
+}
+
+MotionMonitor::MotionMonitor(MJPEGBroadcaster &broadcaster) : _broadcaster(broadcaster)
+{
+  memset(&_last, 0, sizeof(_last));
+  _onMotion = NULL;
+  _onMotionCtx = NULL;
+  _cooldown_ms = 0;
+  _lastSeq = 0;
+  _fired = false;
+  _frames = 0;
+  _fps = 0;
+  _second = Clock::now();
+}
+
+void MotionMonitor::onMotion(MotionFn callback, void *ctx)
+{
+  _onMotion = callback;
+  _onMotionCtx = ctx;
+}
+
+void MotionMonitor::setCooldown(uint32_t ms)
+{
+  _cooldown_ms = ms;
+}
+
+void MotionMonitor::run(void)
+{
+  _broadcaster.attach();
+  while (step())
+    ;
+  _broadcaster.detach();
+}
+
+bool MotionMonitor::step(void)
+{
+  FrameRef frame;
+  if (!_broadcaster.acquire(frame, _lastSeq))
+    return false;
+  if (_lastSeq && frame.getSeq() > _lastSeq + 1)
+    motionMetrics.framesSkipped.add(frame.getSeq() - _lastSeq - 1);
+  _lastSeq = frame.getSeq();
+
+  Clock::time_point started = Clock::now();
+  bool ok = _extractor.extract(frame.getBuf(), frame.getSize(), _grid);
+  frame.reset(); // the grid is all detection needs
+  if (!ok)
+  {
+    motionMetrics.decodeFailures.add();
+    return true;
+  }
+  MotionResult result;
+  _detector.process(_grid, result);
+  Clock::time_point now = Clock::now();
+  motionMetrics.analyse.observe(std::chrono::duration_cast<std::chrono::microseconds>(now - started).count());
+  motionMetrics.framesAnalysed.add();
+  if (result.lighting)
+    motionMetrics.lightingResets.add();
+  {
+    std::lock_guard<std::mutex> guard(_lock);
+    _last = result;
+  }
+
+  _frames++;
+  if (now - _second >= std::chrono::seconds(1))
+  {
+    _fps = _frames;
+    _frames = 0;
+    _second = now;
+  }
+
+  if (result.motion && (!_fired || now - _lastEvent >= std::chrono::milliseconds(_cooldown_ms)))
+  {
+    _fired = true;
+    _lastEvent = now;
+    motionMetrics.events.add();
+    if (_onMotion)
+      _onMotion(result, _onMotionCtx);
+  }
+  return true;
+}
+
+MotionResult MotionMonitor::last(void)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  return _last;
+}
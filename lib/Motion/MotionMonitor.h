@@ -0,0 +1,71 @@
+#ifndef MOTION_MONITOR_H_
+#define MOTION_MONITOR_H_
+
+#include <stdint.h>
+#include <chrono>
+#include <mutex>
+#include <Metrics.h>
+#include <MJPEGBroadcaster.h>
+#include "LumaGrid.h"
+#include "MotionDetector.h"
+
+// Motion pipeline instruments
+struct MotionMetrics
+{
+  MotionMetrics();
+
+  Histogram analyse; // per frame: luma extraction plus detection
+  Counter framesAnalysed;
+  Counter framesSkipped; // published while the previous frame was still being analysed
+  Counter decodeFailures;
+  Counter lightingResets;
+  Counter events;
+};
+
+extern MotionMetrics motionMetrics;
+
+void writeMotionMetrics(PromWriter &w);
+
+// Runs the detector as one more reader of the broadcaster, on a task of its own. It always
+// takes the newest published frame, so a slow round skips frames instead of holding the
+// stream back, and lets go of the frame before detection so the driver gets its buffer back.
+class MotionMonitor
+{
+public:
+  typedef void (*MotionFn)(const MotionResult &result, void *ctx);
+
+  MotionMonitor(MJPEGBroadcaster &broadcaster);
+
+  MotionDetector &detector(void) { return _detector; }
+  // Called from the monitor's task once motion is confirmed, at most once per cooldown
+  void onMotion(MotionFn callback, void *ctx);
+  void setCooldown(uint32_t ms);
+
+  // Task body. Stays attached while it runs, so the producer keeps capturing without viewers;
+  // returns once the broadcaster shuts down.
+  void run(void);
+  // One frame: waits for the next publish and analyses it, false on shutdown
+  bool step(void);
+
+  MotionResult last(void);
+  uint8_t fps(void) const { return _fps; } // frames analysed over the last second
+
+private:
+  MJPEGBroadcaster &_broadcaster;
+  LumaExtractor _extractor;
+  LumaGrid _grid;
+  MotionDetector _detector;
+  std::mutex _lock; // guards _last
+  MotionResult _last;
+  MotionFn _onMotion;
+  void *_onMotionCtx;
+  std::chrono::steady_clock::time_point _lastEvent;
+  std::chrono::steady_clock::time_point _second;
+  uint32_t _cooldown_ms;
+  uint32_t _lastSeq;
+  bool _fired;
+  uint8_t _frames;
+  uint8_t _fps;
+};
+
+#endif // MOTION_MONITOR_H_
@@ -0,0 +1,316 @@
+#include "Notifier.h"
+#include <stdio.h>
+#include <string.h>
+#if defined(ARDUINO)
+  #include "esp_timer.h"
+#else
+  #include <chrono>
+#endif
+
+// 1 ms .. 60 s: deliveries include the coalescing window and any backoff
+static const uint32_t DELIVERY_BUCKETS_US[] = {1000, 5000, 10000, 50000, 100000, 250000, 500000,
+                                               1000000, 2500000, 5000000, 15000000, 60000000};
+
+NotifyMetrics notifyMetrics;
+
+NotifyMetrics::NotifyMetrics() : latency(DELIVERY_BUCKETS_US, sizeof(DELIVERY_BUCKETS_US) / sizeof(DELIVERY_BUCKETS_US[0]))
+{
+}
+
+void writeNotifyMetrics(PromWriter &w)
+{
+  NotifyMetrics &m = notifyMetrics;
+  w.histogram("esp32cam_notify_latency_seconds", "First event of a batch until the webhook accepted it", m.latency, 1e-6);
+  w.counter("esp32cam_notify_events_total", "Events posted to the notifier", m.events.value());
+  w.counter("esp32cam_notify_messages_total", "Webhook messages delivered", m.messages.value());
+  w.counter("esp32cam_notify_failures_total", "Webhook attempts without a 2xx answer", m.failures.value());
+  w.counter("esp32cam_notify_dropped_total", "Batches dropped after the last retry", m.dropped.value());
+  w.counter("esp32cam_notify_snapshots_total", "Messages sent with a frame attached", m.snapshots.value());
+}
+
+//////////////////////////
+//     NotifySignal     //
+//////////////////////////
+
+#if defined(ARDUINO)
+
+NotifySignal::NotifySignal()
+{
+  _sem = xSemaphoreCreateBinary();
+}
+
+NotifySignal::~NotifySignal()
+{
+  vSemaphoreDelete(_sem);
+}
+
+void NotifySignal::give(void)
+{
+  xSemaphoreGive(_sem);
+}
+
+void NOTIFY_ISR_ATTR NotifySignal::giveFromISR(void)
+{
+  BaseType_t woken = pdFALSE;
+  xSemaphoreGiveFromISR(_sem, &woken);
+  if (woken)
+    portYIELD_FROM_ISR();
+}
+
+bool NotifySignal::take(uint32_t timeout_ms)
+{
+  return xSemaphoreTake(_sem, pdMS_TO_TICKS(timeout_ms)) == pdTRUE;
+}
+
+uint32_t NOTIFY_ISR_ATTR Notifier::now(void)
+{
+  return (uint32_t)esp_timer_get_time(); // IRAM safe
+}
+
+#else
+
+NotifySignal::NotifySignal() : _given(false)
+{
+}
+
+NotifySignal::~NotifySignal()
+{
+}
+
+void NotifySignal::give(void)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  _given = true;
+  _cond.notify_one();
+}
+
+void NotifySignal::giveFromISR(void)
+{
+  give(); // the host has no interrupts, the bench calls this from a thread
+}
+
+bool NotifySignal::take(uint32_t timeout_ms)
+{
+  std::unique_lock<std::mutex> guard(_lock);
+  _cond.wait_for(guard, std::chrono::milliseconds(timeout_ms), [this] { return _given; });
+  bool given = _given;
+  _given = false;
+  return given;
+}
+
+uint32_t Notifier::now(void)
+{
+  return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#endif
+
+//////////////////////////
+//       Notifier       //
+//////////////////////////
+
+static const char *SOURCE_NAMES[NOTIFY_SOURCES] = {"sensor", "motion", "button", "manual"};
+
+Notifier::Notifier(NotifyTransport &transport) : _transport(transport)
+{
+  for (uint8_t i = 0; i < NOTIFY_SOURCES; i++)
+    _counts[i] = 0;
+  _first = 0;
+  _last = 0;
+  _stopping = false;
+  _snapshot = NULL;
+  _snapshotCtx = NULL;
+  _name = "esp32cam";
+  _lastSent = 0;
+  _sentAny = false;
+  _batch.open = false;
+  configure(NOTIFY_COALESCE_MS, NOTIFY_MIN_INTERVAL_MS, NOTIFY_RETRY_MS, NOTIFY_MAX_ATTEMPTS);
+}
+
+void Notifier::configure(uint32_t coalesce_ms, uint32_t minInterval_ms, uint32_t retry_ms, uint8_t maxAttempts)
+{
+  _coalesce_us = coalesce_ms * 1000;
+  _minInterval_us = minInterval_ms * 1000;
+  _retry_us = retry_ms * 1000;
+  _maxAttempts = maxAttempts ? maxAttempts : 1;
+}
+
+void Notifier::onSnapshot(SnapshotFn snapshot, void *ctx)
+{
+  _snapshot = snapshot;
+  _snapshotCtx = ctx;
+}
+
+void Notifier::setName(const char *name)
+{
+  _name = name;
+}
+
+void Notifier::post(NotifySource source)
+{
+  uint32_t stamp = now() | 1; // 0 means "nothing pending"
+  uint32_t none = 0;
+  _counts[source].fetch_add(1, std::memory_order_relaxed);
+  _last.store(stamp, std::memory_order_relaxed);
+  _first.compare_exchange_strong(none, stamp, std::memory_order_release);
+  _signal.give();
+}
+
+void NOTIFY_ISR_ATTR Notifier::postFromISR(NotifySource source)
+{
+  uint32_t stamp = now() | 1;
+  uint32_t none = 0;
+  _counts[source].fetch_add(1, std::memory_order_relaxed);
+  _last.store(stamp, std::memory_order_relaxed);
+  _first.compare_exchange_strong(none, stamp, std::memory_order_release);
+  _signal.giveFromISR();
+}
+
+void Notifier::stop(void)
+{
+  _stopping = true;
+  _signal.give();
+}
+
+void Notifier::run(void)
+{
+  while (!_stopping)
+  {
+    harvest();
+    uint32_t wait = _batch.open ? due() : 0;
+    if (_batch.open && !wait)
+    {
+      deliver();
+      continue;
+    }
+    // Idle until an event, or until the open batch may go
+    _signal.take(_batch.open ? (wait + 999) / 1000 : 1000);
+  }
+  _batch.snapshot.clear();
+}
+
+void Notifier::harvest(void)
+{
+  uint32_t first = _first.exchange(0, std::memory_order_acquire);
+  if (!first)
+    return;
+  uint32_t total = 0;
+  uint32_t counts[NOTIFY_SOURCES];
+  for (uint8_t i = 0; i < NOTIFY_SOURCES; i++)
+  {
+    counts[i] = _counts[i].exchange(0, std::memory_order_relaxed);
+    total += counts[i];
+  }
+  uint32_t last = _last.load(std::memory_order_relaxed);
+  notifyMetrics.events.add(total);
+
+  if (!_batch.open)
+  {
+    memset(_batch.counts, 0, sizeof(_batch.counts));
+    _batch.open = true;
+    _batch.first = first;
+    _batch.opened = now();
+    _batch.retryAt = _batch.opened;
+    _batch.attempts = 0;
+    _batch.snapshot.clear(); // keeps its capacity, the next frame is about the same size
+    FrameRef frame;
+    if (_snapshot && _snapshot(frame, _snapshotCtx) && frame)
+      _batch.snapshot.assign((const char *)frame.getBuf(), frame.getSize());
+  }
+  for (uint8_t i = 0; i < NOTIFY_SOURCES; i++)
+    _batch.counts[i] += counts[i];
+  _batch.last = last;
+}
+
+uint32_t Notifier::due(void)
+{
+  uint32_t t = now();
+  int32_t wait = (int32_t)(_batch.first + _coalesce_us - t);
+  if (_sentAny)
+  {
+    int32_t limit = (int32_t)(_lastSent + _minInterval_us - t);
+    wait = limit > wait ? limit : wait;
+  }
+  int32_t retry = (int32_t)(_batch.retryAt - t);
+  wait = retry > wait ? retry : wait;
+  return wait > 0 ? wait : 0;
+}
+
+void Notifier::compose(std::string &body, const char **contentType)
+{
+  char content[192];
+  int len = 0;
+  for (uint8_t i = 0; i < NOTIFY_SOURCES; i++)
+  {
+    if (_batch.counts[i] && len < (int)sizeof(content))
+      len += snprintf(content + len, sizeof(content) - len, "%s%s x%u", len ? ", " : "", SOURCE_NAMES[i], _batch.counts[i]);
+  }
+  if (len < (int)sizeof(content))
+    snprintf(content + len, sizeof(content) - len, " over %.1f s", (uint32_t)(_batch.last - _batch.first) / 1e6);
+  char json[320];
+  int jlen = snprintf(json, sizeof(json), "{\"content\":\"%s\",\"username\":\"%s\",\"embeds\":null,\"attachments\":[]}",
+                      content, _name);
+  if (jlen >= (int)sizeof(json))
+    jlen = sizeof(json) - 1;
+  if (_batch.snapshot.empty())
+  {
+    body.assign(json, jlen);
+    *contentType = "application/json";
+    return;
+  }
+
+  // Discord-style upload: the message as payload_json plus the frame as a file part
+  static const char *BOUNDARY = "esp32camNotifyBoundary";
+  body.clear();
+  body.reserve(jlen + _batch.snapshot.size() + 320);
+  body.append("--").append(BOUNDARY).append("\r\nContent-Disposition: form-data; name=\"payload_json\"\r\n"
+                                            "Content-Type: application/json\r\n\r\n");
+  body.append(json, jlen);
+  body.append("\r\n--").append(BOUNDARY).append("\r\nContent-Disposition: form-data; name=\"files[0]\"; "
+                                                "filename=\"snapshot.jpg\"\r\nContent-Type: image/jpeg\r\n\r\n");
+  body.append(_batch.snapshot);
+  body.append("\r\n--").append(BOUNDARY).append("--\r\n");
+  *contentType = "multipart/form-data; boundary=esp32camNotifyBoundary";
+}
+
+void Notifier::deliver(void)
+{
+  std::string body;
+  const char *type;
+  compose(body, &type);
+  uint32_t retryAfter_ms = 0;
+  int code = _transport.post(type, body, &retryAfter_ms);
+  uint32_t t = now();
+  _batch.attempts++;
+  if (code >= 200 && code < 300)
+  {
+    notifyMetrics.messages.add();
+    notifyMetrics.latency.observe(t - _batch.first);
+    if (!_batch.snapshot.empty())
+      notifyMetrics.snapshots.add();
+    _sentAny = true;
+    _lastSent = t;
+    _batch.open = false;
+    _batch.snapshot.clear();
+    return;
+  }
+
+  notifyMetrics.failures.add();
+  if (_batch.attempts >= _maxAttempts || (code >= 400 && code < 500 && code != 429 && code != 408))
+  {
+    // Out of retries, or the webhook rejected the message itself
+    notifyMetrics.dropped.add();
+    _batch.open = false;
+    _batch.snapshot.clear();
+    return;
+  }
+  uint32_t backoff = _retry_us << (_batch.attempts - 1);
+  if (backoff > NOTIFY_RETRY_MAX_MS * 1000u || backoff < _retry_us)
+    backoff = NOTIFY_RETRY_MAX_MS * 1000u;
+  if (retryAfter_ms > NOTIFY_RETRY_MAX_MS)
+    retryAfter_ms = NOTIFY_RETRY_MAX_MS;
+  if (retryAfter_ms * 1000u > backoff)
+    backoff = retryAfter_ms * 1000u; // the server knows better
+  _batch.retryAt = t + backoff;
+}
@@ -0,0 +1,150 @@
+#ifndef NOTIFIER_H_
+#define NOTIFIER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <string>
+#include <Metrics.h>
+#include <FrameRef.h>
+#if defined(ARDUINO)
+  #include <freertos/FreeRTOS.h>
+  #include <freertos/semphr.h>
+  #include "esp_attr.h"
+  #define NOTIFY_ISR_ATTR IRAM_ATTR
+#else
+  #include <mutex>
+  #include <condition_variable>
+  #define NOTIFY_ISR_ATTR
+#endif
+
+#define NOTIFY_COALESCE_MS     250   // events this close to the first one share a message
+#define NOTIFY_MIN_INTERVAL_MS 2000  // webhook rate limit, later events wait and merge
+#define NOTIFY_RETRY_MS        1000  // first retry, doubled per attempt...
+#define NOTIFY_RETRY_MAX_MS    60000 // ...up to this
+#define NOTIFY_MAX_ATTEMPTS    5     // then the batch is dropped
+#define NOTIFY_SNAPSHOT_MAX_MS 1000  // oldest frame worth attaching
+
+// What raised an event, one bit each in a batch
+enum NotifySource
+{
+  NOTIFY_SENSOR, // PIR or any other GPIO interrupt
+  NOTIFY_MOTION, // software motion detection
+  NOTIFY_BUTTON,
+  NOTIFY_MANUAL,
+  NOTIFY_SOURCES
+};
+
+// Sends one finished message. Returns the HTTP status, or a negative value when the request
+// never got an answer. retryAfter_ms may be set on 429 from the Retry-After header.
+class NotifyTransport
+{
+public:
+  virtual ~NotifyTransport() {}
+  virtual int post(const char *contentType, const std::string &body, uint32_t *retryAfter_ms) = 0;
+};
+
+// Wakes the worker; give() is also safe from an interrupt
+class NotifySignal
+{
+public:
+  NotifySignal();
+  ~NotifySignal();
+  void give(void);
+  NOTIFY_ISR_ATTR void giveFromISR(void);
+  bool take(uint32_t timeout_ms); // false on timeout
+
+private:
+#if defined(ARDUINO)
+  SemaphoreHandle_t _sem;
+#else
+  std::mutex _lock;
+  std::condition_variable _cond;
+  bool _given;
+#endif
+};
+
+struct NotifyMetrics
+{
+  NotifyMetrics();
+
+  Histogram latency; // first event of a batch until the webhook accepted it
+  Counter events;
+  Counter messages;  // batches delivered
+  Counter failures;  // attempts that did not get a 2xx
+  Counter dropped;   // batches given up on after NOTIFY_MAX_ATTEMPTS
+  Counter snapshots; // messages that went out with a frame attached
+};
+
+extern NotifyMetrics notifyMetrics;
+
+void writeNotifyMetrics(PromWriter &w);
+
+// Event queue in front of the webhook. post() and postFromISR() only bump atomic counters
+// and wake the worker, so they cost the same from a task or an interrupt. The worker turns
+// whatever accumulated into one message per batch: events inside the coalescing window or
+// behind the rate limit merge, failed sends are retried with exponential backoff, and a
+// recent frame can be attached as a snapshot. The snapshot is copied, so no frame buffer is
+// held while the webhook is slow or down.
+class Notifier
+{
+public:
+  typedef bool (*SnapshotFn)(FrameRef &out, void *ctx);
+
+  Notifier(NotifyTransport &transport);
+
+  void configure(uint32_t coalesce_ms, uint32_t minInterval_ms, uint32_t retry_ms, uint8_t maxAttempts);
+  // Fetches the frame to attach when a batch opens, e.g. the broadcaster's latest one; the
+  // notifier copies it and hands the frame back straight away
+  void onSnapshot(SnapshotFn snapshot, void *ctx);
+  void setName(const char *name); // shown as the sender
+
+  void post(NotifySource source);
+  NOTIFY_ISR_ATTR void postFromISR(NotifySource source);
+
+  // Worker task body, returns after stop()
+  void run(void);
+  void stop(void);
+
+  NOTIFY_ISR_ATTR static uint32_t now(void); // microseconds, wraps; what event stamps are taken with
+
+private:
+  struct Batch
+  {
+    bool open;
+    uint32_t counts[NOTIFY_SOURCES];
+    uint32_t first;    // stamp of the first event
+    uint32_t last;
+    uint32_t opened;   // when the worker picked it up
+    uint32_t retryAt;
+    uint8_t attempts;
+    // Copy of the attached frame, taken as the batch opens. The driver buffer goes back at
+    // once: retries can take minutes and the sensor has only fb_count buffers
+    std::string snapshot;
+  };
+
+  void harvest(void);
+  uint32_t due(void); // microseconds until the batch may go, 0 when now
+  void deliver(void);
+  void compose(std::string &body, const char **contentType);
+
+  NotifyTransport &_transport;
+  NotifySignal _signal;
+  std::atomic<uint32_t> _counts[NOTIFY_SOURCES];
+  std::atomic<uint32_t> _first; // 0 while nothing is pending
+  std::atomic<uint32_t> _last;
+  std::atomic<bool> _stopping;
+
+  SnapshotFn _snapshot;
+  void *_snapshotCtx;
+  const char *_name;
+  uint32_t _coalesce_us;
+  uint32_t _minInterval_us;
+  uint32_t _retry_us;
+  uint8_t _maxAttempts;
+  uint32_t _lastSent;
+  bool _sentAny;
+  Batch _batch;
+};
+
+#endif // NOTIFIER_H_
@@ -1,24 +1,89 @@
 #include <OLED.h>
+#include <string.h>
+
+// Wire's transfer buffer, the most one I2C write can carry
+#ifdef I2C_BUFFER_LENGTH
+#define OLED_WIRE_BUFFER I2C_BUFFER_LENGTH
+#else
+#define OLED_WIRE_BUFFER 32
+#endif
+
 Adafruit_SSD1306 oled;
 uint8_t SCREEN_WIDTH, SCREEN_HEIGHT, MAX_CHARS;
 uint8_t dynamicUpdateRegion[2];
+OledPanel *panel = NULL;
+OledBus *panelBus = NULL;
 
-void initializeDisplay(uint8_t width, uint8_t height, uint8_t maxchars)
+WireOledBus::WireOledBus(TwoWire &wire, uint8_t address, uint32_t clockDuring, uint32_t clockAfter)
+  : _wire(wire), _address(address), _clockDuring(clockDuring), _clockAfter(clockAfter)
 {
-    SCREEN_WIDTH = width; SCREEN_HEIGHT = height; MAX_CHARS = maxchars;
 }
 
-// Overloading * operator to multiply strings, similar to Python
-String operator * (String a, unsigned int b) {
-    String output = "";
-    while (b--) {
-        output += a;
+void WireOledBus::start(void)
+{
+  _wire.setClock(_clockDuring);
+}
+
+void WireOledBus::finish(void)
+{
+  _wire.setClock(_clockAfter);
+}
+
+bool WireOledBus::transfer(uint8_t control, const uint8_t *bytes, size_t len)
+{
+  // One byte of the Wire buffer goes to the control byte
+  const size_t room = OLED_WIRE_BUFFER - 1;
+  while (len)
+  {
+    size_t n = len < room ? len : room;
+    _wire.beginTransmission(_address);
+    _wire.write(control);
+    _wire.write(bytes, n);
+    if (_wire.endTransmission() != 0)
+      return false;
+    bytes += n;
+    len -= n;
+  }
+  return true;
+}
+
+bool WireOledBus::commands(const uint8_t *cmd, size_t len)
+{
+  return transfer(0x00, cmd, len);
+}
+
+bool WireOledBus::data(const uint8_t *data, size_t len)
+{
+  return transfer(0x40, data, len);
+}
+
+void initializeDisplay(uint8_t width, uint8_t height, uint8_t maxchars, OledBus *bus)
+{
+    SCREEN_WIDTH = width; SCREEN_HEIGHT = height; MAX_CHARS = maxchars;
+    if (bus && !panel)
+    {
+        panel = new OledPanel(width, height);
+        if (!panel->begin())
+        {
+            delete panel;
+            panel = NULL;
+        }
     }
-    return output;
+    panelBus = panel ? bus : NULL;
+}
+
+// Send the framebuffer: only what changed since the last push when a panel bus is set up
+void pushDisplay(Adafruit_SSD1306 &oled)
+{
+  if (panelBus && panel->flush(*panelBus, oled.getBuffer()) >= 0)
+    return;
+  oled.display();
+  if (panel)
+    panel->invalidate();
 }
 
 // Draw a horizontal bar with 2px vertical padding and appropriately re-align the cursor
-void hBar(Adafruit_SSD1306 oled)
+void hBar(Adafruit_SSD1306 &oled)
 {
   int prevX = oled.getCursorX();
   int prevY = oled.getCursorY();
@@ -26,82 +91,56 @@ void hBar(Adafruit_SSD1306 oled)
   oled.setCursor(prevX, prevY + 5);
 }
 
-// Return text spaced apart in the 21-character horizontal range of the 128x64 SSD1306
-String splitAlign(String text1, String text2)
-{
-  if (text1.length()+text2.length() >= 20)
-    return "";
-  return String(text1+String(" ")*(unsigned int)(21-(text1.length()+text2.length()))+text2);
-}
-
 // Print text horizontally center-aligned, optionally print it vertically center aligned between the cursor position at call and the edge of the screen
-void printCenteredText(Adafruit_SSD1306 oled, String text, bool middle)
+void printCenteredText(Adafruit_SSD1306 &oled, const char *text, uint8_t size, bool middle)
 {
-  int16_t centercursorx, centercursory; uint16_t centerwidth, centerheight;
-  oled.getTextBounds(text, 0, 0, &centercursorx, &centercursory, &centerwidth, &centerheight);
-  oled.setCursor((SCREEN_WIDTH-centerwidth)/2, (middle) ? ((oled.getCursorY()+SCREEN_HEIGHT-centerheight)/2) : oled.getCursorY());
+  // Default font cells, no getTextBounds() pass over the text
+  int16_t width = textWidth(strlen(text), size), height = textHeight(size);
+  oled.setCursor((SCREEN_WIDTH-width)/2, (middle) ? ((oled.getCursorY()+SCREEN_HEIGHT-height)/2) : oled.getCursorY());
   oled.println(text);
 }
 
 // Render static properties and return the cursor position to an array
-void renderStaticProperties(Adafruit_SSD1306 oled, uint8_t qualityPreset, const char* mdnsname)
+void renderStaticProperties(Adafruit_SSD1306 &oled, uint8_t qualityPreset, const char* mdnsname)
 {
   oled.clearDisplay();
   oled.setCursor(0,0);
   oled.setTextSize(1);
-  printCenteredText(oled, splitAlign(resToText(qualityPreset), mdnsname), false);
+  TextLine line(MAX_CHARS);
+  printCenteredText(oled, splitAlign(line, resToText(qualityPreset), mdnsname), 1, false);
   hBar(oled);
   dynamicUpdateRegion[0] = oled.getCursorX();
   dynamicUpdateRegion[1] = oled.getCursorY();
-  oled.display();
+  pushDisplay(oled);
 }
 
 // Update dynamic properties
-void updateStats(Adafruit_SSD1306 oled, uint8_t clientCount, uint8_t uptimeHours, uint16_t uptimeDays, uint8_t wifiStatus)
+void updateStats(Adafruit_SSD1306 &oled, uint8_t clientCount, uint8_t uptimeHours, uint16_t uptimeDays, uint8_t wifiStatus)
 {
   // CLear dynamic update region
   oled.fillRect(0, dynamicUpdateRegion[1], SCREEN_WIDTH-1, SCREEN_HEIGHT-1, BLACK);
   oled.setCursor(dynamicUpdateRegion[0],dynamicUpdateRegion[1]);
   // Print client count and uptime
   oled.setTextSize(1);
-  printCenteredText(oled, splitAlign("Clients:",String(clientCount)), false);
+  // Lines are laid out in fixed buffers on the stack, a refresh leaves the heap alone
+  TextLine line(MAX_CHARS), value(MAX_CHARS);
+  value.append((uint32_t)clientCount);
+  printCenteredText(oled, splitAlign(line, "Clients:", value.c_str()), 1, false);
   hBar(oled);
-  printCenteredText(oled, splitAlign("Uptime:",(uptimeDays) ? String(uptimeDays)+" days" : String(uptimeHours)+" hours"), false);
+  value.clear();
+  if (uptimeDays)
+    value.append((uint32_t)uptimeDays).append(" days");
+  else
+    value.append((uint32_t)uptimeHours).append(" hours");
+  printCenteredText(oled, splitAlign(line, "Uptime:", value.c_str()), 1, false);
   // Print large status
   oled.setTextSize(2);
-  printCenteredText(oled, (wifiStatus) ? "ONLINE" : "OFFLINE", true);
-  oled.display();
+  printCenteredText(oled, (wifiStatus) ? "ONLINE" : "OFFLINE", 2, true);
+  pushDisplay(oled);
 }
 
-String resToText(uint8_t qualityPreset)
+// Resolution of a framesize_t value, from the table in TextLayout.cpp
+const char *resToText(uint8_t qualityPreset)
 {
-  /*
-    Possible values (lowest to highest resolution possible, corresponding to the enum framesize_t:
-      5  FRAMESIZE_QVGA,     // 320x240
-      8  FRAMESIZE_VGA,      // 640x480
-      9  FRAMESIZE_SVGA,     // 800x600
-      10 FRAMESIZE_XGA,      // 1024x768
-      11 FRAMESIZE_HD,       // 1280x720
-      12 FRAMESIZE_SXGA,     // 1280x1024
-      13 FRAMESIZE_UXGA,     // 1600x1200
-  */
-  switch(qualityPreset)
-  {
-    case 5:
-      return "320x240";
-    case 8:
-      return "640x480";
-    case 9:
-      return "800x600";
-    case 10:
-      return "1024x768";
-    case 11:
-      return "1280x720";
-    case 12:
-      return "1280x1024";
-    case 13:
-      return "1600x1200";
-    default:
-      return "HUH";
-  }
-}
\ No newline at end of file
+  return frameSizeText(qualityPreset);
+}
@@ -1,15 +1,38 @@
 #include <Adafruit_SSD1306.h>
 #include <Adafruit_GFX.h>
 #include <Arduino.h>
-#include <String.h>
+#include <Wire.h>
+#include <OledPanel.h>
+#include <TextLayout.h>
+
+// SSD1306 over I2C for OledPanel: the control byte and at most the Wire buffer's worth of bytes
+// per transfer, at the fast-mode clock the Adafruit driver also switches to while it draws
+class WireOledBus : public OledBus
+{
+public:
+  WireOledBus(TwoWire &wire, uint8_t address, uint32_t clockDuring = 400000, uint32_t clockAfter = 100000);
+  void start(void);
+  void finish(void);
+  bool commands(const uint8_t *cmd, size_t len);
+  bool data(const uint8_t *data, size_t len);
+
+private:
+  bool transfer(uint8_t control, const uint8_t *bytes, size_t len);
+
+  TwoWire &_wire;
+  uint8_t _address;
+  uint32_t _clockDuring;
+  uint32_t _clockAfter;
+};
 
 // External
-void initializeDisplay(uint8_t width, uint8_t height, uint8_t maxchars);
-void renderStaticProperties(Adafruit_SSD1306 oled, uint8_t qualityPreset, const char* mdnsname);
-void updateStats(Adafruit_SSD1306 oled, uint8_t clientCount, uint8_t uptimeHours, uint16_t uptimeDays, uint8_t wifiStatus);
+// With a bus, refreshes only send the bytes that changed; without, oled.display() sends them all
+void initializeDisplay(uint8_t width, uint8_t height, uint8_t maxchars, OledBus *bus = NULL);
+void renderStaticProperties(Adafruit_SSD1306 &oled, uint8_t qualityPreset, const char* mdnsname);
+void updateStats(Adafruit_SSD1306 &oled, uint8_t clientCount, uint8_t uptimeHours, uint16_t uptimeDays, uint8_t wifiStatus);
 
 // Internal
-void hBar(Adafruit_SSD1306 oled);
-String splitAlign(String text1, String);
-void printCenteredText(Adafruit_SSD1306 oled, String text, bool middle);
-String resToText(uint8_t qualityPreset);
\ No newline at end of file
+void hBar(Adafruit_SSD1306 &oled);
+void printCenteredText(Adafruit_SSD1306 &oled, const char *text, uint8_t size, bool middle);
+void pushDisplay(Adafruit_SSD1306 &oled);
+const char *resToText(uint8_t qualityPreset);
\ No newline at end of file
@@ -0,0 +1,78 @@
+#include "FrameRef.h"
+#include <chrono>
+
+FrameRef::FrameRef(const FrameRef &other) : _slot(other._slot)
+{
+  if (_slot)
+    _slot->refs.fetch_add(1);
+}
+
+FrameRef &FrameRef::operator=(const FrameRef &other)
+{
+  if (other._slot)
+    other._slot->refs.fetch_add(1);
+  reset();
+  _slot = other._slot;
+  return *this;
+}
+
+void FrameRef::reset(void)
+{
+  FrameSlot *slot = _slot;
+  _slot = NULL;
+  if (slot && slot->refs.fetch_sub(1) == 1)
+    slot->pool->recycle(slot);
+}
+
+FramePool::FramePool(ReleaseFn release, void *ctx) : _release(release), _ctx(ctx), _seq(0), _outstanding(0)
+{
+  for (int i = 0; i < FRAME_POOL_SLOTS; i++)
+  {
+    _slots[i].pool = this;
+    _slots[i].refs.store(0);
+    _slots[i].inUse.store(false);
+  }
+}
+
+FrameRef FramePool::wrap(const uint8_t *buf, size_t len, uint16_t width, uint16_t height, uint64_t timestamp_us, void *opaque)
+{
+  for (int i = 0; i < FRAME_POOL_SLOTS; i++)
+  {
+    FrameSlot &slot = _slots[i];
+    bool expected = false;
+    if (!slot.inUse.compare_exchange_strong(expected, true))
+      continue;
+    slot.buf = buf;
+    slot.len = len;
+    slot.width = width;
+    slot.height = height;
+    slot.timestamp_us = timestamp_us;
+    slot.opaque = opaque;
+    slot.seq = _seq.fetch_add(1) + 1;
+    slot.refs.store(1);
+    _outstanding.fetch_add(1);
+    return FrameRef(&slot);
+  }
+  // More frames alive than slots, hand the buffer straight back rather than leak it
+  _release(_ctx, opaque);
+  return FrameRef();
+}
+
+void FramePool::recycle(FrameSlot *slot)
+{
+  _release(_ctx, slot->opaque);
+  slot->buf = NULL;
+  slot->opaque = NULL;
+  slot->inUse.store(false);
+  if (_outstanding.fetch_sub(1) == 1)
+  {
+    std::lock_guard<std::mutex> guard(_lock);
+    _drained.notify_all();
+  }
+}
+
+bool FramePool::drain(uint32_t timeout_ms)
+{
+  std::unique_lock<std::mutex> guard(_lock);
+  return _drained.wait_for(guard, std::chrono::milliseconds(timeout_ms), [this] { return _outstanding.load() == 0; });
+}
@@ -0,0 +1,92 @@
+#ifndef FRAMEREF_H_
+#define FRAMEREF_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+// Upper bound on frames alive at once, comfortably above any sane fb_count
+#define FRAME_POOL_SLOTS 8
+
+class FramePool;
+
+// Bookkeeping for one driver buffer while it is out of the driver's hands
+struct FrameSlot
+{
+  const uint8_t *buf;
+  size_t len;
+  uint16_t width;
+  uint16_t height;
+  uint32_t seq;
+  uint64_t timestamp_us;
+  void *opaque; // whatever the release function needs (the camera_fb_t on the device)
+  FramePool *pool;
+  std::atomic<uint16_t> refs;
+  std::atomic<bool> inUse;
+};
+
+// Counted reference to a captured frame. Copies share the same bytes; the buffer goes back
+// to its owner when the last copy is dropped, so readers never race the driver.
+class FrameRef
+{
+public:
+  FrameRef() : _slot(NULL) {}
+  FrameRef(const FrameRef &other);
+  FrameRef &operator=(const FrameRef &other);
+  ~FrameRef() { reset(); }
+
+  void reset(void);
+  operator bool() const { return _slot != NULL; }
+
+  const uint8_t *getBuf(void) const { return _slot ? _slot->buf : NULL; }
+  size_t getSize(void) const { return _slot ? _slot->len : 0; }
+  int getWidth(void) const { return _slot ? _slot->width : 0; }
+  int getHeight(void) const { return _slot ? _slot->height : 0; }
+  uint32_t getSeq(void) const { return _slot ? _slot->seq : 0; }
+  uint64_t getTimestamp(void) const { return _slot ? _slot->timestamp_us : 0; }
+
+private:
+  friend class FramePool;
+  explicit FrameRef(FrameSlot *slot) : _slot(slot) {}
+  FrameSlot *_slot;
+};
+
+// Fixed set of slots handing out FrameRefs, no allocation after construction
+class FramePool
+{
+public:
+  typedef void (*ReleaseFn)(void *ctx, void *opaque);
+
+  FramePool(ReleaseFn release, void *ctx);
+
+  // Takes ownership of a buffer; returns an empty ref (and releases the buffer) when out of slots
+  FrameRef wrap(const uint8_t *buf, size_t len, uint16_t width, uint16_t height, uint64_t timestamp_us, void *opaque);
+
+  uint8_t outstanding(void) const { return _outstanding.load(); }
+  // Blocks until every handed-out frame is back with its owner, false on timeout
+  bool drain(uint32_t timeout_ms);
+
+private:
+  friend class FrameRef;
+  void recycle(FrameSlot *slot);
+
+  FrameSlot _slots[FRAME_POOL_SLOTS];
+  ReleaseFn _release;
+  void *_ctx;
+  std::atomic<uint32_t> _seq;
+  std::atomic<uint8_t> _outstanding;
+  std::mutex _lock;
+  std::condition_variable _drained;
+};
+
+// Anything that can produce frames: the camera on the device, a synthetic source on the host
+class FrameSource
+{
+public:
+  virtual ~FrameSource() {}
+  virtual FrameRef capture(void) = 0; // blocks until a frame is available
+};
+
+#endif // FRAMEREF_H_
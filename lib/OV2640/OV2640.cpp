@@ -101,58 +101,90 @@ camera_config_t esp32cam_ttgo_t_config{
     .fb_count = 2       // if more than one i2s runs in continous mode.  Use only with jpeg
 };
 
-void OV2640::run(void)
+// Hands a frame buffer back to the driver once its last FrameRef is gone
+static void release_fb(void *ctx, void *opaque)
 {
-    if (fb)
-        //return the frame buffer back to the driver for reuse
-        esp_camera_fb_return(fb);
+    esp_camera_fb_return((camera_fb_t *)opaque);
+}
 
-    fb = esp_camera_fb_get();
+OV2640::OV2640() : pool(release_fb, NULL)
+{
+    _frame_size = FRAMESIZE_QVGA;
 }
 
-void OV2640::runIfNeeded(void)
+FrameRef OV2640::capture(void)
 {
+    camera_fb_t *fb = esp_camera_fb_get();
     if (!fb)
+        return FrameRef(); // FIXME - this shouldn't be possible but apparently the new cam board returns null sometimes?
+
+    uint64_t ts = (uint64_t)fb->timestamp.tv_sec * 1000000ULL + fb->timestamp.tv_usec;
+    return pool.wrap(fb->buf, fb->len, fb->width, fb->height, ts, fb);
+}
+
+void OV2640::run(void)
+{
+    // drop our reference first so a single-buffer config can't deadlock; readers still
+    // holding the old frame keep it away from the driver until they are done
+    frame.reset();
+    frame = capture();
+}
+
+void OV2640::runIfNeeded(void)
+{
+    if (!frame)
         run();
 }
 
+FrameRef OV2640::getFrame(void)
+{
+    runIfNeeded();
+    return frame;
+}
+
 int OV2640::getWidth(void)
 {
     runIfNeeded();
-    return fb->width;
+    return frame.getWidth();
 }
 
 int OV2640::getHeight(void)
 {
     runIfNeeded();
-    return fb->height;
+    return frame.getHeight();
 }
 
 size_t OV2640::getSize(void)
 {
     runIfNeeded();
-    if (!fb)
-        return 0; // FIXME - this shouldn't be possible but apparently the new cam board returns null sometimes?
-    return fb->len;
+    return frame.getSize();
 }
 
 uint8_t *OV2640::getfb(void)
 {
     runIfNeeded();
-    if (!fb)
-        return NULL; // FIXME - this shouldn't be possible but apparently the new cam board returns null sometimes?
+    return (uint8_t *)frame.getBuf();
+}
 
-    return fb->buf;
+uint8_t OV2640::framesInFlight(void)
+{
+    return pool.outstanding();
+}
+
+bool OV2640::drain(uint32_t timeout_ms)
+{
+    frame.reset();
+    return pool.drain(timeout_ms);
 }
 
 framesize_t OV2640::getFrameSize(void)
 {
-    return _cam_config.frame_size;
+    return _frame_size;
 }
 
 void OV2640::setFrameSize(framesize_t size)
 {
-    _cam_config.frame_size = size;
+    _cam_config.frame_size = _frame_size = size;
 }
 
 pixformat_t OV2640::getPixelFormat(void)
@@ -180,6 +212,7 @@ esp_err_t OV2640::init(camera_config_t config)
 {
     memset(&_cam_config, 0, sizeof(_cam_config));
     memcpy(&_cam_config, &config, sizeof(config));
+    _frame_size = config.frame_size;
 
     esp_err_t err = esp_camera_init(&_cam_config);
     if (err != ESP_OK)
@@ -191,3 +224,28 @@ esp_err_t OV2640::init(camera_config_t config)
 
     return ESP_OK;
 }
+
+esp_err_t OV2640::reconfigure(const camera_config_t &config, bool *reinit)
+{
+    // Buffers were allocated for _cam_config.frame_size, anything up to that is a register write
+    bool live = config.fb_count == _cam_config.fb_count && config.frame_size <= _cam_config.frame_size &&
+                config.pixel_format == _cam_config.pixel_format;
+    if (reinit)
+        *reinit = !live;
+    if (live)
+    {
+        sensor_t *s = esp_camera_sensor_get();
+        if (!s || s->set_framesize(s, config.frame_size) != 0 || s->set_quality(s, config.jpeg_quality) != 0)
+            return ESP_FAIL;
+        _cam_config.jpeg_quality = config.jpeg_quality;
+        _frame_size = config.frame_size; // _cam_config keeps the size the buffers were allocated for
+        return ESP_OK;
+    }
+
+    camera_config_t previous = _cam_config;
+    esp_camera_deinit();
+    esp_err_t err = init(config);
+    if (err != ESP_OK && init(previous) != ESP_OK)
+        ESP_LOGE(TAG, "Camera could not be restored after a failed reconfiguration");
+    return err;
+}
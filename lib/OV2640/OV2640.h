@@ -1,25 +1,38 @@
 #ifndef OV2640_H_
 #define OV2640_H_
 
-#include <Arduino.h>
-#include <pgmspace.h>
+#if defined(ARDUINO)
+  #include <Arduino.h>
+  #include <pgmspace.h>
+  #include "esp_log.h"
+  #include "esp_attr.h"
+#endif
 #include <stdio.h>
-#include "esp_log.h"
-#include "esp_attr.h"
-#include "esp_camera.h"
+#include <string.h>
+#include "esp_camera.h" // the native env replays JPEG files through a stand-in (src/host/shim)
+#include "FrameRef.h"
 
 extern camera_config_t esp32cam_config, esp32cam_aithinker_config, esp32cam_ttgo_t_config;
 
-class OV2640
+class OV2640 : public FrameSource
 {
 public:
-    OV2640(){
-        fb = NULL;
-    };
+    OV2640();
     ~OV2640(){
     };
     esp_err_t init(camera_config_t config);
+    // Switches to a new config, live through the sensor while the frame buffers still fit,
+    // otherwise by re-initialising the driver. Every frame must be drained first.
+    esp_err_t reconfigure(const camera_config_t &config, bool *reinit = NULL);
+
+    // Zero-copy frame handles: the buffer returns to the driver when the last FrameRef drops
+    FrameRef capture(void);
+    uint8_t framesInFlight(void);
+    bool drain(uint32_t timeout_ms); // wait for every outstanding frame to come back
+
+    // Single "current frame" API, kept alive by its own FrameRef
     void run(void);
+    FrameRef getFrame(void);
     size_t getSize(void);
     uint8_t *getfb(void);
     int getWidth(void);
@@ -33,11 +46,12 @@ public:
 private:
     void runIfNeeded(); // grab a frame if we don't already have one
 
-    // camera_framesize_t _frame_size;
     // camera_pixelformat_t _pixel_format;
-    camera_config_t _cam_config;
+    camera_config_t _cam_config; // as initialised, frame_size is what the buffers hold
+    framesize_t _frame_size;     // what the sensor delivers, smaller after a live reconfigure
 
-    camera_fb_t *fb;
+    FramePool pool;
+    FrameRef frame;
 };
 
 #endif //OV2640_H_
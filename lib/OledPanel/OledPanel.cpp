@@ -0,0 +1,138 @@
+#include "OledPanel.h"
+#include <stdlib.h>
+#include <string.h>
+
+OledPanel::OledPanel(uint8_t width, uint8_t height)
+{
+  _width = width;
+  _pages = (height + OLED_PAGE_ROWS - 1) / OLED_PAGE_ROWS;
+  _shadow = NULL;
+  _valid = false;
+  _windows = 0;
+}
+
+OledPanel::~OledPanel()
+{
+  free(_shadow);
+}
+
+bool OledPanel::begin(void)
+{
+  if (!_shadow)
+    _shadow = (uint8_t *)malloc((size_t)_width * _pages);
+  _valid = false;
+  return _shadow != NULL;
+}
+
+void OledPanel::invalidate(void)
+{
+  _valid = false;
+}
+
+// One window, pages p0..p1 by columns x0..x1: the panel wraps to the next page at x1
+bool OledPanel::send(OledBus &bus, const uint8_t *frame, uint8_t x0, uint8_t x1, uint8_t p0, uint8_t p1)
+{
+  const uint8_t cmd[] = {OLED_COLUMNADDR, x0, x1, OLED_PAGEADDR, p0, p1};
+  if (!bus.commands(cmd, sizeof(cmd)))
+    return false;
+  for (uint8_t p = p0; p <= p1; p++)
+  {
+    size_t at = (size_t)p * _width + x0;
+    if (!bus.data(frame + at, x1 - x0 + 1))
+      return false;
+    memcpy(_shadow + at, frame + at, x1 - x0 + 1);
+  }
+  _windows++;
+  return true;
+}
+
+int OledPanel::flush(OledBus &bus, const uint8_t *frame)
+{
+  _windows = 0;
+  if (!_shadow)
+    return -1;
+  int sent = 0;
+  bool started = false;
+  // A window waiting to see whether the next page changed the same columns
+  int wx0 = -1, wx1 = -1, wp0 = 0, wp1 = 0;
+  for (int p = 0; p <= _pages; p++)
+  {
+    // Changed column runs of this page, gaps cheaper than a window bridged
+    int runs[2 * 8];
+    int n = 0;
+    if (p < _pages)
+    {
+      const uint8_t *now = frame + (size_t)p * _width;
+      const uint8_t *was = _shadow + (size_t)p * _width;
+      int last = -1;
+      for (int x = 0; x < _width; x++)
+      {
+        if (_valid && now[x] == was[x])
+          continue;
+        if (n && x - last - 1 <= OLED_WINDOW_COST)
+        {
+          runs[n - 1] = x;
+        }
+        else if (n < (int)(sizeof(runs) / sizeof(runs[0])))
+        {
+          runs[n++] = x;
+          runs[n++] = x;
+        }
+        else
+        {
+          runs[n - 1] = x; // out of slots, the last run takes the rest
+        }
+        last = x;
+      }
+    }
+    // Same single run as the page above: grow the waiting window down
+    if (n == 2 && wx0 == runs[0] && wx1 == runs[1] && wp1 == p - 1)
+    {
+      wp1 = p;
+      continue;
+    }
+    if (wx0 >= 0)
+    {
+      if (!started)
+      {
+        bus.start();
+        started = true;
+      }
+      if (!send(bus, frame, wx0, wx1, wp0, wp1))
+      {
+        bus.finish();
+        _valid = false;
+        return -1;
+      }
+      sent += (wx1 - wx0 + 1) * (wp1 - wp0 + 1);
+      wx0 = -1;
+    }
+    for (int i = 0; i < n; i += 2)
+    {
+      if (i + 2 == n)
+      {
+        // The last run may continue on the next page
+        wx0 = runs[i];
+        wx1 = runs[i + 1];
+        wp0 = wp1 = p;
+        break;
+      }
+      if (!started)
+      {
+        bus.start();
+        started = true;
+      }
+      if (!send(bus, frame, runs[i], runs[i + 1], p, p))
+      {
+        bus.finish();
+        _valid = false;
+        return -1;
+      }
+      sent += runs[i + 1] - runs[i] + 1;
+    }
+  }
+  if (started)
+    bus.finish();
+  _valid = true;
+  return sent;
+}
@@ -0,0 +1,55 @@
+#ifndef OLED_PANEL_H_
+#define OLED_PANEL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define OLED_PAGE_ROWS   8  // one framebuffer byte is 8 vertical pixels of a page
+#define OLED_WINDOW_COST 10 // bus bytes to address a new window, unchanged columns up to this are sent instead
+
+// SSD1306 command bytes for windowed writes in horizontal addressing mode
+#define OLED_COLUMNADDR 0x21
+#define OLED_PAGEADDR   0x22
+
+// The wire to the panel: command bytes and pixel data. On the device it is an I2C transfer
+// with the control byte in front (0x00 for commands, 0x40 for data), split to fit the bus
+// driver's buffer; on the host a mock that counts what would have gone out.
+class OledBus
+{
+public:
+  virtual ~OledBus() {}
+  virtual void start(void) {}  // before the first transfer of a flush, e.g. raise the clock
+  virtual void finish(void) {} // after the last one
+  virtual bool commands(const uint8_t *cmd, size_t len) = 0;
+  virtual bool data(const uint8_t *data, size_t len) = 0;
+};
+
+// Sends a framebuffer (Adafruit_SSD1306::getBuffer() layout: page by page, one byte per
+// column) to the panel as partial updates. A shadow of what the panel shows is compared page
+// by page; the columns that changed become address windows, neighbouring changes are joined
+// when the gap costs less than a new window, and the same columns changed on consecutive
+// pages go out as one window. A refresh that changes nothing sends nothing.
+class OledPanel
+{
+public:
+  OledPanel(uint8_t width, uint8_t height);
+  ~OledPanel();
+
+  bool begin(void); // allocates the shadow
+  void invalidate(void); // panel content unknown (reset, power), the next flush sends it all
+  // Returns the pixel bytes sent, -1 when the bus failed (the panel is then invalidated)
+  int flush(OledBus &bus, const uint8_t *frame);
+
+  uint32_t windows(void) const { return _windows; } // of the last flush
+
+private:
+  bool send(OledBus &bus, const uint8_t *frame, uint8_t x0, uint8_t x1, uint8_t p0, uint8_t p1);
+
+  uint8_t _width;
+  uint8_t _pages;
+  uint8_t *_shadow;
+  bool _valid;
+  uint32_t _windows;
+};
+
+#endif // OLED_PANEL_H_
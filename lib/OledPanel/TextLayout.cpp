@@ -0,0 +1,123 @@
+#include "TextLayout.h"
+#include <string.h>
+#include "esp_camera.h"
+
+TextLine::TextLine(uint8_t columns)
+{
+  _columns = columns < TEXT_LINE_MAX ? columns : TEXT_LINE_MAX;
+  clear();
+}
+
+void TextLine::clear(void)
+{
+  _len = 0;
+  _buf[0] = '\0';
+  _truncated = false;
+}
+
+TextLine &TextLine::append(const char *text, size_t len)
+{
+  if (len > (size_t)(_columns - _len))
+  {
+    len = _columns - _len;
+    _truncated = true;
+  }
+  memcpy(_buf + _len, text, len);
+  _len += len;
+  _buf[_len] = '\0';
+  return *this;
+}
+
+TextLine &TextLine::append(const char *text)
+{
+  return append(text, strlen(text));
+}
+
+TextLine &TextLine::append(uint32_t value)
+{
+  char digits[10];
+  size_t n = 0;
+  do
+  {
+    digits[sizeof(digits) - ++n] = '0' + value % 10;
+    value /= 10;
+  } while (value);
+  return append(digits + sizeof(digits) - n, n);
+}
+
+TextLine &TextLine::pad(char c, size_t count)
+{
+  if (count > (size_t)(_columns - _len))
+  {
+    count = _columns - _len;
+    _truncated = true;
+  }
+  memset(_buf + _len, c, count);
+  _len += count;
+  _buf[_len] = '\0';
+  return *this;
+}
+
+TextLine &TextLine::align(TextAlign align, uint8_t width)
+{
+  if (width > _columns)
+    width = _columns;
+  if (_len >= width || align == ALIGN_LEFT)
+    return pad(' ', _len < width ? width - _len : 0);
+  size_t before = align == ALIGN_RIGHT ? width - _len : (width - _len) / 2;
+  memmove(_buf + before, _buf, _len);
+  memset(_buf, ' ', before);
+  _len += before;
+  _buf[_len] = '\0';
+  return pad(' ', width - _len);
+}
+
+const char *splitAlign(TextLine &line, const char *left, const char *right)
+{
+  size_t l = strlen(left), r = strlen(right);
+  size_t columns = line.columns();
+  line.clear();
+  if (l + 2 > columns)
+    l = columns > 2 ? columns - 2 : 0;
+  if (l + r + 1 > columns)
+    r = columns - l - 1;
+  line.append(left, l).pad(' ', columns - l - r).append(right, r);
+  return line.c_str();
+}
+
+// Frame sizes up to the OV2640's largest, in framesize_t order; the text comes from the same
+// numbers as the dimensions so the two can't drift apart
+#define FRAMESIZE_LIST(X) \
+  X(FRAMESIZE_96X96, 96, 96) \
+  X(FRAMESIZE_QQVGA, 160, 120) \
+  X(FRAMESIZE_QCIF, 176, 144) \
+  X(FRAMESIZE_HQVGA, 240, 176) \
+  X(FRAMESIZE_240X240, 240, 240) \
+  X(FRAMESIZE_QVGA, 320, 240) \
+  X(FRAMESIZE_CIF, 400, 296) \
+  X(FRAMESIZE_HVGA, 480, 320) \
+  X(FRAMESIZE_VGA, 640, 480) \
+  X(FRAMESIZE_SVGA, 800, 600) \
+  X(FRAMESIZE_XGA, 1024, 768) \
+  X(FRAMESIZE_HD, 1280, 720) \
+  X(FRAMESIZE_SXGA, 1280, 1024) \
+  X(FRAMESIZE_UXGA, 1600, 1200)
+
+#define FRAMESIZE_TEXT(size, w, h) #w "x" #h,
+#define FRAMESIZE_VALUE(size, w, h) size,
+
+static const char frameSizeTexts[][10] = {FRAMESIZE_LIST(FRAMESIZE_TEXT)};
+static constexpr framesize_t frameSizeValues[] = {FRAMESIZE_LIST(FRAMESIZE_VALUE)};
+
+// Every entry sits at its own enum value
+static constexpr bool inOrder(size_t i)
+{
+  return i == sizeof(frameSizeValues) / sizeof(frameSizeValues[0]) || (frameSizeValues[i] == (framesize_t)i && inOrder(i + 1));
+}
+static_assert(sizeof(frameSizeTexts) / sizeof(frameSizeTexts[0]) == FRAMESIZE_UXGA + 1, "a frame size is missing");
+static_assert(inOrder(0), "frame sizes out of framesize_t order");
+
+const char *frameSizeText(uint8_t framesize)
+{
+  return framesize < sizeof(frameSizeTexts) / sizeof(frameSizeTexts[0]) ? frameSizeTexts[framesize] : "HUH";
+}
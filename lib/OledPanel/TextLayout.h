@@ -0,0 +1,60 @@
+#ifndef TEXT_LAYOUT_H_
+#define TEXT_LAYOUT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Cell of the default Adafruit GFX font (5x7 glyphs plus a column and a row of spacing), so
+// text extents are known without asking the driver
+#define GLYPH_WIDTH   6
+#define GLYPH_HEIGHT  8
+#define TEXT_LINE_MAX 32 // characters a TextLine holds
+
+// Pixel extent of chars characters at text size size
+inline int16_t textWidth(size_t chars, uint8_t size) { return (int16_t)(chars * GLYPH_WIDTH * size); }
+inline int16_t textHeight(uint8_t size) { return (int16_t)(GLYPH_HEIGHT * size); }
+// Characters that fit across width pixels
+inline uint8_t textColumns(int16_t width, uint8_t size) { return (uint8_t)(width / (GLYPH_WIDTH * size)); }
+
+enum TextAlign
+{
+  ALIGN_LEFT,
+  ALIGN_CENTER,
+  ALIGN_RIGHT
+};
+
+// One line of screen text in a fixed buffer, for building status lines without String
+// temporaries. Appends past the line's columns are cut off; c_str() is always terminated.
+class TextLine
+{
+public:
+  TextLine(uint8_t columns = TEXT_LINE_MAX);
+
+  void clear(void);
+  TextLine &append(const char *text);
+  TextLine &append(const char *text, size_t len);
+  TextLine &append(uint32_t value);
+  TextLine &pad(char c, size_t count);
+  // Pad with spaces to width characters, text placed as align says
+  TextLine &align(TextAlign align, uint8_t width);
+
+  const char *c_str(void) const { return _buf; }
+  uint8_t length(void) const { return _len; }
+  uint8_t columns(void) const { return _columns; }
+  bool truncated(void) const { return _truncated; }
+
+private:
+  char _buf[TEXT_LINE_MAX + 1];
+  uint8_t _len;
+  uint8_t _columns;
+  bool _truncated;
+};
+
+// left at the start of the line and right at its end, spaces between. When both don't fit
+// the right text is cut (then the left) so that one space still separates them.
+const char *splitAlign(TextLine &line, const char *left, const char *right);
+
+// "800x600" for FRAMESIZE_SVGA and so on, "HUH" for values the table doesn't know
+const char *frameSizeText(uint8_t framesize);
+
+#endif // TEXT_LAYOUT_H_
@@ -0,0 +1,359 @@
+#include "DeltaPatch.h"
+#include <string.h>
+
+static uint32_t get32(const uint8_t *p)
+{
+  return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+DeltaTarget::DeltaTarget(OtaTarget &flash, OtaSource &running) : _flash(flash), _running(running)
+{
+  _mode = SNIFF;
+  _step = HEADER;
+  _error = NULL;
+  _flashOpen = false;
+  _size = 0;
+  _headerFill = 0;
+  _oldSize = _newSize = 0;
+  _var = 0;
+  _shift = 0;
+  _offset = 0;
+  _oldPos = _nextOld = 0;
+  _remaining = _run = 0;
+  _produced = 0;
+  _fill = 0;
+  _oldStart = _oldLen = 0;
+}
+
+bool DeltaTarget::fail(const char *error)
+{
+  if (!_error)
+    _error = error;
+  return false;
+}
+
+const char *DeltaTarget::error(void)
+{
+  return _error ? _error : _flash.error();
+}
+
+bool DeltaTarget::begin(size_t size)
+{
+  // The flash starts once the first bytes tell a patch from an image
+  _mode = SNIFF;
+  _step = HEADER;
+  _error = NULL;
+  _flashOpen = false;
+  _size = size;
+  _headerFill = 0;
+  _oldSize = _newSize = 0;
+  _var = 0;
+  _shift = 0;
+  _nextOld = 0;
+  _remaining = _run = 0;
+  _produced = 0;
+  _fill = 0;
+  _oldLen = 0;
+  _sha.reset();
+  return true;
+}
+
+void DeltaTarget::abort(void)
+{
+  if (_flashOpen)
+    _flash.abort();
+  _flashOpen = false;
+}
+
+bool DeltaTarget::startPatch(void)
+{
+  _oldSize = get32(_header + 4);
+  _newSize = get32(_header + 8 + SHA256_SIZE);
+  memcpy(_newSha, _header + 12 + SHA256_SIZE, SHA256_SIZE);
+  if (!_newSize)
+    return fail("patch for an empty image");
+  if (_oldSize > _running.size())
+    return fail("patch is for a different image");
+
+  // A patch against any other base would rebuild garbage, check before touching the flash
+  Sha256 sha;
+  uint8_t digest[SHA256_SIZE];
+  for (size_t at = 0; at < _oldSize;)
+  {
+    size_t n = _oldSize - at < sizeof(_out) ? _oldSize - at : sizeof(_out);
+    if (!_running.read(at, _out, n))
+      return fail("running image unreadable");
+    sha.update(_out, n);
+    at += n;
+  }
+  sha.finish(digest);
+  if (memcmp(digest, _header + 8, SHA256_SIZE))
+    return fail("patch is for a different image");
+
+  if (!_flash.begin(_newSize))
+    return false;
+  _flashOpen = true;
+  _step = OP;
+  return true;
+}
+
+bool DeltaTarget::varint(uint8_t b)
+{
+  if (!_shift)
+    _var = 0;
+  _var |= (uint32_t)(b & 0x7F) << _shift;
+  if (b & 0x80)
+  {
+    _shift += 7;
+    if (_shift > 28)
+      return fail("corrupt patch");
+    return false;
+  }
+  _shift = 0;
+  return true;
+}
+
+bool DeltaTarget::flush(void)
+{
+  if (!_fill)
+    return true;
+  _sha.update(_out, _fill);
+  if (!_flash.write(_out, _fill))
+    return false;
+  _produced += _fill;
+  _fill = 0;
+  return true;
+}
+
+bool DeltaTarget::put(const uint8_t *data, size_t len)
+{
+  if (_produced + _fill + len > _newSize)
+    return fail("patch runs past the image");
+  while (len)
+  {
+    size_t n = sizeof(_out) - _fill < len ? sizeof(_out) - _fill : len;
+    memcpy(_out + _fill, data, n);
+    _fill += n;
+    data += n;
+    len -= n;
+    if (_fill == sizeof(_out) && !flush())
+      return false;
+  }
+  return true;
+}
+
+// Unchanged run: straight from the running image into the output buffer
+bool DeltaTarget::copyOld(size_t len)
+{
+  if (_oldPos + len > _oldSize)
+    return fail("corrupt patch");
+  if (_produced + _fill + len > _newSize)
+    return fail("patch runs past the image");
+  while (len)
+  {
+    size_t n = sizeof(_out) - _fill < len ? sizeof(_out) - _fill : len;
+    if (!_running.read(_oldPos, _out + _fill, n))
+      return fail("running image unreadable");
+    _fill += n;
+    _oldPos += n;
+    len -= n;
+    if (_fill == sizeof(_out) && !flush())
+      return false;
+  }
+  return true;
+}
+
+// Changed run: old byte plus the patch byte, through a small read-ahead of the old image
+bool DeltaTarget::addOld(const uint8_t *diff, size_t len)
+{
+  if (_oldPos + len > _oldSize)
+    return fail("corrupt patch");
+  uint8_t sum[64];
+  while (len)
+  {
+    if (_oldPos < _oldStart || _oldPos >= _oldStart + _oldLen)
+    {
+      _oldStart = _oldPos;
+      _oldLen = _oldSize - _oldPos < sizeof(_old) ? _oldSize - _oldPos : sizeof(_old);
+      if (!_running.read(_oldStart, _old, _oldLen))
+      {
+        _oldLen = 0;
+        return fail("running image unreadable");
+      }
+    }
+    size_t n = _oldStart + _oldLen - _oldPos;
+    if (n > len)
+      n = len;
+    if (n > sizeof(sum))
+      n = sizeof(sum);
+    const uint8_t *old = _old + (_oldPos - _oldStart);
+    for (size_t i = 0; i < n; i++)
+      sum[i] = old[i] + diff[i];
+    if (!put(sum, n))
+      return false;
+    _oldPos += n;
+    diff += n;
+    len -= n;
+  }
+  return true;
+}
+
+bool DeltaTarget::write(const uint8_t *data, size_t len)
+{
+  if (_error)
+    return false;
+  const uint8_t *p = data;
+  const uint8_t *end = data + len;
+  if (_mode == SNIFF)
+  {
+    // Buffer up to the magic, then decide
+    while (p < end && _headerFill < 4)
+      _header[_headerFill++] = *p++;
+    if (_headerFill < 4)
+      return true;
+    if (memcmp(_header, DELTA_MAGIC, 4))
+    {
+      _mode = RAW;
+      if (!_flash.begin(_size))
+        return false;
+      _flashOpen = true;
+      if (!_flash.write(_header, 4))
+        return false;
+    }
+    else
+    {
+      _mode = PATCH;
+    }
+  }
+  if (_mode == RAW)
+    return p == end || _flash.write(p, end - p);
+
+  while (p < end)
+  {
+    switch (_step)
+    {
+    case HEADER:
+    {
+      size_t n = DELTA_HEADER_SIZE - _headerFill < (size_t)(end - p) ? DELTA_HEADER_SIZE - _headerFill : end - p;
+      memcpy(_header + _headerFill, p, n);
+      _headerFill += n;
+      p += n;
+      if (_headerFill == DELTA_HEADER_SIZE && !startPatch())
+        return false;
+      break;
+    }
+    case OP:
+      if (*p == DELTA_OP_ADD)
+        _step = ADD_OFFSET;
+      else if (*p == DELTA_OP_INSERT)
+        _step = INSERT_LENGTH;
+      else
+        return fail("corrupt patch");
+      p++;
+      break;
+    case ADD_OFFSET:
+      if (varint(*p++))
+      {
+        _offset = (_var >> 1) ^ -(int64_t)(_var & 1);
+        _step = ADD_LENGTH;
+      }
+      break;
+    case ADD_LENGTH:
+      if (varint(*p++))
+      {
+        int64_t at = (int64_t)_nextOld + _offset;
+        if (at < 0 || at + _var > (int64_t)_oldSize || !_var)
+          return fail("corrupt patch");
+        _oldPos = at;
+        _remaining = _var;
+        _step = ADD_SAME;
+      }
+      break;
+    case ADD_SAME:
+      if (varint(*p++))
+      {
+        if (_var > _remaining)
+          return fail("corrupt patch");
+        if (!copyOld(_var))
+          return false;
+        _remaining -= _var;
+        _step = ADD_CHANGED;
+      }
+      break;
+    case ADD_CHANGED:
+      if (varint(*p++))
+      {
+        if (_var > _remaining)
+          return fail("corrupt patch");
+        _run = _var;
+        _step = CHANGED_BYTES;
+      }
+      break;
+    case CHANGED_BYTES:
+    {
+      size_t n = _run < (size_t)(end - p) ? _run : end - p;
+      if (n && !addOld(p, n))
+        return false;
+      p += n;
+      _run -= n;
+      _remaining -= n;
+      break;
+    }
+    case INSERT_LENGTH:
+      if (varint(*p++))
+      {
+        if (!_var)
+          return fail("corrupt patch");
+        _remaining = _var;
+        _step = INSERT_BYTES;
+      }
+      break;
+    case INSERT_BYTES:
+    {
+      size_t n = _remaining < (size_t)(end - p) ? _remaining : end - p;
+      if (!put(p, n))
+        return false;
+      p += n;
+      _remaining -= n;
+      break;
+    }
+    }
+    if (_error)
+      return false;
+    // A finished run either ends its op or starts the next triple
+    if (_step == CHANGED_BYTES && !_run)
+    {
+      _step = _remaining ? ADD_SAME : OP;
+      if (!_remaining)
+        _nextOld = _oldPos;
+    }
+    else if (_step == ADD_CHANGED && !_remaining)
+    {
+      _step = OP; // the add ended on an unchanged run
+      _nextOld = _oldPos;
+    }
+    else if (_step == INSERT_BYTES && !_remaining)
+    {
+      _step = OP;
+    }
+  }
+  return true;
+}
+
+bool DeltaTarget::end(void)
+{
+  if (_mode == RAW)
+    return _flash.end();
+  if (_mode == SNIFF)
+    return fail("empty image");
+  if (_step != OP || !flush())
+    return fail("patch ended early");
+  if (_produced != _newSize)
+    return fail("patch ended early");
+  uint8_t digest[SHA256_SIZE];
+  _sha.finish(digest);
+  if (memcmp(digest, _newSha, SHA256_SIZE))
+    return fail("rebuilt image does not match the patch");
+  _flashOpen = false;
+  return _flash.end();
+}
@@ -0,0 +1,110 @@
+#ifndef DELTA_PATCH_H_
+#define DELTA_PATCH_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "OtaSession.h"
+#include "Sha256.h"
+
+// Patch format, all integers little endian, lengths as LEB128 varints:
+//   header   "OWD1", old size (u32), old SHA-256, new size (u32), new SHA-256
+//   'A' add     signed (zigzag) offset of the old bytes relative to where the last add
+//               ended, length, then (unchanged run, changed run, changed bytes) triples
+//               until length is covered (the last one may stop after its unchanged run);
+//               a changed byte is added to the old byte (mod 256), so code that only
+//               moved, and whose addresses shifted, costs little
+//   'I' insert  length, then the bytes
+// The ops produce the new image front to back, so it can be flashed as it is rebuilt.
+#define DELTA_MAGIC       "OWD1"
+#define DELTA_HEADER_SIZE (4 + 4 + SHA256_SIZE + 4 + SHA256_SIZE)
+#define DELTA_OP_ADD      'A'
+#define DELTA_OP_INSERT   'I'
+#define DELTA_OUT_BUFFER  1024 // rebuilt bytes collected per flash write
+#define DELTA_OLD_BUFFER  256  // running image bytes read ahead for changed runs
+
+// Read access to the image the device runs, the base a patch applies to
+class OtaSource
+{
+public:
+  virtual ~OtaSource() {}
+  virtual size_t size(void) = 0;
+  virtual bool read(size_t offset, uint8_t *buf, size_t len) = 0;
+};
+
+// Sits between an OtaSession and the flash. Uploads that start with the patch magic are
+// applied against the running image as they stream in and the rebuilt image goes to the
+// flash; anything else passes through unchanged. The patch must name the running image by
+// its digest, and the rebuilt image must match the digest the patch promises before the
+// flash target is told to switch. A fixed ~1.5 KB of buffers, whatever the image size.
+class DeltaTarget : public OtaTarget
+{
+public:
+  DeltaTarget(OtaTarget &flash, OtaSource &running);
+
+  bool begin(size_t size);
+  bool write(const uint8_t *data, size_t len);
+  bool end(void);
+  void abort(void);
+  const char *error(void);
+
+  bool patching(void) const { return _mode == PATCH; }
+  size_t imageSize(void) const { return _newSize; } // of the rebuilt image, once the header is in
+  size_t produced(void) const { return _produced + _fill; }
+
+private:
+  enum Mode
+  {
+    SNIFF, // first bytes decide
+    RAW,
+    PATCH
+  };
+  enum Step
+  {
+    HEADER,
+    OP,
+    ADD_OFFSET,
+    ADD_LENGTH,
+    ADD_SAME,    // length of an unchanged run
+    ADD_CHANGED, // length of a changed run
+    CHANGED_BYTES,
+    INSERT_LENGTH,
+    INSERT_BYTES
+  };
+
+  bool fail(const char *error);
+  bool startPatch(void);
+  bool varint(uint8_t b); // true when _var is complete
+  bool put(const uint8_t *data, size_t len);
+  bool copyOld(size_t len);
+  bool addOld(const uint8_t *diff, size_t len);
+  bool flush(void);
+
+  OtaTarget &_flash;
+  OtaSource &_running;
+  Mode _mode;
+  Step _step;
+  const char *_error;
+  bool _flashOpen;
+  size_t _size;
+  uint8_t _header[DELTA_HEADER_SIZE];
+  size_t _headerFill;
+  size_t _oldSize;
+  size_t _newSize;
+  uint8_t _newSha[SHA256_SIZE];
+  uint32_t _var;
+  uint8_t _shift;
+  int64_t _offset;
+  size_t _oldPos;
+  size_t _nextOld;   // where the next add starts when its offset is 0
+  size_t _remaining; // of the current add, or insert
+  size_t _run;       // of the current changed run
+  size_t _produced;  // rebuilt bytes already handed to the flash
+  uint8_t _out[DELTA_OUT_BUFFER];
+  size_t _fill;
+  uint8_t _old[DELTA_OLD_BUFFER];
+  size_t _oldStart;  // image offset of _old[0]
+  size_t _oldLen;
+  Sha256 _sha;
+};
+
+#endif // DELTA_PATCH_H_
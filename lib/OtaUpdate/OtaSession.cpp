@@ -0,0 +1,503 @@
+#include "OtaSession.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+typedef std::chrono::steady_clock Clock;
+
+static uint64_t now_us(void)
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now().time_since_epoch()).count();
+}
+
+static const char *state_name(OtaState s)
+{
+  switch (s)
+  {
+  case OTA_RECEIVING: return "receiving";
+  case OTA_PAUSED:    return "paused";
+  case OTA_VERIFYING: return "verifying";
+  case OTA_DONE:      return "done";
+  case OTA_FAILED:    return "failed";
+  default:            return "idle";
+  }
+}
+
+OtaMetrics otaMetrics;
+
+OtaMetrics::OtaMetrics() : write(LATENCY_BUCKETS_US, LATENCY_BUCKET_COUNT)
+{
+}
+
+void writeOtaMetrics(PromWriter &w)
+{
+  OtaMetrics &m = otaMetrics;
+  w.histogram("esp32cam_ota_write_seconds", "Per OTA chunk, time to hash it and write it to flash", m.write, 1e-6);
+  w.counter("esp32cam_ota_bytes_total", "Firmware bytes written to flash", m.bytes.value());
+  w.counter("esp32cam_ota_updates_total", "Firmware images verified and activated", m.updates.value());
+  w.counter("esp32cam_ota_failures_total", "Firmware images abandoned", m.failures.value());
+  w.counter("esp32cam_ota_resumes_total", "Uploads continued at an offset", m.resumes.value());
+  w.counter("esp32cam_ota_gated_total", "Times upload reads paused for the flash writer", m.gated.value());
+}
+
+OtaSession::OtaSession(OtaTarget &target) : _target(target)
+{
+  _buf = NULL;
+  _size = 0;
+  _head = _tail = _used = 0;
+  _busy = false;
+  _stopping = false;
+  _gated = false;
+  _onChange = NULL;
+  _ctx = NULL;
+  _owner = NULL;
+  _refusedOwner = NULL;
+  _refusalCode = 0;
+  _refusal = NULL;
+  _state = OTA_IDLE;
+  _error = NULL;
+  _needBegin = false;
+  _targetOpen = false;
+  _imageSize = 0;
+  _received = _written = 0;
+  _resumes = 0;
+  _verify = false;
+  _hasDigest = false;
+  _openUs = _lastUs = 0;
+  _openBytes = 0;
+}
+
+OtaSession::~OtaSession()
+{
+  free(_buf);
+}
+
+bool OtaSession::begin(size_t bufferBytes)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  if (_buf)
+    return true;
+  // Internal RAM: small, and the flash writes read from it with the cache disabled
+  _buf = (uint8_t *)malloc(bufferBytes);
+  _size = _buf ? bufferBytes : 0;
+  return _buf != NULL;
+}
+
+void OtaSession::onChange(void (*cb)(void *ctx), void *ctx)
+{
+  _onChange = cb;
+  _ctx = ctx;
+}
+
+void OtaSession::changed(void)
+{
+  if (_onChange)
+    _onChange(_ctx);
+}
+
+int OtaSession::refuse(const void *owner, int code, const char *reason)
+{
+  _refusedOwner = owner;
+  _refusalCode = code;
+  _refusal = reason;
+  return code;
+}
+
+// Called with the lock held
+void OtaSession::fail(const char *error)
+{
+  if (_state == OTA_FAILED)
+    return;
+  _state = OTA_FAILED;
+  _error = error;
+  otaMetrics.failures.add();
+  _work.notify_one();
+  _room.notify_all();
+}
+
+int OtaSession::open(const void *owner, size_t size, const char *sha256, size_t offset, size_t length)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  uint8_t expected[SHA256_SIZE];
+  bool verify = sha256 && *sha256;
+  if (!_buf)
+    return refuse(owner, 503, "updates not available");
+  if (verify && !Sha256::fromHex(sha256, expected))
+    return refuse(owner, 400, "sha256 must be 64 hex digits");
+  if (size ? offset + length > size : offset != 0)
+    return refuse(owner, 400, "offset and length go past the image size");
+  if (_owner && _owner != owner)
+    return refuse(owner, 409, "another upload is in progress");
+  if (_state == OTA_VERIFYING || _state == OTA_DONE)
+    return refuse(owner, 409, "an image is already complete");
+
+  if (offset)
+  {
+    bool same = _imageSize == size && _verify == verify && (!verify || !memcmp(expected, _expected, SHA256_SIZE));
+    if ((_state != OTA_RECEIVING && _state != OTA_PAUSED) || !same)
+      return refuse(owner, 409, "no upload of this image to continue");
+    if (offset != _received)
+      return refuse(owner, 409, "offset does not match received");
+    _resumes++;
+    otaMetrics.resumes.add();
+  }
+  else
+  {
+    if (_busy)
+      return refuse(owner, 503, "flash writer busy, try again");
+    // A new image replaces whatever came before, the writer aborts the old one first
+    _head = _tail = _used = 0;
+    _imageSize = size;
+    _verify = verify;
+    if (verify)
+      memcpy(_expected, expected, SHA256_SIZE);
+    _received = _written = 0;
+    _resumes = 0;
+    _hasDigest = false;
+    _sha.reset();
+    _needBegin = true;
+  }
+  _owner = owner;
+  _state = OTA_RECEIVING;
+  _error = NULL;
+  _openUs = _lastUs = now_us();
+  _openBytes = _received;
+  _work.notify_one();
+  return 0;
+}
+
+bool OtaSession::write(const void *owner, const uint8_t *data, size_t len)
+{
+  std::unique_lock<std::mutex> guard(_lock);
+  if (_owner != owner || _state != OTA_RECEIVING)
+    return false;
+  if ((_imageSize && _received + len > _imageSize) || len > _size)
+  {
+    fail("more data than the image size");
+    return false;
+  }
+  // The gate keeps reads from outrunning the buffer, this only waits for the bytes that
+  // arrived together with the request head
+  if (!_room.wait_for(guard, std::chrono::milliseconds(OTA_STALL_MS),
+                      [&] { return _size - _used >= len || _state != OTA_RECEIVING; }))
+  {
+    fail("flash writer stalled");
+    return false;
+  }
+  if (_state != OTA_RECEIVING)
+    return false;
+  size_t first = _size - _head < len ? _size - _head : len;
+  memcpy(_buf + _head, data, first);
+  memcpy(_buf, data + first, len - first);
+  _head = (_head + len) % _size;
+  _used += len;
+  _received += len;
+  _lastUs = now_us();
+  if (_imageSize && _received == _imageSize)
+    _state = OTA_VERIFYING;
+  _work.notify_one();
+  return true;
+}
+
+void OtaSession::end(const void *owner)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  if (_owner != owner || _state != OTA_RECEIVING || _imageSize)
+    return; // a known size completes by itself, short bodies are pieces of it
+  _state = OTA_VERIFYING;
+  _work.notify_one();
+}
+
+void OtaSession::abort(const void *owner)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  if (_owner != owner)
+    return;
+  _owner = NULL;
+  if (_state != OTA_RECEIVING)
+    return;
+  if (_imageSize)
+    _state = OTA_PAUSED; // what arrived still goes to flash, the next request picks up from there
+  else
+    fail("upload interrupted");
+}
+
+bool OtaSession::owns(const void *owner)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  return _owner && _owner == owner;
+}
+
+void OtaSession::release(const void *owner)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  if (_owner == owner)
+    _owner = NULL;
+}
+
+bool OtaSession::room(void)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  bool open = _state != OTA_RECEIVING || _size - _used >= OTA_GATE_ROOM;
+  if (!open && !_gated)
+    otaMetrics.gated.add();
+  _gated = !open;
+  return open;
+}
+
+bool OtaSession::settled(void)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  if (_state == OTA_DONE || _state == OTA_FAILED)
+    return true;
+  return !_used && !_busy && !_needBegin && _state != OTA_VERIFYING;
+}
+
+int OtaSession::refusal(const void *owner, const char **reason)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  if (!owner || owner != _refusedOwner)
+    return 0;
+  _refusedOwner = NULL; // the connection moves on to its next request
+  *reason = _refusal;
+  return _refusalCode;
+}
+
+OtaState OtaSession::state(void)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  return _state;
+}
+
+size_t OtaSession::received(void)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  return _received;
+}
+
+int OtaSession::status(char *json, size_t size, const char *refused)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  char expected[2 * SHA256_SIZE + 1] = "";
+  char digest[2 * SHA256_SIZE + 1] = "";
+  if (_verify)
+    Sha256::toHex(_expected, expected);
+  if (_hasDigest)
+    Sha256::toHex(_digest, digest);
+  uint64_t span = _lastUs - _openUs;
+  uint32_t rate = span ? (uint32_t)((_received - _openBytes) * 1000000ULL / span) : 0;
+  char extra[96] = "";
+  if (refused)
+    snprintf(extra, sizeof(extra), ",\"refused\":\"%s\"", refused);
+  int n = snprintf(json, size,
+                   "{\"state\":\"%s\",\"size\":%u,\"received\":%u,\"written\":%u,\"buffered\":%u,\"resumes\":%u,"
+                   "\"bytes_per_s\":%u,\"sha256\":\"%s\",\"digest\":\"%s\",\"error\":\"%s\"%s}",
+                   state_name(_state), (unsigned)_imageSize, (unsigned)_received, (unsigned)_written,
+                   (unsigned)_used, (unsigned)_resumes, (unsigned)rate, expected, digest, _error ? _error : "", extra);
+  if (n < 0)
+    return 0;
+  return (size_t)n < size ? n : size - 1;
+}
+
+void OtaSession::shutdown(void)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  _stopping = true;
+  _work.notify_one();
+}
+
+void OtaSession::run(void)
+{
+  std::unique_lock<std::mutex> guard(_lock);
+  while (!_stopping)
+  {
+    // The target is only touched here, with _busy keeping open() from restarting under us
+    if (_needBegin)
+    {
+      _needBegin = false;
+      bool wasOpen = _targetOpen;
+      size_t size = _imageSize;
+      _busy = true;
+      guard.unlock();
+      if (wasOpen)
+        _target.abort();
+      bool ok = _target.begin(size);
+      guard.lock();
+      _busy = false;
+      _targetOpen = ok;
+      if (!ok)
+        fail(_target.error());
+      changed();
+      continue;
+    }
+    if (_state == OTA_FAILED && (_used || _targetOpen))
+    {
+      // Whatever is still buffered is of no use any more
+      _head = _tail = _used = 0;
+      bool wasOpen = _targetOpen;
+      _targetOpen = false;
+      _busy = true;
+      guard.unlock();
+      if (wasOpen)
+        _target.abort();
+      guard.lock();
+      _busy = false;
+      _room.notify_all();
+      changed();
+      continue;
+    }
+    if (_used)
+    {
+      size_t n = _used;
+      if (n > _size - _tail)
+        n = _size - _tail;
+      if (n > OTA_WRITE_CHUNK)
+        n = OTA_WRITE_CHUNK;
+      const uint8_t *p = _buf + _tail;
+      _busy = true;
+      guard.unlock();
+      // The loop only copies in at _head, this range stays put
+      Clock::time_point started = Clock::now();
+      _sha.update(p, n);
+      bool ok = _target.write(p, n);
+      otaMetrics.write.observe(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - started).count());
+      guard.lock();
+      _busy = false;
+      if (_state == OTA_FAILED)
+        continue;
+      _tail = (_tail + n) % _size;
+      _used -= n;
+      if (ok)
+      {
+        _written += n;
+        otaMetrics.bytes.add(n);
+      }
+      else
+      {
+        fail(_target.error());
+      }
+      _room.notify_all();
+      changed();
+      continue;
+    }
+    if (_state == OTA_VERIFYING)
+    {
+      _sha.finish(_digest);
+      _hasDigest = true;
+      if (_verify && memcmp(_digest, _expected, SHA256_SIZE))
+      {
+        fail("sha256 mismatch");
+        continue; // the failure branch drops the image
+      }
+      _busy = true;
+      guard.unlock();
+      bool ok = _target.end();
+      guard.lock();
+      _busy = false;
+      if (ok)
+      {
+        _targetOpen = false;
+        _state = OTA_DONE;
+        otaMetrics.updates.add();
+      }
+      else
+      {
+        fail(_target.error());
+      }
+      changed();
+      continue;
+    }
+    _work.wait(guard);
+  }
+}
+
+//////////////////////////
+//      Route glue      //
+//////////////////////////
+
+// Answers an upload once its bytes are on flash, and for the last piece, once verified
+class OtaReply : public Streamer
+{
+public:
+  OtaReply(OtaSession &ota, const void *owner) : _ota(ota), _owner(owner), _sent(false) {}
+  ~OtaReply() { _ota.release(_owner); }
+  bool ready(void) { return _sent || _ota.settled(); }
+  bool pump(HttpConnection &conn);
+
+private:
+  OtaSession &_ota;
+  const void *_owner;
+  bool _sent;
+};
+
+bool OtaReply::pump(HttpConnection &conn)
+{
+  if (_sent)
+    return false;
+  char json[400];
+  int len = _ota.status(json, sizeof(json));
+  conn.sendCopy(_ota.state() == OTA_FAILED ? 500 : 200, "application/json", json, len);
+  _sent = true;
+  return true;
+}
+
+static bool ota_gate(void *ctx)
+{
+  return ((OtaSession *)ctx)->room();
+}
+
+void otaUpload(OtaSession &ota, HttpConnection &conn, const Upload &upload)
+{
+  switch (upload.status)
+  {
+  case UPLOAD_START:
+    if (upload.filename[0])
+    {
+      // The form upload: one piece, no size or digest to check against
+      ota.open(&conn, 0, NULL, 0, 0);
+    }
+    else
+    {
+      char size[16] = "", offset[16] = "", sha256[2 * SHA256_SIZE + 2] = "";
+      conn.arg("size", size, sizeof(size));
+      conn.arg("offset", offset, sizeof(offset));
+      conn.arg("sha256", sha256, sizeof(sha256));
+      size_t total = strtoul(size, NULL, 10);
+      size_t at = strtoul(offset, NULL, 10);
+      // Without a size a fresh upload is taken to be the whole image
+      ota.open(&conn, total ? total : at ? 0 : conn.contentLength(), sha256, at, conn.contentLength());
+    }
+    if (ota.owns(&conn))
+      conn.gateBody(ota_gate, &ota);
+    break;
+  case UPLOAD_WRITE:
+    ota.write(&conn, upload.buf, upload.len);
+    break;
+  case UPLOAD_END:
+    ota.end(&conn);
+    break;
+  case UPLOAD_ABORTED:
+    ota.abort(&conn);
+    break;
+  }
+}
+
+void otaRequest(OtaSession &ota, HttpConnection &conn)
+{
+  if (conn.method() == METHOD_POST && ota.owns(&conn))
+  {
+    conn.stream(new OtaReply(ota, &conn));
+    return;
+  }
+  int code = 200;
+  const char *reason = NULL;
+  if (conn.method() == METHOD_POST && !(code = ota.refusal(&conn, &reason)))
+  {
+    code = 400;
+    reason = "no image in the request";
+  }
+  char json[400];
+  int len = ota.status(json, sizeof(json), reason);
+  conn.sendCopy(code, "application/json", json, len);
+}
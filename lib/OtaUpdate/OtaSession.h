@@ -0,0 +1,146 @@
+#ifndef OTA_SESSION_H_
+#define OTA_SESSION_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <mutex>
+#include <condition_variable>
+#include <Metrics.h>
+#include <EventServer.h>
+#include "Sha256.h"
+
+#define OTA_BUFFER_SIZE 16384                // between the event loop and the flash writer
+#define OTA_WRITE_CHUNK 4096                 // one flash sector per write
+#define OTA_GATE_ROOM   (2 * EVS_BODY_CHUNK) // body reads pause below this much free buffer
+#define OTA_STALL_MS    2000                 // longest a write waits on the flash before giving up
+
+enum OtaState
+{
+  OTA_IDLE,
+  OTA_RECEIVING,
+  OTA_PAUSED,    // connection dropped, resumable at received()
+  OTA_VERIFYING, // all bytes in, waiting for the last writes and the digest
+  OTA_DONE,      // verified and activated, restart to boot it
+  OTA_FAILED
+};
+
+// OTA instruments
+struct OtaMetrics
+{
+  OtaMetrics();
+
+  Histogram write;  // per chunk: hashing and writing it to flash
+  Counter bytes;    // image bytes written
+  Counter updates;  // images verified and activated
+  Counter failures; // images abandoned: write error, digest mismatch, interrupted form upload
+  Counter resumes;  // uploads continued at an offset
+  Counter gated;    // body reads paused until the flash caught up
+};
+
+extern OtaMetrics otaMetrics;
+
+void writeOtaMetrics(PromWriter &w);
+
+// Where the image goes: the Arduino Update class on the device, memory or a file on the host.
+// Only ever called from the writer task.
+class OtaTarget
+{
+public:
+  virtual ~OtaTarget() {}
+  virtual bool begin(size_t size) = 0; // 0 when the size is not known up front
+  virtual bool write(const uint8_t *data, size_t len) = 0;
+  virtual bool end(void) = 0;          // image complete and verified, make it the boot image
+  virtual void abort(void) = 0;
+  virtual const char *error(void) { return "flash write failed"; }
+};
+
+// One firmware image arriving over HTTP. The event loop only copies body chunks into a bounded
+// buffer; a writer task hashes them (SHA-256, incrementally) and writes them to the target, so
+// the loop keeps pumping streams while flash sectors erase. A full buffer pauses the upload's
+// socket through HttpConnection::gateBody() instead of blocking the loop.
+// The session outlives its connection: when an upload of known size drops, it waits in
+// OTA_PAUSED and a new request continues at offset received(). Only after every byte is in and
+// the digest matches is the target told to switch images.
+class OtaSession
+{
+public:
+  OtaSession(OtaTarget &target);
+  ~OtaSession();
+
+  bool begin(size_t bufferBytes = OTA_BUFFER_SIZE);
+  // Called from the writer task when buffer room frees up or the image settles (e.g. wake the server)
+  void onChange(void (*cb)(void *ctx), void *ctx);
+
+  // Event-loop side. owner identifies the request feeding the image, its connection.
+  // open() returns 0 when it took the upload, otherwise an HTTP status (see refusal()).
+  // size 0 and no sha256 for uploads that can't say up front (the multipart form).
+  int open(const void *owner, size_t size, const char *sha256, size_t offset, size_t length);
+  bool write(const void *owner, const uint8_t *data, size_t len);
+  void end(const void *owner);   // body complete
+  void abort(const void *owner); // connection lost mid-body
+  bool owns(const void *owner);
+  void release(const void *owner);
+  bool room(void);    // enough buffer for another body read, the gate
+  bool settled(void); // buffered bytes are on flash and, if that was the last of them, verified
+  // The status open() turned owner away with and why, 0 if it didn't; reported once
+  int refusal(const void *owner, const char **reason);
+
+  OtaState state(void);
+  size_t received(void);
+  // Progress as JSON, returns the length; refused adds the reason a request was turned away
+  int status(char *json, size_t size, const char *refused = NULL);
+
+  // Writer task body, returns after shutdown()
+  void run(void);
+  void shutdown(void);
+
+private:
+  int refuse(const void *owner, int code, const char *reason);
+  void fail(const char *error);
+  void changed(void);
+
+  OtaTarget &_target;
+  std::mutex _lock;
+  std::condition_variable _work; // for the writer: data, a new image or the end of one
+  std::condition_variable _room; // for write(): the writer freed buffer space
+  uint8_t *_buf;
+  size_t _size;
+  size_t _head;
+  size_t _tail;
+  size_t _used;
+  bool _busy; // writer holds [tail, tail + n) outside the lock
+  bool _stopping;
+  bool _gated;
+  void (*_onChange)(void *ctx);
+  void *_ctx;
+
+  const void *_owner;
+  const void *_refusedOwner;
+  int _refusalCode;
+  const char *_refusal;
+  OtaState _state;
+  const char *_error;
+  bool _needBegin;  // writer starts the target before the next bytes
+  bool _targetOpen;
+  size_t _imageSize; // 0 when unknown
+  size_t _received;
+  size_t _written;
+  uint32_t _resumes;
+  bool _verify;
+  uint8_t _expected[SHA256_SIZE];
+  uint8_t _digest[SHA256_SIZE];
+  bool _hasDigest;
+  Sha256 _sha;
+  uint64_t _openUs;
+  size_t _openBytes;
+  uint64_t _lastUs;
+};
+
+// Route glue for HttpServer. A raw body to POST <path>?size=N&sha256=HEX[&offset=K] uploads
+// (or continues) a verified image; a multipart form upload is taken as one unverified piece.
+// Call otaUpload() from the route's upload handler and otaRequest() from its handler, which
+// also answers GET with the progress JSON.
+void otaUpload(OtaSession &ota, HttpConnection &conn, const Upload &upload);
+void otaRequest(OtaSession &ota, HttpConnection &conn);
+
+#endif // OTA_SESSION_H_
@@ -0,0 +1,140 @@
+#include "Sha256.h"
+#include <string.h>
+
+static const uint32_t K[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+static inline uint32_t ror(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+void Sha256::reset(void)
+{
+  static const uint32_t init[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                   0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+  memcpy(_h, init, sizeof(_h));
+  _fill = 0;
+  _length = 0;
+}
+
+void Sha256::block(const uint8_t *p)
+{
+  uint32_t w[64];
+  for (int i = 0; i < 16; i++)
+    w[i] = (uint32_t)p[4 * i] << 24 | (uint32_t)p[4 * i + 1] << 16 | (uint32_t)p[4 * i + 2] << 8 | p[4 * i + 3];
+  for (int i = 16; i < 64; i++)
+  {
+    uint32_t s0 = ror(w[i - 15], 7) ^ ror(w[i - 15], 18) ^ (w[i - 15] >> 3);
+    uint32_t s1 = ror(w[i - 2], 17) ^ ror(w[i - 2], 19) ^ (w[i - 2] >> 10);
+    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+  }
+  uint32_t a = _h[0], b = _h[1], c = _h[2], d = _h[3], e = _h[4], f = _h[5], g = _h[6], h = _h[7];
+  for (int i = 0; i < 64; i++)
+  {
+    uint32_t t1 = h + (ror(e, 6) ^ ror(e, 11) ^ ror(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+    uint32_t t2 = (ror(a, 2) ^ ror(a, 13) ^ ror(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+    h = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+  _h[0] += a;
+  _h[1] += b;
+  _h[2] += c;
+  _h[3] += d;
+  _h[4] += e;
+  _h[5] += f;
+  _h[6] += g;
+  _h[7] += h;
+}
+
+void Sha256::update(const void *data, size_t len)
+{
+  const uint8_t *p = (const uint8_t *)data;
+  _length += len;
+  if (_fill)
+  {
+    size_t n = 64 - _fill < len ? 64 - _fill : len;
+    memcpy(_buf + _fill, p, n);
+    _fill += n;
+    p += n;
+    len -= n;
+    if (_fill < 64)
+      return;
+    block(_buf);
+    _fill = 0;
+  }
+  // Whole blocks straight from the caller's buffer
+  for (; len >= 64; p += 64, len -= 64)
+    block(p);
+  memcpy(_buf, p, len);
+  _fill = len;
+}
+
+void Sha256::finish(uint8_t digest[SHA256_SIZE])
+{
+  uint64_t bits = _length * 8;
+  _buf[_fill++] = 0x80;
+  if (_fill > 56)
+  {
+    memset(_buf + _fill, 0, 64 - _fill);
+    block(_buf);
+    _fill = 0;
+  }
+  memset(_buf + _fill, 0, 56 - _fill);
+  for (int i = 0; i < 8; i++)
+    _buf[56 + i] = bits >> (56 - 8 * i);
+  block(_buf);
+  for (int i = 0; i < 8; i++)
+  {
+    digest[4 * i] = _h[i] >> 24;
+    digest[4 * i + 1] = _h[i] >> 16;
+    digest[4 * i + 2] = _h[i] >> 8;
+    digest[4 * i + 3] = _h[i];
+  }
+}
+
+void Sha256::toHex(const uint8_t digest[SHA256_SIZE], char *out)
+{
+  static const char hex[] = "0123456789abcdef";
+  for (int i = 0; i < SHA256_SIZE; i++)
+  {
+    out[2 * i] = hex[digest[i] >> 4];
+    out[2 * i + 1] = hex[digest[i] & 15];
+  }
+  out[2 * SHA256_SIZE] = 0;
+}
+
+static int nibble(char c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+bool Sha256::fromHex(const char *hex, uint8_t digest[SHA256_SIZE])
+{
+  if (strlen(hex) != 2 * SHA256_SIZE)
+    return false;
+  for (int i = 0; i < SHA256_SIZE; i++)
+  {
+    int hi = nibble(hex[2 * i]), lo = nibble(hex[2 * i + 1]);
+    if (hi < 0 || lo < 0)
+      return false;
+    digest[i] = hi << 4 | lo;
+  }
+  return true;
+}
@@ -0,0 +1,34 @@
+#ifndef SHA256_H_
+#define SHA256_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SHA256_SIZE 32
+
+// Incremental SHA-256 (FIPS 180-4). Plain C++ so the device and the host benchmarks hash
+// the same way; at a few MB/s on the ESP32 it stays well ahead of flash writes.
+class Sha256
+{
+public:
+  Sha256() { reset(); }
+
+  void reset(void);
+  void update(const void *data, size_t len);
+  void finish(uint8_t digest[SHA256_SIZE]); // reset() before reusing
+
+  // Lowercase hex, out needs 2 * SHA256_SIZE + 1 bytes
+  static void toHex(const uint8_t digest[SHA256_SIZE], char *out);
+  // Exactly 64 hex digits, either case
+  static bool fromHex(const char *hex, uint8_t digest[SHA256_SIZE]);
+
+private:
+  void block(const uint8_t *p);
+
+  uint32_t _h[8];
+  uint8_t _buf[64];
+  size_t _fill;
+  uint64_t _length;
+};
+
+#endif // SHA256_H_
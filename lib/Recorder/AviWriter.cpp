@@ -0,0 +1,250 @@
+#include "AviWriter.h"
+#include <stdlib.h>
+#include <string.h>
+#if defined(ARDUINO)
+  #include "esp_heap_caps.h"
+#endif
+
+// Header layout, see buildHeader()
+#define AVI_MOVI_LIST 500 // 'LIST' of the movi list, its 'movi' tag sits at 508 and frames start at 512
+#define AVI_MOVI_TAG  508
+
+static inline void put16(uint8_t *p, uint16_t v)
+{
+  p[0] = v;
+  p[1] = v >> 8;
+}
+
+static inline void put32(uint8_t *p, uint32_t v)
+{
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+}
+
+static inline void tag(uint8_t *p, const char *fourcc, uint32_t size)
+{
+  memcpy(p, fourcc, 4);
+  put32(p + 4, size);
+}
+
+AviWriter::AviWriter()
+{
+  _file = NULL;
+  _index = NULL;
+  _indexPath[0] = 0;
+  _buf = NULL;
+  _bufSize = 0;
+  _fill = 0;
+  _indexFill = 0;
+  _offset = 0;
+  _frames = 0;
+  _maxFrame = 0;
+  _firstTs = _lastTs = 0;
+  _width = _height = 0;
+  _failed = false;
+}
+
+AviWriter::~AviWriter()
+{
+  close();
+  free(_buf);
+}
+
+bool AviWriter::begin(size_t bufferSize)
+{
+  if (_buf)
+    return true;
+  bufferSize = (bufferSize + 511) & ~(size_t)511;
+  if (bufferSize < AVI_HEADER_SIZE)
+    bufferSize = AVI_HEADER_SIZE;
+#if defined(ARDUINO)
+  // The SD host DMAs straight out of internal RAM, PSRAM would be bounced through a copy
+  _buf = (uint8_t *)heap_caps_malloc(bufferSize, MALLOC_CAP_DMA | MALLOC_CAP_8BIT);
+#else
+  _buf = (uint8_t *)malloc(bufferSize);
+#endif
+  _bufSize = _buf ? bufferSize : 0;
+  return _buf != NULL;
+}
+
+void AviWriter::buildHeader(uint8_t *h, uint32_t usPerFrame, uint32_t maxBytesPerSec, uint32_t moviSize, uint32_t riffSize)
+{
+  memset(h, 0, AVI_HEADER_SIZE);
+  memcpy(h, "RIFF", 4);
+  put32(h + 4, riffSize);
+  memcpy(h + 8, "AVI ", 4);
+  tag(h + 12, "LIST", 192);
+  memcpy(h + 20, "hdrl", 4);
+
+  // Main header
+  uint8_t *a = h + 32;
+  tag(h + 24, "avih", 56);
+  put32(a, usPerFrame);
+  put32(a + 4, maxBytesPerSec);
+  put32(a + 12, 0x10); // AVIF_HASINDEX
+  put32(a + 16, _frames);
+  put32(a + 24, 1);    // streams
+  put32(a + 28, _maxFrame + 8);
+  put32(a + 32, _width);
+  put32(a + 36, _height);
+
+  // The one video stream
+  tag(h + 88, "LIST", 116);
+  memcpy(h + 96, "strl", 4);
+  uint8_t *s = h + 108;
+  tag(h + 100, "strh", 56);
+  memcpy(s, "vids", 4);
+  memcpy(s + 4, "MJPG", 4);
+  put32(s + 20, usPerFrame); // scale / rate = seconds per frame
+  put32(s + 24, 1000000);
+  put32(s + 32, _frames);
+  put32(s + 36, _maxFrame + 8);
+  put32(s + 40, 0xFFFFFFFF); // default quality
+  put16(s + 52, _width);
+  put16(s + 54, _height);
+
+  uint8_t *b = h + 172;
+  tag(h + 164, "strf", 40);
+  put32(b, 40);
+  put32(b + 4, _width);
+  put32(b + 8, _height);
+  put16(b + 12, 1);
+  put16(b + 14, 24);
+  memcpy(b + 16, "MJPG", 4);
+  put32(b + 20, (uint32_t)_width * _height * 3);
+
+  // Padding up to the movi list, so every frame write starts sector aligned
+  tag(h + 212, "JUNK", AVI_MOVI_LIST - 220);
+  tag(h + AVI_MOVI_LIST, "LIST", moviSize);
+  memcpy(h + AVI_MOVI_TAG, "movi", 4);
+}
+
+bool AviWriter::open(const char *path, uint16_t width, uint16_t height)
+{
+  if (_file || !_buf || strlen(path) + 5 > sizeof(_indexPath))
+    return false;
+  snprintf(_indexPath, sizeof(_indexPath), "%s.idx", path);
+  _file = fopen(path, "wb");
+  _index = _file ? fopen(_indexPath, "w+b") : NULL;
+  if (!_index)
+  {
+    if (_file)
+      fclose(_file);
+    _file = NULL;
+    return false;
+  }
+  // Our own buffer decides the write size, stdio would split it up again
+  setvbuf(_file, NULL, _IONBF, 0);
+  _fill = 0;
+  _indexFill = 0;
+  _offset = 0;
+  _frames = 0;
+  _maxFrame = 0;
+  _firstTs = _lastTs = 0;
+  _width = width;
+  _height = height;
+  _failed = false;
+
+  // Sizes stay at 0 until close(); players treat the file as unindexed meanwhile
+  uint8_t header[AVI_HEADER_SIZE];
+  buildHeader(header, 100000, 0, 4, 0);
+  return put(header, sizeof(header));
+}
+
+bool AviWriter::put(const void *data, size_t len)
+{
+  const uint8_t *p = (const uint8_t *)data;
+  _offset += len;
+  while (len)
+  {
+    size_t n = _bufSize - _fill < len ? _bufSize - _fill : len;
+    memcpy(_buf + _fill, p, n);
+    _fill += n;
+    p += n;
+    len -= n;
+    if (_fill == _bufSize && !flush())
+      return false;
+  }
+  return !_failed;
+}
+
+bool AviWriter::flush(void)
+{
+  if (_fill && fwrite(_buf, 1, _fill, _file) != _fill)
+    _failed = true;
+  _fill = 0;
+  return !_failed;
+}
+
+bool AviWriter::flushIndex(void)
+{
+  if (_indexFill && fwrite(_indexBuf, 16, _indexFill, _index) != _indexFill)
+    _failed = true;
+  _indexFill = 0;
+  return !_failed;
+}
+
+bool AviWriter::writeFrame(const uint8_t *jpg, size_t len, uint64_t timestamp_us)
+{
+  if (!_file || _failed)
+    return false;
+  uint8_t *e = _indexBuf + _indexFill * 16;
+  memcpy(e, "00dc", 4);
+  put32(e + 4, 0x10); // AVIIF_KEYFRAME, every MJPEG frame is one
+  put32(e + 8, (uint32_t)(_offset - AVI_MOVI_TAG));
+  put32(e + 12, len);
+  if (++_indexFill == AVI_INDEX_BATCH && !flushIndex())
+    return false;
+
+  uint8_t chunk[8];
+  tag(chunk, "00dc", len);
+  static const uint8_t pad = 0;
+  if (!put(chunk, sizeof(chunk)) || !put(jpg, len) || ((len & 1) && !put(&pad, 1)))
+    return false;
+
+  if (!_frames)
+    _firstTs = timestamp_us;
+  _lastTs = timestamp_us;
+  _frames++;
+  if (len > _maxFrame)
+    _maxFrame = len;
+  return true;
+}
+
+bool AviWriter::close(void)
+{
+  if (!_file)
+    return false;
+  uint64_t moviEnd = _offset;
+  bool ok = flushIndex();
+
+  // idx1 goes behind the movi list, copied over from the side file through the write buffer
+  uint8_t chunk[8];
+  tag(chunk, "idx1", _frames * 16);
+  ok = ok && put(chunk, sizeof(chunk));
+  rewind(_index);
+  uint8_t copy[512];
+  size_t n;
+  while (ok && (n = fread(copy, 1, sizeof(copy), _index)) > 0)
+    ok = put(copy, n);
+  ok = ok && flush();
+
+  // Now that the totals are known, rewrite the headers
+  uint32_t duration = _lastTs - _firstTs;
+  uint32_t usPerFrame = _frames > 1 ? duration / (_frames - 1) : 100000;
+  if (!usPerFrame)
+    usPerFrame = 1;
+  uint32_t bytesPerSec = duration ? (uint32_t)((moviEnd - AVI_HEADER_SIZE) * 1000000ULL / duration) : 0;
+  uint8_t header[AVI_HEADER_SIZE];
+  buildHeader(header, usPerFrame, bytesPerSec, (uint32_t)(moviEnd - AVI_MOVI_TAG), (uint32_t)(_offset - 8));
+  ok = ok && fseek(_file, 0, SEEK_SET) == 0 && fwrite(header, 1, sizeof(header), _file) == sizeof(header);
+
+  ok = fclose(_file) == 0 && ok;
+  fclose(_index);
+  remove(_indexPath);
+  _file = NULL;
+  _index = NULL;
+  return ok;
+}
@@ -0,0 +1,62 @@
+#ifndef AVI_WRITER_H_
+#define AVI_WRITER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#define AVI_BUFFER_SIZE  32768 // bytes per write, a multiple of the 512-byte sector
+#define AVI_HEADER_SIZE  512   // headers padded so frame data starts on a sector
+#define AVI_INDEX_BATCH  256   // idx1 entries buffered before they go to the side file
+
+// Motion-JPEG AVI (RIFF, AVI 1.0) written front to back through plain stdio, so the same
+// code runs on the SD card's VFS mount and on a Linux filesystem. Frames are packed into a
+// large buffer that leaves as whole, sector-aligned writes; idx1 entries are appended to a
+// side file as frames go in and copied behind the movi list on close(), which also patches
+// the frame count, rate and sizes into the headers. Until then the file plays as an
+// unindexed AVI.
+class AviWriter
+{
+public:
+  AviWriter();
+  ~AviWriter();
+
+  // Allocates the write buffer (internal DMA-capable RAM on the device), false when it cannot
+  bool begin(size_t bufferSize = AVI_BUFFER_SIZE);
+
+  bool open(const char *path, uint16_t width, uint16_t height);
+  bool writeFrame(const uint8_t *jpg, size_t len, uint64_t timestamp_us);
+  bool close(void);
+  bool isOpen(void) const { return _file != NULL; }
+
+  uint32_t frames(void) const { return _frames; }
+  uint64_t size(void) const { return _offset; } // file bytes so far, headers included
+  uint32_t durationMs(void) const { return _frames ? (_lastTs - _firstTs) / 1000 : 0; }
+  uint16_t width(void) const { return _width; }
+  uint16_t height(void) const { return _height; }
+
+private:
+  bool put(const void *data, size_t len);
+  bool flush(void);
+  bool flushIndex(void);
+  void buildHeader(uint8_t *h, uint32_t usPerFrame, uint32_t maxBytesPerSec, uint32_t moviSize, uint32_t riffSize);
+
+  FILE *_file;
+  FILE *_index;
+  char _indexPath[96];
+  uint8_t *_buf;
+  size_t _bufSize;
+  size_t _fill;
+  uint8_t _indexBuf[AVI_INDEX_BATCH * 16];
+  uint16_t _indexFill;
+  uint64_t _offset;
+  uint32_t _frames;
+  uint32_t _maxFrame;
+  uint64_t _firstTs;
+  uint64_t _lastTs;
+  uint16_t _width;
+  uint16_t _height;
+  bool _failed;
+};
+
+#endif // AVI_WRITER_H_
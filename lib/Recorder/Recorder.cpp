@@ -0,0 +1,330 @@
+#include "Recorder.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <chrono>
+#if defined(ARDUINO)
+  #include "esp_heap_caps.h"
+#endif
+
+typedef std::chrono::steady_clock Clock;
+
+RecordMetrics recordMetrics;
+
+RecordMetrics::RecordMetrics() : write(LATENCY_BUCKETS_US, LATENCY_BUCKET_COUNT)
+{
+}
+
+void writeRecordMetrics(PromWriter &w)
+{
+  RecordMetrics &m = recordMetrics;
+  w.histogram("esp32cam_record_write_seconds", "Per recorded frame, time to hand it to the filesystem", m.write, 1e-6);
+  w.counter("esp32cam_record_frames_total", "Frames written to recordings", m.frames.value());
+  w.counter("esp32cam_record_bytes_total", "Frame bytes written to recordings", m.bytes.value());
+  w.counter("esp32cam_record_dropped_total", "Frames not recorded, queue full or passed over during a copy", m.dropped.value());
+  w.counter("esp32cam_record_files_total", "Recordings finished", m.files.value());
+  w.counter("esp32cam_record_errors_total", "Recording open or write failures", m.errors.value());
+}
+
+//////////////////////////
+//     RecordQueue      //
+//////////////////////////
+
+RecordQueue::RecordQueue()
+{
+  _data = NULL;
+  _size = 0;
+  _entries = NULL;
+  _max = 0;
+  _first = _count = 0;
+  _head = 0;
+  _used = 0;
+  _woken = false;
+}
+
+RecordQueue::~RecordQueue()
+{
+  free(_data);
+  free(_entries);
+}
+
+bool RecordQueue::begin(size_t bytes, uint16_t maxFrames)
+{
+  if (_data || !maxFrames)
+    return false;
+#if defined(ARDUINO)
+  _data = (uint8_t *)heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+#else
+  _data = (uint8_t *)malloc(bytes);
+#endif
+  _entries = (Entry *)malloc(maxFrames * sizeof(Entry));
+  if (!_data || !_entries)
+  {
+    free(_data);
+    free(_entries);
+    _data = NULL;
+    _entries = NULL;
+    return false;
+  }
+  _size = bytes;
+  _max = maxFrames;
+  return true;
+}
+
+bool RecordQueue::push(const FrameRef &frame)
+{
+  size_t len = frame.getSize();
+  size_t need = (len + 3) & ~(size_t)3;
+  size_t pos;
+  {
+    std::lock_guard<std::mutex> guard(_lock);
+    if (!_data || !len || _count == _max)
+      return false;
+    if (!_count)
+      pos = 0;
+    else
+    {
+      // Free space is [head, end) plus [0, tail) before a wrap, [head, tail) after it
+      size_t tail = _entries[_first].offset;
+      if (_head > tail)
+        pos = _head + need <= _size ? _head : need <= tail ? 0 : _size;
+      else
+        pos = _head + need <= tail ? _head : _size;
+    }
+    if (pos + need > _size)
+      return false;
+  }
+
+  // Only the consumer frees space, so the reserved range stays ours while the lock is down
+  memcpy(_data + pos, frame.getBuf(), len);
+
+  std::lock_guard<std::mutex> guard(_lock);
+  Entry &e = _entries[(_first + _count) % _max];
+  e.offset = pos;
+  e.len = len;
+  e.timestamp_us = frame.getTimestamp();
+  e.width = frame.getWidth();
+  e.height = frame.getHeight();
+  _count++;
+  _head = pos + need;
+  _used += len;
+  _pushed.notify_one();
+  return true;
+}
+
+bool RecordQueue::front(Item &out, uint32_t timeout_ms)
+{
+  std::unique_lock<std::mutex> guard(_lock);
+  _pushed.wait_for(guard, std::chrono::milliseconds(timeout_ms), [this] { return _count || _woken; });
+  _woken = false;
+  if (!_count)
+    return false;
+  const Entry &e = _entries[_first];
+  out.buf = _data + e.offset;
+  out.len = e.len;
+  out.timestamp_us = e.timestamp_us;
+  out.width = e.width;
+  out.height = e.height;
+  return true;
+}
+
+void RecordQueue::pop(void)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  if (!_count)
+    return;
+  _used -= _entries[_first].len;
+  _first = (_first + 1) % _max;
+  _count--;
+}
+
+void RecordQueue::wake(void)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  _woken = true;
+  _pushed.notify_one();
+}
+
+uint16_t RecordQueue::depth(void)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  return _count;
+}
+
+size_t RecordQueue::bytes(void)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  return _used;
+}
+
+//////////////////////////
+//       Recorder       //
+//////////////////////////
+
+Recorder::Recorder(MJPEGBroadcaster &broadcaster) : _broadcaster(broadcaster)
+{
+  _active = false;
+  _stopping = false;
+  _fileBytes = 0;
+  _dir[0] = 0;
+  _path[0] = 0;
+  _next = 1;
+  configure(REC_MAX_FILE_MB, REC_MAX_FILE_S);
+}
+
+bool Recorder::begin(const char *dir, size_t queueBytes, uint16_t queueFrames)
+{
+  if (strlen(dir) >= sizeof(_dir) || !_writer.begin() || !_queue.begin(queueBytes, queueFrames))
+    return false;
+  strcpy(_dir, dir);
+  mkdir(dir, 0755);
+  DIR *d = opendir(dir);
+  if (!d)
+    return false;
+  // Carry on after the highest recNNNNN.avi already there
+  for (struct dirent *e; (e = readdir(d));)
+  {
+    unsigned n;
+    char ext[4];
+    if (sscanf(e->d_name, "rec%u.%3s", &n, ext) == 2 && !strcmp(ext, "avi") && n >= _next)
+      _next = n + 1;
+  }
+  closedir(d);
+  return true;
+}
+
+void Recorder::configure(uint32_t maxFileMB, uint32_t maxFileS)
+{
+  _maxBytes = (uint64_t)maxFileMB << 20;
+  _maxUs = maxFileS * 1000000ULL;
+}
+
+void Recorder::start(void)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  if (!_dir[0])
+    return;
+  _active = true;
+  _changed.notify_all();
+}
+
+void Recorder::stop(void)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  _active = false;
+  _queue.wake();
+}
+
+void Recorder::shutdown(void)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  _active = false;
+  _stopping = true;
+  _changed.notify_all();
+  _queue.wake();
+}
+
+void Recorder::file(char *name, size_t size, uint64_t *bytes)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  snprintf(name, size, "%s", _path);
+  *bytes = _fileBytes;
+}
+
+void Recorder::runFeeder(void)
+{
+  for (;;)
+  {
+    {
+      std::unique_lock<std::mutex> guard(_lock);
+      _changed.wait(guard, [this] { return _active || _stopping; });
+    }
+    if (_stopping)
+      return;
+    // Only a client while recording; starts from the next published frame
+    _broadcaster.attach();
+    uint32_t seq = _broadcaster.latestSeq();
+    FrameRef frame;
+    while (_active)
+    {
+      if (!_broadcaster.acquire(frame, seq))
+      {
+        _broadcaster.detach();
+        return; // broadcaster shut down
+      }
+      if (seq && frame.getSeq() > seq + 1)
+        recordMetrics.dropped.add(frame.getSeq() - seq - 1); // published while the last copy ran
+      seq = frame.getSeq();
+      if (!_queue.push(frame))
+        recordMetrics.dropped.add();
+      frame.reset();
+    }
+    _broadcaster.detach();
+  }
+}
+
+// A new file for the first frame, at the size or duration limit, and when the resolution
+// changed (the bitrate controller steps framesizes, an AVI stream has just the one)
+bool Recorder::roll(const RecordQueue::Item &item)
+{
+  if (_writer.isOpen())
+  {
+    bool full = _writer.size() + item.len + 8 + 16 * (_writer.frames() + 1) > _maxBytes;
+    bool tooLong = _writer.durationMs() * 1000ULL >= _maxUs;
+    bool resized = item.width != _writer.width() || item.height != _writer.height();
+    if (!full && !tooLong && !resized)
+      return true;
+    finish();
+  }
+  char path[96];
+  snprintf(path, sizeof(path), "%s/rec%05u.avi", _dir, (unsigned)_next++);
+  if (!_writer.open(path, item.width, item.height))
+    return false;
+  std::lock_guard<std::mutex> guard(_lock);
+  strcpy(_path, path);
+  _fileBytes = _writer.size();
+  return true;
+}
+
+void Recorder::finish(void)
+{
+  if (!_writer.isOpen())
+    return;
+  if (_writer.close())
+    recordMetrics.files.add();
+  else
+    recordMetrics.errors.add();
+}
+
+void Recorder::runWriter(void)
+{
+  while (!_stopping || _queue.depth())
+  {
+    RecordQueue::Item item;
+    if (!_queue.front(item, 1000))
+    {
+      // Drained after stop(): finish the file so it is indexed and playable
+      if (!_active)
+        finish();
+      continue;
+    }
+    Clock::time_point started = Clock::now();
+    bool ok = roll(item) && _writer.writeFrame(item.buf, item.len, item.timestamp_us);
+    _queue.pop();
+    if (!ok)
+    {
+      // Card full or gone: keep what was written and stop instead of failing every frame
+      recordMetrics.errors.add();
+      finish();
+      stop();
+      continue;
+    }
+    recordMetrics.write.observe(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - started).count());
+    recordMetrics.frames.add();
+    recordMetrics.bytes.add(item.len);
+    _fileBytes = _writer.size();
+  }
+  finish();
+}
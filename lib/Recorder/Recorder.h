@@ -0,0 +1,132 @@
+#ifndef RECORDER_H_
+#define RECORDER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <Metrics.h>
+#include <MJPEGBroadcaster.h>
+#include "AviWriter.h"
+
+#define REC_QUEUE_BYTES  (512 * 1024) // PSRAM between the capture and the card
+#define REC_QUEUE_FRAMES 64
+#define REC_MAX_FILE_MB  256          // a new file after this much...
+#define REC_MAX_FILE_S   600          // ...or this long, whichever comes first
+
+// Recording instruments
+struct RecordMetrics
+{
+  RecordMetrics();
+
+  Histogram write;  // per frame: handing it to the filesystem
+  Counter frames;   // frames written
+  Counter bytes;
+  Counter dropped;  // frames the queue had no room for, or that went by during a copy
+  Counter files;    // files finished
+  Counter errors;   // open or write failures
+};
+
+extern RecordMetrics recordMetrics;
+
+void writeRecordMetrics(PromWriter &w);
+
+// Bounded FIFO of frame copies in one fixed arena. The capture side copies a frame in and
+// lets go of the driver buffer at once; a full queue drops the frame instead of waiting.
+// One producer, one consumer.
+class RecordQueue
+{
+public:
+  struct Item
+  {
+    const uint8_t *buf;
+    size_t len;
+    uint64_t timestamp_us;
+    uint16_t width;
+    uint16_t height;
+  };
+
+  RecordQueue();
+  ~RecordQueue();
+
+  bool begin(size_t bytes, uint16_t maxFrames);
+  bool push(const FrameRef &frame); // false when it did not fit
+  // Oldest frame, left in place until pop(); waits up to timeout_ms for one
+  bool front(Item &out, uint32_t timeout_ms);
+  void pop(void);
+  void wake(void); // ends a waiting front() early
+
+  uint16_t depth(void);
+  size_t bytes(void);
+
+private:
+  struct Entry
+  {
+    uint32_t offset;
+    uint32_t len;
+    uint64_t timestamp_us;
+    uint16_t width;
+    uint16_t height;
+  };
+
+  std::mutex _lock;
+  std::condition_variable _pushed;
+  uint8_t *_data;
+  size_t _size;
+  Entry *_entries;
+  uint16_t _max;
+  uint16_t _first;
+  uint16_t _count;
+  size_t _head; // end of the newest frame
+  size_t _used;
+  bool _woken;
+};
+
+// Records the stream to AVI files on a filesystem (the SD card's VFS mount on the device).
+// A feeder task reads the broadcaster like any other client and only copies frames into the
+// queue; a writer task drains the queue into AviWriter, so a slow card costs queued frames,
+// never a stalled stream. Files roll over by size, duration and resolution changes.
+class Recorder
+{
+public:
+  Recorder(MJPEGBroadcaster &broadcaster);
+
+  // Creates dir if needed and continues the recNNNNN.avi numbering found there
+  bool begin(const char *dir, size_t queueBytes = REC_QUEUE_BYTES, uint16_t queueFrames = REC_QUEUE_FRAMES);
+  void configure(uint32_t maxFileMB, uint32_t maxFileS);
+
+  void start(void);
+  void stop(void); // the current file is finished once the queue has drained
+  bool active(void) const { return _active; }
+
+  // Task bodies, both return after shutdown()
+  void runFeeder(void);
+  void runWriter(void);
+  void shutdown(void);
+
+  uint16_t queued(void) { return _queue.depth(); }
+  size_t queuedBytes(void) { return _queue.bytes(); }
+  // Current (or last) file name and its size so far
+  void file(char *name, size_t size, uint64_t *bytes);
+
+private:
+  bool roll(const RecordQueue::Item &item);
+  void finish(void);
+
+  MJPEGBroadcaster &_broadcaster;
+  RecordQueue _queue;
+  AviWriter _writer;
+  std::mutex _lock; // guards _path and the active/stopping handshake
+  std::condition_variable _changed;
+  std::atomic<bool> _active;
+  std::atomic<bool> _stopping;
+  std::atomic<uint64_t> _fileBytes;
+  char _dir[64];
+  char _path[96];
+  uint32_t _next;
+  uint64_t _maxBytes;
+  uint64_t _maxUs;
+};
+
+#endif // RECORDER_H_
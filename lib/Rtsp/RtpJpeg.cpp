@@ -0,0 +1,277 @@
+#include "RtpJpeg.h"
+#include <string.h>
+
+// ITU T.81 Annex K Huffman tables, the only ones RFC 2435 receivers know
+static const uint8_t DC_LUMA_COUNTS[16] = {0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+static const uint8_t DC_CHROMA_COUNTS[16] = {0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0};
+static const uint8_t DC_VALUES[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+static const uint8_t AC_LUMA_COUNTS[16] = {0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7D};
+static const uint8_t AC_LUMA_VALUES[162] = {
+  0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+  0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xA1, 0x08, 0x23, 0x42, 0xB1, 0xC1, 0x15, 0x52, 0xD1, 0xF0,
+  0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0A, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x25, 0x26, 0x27, 0x28,
+  0x29, 0x2A, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+  0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+  0x6A, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+  0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7,
+  0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3, 0xC4, 0xC5,
+  0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA, 0xE1, 0xE2,
+  0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8,
+  0xF9, 0xFA};
+static const uint8_t AC_CHROMA_COUNTS[16] = {0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77};
+static const uint8_t AC_CHROMA_VALUES[162] = {
+  0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+  0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xA1, 0xB1, 0xC1, 0x09, 0x23, 0x33, 0x52, 0xF0,
+  0x15, 0x62, 0x72, 0xD1, 0x0A, 0x16, 0x24, 0x34, 0xE1, 0x25, 0xF1, 0x17, 0x18, 0x19, 0x1A, 0x26,
+  0x27, 0x28, 0x29, 0x2A, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+  0x49, 0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+  0x69, 0x6A, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+  0x88, 0x89, 0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A, 0xA2, 0xA3, 0xA4, 0xA5,
+  0xA6, 0xA7, 0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3,
+  0xC4, 0xC5, 0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA,
+  0xE2, 0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8,
+  0xF9, 0xFA};
+
+struct StdTable
+{
+  const uint8_t *counts;
+  const uint8_t *values;
+  uint8_t n;
+};
+// Indexed by (class << 1) | id
+static const StdTable STD_TABLES[4] = {
+  {DC_LUMA_COUNTS, DC_VALUES, 12}, {DC_CHROMA_COUNTS, DC_VALUES, 12},
+  {AC_LUMA_COUNTS, AC_LUMA_VALUES, 162}, {AC_CHROMA_COUNTS, AC_CHROMA_VALUES, 162}};
+
+static inline uint16_t be16(const uint8_t *p)
+{
+  return (p[0] << 8) | p[1];
+}
+
+// Every table in a DHT segment has to be one of the standard four
+static bool standardTables(const uint8_t *p, const uint8_t *end)
+{
+  while (p < end)
+  {
+    uint8_t tc = p[0] >> 4, th = p[0] & 15;
+    if (tc > 1 || th > 1 || end - p < 17)
+      return false;
+    const StdTable &t = STD_TABLES[(tc << 1) | th];
+    size_t n = 0;
+    for (int i = 0; i < 16; i++)
+      n += p[1 + i];
+    if (n != t.n || end - p < (ptrdiff_t)(17 + n) || memcmp(p + 1, t.counts, 16) || memcmp(p + 17, t.values, n))
+      return false;
+    p += 17 + n;
+  }
+  return true;
+}
+
+bool rtpJpegParse(const uint8_t *jpg, size_t len, RtpJpegFrame &out)
+{
+  memset(&out, 0, sizeof(out));
+  if (len < 4 || jpg[0] != 0xFF || jpg[1] != 0xD8)
+    return false;
+  const uint8_t *p = jpg + 2, *end = jpg + len;
+  bool sof = false;
+  for (;;)
+  {
+    while (p < end && *p == 0xFF && p + 1 < end && p[1] == 0xFF)
+      p++; // fill bytes
+    if (end - p < 4 || p[0] != 0xFF)
+      return false;
+    uint8_t marker = p[1];
+    uint16_t seglen = be16(p + 2);
+    const uint8_t *seg = p + 4, *segEnd = p + 2 + seglen;
+    if (seglen < 2 || segEnd > end)
+      return false;
+    switch (marker)
+    {
+    case 0xDB: // DQT, 8-bit tables 0 and 1 only
+      while (seg < segEnd)
+      {
+        if ((seg[0] >> 4) || (seg[0] & 15) > 1 || segEnd - seg < 65)
+          return false;
+        out.tables[seg[0] & 15] = seg + 1;
+        seg += 65;
+      }
+      break;
+    case 0xC0: // baseline
+    case 0xC1: // extended Huffman, same layout
+      if (seglen != 17 || seg[0] != 8 || seg[5] != 3)
+        return false;
+      out.height = be16(seg + 1);
+      out.width = be16(seg + 3);
+      if (seg[7] == 0x21)
+        out.type = 0;
+      else if (seg[7] == 0x22)
+        out.type = 1;
+      else
+        return false;
+      if (seg[8] != 0 || seg[10] != 0x11 || seg[11] != 1 || seg[13] != 0x11 || seg[14] != 1)
+        return false;
+      if (!out.width || !out.height || (out.width & 7) || (out.height & 7) || out.width > 2040 ||
+          out.height > 2040)
+        return false;
+      sof = true;
+      break;
+    case 0xC4:
+      if (!standardTables(seg, segEnd))
+        return false;
+      break;
+    case 0xDD:
+      if (seglen != 4)
+        return false;
+      out.restart = be16(seg);
+      break;
+    case 0xDA: // luma on Huffman tables 0, chroma on 1, the whole spectrum in one scan
+      if (!sof || !out.tables[0] || !out.tables[1] || seglen != 12 || seg[0] != 3 || seg[2] != 0x00 ||
+          seg[4] != 0x11 || seg[6] != 0x11 || seg[7] != 0 || seg[8] != 63 || seg[9] != 0)
+        return false;
+      out.scan = segEnd;
+      // The EOI, with whatever padding the driver left behind it
+      for (const uint8_t *q = end - 2; q >= out.scan; q--)
+      {
+        if (q[0] == 0xFF && q[1] == 0xD9)
+        {
+          out.scanLen = q - out.scan;
+          break;
+        }
+      }
+      if (!out.scanLen)
+        return false;
+      if (out.restart)
+        out.type += 64;
+      return true;
+    default:
+      if ((marker >= 0xC2 && marker <= 0xCF) || marker == 0xD9)
+        return false; // progressive, lossless, arithmetic, or no scan at all
+      break;
+    }
+    p = segEnd;
+  }
+}
+
+static uint8_t *put16(uint8_t *p, uint16_t v)
+{
+  *p++ = v >> 8;
+  *p++ = v & 0xFF;
+  return p;
+}
+
+static uint8_t *putHuffman(uint8_t *p, uint8_t tcth)
+{
+  const StdTable &t = STD_TABLES[((tcth >> 4) << 1) | (tcth & 15)];
+  *p++ = 0xFF;
+  *p++ = 0xC4;
+  p = put16(p, 3 + 16 + t.n);
+  *p++ = tcth;
+  memcpy(p, t.counts, 16);
+  memcpy(p + 16, t.values, t.n);
+  return p + 16 + t.n;
+}
+
+size_t rtpJpegHeaders(uint8_t *out, uint8_t type, uint16_t width, uint16_t height, const uint8_t *tables,
+                      uint16_t restart)
+{
+  uint8_t *p = out;
+  *p++ = 0xFF;
+  *p++ = 0xD8;
+  for (int i = 0; i < 2; i++)
+  {
+    *p++ = 0xFF;
+    *p++ = 0xDB;
+    p = put16(p, 67);
+    *p++ = i;
+    memcpy(p, tables + 64 * i, 64);
+    p += 64;
+  }
+  if (type >= 64 && restart)
+  {
+    *p++ = 0xFF;
+    *p++ = 0xDD;
+    p = put16(p, 4);
+    p = put16(p, restart);
+  }
+  static const uint8_t sof[] = {0x08, 0, 0, 0, 0, 0x03, 0x01, 0x21, 0x00, 0x02, 0x11, 0x01, 0x03, 0x11, 0x01};
+  *p++ = 0xFF;
+  *p++ = 0xC0;
+  p = put16(p, 17);
+  memcpy(p, sof, sizeof(sof));
+  put16(p + 1, height);
+  put16(p + 3, width);
+  p[7] = (type & 63) == 1 ? 0x22 : 0x21;
+  p += sizeof(sof);
+  p = putHuffman(p, 0x00);
+  p = putHuffman(p, 0x10);
+  p = putHuffman(p, 0x01);
+  p = putHuffman(p, 0x11);
+  static const uint8_t sos[] = {0xFF, 0xDA, 0x00, 0x0C, 0x03, 0x01, 0x00, 0x02, 0x11, 0x03, 0x11, 0x00, 0x3F, 0x00};
+  memcpy(p, sos, sizeof(sos));
+  p += sizeof(sos);
+  return p - out;
+}
+
+RtpJpegPacketizer::RtpJpegPacketizer(uint32_t ssrc) : _offset(0), _ssrc(ssrc), _timestamp(0), _q(255), _withTables(false)
+{
+  memset(&_frame, 0, sizeof(_frame));
+  _seq = (uint16_t)(ssrc * 2654435761u >> 16); // random start, as RFC 3550 asks
+}
+
+void RtpJpegPacketizer::start(const RtpJpegFrame &frame, uint32_t timestamp, uint8_t q, bool withTables)
+{
+  _frame = frame;
+  _offset = 0;
+  _timestamp = timestamp;
+  _q = q;
+  _withTables = withTables || q == 255;
+}
+
+size_t RtpJpegPacketizer::next(uint8_t *buf)
+{
+  if (done())
+    return 0;
+  uint8_t *p = buf;
+  // RTP header: version 2, marker on the frame's last packet (filled in below)
+  *p++ = 0x80;
+  *p++ = RTP_JPEG_PAYLOAD_TYPE;
+  p = put16(p, _seq++);
+  p = put16(p, _timestamp >> 16);
+  p = put16(p, _timestamp & 0xFFFF);
+  p = put16(p, _ssrc >> 16);
+  p = put16(p, _ssrc & 0xFFFF);
+  // JPEG header: fragment offset into the scan, type, Q, size in 8-pixel units
+  *p++ = 0;
+  *p++ = _offset >> 16;
+  p = put16(p, _offset & 0xFFFF);
+  *p++ = _frame.type;
+  *p++ = _q;
+  *p++ = _frame.width >> 3;
+  *p++ = _frame.height >> 3;
+  if (_frame.type >= 64)
+  {
+    // Packets do not follow restart intervals: F and L set, count 0x3FFF, the receiver
+    // reassembles the whole frame
+    p = put16(p, _frame.restart);
+    p = put16(p, 0xFFFF);
+  }
+  if (!_offset)
+  {
+    *p++ = 0;
+    *p++ = 0;
+    p = put16(p, _withTables ? RTP_JPEG_TABLES_SIZE : 0);
+    if (_withTables)
+    {
+      memcpy(p, _frame.tables[0], 64);
+      memcpy(p + 64, _frame.tables[1], 64);
+      p += RTP_JPEG_TABLES_SIZE;
+    }
+  }
+  size_t room = RTP_MAX_PACKET - (p - buf);
+  size_t n = _frame.scanLen - _offset < room ? _frame.scanLen - _offset : room;
+  memcpy(p, _frame.scan + _offset, n);
+  _offset += n;
+  if (done())
+    buf[1] |= 0x80;
+  return p - buf + n;
+}
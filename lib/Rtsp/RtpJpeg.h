@@ -0,0 +1,66 @@
+#ifndef RTP_JPEG_H_
+#define RTP_JPEG_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define RTP_JPEG_PAYLOAD_TYPE 26    // static payload type for JPEG (RFC 3551)
+#define RTP_JPEG_CLOCK_HZ     90000
+#define RTP_MAX_PACKET        1400  // RTP + JPEG headers + scan data, under a WiFi MTU with IP/UDP
+#define RTP_JPEG_TABLES_SIZE  128   // both 8-bit quantisation tables
+#define RTP_JPEG_HEADERS_SIZE 700   // what rtpJpegHeaders() writes at most
+
+// A camera JPEG the way RFC 2435 carries it: the entropy-coded scan, plus what a receiver needs
+// to put standard headers back around it. Only frames the format can describe are accepted:
+// three components sampled 4:2:2 or 4:2:0, luma on quantisation table 0 and chroma on 1, 8-bit
+// tables, the standard Huffman tables, and a size in whole 8-pixel units up to 2040.
+struct RtpJpegFrame
+{
+  const uint8_t *scan; // entropy-coded data, up to the EOI
+  size_t scanLen;
+  const uint8_t *tables[2]; // 64 bytes each, zigzag order as in the DQT
+  uint16_t width;
+  uint16_t height;
+  uint16_t restart; // DRI interval in MCUs, 0 without restart markers
+  uint8_t type;     // 0 for 4:2:2, 1 for 4:2:0, plus 64 with restart markers
+};
+
+// False when jpg is not a frame RTP/JPEG can carry
+bool rtpJpegParse(const uint8_t *jpg, size_t len, RtpJpegFrame &out);
+
+// Receiver side (RFC 2435 appendix A): the JPEG headers for a frame rebuilt from its RTP/JPEG
+// fields, up to and including the SOS; the scan and an EOI follow. Returns the length.
+size_t rtpJpegHeaders(uint8_t *out, uint8_t type, uint16_t width, uint16_t height, const uint8_t *tables,
+                      uint16_t restart);
+
+// Cuts frames into RTP packets. Sequence numbers run on across frames, so one packetizer per
+// destination. Packets are written whole into the caller's buffer; the payload is copied out
+// of the frame, which only has to stay valid until the frame's last packet.
+class RtpJpegPacketizer
+{
+public:
+  RtpJpegPacketizer(uint32_t ssrc);
+
+  // Next frame. q is 128..255; the quantisation tables ride in its first packet when
+  // withTables, otherwise the receiver uses the ones it last got for the same q (128..254)
+  void start(const RtpJpegFrame &frame, uint32_t timestamp, uint8_t q, bool withTables);
+  // Writes the next packet into buf (at least RTP_MAX_PACKET), 0 once the frame is out
+  size_t next(uint8_t *buf);
+  bool done(void) const { return _offset >= _frame.scanLen; }
+  // Gives up on the rest of the frame (e.g. no room to send it)
+  void abandon(void) { _offset = _frame.scanLen; }
+
+  uint32_t ssrc(void) const { return _ssrc; }
+  uint16_t seq(void) const { return _seq; }
+
+private:
+  RtpJpegFrame _frame;
+  size_t _offset;
+  uint32_t _ssrc;
+  uint32_t _timestamp;
+  uint16_t _seq;
+  uint8_t _q;
+  bool _withTables;
+};
+
+#endif // RTP_JPEG_H_
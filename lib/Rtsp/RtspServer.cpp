@@ -0,0 +1,706 @@
+#include "RtspServer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <chrono>
+
+static uint64_t now_us(void)
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static uint32_t now_ms(void)
+{
+  return (uint32_t)(now_us() / 1000);
+}
+
+RtspMetrics rtspMetrics;
+
+RtspMetrics::RtspMetrics() : frameSend(LATENCY_BUCKETS_US, LATENCY_BUCKET_COUNT)
+{
+}
+
+void writeRtspMetrics(PromWriter &w)
+{
+  RtspMetrics &m = rtspMetrics;
+  w.histogram("esp32cam_rtsp_frame_send_seconds", "Per frame and session, from picking it up to its last RTP packet handed to the socket",
+              m.frameSend, 1e-6);
+  w.counter("esp32cam_rtsp_sessions_total", "RTSP sessions that started playing", m.sessions.value());
+  w.counter("esp32cam_rtsp_frames_sent_total", "Frames sent over RTP, every session", m.framesSent.value());
+  w.counter("esp32cam_rtsp_frames_dropped_total", "Frames an RTSP session skipped while still sending an older one", m.framesDropped.value());
+  w.counter("esp32cam_rtsp_frames_refused_total", "Frames RTP/JPEG cannot carry (sampling, tables, size)", m.framesRefused.value());
+  w.counter("esp32cam_rtsp_frames_truncated_total", "Frames given up part way because a UDP send failed", m.framesTruncated.value());
+  w.counter("esp32cam_rtsp_packets_total", "RTP packets sent", m.packetsSent.value());
+  w.counter("esp32cam_rtsp_bytes_total", "RTP bytes sent, with the interleave prefix on TCP", m.bytesSent.value());
+}
+
+// Value of a header line in a NUL-terminated request head, false when absent
+static bool find_header(const char *head, const char *name, char *out, size_t outLen)
+{
+  size_t n = strlen(name);
+  for (const char *line = strstr(head, "\r\n"); line; line = strstr(line, "\r\n"))
+  {
+    line += 2;
+    if (strncasecmp(line, name, n) || line[n] != ':')
+      continue;
+    const char *v = line + n + 1;
+    while (*v == ' ' || *v == '\t')
+      v++;
+    const char *e = strstr(v, "\r\n");
+    size_t len = e ? (size_t)(e - v) : strlen(v);
+    if (len >= outLen)
+      len = outLen - 1;
+    memcpy(out, v, len);
+    out[len] = 0;
+    return true;
+  }
+  return false;
+}
+
+static const char *reason_phrase(int code)
+{
+  switch (code)
+  {
+  case 200: return "OK";
+  case 400: return "Bad Request";
+  case 454: return "Session Not Found";
+  case 455: return "Method Not Valid in This State";
+  case 461: return "Unsupported Transport";
+  case 503: return "Service Unavailable";
+  default: return "Not Implemented";
+  }
+}
+
+//////////////////////////
+//      RtspClient      //
+//////////////////////////
+
+RtspClient::RtspClient() : _state(FREE), _fd(-1), _packetizer(0)
+{
+}
+
+void RtspClient::open(int fd, uint32_t now, uint32_t ssrc)
+{
+  _state = OPEN;
+  _fd = fd;
+  _lastActivity = now;
+  _closing = false;
+  _requestLen = 0;
+  _skip = 0;
+  _replyLen = _replySent = 0;
+  _session = 0;
+  _setup = false;
+  _playing = false;
+  _tcp = false;
+  _channel = 0;
+  memset(&_rtp, 0, sizeof(_rtp));
+  memset(&_rtcp, 0, sizeof(_rtcp));
+  _packetizer = RtpJpegPacketizer(ssrc);
+  _lastSeq = 0;
+  _q = 0;
+  _sinceTables = 0;
+  _frameStarted = 0;
+  _packetLen = _packetSent = 0;
+  _frames = 0;
+  _dropped = 0;
+}
+
+void RtspClient::stopPlaying(MJPEGBroadcaster &source)
+{
+  if (!_playing)
+    return;
+  _playing = false;
+  _packetizer.abandon();
+  _frame.reset();
+  source.detach();
+}
+
+void RtspClient::release(MJPEGBroadcaster &source)
+{
+  stopPlaying(source);
+  sock_close(_fd);
+  _fd = -1;
+  _state = FREE;
+}
+
+//////////////////////////
+//      RtspServer      //
+//////////////////////////
+
+RtspServer::RtspServer(MJPEGBroadcaster &source) : _source(source)
+{
+  _listenFd = _rtpFd = _rtcpFd = _wakeFd = -1;
+  _port = _rtpPort = _rtcpPort = _wakePort = 0;
+  _nextSession = (uint32_t)now_us() * 2654435761u;
+  _busyUs = 0;
+}
+
+RtspServer::~RtspServer()
+{
+  stop();
+}
+
+static int udp_bind(uint32_t ip, uint16_t port, uint16_t *bound)
+{
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd < 0)
+    return -1;
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(ip);
+  addr.sin_port = htons(port);
+  socklen_t len = sizeof(addr);
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || getsockname(fd, (struct sockaddr *)&addr, &len) < 0)
+  {
+    sock_close(fd);
+    return -1;
+  }
+  sock_set_nonblocking(fd);
+  *bound = ntohs(addr.sin_port);
+  return fd;
+}
+
+bool RtspServer::begin(uint16_t port, uint16_t rtpPort)
+{
+  _listenFd = socket(AF_INET, SOCK_STREAM, 0);
+  if (_listenFd < 0)
+    return false;
+  int one = 1;
+  setsockopt(_listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if (bind(_listenFd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(_listenFd, RTSP_MAX_CLIENTS) < 0)
+  {
+    stop();
+    return false;
+  }
+  sock_set_nonblocking(_listenFd);
+  socklen_t len = sizeof(addr);
+  getsockname(_listenFd, (struct sockaddr *)&addr, &len);
+  _port = ntohs(addr.sin_port);
+
+  // UDP sessions share one RTP and one RTCP socket; without them only interleaved ones work
+  _rtpFd = udp_bind(INADDR_ANY, rtpPort, &_rtpPort);
+  _rtcpFd = udp_bind(INADDR_ANY, rtpPort ? rtpPort + 1 : 0, &_rtcpPort);
+  // Loopback datagram socket other tasks poke to cut a select() short
+  _wakeFd = udp_bind(INADDR_LOOPBACK, 0, &_wakePort);
+  return true;
+}
+
+void RtspServer::stop(void)
+{
+  for (int i = 0; i < RTSP_MAX_CLIENTS; i++)
+    if (_clients[i]._state != RtspClient::FREE)
+      _clients[i].release(_source);
+  sock_close(_listenFd);
+  sock_close(_rtpFd);
+  sock_close(_rtcpFd);
+  sock_close(_wakeFd);
+  _listenFd = _rtpFd = _rtcpFd = _wakeFd = -1;
+}
+
+void RtspServer::wake(void)
+{
+  if (_wakeFd < 0)
+    return;
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(_wakePort);
+  char b = 1;
+  sendto(_wakeFd, &b, 1, MSG_DONTWAIT, (struct sockaddr *)&addr, sizeof(addr));
+}
+
+uint8_t RtspServer::clientCount(void) const
+{
+  uint8_t n = 0;
+  for (int i = 0; i < RTSP_MAX_CLIENTS; i++)
+    if (_clients[i]._state != RtspClient::FREE)
+      n++;
+  return n;
+}
+
+uint8_t RtspServer::playingCount(void) const
+{
+  uint8_t n = 0;
+  for (int i = 0; i < RTSP_MAX_CLIENTS; i++)
+    if (_clients[i]._state != RtspClient::FREE && _clients[i]._playing)
+      n++;
+  return n;
+}
+
+void RtspServer::closeClient(RtspClient &c)
+{
+  c.release(_source);
+}
+
+void RtspServer::acceptAll(uint32_t now)
+{
+  for (;;)
+  {
+    int fd = accept(_listenFd, NULL, NULL);
+    if (fd < 0)
+      return;
+    RtspClient *slot = NULL;
+    for (int i = 0; i < RTSP_MAX_CLIENTS && !slot; i++)
+      if (_clients[i]._state == RtspClient::FREE)
+        slot = &_clients[i];
+    if (!slot)
+    {
+      sock_close(fd);
+      continue;
+    }
+    sock_set_nonblocking(fd);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    _nextSession += 0x9E3779B9;
+    slot->open(fd, now, _nextSession * 2654435761u);
+  }
+}
+
+void RtspServer::reply(RtspClient &c, int code, const char *cseq, const char *extra, const char *body)
+{
+  int n = snprintf(c._reply, sizeof(c._reply), "RTSP/1.0 %d %s\r\nCSeq: %s\r\n%s", code, reason_phrase(code), cseq,
+                   extra ? extra : "");
+  if (n > 0 && (size_t)n < sizeof(c._reply))
+  {
+    if (body)
+      n += snprintf(c._reply + n, sizeof(c._reply) - n, "Content-Length: %u\r\n\r\n%s", (unsigned)strlen(body), body);
+    else
+      n += snprintf(c._reply + n, sizeof(c._reply) - n, "\r\n");
+  }
+  c._replyLen = (n > 0 && (size_t)n < sizeof(c._reply)) ? n : 0;
+  c._replySent = 0;
+}
+
+bool RtspServer::setup(RtspClient &c, const char *transport, char *out, size_t outLen)
+{
+  if (strstr(transport, "multicast"))
+    return false;
+  if (strstr(transport, "RTP/AVP/TCP"))
+  {
+    const char *il = strstr(transport, "interleaved=");
+    c._channel = il ? atoi(il + 12) : 0;
+    c._tcp = true;
+    snprintf(out, outLen, "RTP/AVP/TCP;unicast;interleaved=%u-%u;ssrc=%08X", c._channel, c._channel + 1,
+             (unsigned)c._packetizer.ssrc());
+    return true;
+  }
+  const char *cp = strstr(transport, "client_port=");
+  if (!cp || _rtpFd < 0)
+    return false;
+  int rtp = atoi(cp + 12);
+  const char *dash = strchr(cp, '-');
+  int rtcp = dash && dash - cp < 20 ? atoi(dash + 1) : rtp + 1;
+  struct sockaddr_in peer;
+  socklen_t len = sizeof(peer);
+  if (rtp <= 0 || rtp > 65535 || getpeername(c._fd, (struct sockaddr *)&peer, &len) < 0)
+    return false;
+  c._rtp = peer;
+  c._rtp.sin_port = htons(rtp);
+  c._rtcp = peer;
+  c._rtcp.sin_port = htons(rtcp);
+  c._tcp = false;
+  snprintf(out, outLen, "RTP/AVP;unicast;client_port=%d-%d;server_port=%u-%u;ssrc=%08X", rtp, rtcp, _rtpPort,
+           _rtcpPort, (unsigned)c._packetizer.ssrc());
+  return true;
+}
+
+// One request, head NUL terminated; false when it was not RTSP at all
+bool RtspServer::handle(RtspClient &c, char *request)
+{
+  char method[16], url[160], cseq[16], session[24], extra[320];
+  if (sscanf(request, "%15s %159s RTSP/1.0", method, url) != 2)
+    return false;
+  if (!find_header(request, "CSeq", cseq, sizeof(cseq)))
+    strcpy(cseq, "0");
+  bool hasSession = find_header(request, "Session", session, sizeof(session));
+  if (hasSession && (!c._setup || strtoul(session, NULL, 16) != c._session))
+  {
+    reply(c, 454, cseq, NULL);
+    return true;
+  }
+  extra[0] = 0;
+
+  if (!strcmp(method, "OPTIONS"))
+  {
+    reply(c, 200, cseq, "Public: OPTIONS, DESCRIBE, SETUP, PLAY, PAUSE, TEARDOWN, GET_PARAMETER, SET_PARAMETER\r\n");
+  }
+  else if (!strcmp(method, "DESCRIBE"))
+  {
+    struct sockaddr_in local;
+    socklen_t len = sizeof(local);
+    const char *ip = "0.0.0.0";
+    if (getsockname(c._fd, (struct sockaddr *)&local, &len) == 0)
+      ip = inet_ntoa(local.sin_addr);
+    char sdp[256];
+    snprintf(sdp, sizeof(sdp),
+             "v=0\r\no=- %u 1 IN IP4 %s\r\ns=ESP32-CAM\r\nc=IN IP4 0.0.0.0\r\nt=0 0\r\na=control:*\r\n"
+             "m=video 0 RTP/AVP %d\r\na=rtpmap:%d JPEG/%d\r\na=control:track1\r\n",
+             (unsigned)_nextSession, ip, RTP_JPEG_PAYLOAD_TYPE, RTP_JPEG_PAYLOAD_TYPE, RTP_JPEG_CLOCK_HZ);
+    size_t n = strlen(url);
+    snprintf(extra, sizeof(extra), "Content-Base: %s%s\r\nContent-Type: application/sdp\r\n", url,
+             n && url[n - 1] == '/' ? "" : "/");
+    reply(c, 200, cseq, extra, sdp);
+  }
+  else if (!strcmp(method, "SETUP"))
+  {
+    char transport[128], chosen[128];
+    if (c._playing)
+      reply(c, 455, cseq, NULL);
+    else if (!find_header(request, "Transport", transport, sizeof(transport)) ||
+             !setup(c, transport, chosen, sizeof(chosen)))
+      reply(c, 461, cseq, NULL);
+    else
+    {
+      if (!c._setup)
+      {
+        _nextSession += 0x9E3779B9;
+        c._session = _nextSession;
+        c._setup = true;
+      }
+      snprintf(extra, sizeof(extra), "Transport: %s\r\nSession: %08X;timeout=%d\r\n", chosen, (unsigned)c._session,
+               RTSP_SESSION_TIMEOUT);
+      reply(c, 200, cseq, extra);
+    }
+  }
+  else if (!strcmp(method, "PLAY"))
+  {
+    if (!c._setup)
+    {
+      reply(c, 455, cseq, NULL);
+      return true;
+    }
+    if (!c._playing)
+    {
+      c._playing = true;
+      c._lastSeq = 0; // the latest frame goes out straight away, as on /mjpeg
+      _source.attach();
+      rtspMetrics.sessions.add();
+    }
+    snprintf(extra, sizeof(extra), "Session: %08X\r\nRange: npt=0.000-\r\nRTP-Info: url=%s;seq=%u\r\n",
+             (unsigned)c._session, url, c._packetizer.seq());
+    reply(c, 200, cseq, extra);
+  }
+  else if (!strcmp(method, "PAUSE") || !strcmp(method, "TEARDOWN"))
+  {
+    c.stopPlaying(_source);
+    snprintf(extra, sizeof(extra), "Session: %08X\r\n", (unsigned)c._session);
+    if (method[0] == 'T')
+      c._setup = false;
+    reply(c, 200, cseq, extra);
+  }
+  else if (!strcmp(method, "GET_PARAMETER") || !strcmp(method, "SET_PARAMETER"))
+  {
+    // Keep-alives
+    if (c._setup)
+      snprintf(extra, sizeof(extra), "Session: %08X\r\n", (unsigned)c._session);
+    reply(c, 200, cseq, extra);
+  }
+  else
+    reply(c, 501, cseq, NULL);
+  return true;
+}
+
+void RtspServer::onReadable(RtspClient &c, uint32_t now)
+{
+  ssize_t n = recv(c._fd, c._request + c._requestLen, sizeof(c._request) - 1 - c._requestLen, 0);
+  if (n == 0 || (n < 0 && !sock_would_block()))
+  {
+    c._closing = true;
+    return;
+  }
+  if (n < 0)
+    return;
+  c._requestLen += n;
+  c._lastActivity = now;
+  process(c);
+}
+
+// One request at a time: the next waits in the buffer until this reply has left
+void RtspServer::process(RtspClient &c)
+{
+  while (c._requestLen && c._replySent == c._replyLen && !c._closing)
+  {
+    size_t drop = 0;
+    if (c._skip)
+    {
+      drop = c._skip < c._requestLen ? c._skip : c._requestLen;
+      c._skip -= drop;
+    }
+    else if (c._request[0] == '$')
+    {
+      // Interleaved RTCP from the client (receiver reports), nothing we need
+      if (c._requestLen < 4)
+        break;
+      c._skip = 4 + (((uint8_t)c._request[2] << 8) | (uint8_t)c._request[3]);
+      continue;
+    }
+    else
+    {
+      c._request[c._requestLen] = 0;
+      char *end = strstr(c._request, "\r\n\r\n");
+      if (!end)
+      {
+        if (c._requestLen >= sizeof(c._request) - 1)
+          c._closing = true; // head too large
+        break;
+      }
+      end[2] = 0;
+      drop = end + 4 - c._request;
+      char length[12];
+      if (!handle(c, c._request))
+      {
+        c._closing = true;
+        break;
+      }
+      if (find_header(c._request, "Content-Length", length, sizeof(length)))
+        c._skip = strtoul(length, NULL, 10);
+    }
+    memmove(c._request, c._request + drop, c._requestLen - drop);
+    c._requestLen -= drop;
+  }
+}
+
+void RtspServer::onRtcp(uint32_t now)
+{
+  // Receiver reports keep UDP sessions alive without RTSP keep-alives
+  uint8_t buf[256];
+  struct sockaddr_in from;
+  for (;;)
+  {
+    socklen_t len = sizeof(from);
+    if (recvfrom(_rtcpFd, buf, sizeof(buf), 0, (struct sockaddr *)&from, &len) < 0)
+      return;
+    for (int i = 0; i < RTSP_MAX_CLIENTS; i++)
+    {
+      RtspClient &c = _clients[i];
+      if (c._state == RtspClient::OPEN && c._setup && !c._tcp && c._rtcp.sin_addr.s_addr == from.sin_addr.s_addr &&
+          c._rtcp.sin_port == from.sin_port)
+        c._lastActivity = now;
+    }
+  }
+}
+
+// Takes up the newest published frame, false when there is none to send yet
+bool RtspServer::nextFrame(RtspClient &c)
+{
+  // Hand frames back while the source is being reconfigured
+  if (_source.paused() || !_source.tryAcquire(c._frame, c._lastSeq))
+  {
+    c._frame.reset();
+    return false;
+  }
+  if (c._lastSeq && c._frame.getSeq() > c._lastSeq + 1)
+  {
+    uint32_t skipped = c._frame.getSeq() - c._lastSeq - 1;
+    c._dropped += skipped;
+    rtspMetrics.framesDropped.add(skipped);
+  }
+  c._lastSeq = c._frame.getSeq();
+  c._frameStarted = now_us();
+
+  RtpJpegFrame f;
+  if (!rtpJpegParse(c._frame.getBuf(), c._frame.getSize(), f))
+  {
+    rtspMetrics.framesRefused.add();
+    c._frame.reset();
+    return false;
+  }
+  // The tables go out once; new tables (a quality change) get a new Q, so a receiver that
+  // caches them per Q never decodes with the old ones. UDP repeats them in case one got lost.
+  bool tables = false;
+  if (!c._q || memcmp(c._tables, f.tables[0], 64) || memcmp(c._tables + 64, f.tables[1], 64))
+  {
+    memcpy(c._tables, f.tables[0], 64);
+    memcpy(c._tables + 64, f.tables[1], 64);
+    c._q = c._q && c._q < 254 ? c._q + 1 : 128;
+    tables = true;
+  }
+  else if (!c._tcp && ++c._sinceTables >= RTSP_TABLES_EVERY)
+    tables = true;
+  if (tables)
+    c._sinceTables = 0;
+  uint32_t timestamp = (uint32_t)(c._frame.getTimestamp() * (RTP_JPEG_CLOCK_HZ / 1000) / 1000);
+  c._packetizer.start(f, timestamp, c._q, tables);
+  return true;
+}
+
+// Pushes the pending interleaved packet, false when the connection is gone
+bool RtspServer::flushPacket(RtspClient &c)
+{
+  while (c._packetSent < c._packetLen)
+  {
+    ssize_t n = ::send(c._fd, c._packet + c._packetSent, c._packetLen - c._packetSent, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (n < 0 && sock_would_block())
+      return true;
+    if (n <= 0)
+      return false;
+    c._packetSent += n;
+  }
+  return true;
+}
+
+void RtspServer::frameDone(RtspClient &c)
+{
+  c._frames++;
+  rtspMetrics.framesSent.add();
+  rtspMetrics.frameSend.observe(now_us() - c._frameStarted);
+}
+
+bool RtspServer::pump(RtspClient &c)
+{
+  for (;;)
+  {
+    // An interleaved packet is never cut by a reply, or the client loses its framing
+    if (c._packetSent < c._packetLen)
+    {
+      bool last = c._packetizer.done();
+      if (!flushPacket(c))
+        return false;
+      if (c._packetSent < c._packetLen)
+        return true;
+      c._packetLen = c._packetSent = 0;
+      if (last && c._playing)
+        frameDone(c);
+    }
+    if (c._replySent < c._replyLen)
+    {
+      ssize_t n = ::send(c._fd, c._reply + c._replySent, c._replyLen - c._replySent, MSG_NOSIGNAL | MSG_DONTWAIT);
+      if (n < 0 && sock_would_block())
+        return true;
+      if (n <= 0)
+        return false;
+      c._replySent += n;
+      if (c._replySent < c._replyLen)
+        return true;
+      c._replyLen = c._replySent = 0;
+      process(c);
+      continue;
+    }
+    if (!c._playing)
+      return true;
+    if (c._packetizer.done() && !nextFrame(c))
+      return true;
+
+    size_t n = c._packetizer.next(c._packet + 4);
+    bool last = c._packetizer.done();
+    if (last)
+      c._frame.reset(); // the payload is copied out, the driver gets its buffer back
+    rtspMetrics.packetsSent.add();
+    if (c._tcp)
+    {
+      c._packet[0] = '$';
+      c._packet[1] = c._channel;
+      c._packet[2] = n >> 8;
+      c._packet[3] = n & 0xFF;
+      c._packetLen = n + 4;
+      c._packetSent = 0;
+      rtspMetrics.bytesSent.add(n + 4);
+      continue;
+    }
+    if (sendto(_rtpFd, c._packet + 4, n, MSG_DONTWAIT, (struct sockaddr *)&c._rtp, sizeof(c._rtp)) < 0)
+    {
+      // No room in the stack's buffers; the receiver drops the incomplete frame anyway
+      c._packetizer.abandon();
+      c._frame.reset();
+      rtspMetrics.framesTruncated.add();
+      return true;
+    }
+    rtspMetrics.bytesSent.add(n);
+    if (last)
+      frameDone(c);
+  }
+}
+
+void RtspServer::poll(uint32_t timeout_ms)
+{
+  uint64_t started = now_us();
+  uint64_t slept = turn(timeout_ms);
+  _busyUs.fetch_add(now_us() - started - slept, std::memory_order_relaxed);
+}
+
+uint64_t RtspServer::turn(uint32_t timeout_ms)
+{
+  fd_set rd, wr;
+  FD_ZERO(&rd);
+  FD_ZERO(&wr);
+  int maxFd = -1;
+  uint32_t now = now_ms();
+  int fixed[3] = {_listenFd, _rtcpFd, _wakeFd};
+  for (int i = 0; i < 3; i++)
+  {
+    if (fixed[i] < 0)
+      continue;
+    FD_SET(fixed[i], &rd);
+    if (fixed[i] > maxFd)
+      maxFd = fixed[i];
+  }
+  for (int i = 0; i < RTSP_MAX_CLIENTS; i++)
+  {
+    RtspClient &c = _clients[i];
+    if (c._state == RtspClient::FREE)
+      continue;
+    // Sessions get their frames before we go to sleep
+    if (!c._closing && !pump(c))
+      c._closing = true;
+    // Interleaved sessions are alive as long as the connection is; the rest need requests
+    // or receiver reports now and then
+    if (c._closing || (!(c._playing && c._tcp) && now - c._lastActivity > RTSP_SESSION_TIMEOUT * 1000u))
+    {
+      closeClient(c);
+      continue;
+    }
+    // A full buffer waits for the reply in front of it to leave
+    if (c._requestLen < sizeof(c._request) - 1)
+      FD_SET(c._fd, &rd);
+    if (c._packetSent < c._packetLen || c._replySent < c._replyLen)
+      FD_SET(c._fd, &wr);
+    if (c._fd > maxFd)
+      maxFd = c._fd;
+  }
+  if (maxFd < 0)
+    return 0;
+
+  struct timeval tv;
+  tv.tv_sec = timeout_ms / 1000;
+  tv.tv_usec = (timeout_ms % 1000) * 1000;
+  uint64_t asleep = now_us();
+  int ready = select(maxFd + 1, &rd, &wr, NULL, &tv);
+  asleep = now_us() - asleep;
+  if (ready <= 0)
+    return asleep;
+  now = now_ms();
+
+  if (_wakeFd >= 0 && FD_ISSET(_wakeFd, &rd))
+  {
+    char drain[16];
+    while (recv(_wakeFd, drain, sizeof(drain), 0) > 0)
+      ;
+  }
+  if (_rtcpFd >= 0 && FD_ISSET(_rtcpFd, &rd))
+    onRtcp(now);
+  if (_listenFd >= 0 && FD_ISSET(_listenFd, &rd))
+    acceptAll(now);
+
+  for (int i = 0; i < RTSP_MAX_CLIENTS; i++)
+  {
+    RtspClient &c = _clients[i];
+    if (c._state == RtspClient::FREE || c._fd > maxFd)
+      continue;
+    if (FD_ISSET(c._fd, &rd))
+      onReadable(c, now);
+    if (!c._closing && !pump(c))
+      c._closing = true;
+    if (c._closing)
+      closeClient(c);
+  }
+  return asleep;
+}
@@ -0,0 +1,159 @@
+#ifndef RTSP_SERVER_H_
+#define RTSP_SERVER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <Metrics.h>
+#include <SocketCompat.h>
+#include <FrameRef.h>
+#include <MJPEGBroadcaster.h>
+#include "RtpJpeg.h"
+
+#define RTSP_PORT             554
+#define RTSP_MAX_CLIENTS      4
+#define RTSP_REQUEST_SIZE     1024 // request line + headers
+#define RTSP_REPLY_SIZE       768
+#define RTSP_SESSION_TIMEOUT  60   // seconds without a request or receiver report, UDP sessions
+#define RTSP_TABLES_EVERY     50   // UDP sessions get the quantisation tables again this many frames on
+
+// RTSP server instruments, every session together
+struct RtspMetrics
+{
+  RtspMetrics();
+
+  Histogram frameSend; // per frame, parse, packetize and hand every packet to the socket (us)
+  Counter sessions;    // PLAYs started
+  Counter framesSent;
+  Counter framesDropped;  // published while a session was still sending an older one
+  Counter framesRefused;  // frames RTP/JPEG cannot carry (see rtpJpegParse)
+  Counter framesTruncated; // UDP sends that failed part way, the rest of the frame was given up
+  Counter packetsSent;
+  Counter bytesSent; // RTP packets, with the interleave prefix on TCP
+};
+
+extern RtspMetrics rtspMetrics;
+
+void writeRtspMetrics(PromWriter &w);
+
+// One RTSP control connection and the session set up on it
+class RtspClient
+{
+public:
+  RtspClient();
+
+  bool playing(void) const { return _playing; }
+  bool interleaved(void) const { return _tcp; }
+  uint32_t frames(void) const { return _frames; }
+  uint32_t dropped(void) const { return _dropped; }
+
+private:
+  friend class RtspServer;
+
+  enum State
+  {
+    FREE,
+    OPEN
+  };
+
+  void open(int fd, uint32_t now, uint32_t ssrc);
+  void release(MJPEGBroadcaster &source);
+  void stopPlaying(MJPEGBroadcaster &source);
+
+  State _state;
+  int _fd;
+  uint32_t _lastActivity;
+  bool _closing;
+
+  char _request[RTSP_REQUEST_SIZE];
+  size_t _requestLen;
+  size_t _skip; // body or interleaved bytes from the client still to be thrown away
+
+  char _reply[RTSP_REPLY_SIZE];
+  size_t _replyLen;
+  size_t _replySent;
+
+  // Session, at most one per connection
+  uint32_t _session;
+  bool _setup;
+  bool _playing;
+  bool _tcp;
+  uint8_t _channel;         // interleaved RTP channel, RTCP is the next one
+  struct sockaddr_in _rtp;  // UDP destinations
+  struct sockaddr_in _rtcp;
+
+  RtpJpegPacketizer _packetizer;
+  FrameRef _frame;
+  uint32_t _lastSeq;
+  uint8_t _tables[RTP_JPEG_TABLES_SIZE]; // what this receiver last got
+  uint8_t _q;                            // and the Q it got them for, 0 before the first frame
+  uint32_t _sinceTables;
+  uint64_t _frameStarted;
+
+  uint8_t _packet[4 + RTP_MAX_PACKET]; // $ channel length prefix on TCP
+  size_t _packetLen;
+  size_t _packetSent;
+
+  uint32_t _frames;
+  uint32_t _dropped;
+};
+
+// select()-driven RTSP server for one stream: every client gets the broadcaster's frames as
+// RTP/JPEG (RFC 2435), over UDP unicast or interleaved in the RTSP connection. JPEG headers
+// are stripped, the quantisation tables go out once per receiver (again when they change, and
+// now and then over UDP), and a session that falls behind skips to the newest frame. Any URL
+// names the stream. Sessions live as long as their control connection.
+class RtspServer
+{
+public:
+  RtspServer(MJPEGBroadcaster &source);
+  ~RtspServer();
+
+  // RTSP on port, RTP/RTCP from rtpPort and the one above it (0 for any free ones)
+  bool begin(uint16_t port = RTSP_PORT, uint16_t rtpPort = 0);
+  void stop(void);
+  uint16_t port(void) const { return _port; }
+  uint16_t rtpPort(void) const { return _rtpPort; }
+  uint16_t rtcpPort(void) const { return _rtcpPort; }
+
+  // One turn of the event loop, returns after at most timeout_ms
+  void poll(uint32_t timeout_ms);
+  // Thread-safe; interrupts a poll(), e.g. when a frame is published
+  void wake(void);
+
+  uint8_t clientCount(void) const;
+  uint8_t playingCount(void) const;
+  const RtspClient &client(uint8_t i) const { return _clients[i]; }
+  // Time spent in poll() outside select(), thread-safe
+  uint64_t busyMicros(void) const { return _busyUs.load(std::memory_order_relaxed); }
+
+private:
+  void acceptAll(uint32_t now);
+  void onReadable(RtspClient &c, uint32_t now);
+  void process(RtspClient &c);
+  void onRtcp(uint32_t now);
+  bool handle(RtspClient &c, char *request);
+  void reply(RtspClient &c, int code, const char *cseq, const char *extra, const char *body = NULL);
+  bool setup(RtspClient &c, const char *transport, char *out, size_t outLen);
+  bool pump(RtspClient &c); // false when the connection is gone
+  bool nextFrame(RtspClient &c);
+  bool flushPacket(RtspClient &c);
+  void frameDone(RtspClient &c);
+  void closeClient(RtspClient &c);
+  uint64_t turn(uint32_t timeout_ms);
+
+  MJPEGBroadcaster &_source;
+  int _listenFd;
+  int _rtpFd;
+  int _rtcpFd;
+  int _wakeFd;
+  uint16_t _port;
+  uint16_t _rtpPort;
+  uint16_t _rtcpPort;
+  uint16_t _wakePort;
+  uint32_t _nextSession;
+  RtspClient _clients[RTSP_MAX_CLIENTS];
+  std::atomic<uint64_t> _busyUs;
+};
+
+#endif // RTSP_SERVER_H_
@@ -0,0 +1,339 @@
+#include "Scheduler.h"
+#include <stdio.h>
+#include <string.h>
+#if defined(ARDUINO)
+  #include "esp_timer.h"
+#else
+  #include <chrono>
+#endif
+
+#define SCHED_SLOT_MASK (SCHED_WHEEL_SLOTS - 1)
+
+static uint64_t system_clock(void)
+{
+#if defined(ARDUINO)
+  return esp_timer_get_time();
+#else
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+Scheduler::Scheduler(SchedClock clock) : lateness(LATENCY_BUCKETS_US, LATENCY_BUCKET_COUNT), _stopping(false)
+{
+  _clock = clock ? clock : system_clock;
+  for (int i = 0; i < SCHED_MAX_JOBS; i++)
+  {
+    _jobs[i].used = false;
+    _jobs[i].generation = 1;
+  }
+  for (int i = 0; i < SCHED_WHEEL_SLOTS; i++)
+    _slots[i] = -1;
+  _tick = _clock() / SCHED_TICK_US;
+#if defined(ARDUINO)
+  _signal = xSemaphoreCreateBinary();
+#else
+  _signalled = false;
+#endif
+}
+
+//////////////////////////
+//        Wheel         //
+//////////////////////////
+
+// Into the slot of its deadline's tick, with the whole turns until then. Overdue jobs go on
+// the current tick. Called with the lock held.
+void Scheduler::link(int i)
+{
+  Job &job = _jobs[i];
+  uint64_t tick = job.due_us / SCHED_TICK_US;
+  if (tick < _tick)
+    tick = _tick;
+  job.rounds = (tick - _tick) / SCHED_WHEEL_SLOTS;
+  job.slot = tick & SCHED_SLOT_MASK;
+  job.next = _slots[job.slot];
+  _slots[job.slot] = i;
+  job.linked = true;
+}
+
+void Scheduler::unlink(int i)
+{
+  Job &job = _jobs[i];
+  if (!job.linked)
+    return;
+  for (int8_t *p = &_slots[job.slot]; *p >= 0; p = &_jobs[*p].next)
+  {
+    if (*p == i)
+    {
+      *p = job.next;
+      break;
+    }
+  }
+  job.linked = false;
+}
+
+// Expires whole ticks up to now: a job on a passed tick with no turns left is due. Each passed
+// slot loses a turn from everything else on it. On the current, unfinished tick only jobs whose
+// deadline has arrived are due, so nothing runs early for the tick resolution.
+int Scheduler::findDue(uint64_t now)
+{
+  uint64_t nowTick = now / SCHED_TICK_US;
+  for (;;)
+  {
+    bool whole = _tick < nowTick;
+    for (int8_t i = _slots[_tick & SCHED_SLOT_MASK]; i >= 0; i = _jobs[i].next)
+    {
+      if (!_jobs[i].rounds && (whole || _jobs[i].due_us <= now))
+        return i;
+    }
+    if (!whole)
+      return -1;
+    for (int8_t i = _slots[_tick & SCHED_SLOT_MASK]; i >= 0; i = _jobs[i].next)
+      _jobs[i].rounds--;
+    _tick++;
+  }
+}
+
+uint64_t Scheduler::nextDeadline(void)
+{
+  uint64_t next = UINT64_MAX;
+  for (int i = 0; i < SCHED_MAX_JOBS; i++)
+    if (_jobs[i].used && _jobs[i].linked && _jobs[i].due_us < next)
+      next = _jobs[i].due_us;
+  return next;
+}
+
+//////////////////////////
+//         Jobs         //
+//////////////////////////
+
+SchedId Scheduler::add(const char *name, uint64_t period_us, uint64_t delay_us, SchedFn fn, void *ctx)
+{
+  SchedId id = 0;
+  {
+    std::lock_guard<std::mutex> guard(_lock);
+    for (int i = 0; i < SCHED_MAX_JOBS; i++)
+    {
+      Job &job = _jobs[i];
+      if (job.used)
+        continue;
+      job.used = true;
+      job.name = name;
+      job.fn = fn;
+      job.ctx = ctx;
+      job.period_us = period_us;
+      job.due_us = _clock() + delay_us;
+      job.running = job.cancelled = false;
+      job.linked = false;
+      memset(&job.stats, 0, sizeof(job.stats));
+      link(i);
+      id = (SchedId)(job.generation << 8 | i);
+      break;
+    }
+  }
+  if (id)
+    wake(); // the deadline may be earlier than the one the task sleeps towards
+  return id;
+}
+
+SchedId Scheduler::every(const char *name, uint32_t period_ms, SchedFn fn, void *ctx, uint32_t first_ms)
+{
+  if (!period_ms)
+    return 0;
+  return add(name, (uint64_t)period_ms * 1000, (uint64_t)first_ms * 1000, fn, ctx);
+}
+
+SchedId Scheduler::after(const char *name, uint32_t delay_ms, SchedFn fn, void *ctx)
+{
+  return add(name, 0, (uint64_t)delay_ms * 1000, fn, ctx);
+}
+
+bool Scheduler::cancel(SchedId id)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  int i = id & 0xFF;
+  if (i >= SCHED_MAX_JOBS)
+    return false;
+  Job &job = _jobs[i];
+  if (!job.used || job.generation != id >> 8 || job.cancelled)
+    return false;
+  if (job.running)
+  {
+    job.cancelled = true; // runDue() frees it once the run returns
+    return true;
+  }
+  unlink(i);
+  job.used = false;
+  job.generation = job.generation == 0xFF ? 1 : job.generation + 1;
+  return true;
+}
+
+bool Scheduler::stats(SchedId id, SchedStats *out)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  int i = id & 0xFF;
+  if (i >= SCHED_MAX_JOBS || !_jobs[i].used || _jobs[i].generation != id >> 8)
+    return false;
+  *out = _jobs[i].stats;
+  return true;
+}
+
+uint64_t Scheduler::runDue(void)
+{
+  for (;;)
+  {
+    int i;
+    SchedFn fn;
+    void *ctx;
+    uint64_t due;
+    uint64_t now = _clock();
+    {
+      std::lock_guard<std::mutex> guard(_lock);
+      i = findDue(now);
+      if (i < 0)
+      {
+        uint64_t next = nextDeadline();
+        return next > now ? next - now : 0;
+      }
+      Job &job = _jobs[i];
+      unlink(i);
+      job.running = true;
+      fn = job.fn;
+      ctx = job.ctx;
+      due = job.due_us;
+    }
+
+    uint64_t started = _clock();
+    fn(ctx);
+    uint64_t finished = _clock();
+
+    std::lock_guard<std::mutex> guard(_lock);
+    Job &job = _jobs[i];
+    SchedStats &s = job.stats;
+    uint32_t late = started > due ? (uint32_t)(started - due) : 0;
+    uint32_t took = (uint32_t)(finished - started);
+    s.runs++;
+    s.lastLate_us = late;
+    s.lastRun_us = took;
+    if (late > s.maxLate_us)
+      s.maxLate_us = late;
+    if (took > s.maxRun_us)
+      s.maxRun_us = took;
+    lateness.observe(late);
+    job.running = false;
+    if (job.period_us && !job.cancelled)
+    {
+      // Stay in phase; periods that went by while it was late or running are skipped
+      uint64_t missed = finished > due ? (finished - due) / job.period_us : 0;
+      s.overruns += missed;
+      job.due_us = due + (missed + 1) * job.period_us;
+      link(i);
+    }
+    else
+    {
+      job.used = false;
+      job.generation = job.generation == 0xFF ? 1 : job.generation + 1;
+    }
+  }
+}
+
+//////////////////////////
+//         Task         //
+//////////////////////////
+
+void Scheduler::run(void)
+{
+  while (!_stopping)
+  {
+    uint64_t wait_us = runDue();
+    if (wait_us > (uint64_t)SCHED_MAX_WAIT_MS * 1000)
+      wait_us = (uint64_t)SCHED_MAX_WAIT_MS * 1000;
+    if (wait_us && !_stopping)
+      wait(wait_us);
+  }
+}
+
+void Scheduler::stop(void)
+{
+  _stopping = true;
+  wake();
+}
+
+#if defined(ARDUINO)
+
+void Scheduler::wake(void)
+{
+  xSemaphoreGive(_signal);
+}
+
+void Scheduler::wait(uint64_t timeout_us)
+{
+  // Rounded up to whole RTOS ticks, waking early would only mean another look at the wheel
+  TickType_t ticks = (timeout_us + portTICK_PERIOD_MS * 1000 - 1) / (portTICK_PERIOD_MS * 1000);
+  xSemaphoreTake(_signal, ticks);
+}
+
+#else
+
+void Scheduler::wake(void)
+{
+  std::lock_guard<std::mutex> guard(_signalLock);
+  _signalled = true;
+  _signal.notify_one();
+}
+
+void Scheduler::wait(uint64_t timeout_us)
+{
+  std::unique_lock<std::mutex> guard(_signalLock);
+  _signal.wait_for(guard, std::chrono::microseconds(timeout_us), [this] { return _signalled; });
+  _signalled = false;
+}
+
+#endif
+
+//////////////////////////
+//       Metrics        //
+//////////////////////////
+
+void writeSchedulerMetrics(PromWriter &w, Scheduler &s)
+{
+  w.histogram("esp32cam_sched_lateness_seconds", "Housekeeping job start past its deadline", s.lateness, 1e-6);
+
+  SchedStats stats[SCHED_MAX_JOBS];
+  const char *names[SCHED_MAX_JOBS];
+  int n = 0;
+  {
+    std::lock_guard<std::mutex> guard(s._lock);
+    for (int i = 0; i < SCHED_MAX_JOBS; i++)
+    {
+      if (!s._jobs[i].used)
+        continue;
+      stats[n] = s._jobs[i].stats;
+      names[n++] = s._jobs[i].name;
+    }
+  }
+  char labels[48];
+  w.header("esp32cam_sched_runs_total", "counter", "Runs of each housekeeping job");
+  for (int i = 0; i < n; i++)
+  {
+    snprintf(labels, sizeof(labels), "job=\"%s\"", names[i]);
+    w.sample("esp32cam_sched_runs_total", labels, stats[i].runs);
+  }
+  w.header("esp32cam_sched_overruns_total", "counter", "Periods each job skipped because it started late or ran too long");
+  for (int i = 0; i < n; i++)
+  {
+    snprintf(labels, sizeof(labels), "job=\"%s\"", names[i]);
+    w.sample("esp32cam_sched_overruns_total", labels, stats[i].overruns);
+  }
+  w.header("esp32cam_sched_late_max_seconds", "gauge", "Worst start past the deadline of each job");
+  for (int i = 0; i < n; i++)
+  {
+    snprintf(labels, sizeof(labels), "job=\"%s\"", names[i]);
+    w.sample("esp32cam_sched_late_max_seconds", labels, stats[i].maxLate_us / 1e6);
+  }
+  w.header("esp32cam_sched_run_max_seconds", "gauge", "Longest run of each job");
+  for (int i = 0; i < n; i++)
+  {
+    snprintf(labels, sizeof(labels), "job=\"%s\"", names[i]);
+    w.sample("esp32cam_sched_run_max_seconds", labels, stats[i].maxRun_us / 1e6);
+  }
+}
@@ -0,0 +1,110 @@
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <mutex>
+#include <Metrics.h>
+#if defined(ARDUINO)
+  #include <freertos/FreeRTOS.h>
+  #include <freertos/semphr.h>
+#else
+  #include <condition_variable>
+#endif
+
+#define SCHED_MAX_JOBS    12
+#define SCHED_TICK_US     10000 // wheel resolution; jobs still run at their own deadline, not on a tick
+#define SCHED_WHEEL_SLOTS 64    // power of two, one turn is 640 ms; longer delays count whole turns
+#define SCHED_MAX_WAIT_MS 60000 // longest sleep between two looks at the wheel
+
+typedef void (*SchedFn)(void *ctx);
+typedef uint64_t (*SchedClock)(void); // microseconds, monotonic
+typedef uint16_t SchedId;             // 0 is never a valid job
+
+struct SchedStats
+{
+  uint32_t runs;
+  uint32_t overruns; // periods skipped because the job started late or ran longer than its period
+  uint32_t lastLate_us;
+  uint32_t maxLate_us;
+  uint32_t lastRun_us;
+  uint32_t maxRun_us;
+};
+
+// Periodic and one-shot jobs on a hashed timer wheel, all run by one task that sleeps until
+// the next deadline. Adding, cancelling and expiring are O(1) per job whatever the delay; a
+// periodic job keeps its phase (the next deadline is the last one plus the period, never
+// "now" plus the period) and skips, rather than queues up, periods it missed. Jobs run
+// outside the lock and may add or cancel jobs themselves.
+class Scheduler
+{
+public:
+  Scheduler(SchedClock clock = NULL); // NULL for the system's monotonic clock
+
+  // First run after first_ms, then every period_ms; 0 when the table is full
+  SchedId every(const char *name, uint32_t period_ms, SchedFn fn, void *ctx, uint32_t first_ms = 0);
+  // One run after delay_ms
+  SchedId after(const char *name, uint32_t delay_ms, SchedFn fn, void *ctx);
+  // False when id is not scheduled (any more); a running job finishes but is not rescheduled
+  bool cancel(SchedId id);
+
+  // Runs every job that is due, returns microseconds until the next deadline
+  uint64_t runDue(void);
+  // Task body: runDue() and sleep, until stop()
+  void run(void);
+  void stop(void);
+
+  uint64_t now(void) const { return _clock(); }
+  bool stats(SchedId id, SchedStats *out);
+
+  Histogram lateness; // start time past the deadline, every run of every job
+
+private:
+  friend void writeSchedulerMetrics(PromWriter &w, Scheduler &s);
+
+  struct Job
+  {
+    const char *name;
+    SchedFn fn;
+    void *ctx;
+    uint64_t period_us; // 0 for one-shots
+    uint64_t due_us;
+    uint32_t rounds;    // whole wheel turns left before the slot's expiry applies
+    uint8_t slot;
+    int8_t next;        // in the slot's list
+    uint8_t generation;
+    bool used;
+    bool linked;
+    bool running;
+    bool cancelled;
+    SchedStats stats;
+  };
+
+  SchedId add(const char *name, uint64_t period_us, uint64_t delay_us, SchedFn fn, void *ctx);
+  void link(int i);
+  void unlink(int i);
+  int findDue(uint64_t now); // next job to run, -1 when none is due
+  uint64_t nextDeadline(void);
+  void wake(void);
+  void wait(uint64_t timeout_us);
+
+  SchedClock _clock;
+  std::mutex _lock;
+  Job _jobs[SCHED_MAX_JOBS];
+  int8_t _slots[SCHED_WHEEL_SLOTS];
+  uint64_t _tick; // wheel position: every tick before it has been expired
+  std::atomic<bool> _stopping;
+#if defined(ARDUINO)
+  SemaphoreHandle_t _signal;
+#else
+  std::mutex _signalLock;
+  std::condition_variable _signal;
+  bool _signalled;
+#endif
+};
+
+// Lateness histogram plus per-job runs, overruns and worst lateness and run time
+void writeSchedulerMetrics(PromWriter &w, Scheduler &s);
+
+#endif // SCHEDULER_H_
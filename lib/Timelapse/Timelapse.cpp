@@ -0,0 +1,287 @@
+#include "Timelapse.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <chrono>
+#include <MJPEG_Streaming.h>
+#if defined(ARDUINO)
+  #include "esp_heap_caps.h"
+#endif
+
+TimelapseMetrics timelapseMetrics;
+
+TimelapseMetrics::TimelapseMetrics()
+    : take(LATENCY_BUCKETS_US, LATENCY_BUCKET_COUNT), write(LATENCY_BUCKETS_US, LATENCY_BUCKET_COUNT)
+{
+}
+
+void writeTimelapseMetrics(PromWriter &w)
+{
+  TimelapseMetrics &m = timelapseMetrics;
+  w.histogram("esp32cam_timelapse_take_seconds", "Per time-lapse frame, from due to stored, framesize switch included",
+              m.take, 1e-6);
+  w.histogram("esp32cam_timelapse_write_seconds", "Per time-lapse frame, appending and syncing data and index", m.write,
+              1e-6);
+  w.counter("esp32cam_timelapse_frames_total", "Frames added to the time-lapse store", m.frames.value());
+  w.counter("esp32cam_timelapse_bytes_total", "Frame bytes added to the time-lapse store", m.bytes.value());
+  w.counter("esp32cam_timelapse_failures_total", "Time-lapse frames not stored: capture, switch or write failed, or store full",
+            m.failures.value());
+  w.counter("esp32cam_timelapse_missed_total", "Time-lapse frames due while the previous one was still being taken",
+            m.missed.value());
+  w.counter("esp32cam_timelapse_served_total", "Time-lapse frames played back", m.served.value());
+}
+
+static uint64_t steady_us(void)
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// The driver's buffer may run past the image; only the bytes up to EOI are worth keeping
+static size_t jpeg_length(const uint8_t *buf, size_t len)
+{
+  size_t stop = len > 1024 ? len - 1024 : 0;
+  for (size_t i = len; i >= stop + 2; i--)
+  {
+    if (buf[i - 2] == 0xFF && buf[i - 1] == 0xD9)
+      return i;
+  }
+  return len;
+}
+
+//////////////////////////
+//       Timelapse      //
+//////////////////////////
+
+Timelapse::Timelapse(MJPEGBroadcaster &broadcaster, FrameSource &source, TimelapseStore &store)
+    : _broadcaster(broadcaster), _source(source), _store(store)
+{
+  _switch = _jobSwitch = NULL;
+  _switchCtx = _jobCtx = NULL;
+  _buf = NULL;
+  _bufSize = 0;
+  _len = 0;
+  _due = false;
+  _jobDone = false;
+  _jobOk = false;
+  _stopping = false;
+}
+
+Timelapse::~Timelapse()
+{
+  free(_buf);
+}
+
+bool Timelapse::begin(size_t maxFrame)
+{
+  if (_buf)
+    return true;
+#if defined(ARDUINO)
+  _buf = (uint8_t *)heap_caps_malloc(maxFrame, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+#else
+  _buf = (uint8_t *)malloc(maxFrame);
+#endif
+  _bufSize = _buf ? maxFrame : 0;
+  return _buf != NULL;
+}
+
+void Timelapse::onSwitch(TimelapseSwitch fn, void *ctx)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  _switch = fn;
+  _switchCtx = ctx;
+}
+
+void Timelapse::trigger(void)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  if (_due)
+    timelapseMetrics.missed.add();
+  _due = true;
+  _changed.notify_all();
+}
+
+bool Timelapse::copy(const FrameRef &frame)
+{
+  size_t len = jpeg_length(frame.getBuf(), frame.getSize());
+  if (!len || len > _bufSize)
+    return false;
+  memcpy(_buf, frame.getBuf(), len);
+  _len = len;
+  return true;
+}
+
+void Timelapse::switchedJob(void *ctx)
+{
+  Timelapse *self = (Timelapse *)ctx;
+  self->_jobSwitch(true, self->_jobCtx);
+  // Each capture hands the previous buffer back first, so this works with a single frame buffer too
+  FrameRef frame;
+  for (uint8_t i = 0; i <= TL_SETTLE_FRAMES; i++)
+  {
+    frame.reset();
+    frame = self->_source.capture();
+  }
+  bool ok = frame && self->copy(frame);
+  frame.reset();
+  self->_jobSwitch(false, self->_jobCtx);
+  for (uint8_t i = 0; i < TL_SETTLE_FRAMES; i++)
+    self->_source.capture();
+
+  std::lock_guard<std::mutex> guard(self->_lock);
+  self->_jobOk = ok;
+  self->_jobDone = true;
+  self->_changed.notify_all();
+}
+
+bool Timelapse::takeOne(void)
+{
+  if (!_buf)
+    return false;
+  uint64_t start = steady_us();
+  bool ok;
+  std::unique_lock<std::mutex> guard(_lock);
+  if (_switch)
+  {
+    _jobSwitch = _switch;
+    _jobCtx = _switchCtx;
+    _jobDone = false;
+    guard.unlock();
+    // False while another job is pending, e.g. a reconfiguration; this frame is lost then
+    ok = _broadcaster.schedule(switchedJob, this);
+    guard.lock();
+    _changed.wait(guard, [this, ok] { return !ok || _jobDone || _stopping; });
+    ok = ok && _jobDone && _jobOk;
+    guard.unlock();
+  }
+  else
+  {
+    guard.unlock();
+    // Attaching wakes an idle producer; the frame must be captured after the request
+    _broadcaster.attach();
+    FrameRef frame;
+    ok = _broadcaster.acquire(frame, _broadcaster.latestSeq()) && copy(frame);
+    frame.reset();
+    _broadcaster.detach();
+  }
+
+  if (ok)
+  {
+    uint64_t written = steady_us();
+    ok = _store.append(_buf, _len, time(NULL));
+    timelapseMetrics.write.observe(steady_us() - written);
+  }
+  if (ok)
+  {
+    timelapseMetrics.frames.add();
+    timelapseMetrics.bytes.add(_len);
+    timelapseMetrics.take.observe(steady_us() - start);
+  }
+  else
+  {
+    timelapseMetrics.failures.add();
+  }
+  return ok;
+}
+
+void Timelapse::run(void)
+{
+  std::unique_lock<std::mutex> guard(_lock);
+  for (;;)
+  {
+    _changed.wait(guard, [this] { return _due || _stopping; });
+    if (_stopping)
+      return;
+    _due = false;
+    guard.unlock();
+    takeOne();
+    guard.lock();
+  }
+}
+
+void Timelapse::shutdown(void)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  _stopping = true;
+  _changed.notify_all();
+}
+
+//////////////////////////
+//   TimelapseStreamer  //
+//////////////////////////
+
+TimelapseStreamer::TimelapseStreamer(TimelapseStore &store, uint32_t from, uint32_t to, float fps) : _store(store)
+{
+  _buf = NULL;
+  _started = 0;
+  _interval = fps > 0 ? (uint64_t)(1e6 / fps) : 0;
+  _first = _index = from ? _store.find(from) : 0;
+  _end = to && to < 0xFFFFFFFF ? _store.find(to + 1) : _store.count();
+  _pos = 0;
+  _inFrame = false;
+  _headerSent = false;
+  if (_first >= _end)
+  {
+    _end = _first;
+    return;
+  }
+#if defined(ARDUINO)
+  _buf = (uint8_t *)heap_caps_malloc(TL_READ_CHUNK, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+#else
+  _buf = (uint8_t *)malloc(TL_READ_CHUNK);
+#endif
+}
+
+TimelapseStreamer::~TimelapseStreamer()
+{
+  free(_buf);
+}
+
+bool TimelapseStreamer::due(void)
+{
+  return !_interval || steady_us() - _started >= (_index - _first) * _interval;
+}
+
+bool TimelapseStreamer::ready(void)
+{
+  return !_headerSent || _inFrame || _index >= _end || due();
+}
+
+bool TimelapseStreamer::pump(HttpConnection &conn)
+{
+  if (!_headerSent)
+  {
+    _headerSent = true;
+    _started = steady_us();
+    conn.queue(HEADER, hdrLen);
+    conn.queue(BOUNDARY, bdrLen);
+    return true;
+  }
+  if (!_inFrame)
+  {
+    if (_index >= _end)
+      return false;
+    if (!due())
+      return true;
+    if (!_store.entry(_index, _entry))
+      return false;
+    char head[64];
+    conn.queueCopy(head, mjpegPartHeader(head, sizeof(head), _entry.len, false));
+    _pos = 0;
+    _inFrame = true;
+  }
+  // The buffer is only refilled once the connection is idle again, i.e. after it has gone out
+  uint32_t n = _entry.len - _pos < TL_READ_CHUNK ? _entry.len - _pos : TL_READ_CHUNK;
+  if (!_store.read(_entry, _pos, _buf, n))
+    return false;
+  conn.queue(_buf, n);
+  _pos += n;
+  if (_pos == _entry.len)
+  {
+    conn.queue(BOUNDARY, bdrLen);
+    _inFrame = false;
+    _index++;
+    timelapseMetrics.served.add();
+  }
+  return true;
+}
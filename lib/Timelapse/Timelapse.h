@@ -0,0 +1,117 @@
+#ifndef TIMELAPSE_H_
+#define TIMELAPSE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <mutex>
+#include <condition_variable>
+#include <EventServer.h>
+#include <Metrics.h>
+#include <MJPEGBroadcaster.h>
+#include "TimelapseStore.h"
+
+#define TL_MAX_FRAME     (160 * 1024) // largest frame kept, a UXGA capture at a good quality
+#define TL_SETTLE_FRAMES 2            // dropped after each framesize switch, still in flight at the old size
+#define TL_READ_CHUNK    (16 * 1024)  // playback reads per pump, bounds the event loop's time on the card
+
+// Time-lapse instruments
+struct TimelapseMetrics
+{
+  TimelapseMetrics();
+
+  Histogram take;  // per frame: due until stored, framesize switch included (us)
+  Histogram write; // per frame: data, index and sync
+  Counter frames;  // frames stored
+  Counter bytes;
+  Counter failures; // capture, switch or write failures, and frames the full store turned away
+  Counter missed;   // due while the previous frame was still being taken
+  Counter served;   // frames played back
+};
+
+extern TimelapseMetrics timelapseMetrics;
+
+void writeTimelapseMetrics(PromWriter &w);
+
+// Called on the producer with publishing stopped: true before the time-lapse frame, false after
+typedef void (*TimelapseSwitch)(bool timelapse, void *ctx);
+
+// Takes one frame whenever trigger() says one is due and appends it to the store, on a task of
+// its own so the card never holds up the producer or the event loop. Without a switch function
+// the next published frame is taken, like any other reader would. With one, the frame is taken
+// as a broadcaster job instead: the switch (e.g. the sensor's framesize), TL_SETTLE_FRAMES
+// dropped, one frame copied, the switch back and as many dropped again, so streams pause for
+// a few frame times and never see a frame at the other size.
+class Timelapse
+{
+public:
+  Timelapse(MJPEGBroadcaster &broadcaster, FrameSource &source, TimelapseStore &store);
+  ~Timelapse();
+
+  // Allocates the frame copy (PSRAM on the device), false when it cannot
+  bool begin(size_t maxFrame = TL_MAX_FRAME);
+  void onSwitch(TimelapseSwitch fn, void *ctx); // NULL takes frames as streamed
+
+  // A frame is due. Never blocks, e.g. for a periodic housekeeping job
+  void trigger(void);
+  // Takes and stores a frame now, false when that failed
+  bool takeOne(void);
+
+  // Task body, returns after shutdown()
+  void run(void);
+  void shutdown(void);
+
+private:
+  static void switchedJob(void *ctx);
+  bool copy(const FrameRef &frame);
+
+  MJPEGBroadcaster &_broadcaster;
+  FrameSource &_source;
+  TimelapseStore &_store;
+  std::mutex _lock;
+  std::condition_variable _changed;
+  TimelapseSwitch _switch;
+  void *_switchCtx;
+  TimelapseSwitch _jobSwitch; // what the pending job switches with, fixed when it was scheduled
+  void *_jobCtx;
+  uint8_t *_buf;
+  size_t _bufSize;
+  size_t _len;
+  bool _due;
+  bool _jobDone;
+  bool _jobOk;
+  bool _stopping;
+};
+
+// Plays stored frames from one time through another as MJPEG at fps frames per second, or as
+// fast as the socket takes them with fps 0. Frames are read from the store a TL_READ_CHUNK at
+// a time as the connection drains, so one buffer serves any frame size. Pacing is re-checked
+// whenever the server wakes.
+class TimelapseStreamer : public Streamer
+{
+public:
+  // Frames taken from 'from' through 'to' (unix seconds, inclusive; 0 leaves that end open)
+  TimelapseStreamer(TimelapseStore &store, uint32_t from, uint32_t to, float fps);
+  ~TimelapseStreamer();
+
+  bool opened(void) const { return _buf != NULL; } // false when there was no frame in range
+  uint32_t frames(void) const { return _end - _first; }
+  bool ready(void);
+  bool pump(HttpConnection &conn);
+
+private:
+  bool due(void);
+
+  TimelapseStore &_store;
+  TimelapseEntry _entry;
+  uint8_t *_buf;
+  uint64_t _started;   // steady clock when the first frame went out
+  uint64_t _interval;  // us between frames, 0 unpaced
+  uint32_t _first;
+  uint32_t _index;
+  uint32_t _end;
+  uint32_t _pos;       // bytes of the current frame queued so far
+  bool _inFrame;
+  bool _headerSent;
+};
+
+#endif // TIMELAPSE_H_
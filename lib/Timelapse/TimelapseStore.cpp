@@ -0,0 +1,207 @@
+#include "TimelapseStore.h"
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define TL_CHECK 0x544C5831 // "TLX1", folded into every record's check word
+
+static inline void put32(uint8_t *p, uint32_t v)
+{
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+}
+
+static inline uint32_t get32(const uint8_t *p)
+{
+  return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline uint32_t check_word(const TimelapseEntry &e)
+{
+  return e.offset ^ (e.len * 2654435761u) ^ (e.time * 40503u) ^ TL_CHECK;
+}
+
+// Written data only counts once it is on the medium, not in stdio's or the VFS's buffers
+static bool sync_file(FILE *f)
+{
+  return fflush(f) == 0 && fsync(fileno(f)) == 0;
+}
+
+TimelapseStore::TimelapseStore()
+{
+  _data = NULL;
+  _index = NULL;
+  _dataPath[0] = _indexPath[0] = 0;
+  _count = 0;
+  _end = 0;
+  _lastTime = 0;
+  _max = TL_MAX_STORE_BYTES;
+  _full = false;
+}
+
+TimelapseStore::~TimelapseStore()
+{
+  close();
+}
+
+bool TimelapseStore::openFiles(const char *mode)
+{
+  _data = fopen(_dataPath, mode);
+  _index = fopen(_indexPath, mode);
+  if (_data && _index)
+    return true;
+  if (_data)
+    fclose(_data);
+  if (_index)
+    fclose(_index);
+  _data = _index = NULL;
+  return false;
+}
+
+bool TimelapseStore::open(const char *dir, uint32_t maxBytes)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  if (_data)
+    return false;
+  mkdir(dir, 0755);
+  snprintf(_dataPath, sizeof(_dataPath), "%s/frames.bin", dir);
+  snprintf(_indexPath, sizeof(_indexPath), "%s/index.bin", dir);
+  _max = maxBytes;
+  // Both files are written at explicit positions, so they are opened for update, not append
+  if (!openFiles("r+b") && !openFiles("w+b"))
+    return false;
+
+  fseek(_data, 0, SEEK_END);
+  long dataSize = ftell(_data);
+  fseek(_index, 0, SEEK_END);
+  _count = ftell(_index) / TL_RECORD_SIZE; // a torn last record is left out here...
+  // ...and one whose data never fully made it is dropped now; the next append overwrites both
+  TimelapseEntry last;
+  while (_count && (!readRecord(_count - 1, last) || (long)last.offset + last.len > dataSize))
+    _count--;
+  _end = _count ? last.offset + last.len : 0;
+  _lastTime = _count ? last.time : 0;
+  _full = false;
+  return true;
+}
+
+void TimelapseStore::close(void)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  if (_data)
+    fclose(_data);
+  if (_index)
+    fclose(_index);
+  _data = _index = NULL;
+  _count = 0;
+}
+
+bool TimelapseStore::clear(void)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  if (!_data)
+    return false;
+  fclose(_data);
+  fclose(_index);
+  _count = 0;
+  _end = 0;
+  _lastTime = 0;
+  _full = false;
+  return openFiles("w+b");
+}
+
+bool TimelapseStore::append(const uint8_t *jpg, size_t len, uint32_t time)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  if (!_data || !len)
+    return false;
+  if (len > _max - _end)
+  {
+    _full = true;
+    return false;
+  }
+  TimelapseEntry e;
+  e.offset = _end;
+  e.len = len;
+  e.time = time > _lastTime ? time : _lastTime;
+  if (fseek(_data, e.offset, SEEK_SET) || fwrite(jpg, 1, len, _data) != len || !sync_file(_data))
+    return false;
+  // The record goes in last: until it is synced the frame does not exist
+  uint8_t record[TL_RECORD_SIZE];
+  put32(record, e.offset);
+  put32(record + 4, e.len);
+  put32(record + 8, e.time);
+  put32(record + 12, check_word(e));
+  if (fseek(_index, (long)_count * TL_RECORD_SIZE, SEEK_SET) || fwrite(record, 1, sizeof(record), _index) != sizeof(record) ||
+      !sync_file(_index))
+    return false;
+  _count++;
+  _end += len;
+  _lastTime = e.time;
+  return true;
+}
+
+uint32_t TimelapseStore::count(void)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  return _count;
+}
+
+uint32_t TimelapseStore::bytes(void)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  return _end;
+}
+
+bool TimelapseStore::full(void)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  return _full;
+}
+
+bool TimelapseStore::readRecord(uint32_t index, TimelapseEntry &out)
+{
+  uint8_t record[TL_RECORD_SIZE];
+  if (fseek(_index, (long)index * TL_RECORD_SIZE, SEEK_SET) || fread(record, 1, sizeof(record), _index) != sizeof(record))
+    return false;
+  out.offset = get32(record);
+  out.len = get32(record + 4);
+  out.time = get32(record + 8);
+  return out.len && get32(record + 12) == check_word(out);
+}
+
+bool TimelapseStore::entry(uint32_t index, TimelapseEntry &out)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  return _data && index < _count && readRecord(index, out);
+}
+
+uint32_t TimelapseStore::find(uint32_t time)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  if (!_data)
+    return 0;
+  uint32_t lo = 0, hi = _count;
+  while (lo < hi)
+  {
+    uint32_t mid = lo + (hi - lo) / 2;
+    TimelapseEntry e;
+    if (!readRecord(mid, e))
+      return _count;
+    if (e.time < time)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+bool TimelapseStore::read(const TimelapseEntry &e, uint32_t at, uint8_t *buf, size_t len)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  if (!_data || at > e.len || len > e.len - at)
+    return false;
+  return !fseek(_data, (long)(e.offset + at), SEEK_SET) && fread(buf, 1, len, _data) == len;
+}
@@ -0,0 +1,66 @@
+#ifndef TIMELAPSE_STORE_H_
+#define TIMELAPSE_STORE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <mutex>
+
+#define TL_RECORD_SIZE     16         // index bytes per frame
+#define TL_MAX_STORE_BYTES 0x7FFFFFFF // frame data cap: the largest offset stdio seeks to on the device (32-bit off_t)
+
+struct TimelapseEntry
+{
+  uint32_t offset; // in the data file
+  uint32_t len;
+  uint32_t time; // unix seconds, never decreasing along the index
+};
+
+// Append-only frame store in two files through plain stdio, like AviWriter, so the same code
+// runs on the SD card's VFS mount and on a Linux filesystem. frames.bin holds the JPEGs back to
+// back; index.bin one fixed-size record per frame (offset, length, time and a check word, all
+// little-endian), so frame i is a single seek away and a time is a binary search over the
+// index. A frame's data is synced before its record is written, and open() drops a torn or
+// dangling tail, so a power cut costs at most the frame that was being written.
+class TimelapseStore
+{
+public:
+  TimelapseStore();
+  ~TimelapseStore();
+
+  // Creates dir if needed and picks up the frames already stored there
+  bool open(const char *dir, uint32_t maxBytes = TL_MAX_STORE_BYTES);
+  void close(void);
+  bool isOpen(void) const { return _data != NULL; }
+  bool clear(void); // drops every frame
+
+  // False when the store is full or the write failed. The time is clamped to the last frame's,
+  // so a clock that steps back (e.g. the first NTP sync) keeps the index sorted.
+  bool append(const uint8_t *jpg, size_t len, uint32_t time);
+
+  uint32_t count(void);
+  uint32_t bytes(void); // frame data, the index is count() * TL_RECORD_SIZE on top
+  bool full(void);      // the last append did not fit
+  bool entry(uint32_t index, TimelapseEntry &out);
+  // First frame taken at or after time, count() when there is none
+  uint32_t find(uint32_t time);
+  // len bytes of a frame starting at offset at
+  bool read(const TimelapseEntry &e, uint32_t at, uint8_t *buf, size_t len);
+
+private:
+  bool openFiles(const char *mode);
+  bool readRecord(uint32_t index, TimelapseEntry &out);
+
+  std::mutex _lock; // one FILE per file, shared by the capture task and playback
+  FILE *_data;
+  FILE *_index;
+  char _dataPath[96];
+  char _indexPath[96];
+  uint32_t _count;
+  uint32_t _end; // end of the last frame's data, where the next one goes
+  uint32_t _lastTime;
+  uint32_t _max;
+  bool _full;
+};
+
+#endif // TIMELAPSE_STORE_H_
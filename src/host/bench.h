@@ -0,0 +1,49 @@
+#ifndef HOST_BENCH_H_
+#define HOST_BENCH_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <vector>
+
+class SocketReader;
+
+// Command line helpers shared by the benchmarks, options are passed as --name=value
+const char *opt_str(int argc, char **argv, const char *name, const char *fallback);
+long opt_int(int argc, char **argv, const char *name, long fallback);
+double opt_double(int argc, char **argv, const char *name, double fallback);
+
+// /mjpeg client counting received frames until stop is set (bench_http.cpp)
+void mjpeg_viewer(uint16_t port, std::atomic<bool> *stop, std::atomic<uint64_t> *frames);
+// Reads the next part of a /mjpeg response into frame (bench_ws.cpp)
+bool mjpeg_part(SocketReader &in, std::vector<uint8_t> &frame);
+// JPEGs of a clip directory, or JPEG-shaped filler around size bytes without one (bench_record.cpp)
+void load_frames(const char *dir, size_t size, std::vector<std::vector<uint8_t> > &clip);
+
+// Benchmarks (one per file)
+int bench_broadcast(int argc, char **argv);
+int bench_http(int argc, char **argv);
+int bench_framing(int argc, char **argv);
+int bench_abr(int argc, char **argv);
+int bench_reconfig(int argc, char **argv);
+int bench_snapshot(int argc, char **argv);
+int bench_metrics(int argc, char **argv);
+int bench_replay(int argc, char **argv);
+int bench_motion(int argc, char **argv);
+int bench_notify(int argc, char **argv);
+int bench_ring(int argc, char **argv);
+int bench_record(int argc, char **argv);
+int bench_ota(int argc, char **argv);
+int bench_delta(int argc, char **argv);
+int bench_oled(int argc, char **argv);
+int bench_text(int argc, char **argv);
+int bench_assets(int argc, char **argv);
+int bench_pipeline(int argc, char **argv);
+int bench_sched(int argc, char **argv);
+int bench_scale(int argc, char **argv);
+int bench_rtsp(int argc, char **argv);
+int bench_ws(int argc, char **argv);
+int bench_backpressure(int argc, char **argv);
+int bench_timelapse(int argc, char **argv);
+
+#endif // HOST_BENCH_H_
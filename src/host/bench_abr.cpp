@@ -0,0 +1,107 @@
+// Bitrate controller against a simulated bandwidth-limited link, in virtual time
+#include <stdio.h>
+#include <stdlib.h>
+#include <AdaptiveBitrate.h>
+#include "bench.h"
+
+// Same ladder as the firmware, framesize_t values spelled out
+static const AbrLevel ladder[] = {
+  {13, 12}, {12, 12}, {11, 12}, {10, 12}, {9, 12}, {9, 18},
+  {8, 12},  {8, 18},  {8, 25},  {7, 15},  {5, 12}, {5, 20}
+};
+
+static uint32_t pixels(uint8_t framesize)
+{
+  switch (framesize)
+  {
+  case 5:  return 320 * 240;
+  case 7:  return 480 * 320;
+  case 8:  return 640 * 480;
+  case 9:  return 800 * 600;
+  case 10: return 1024 * 768;
+  case 11: return 1280 * 720;
+  case 12: return 1280 * 1024;
+  default: return 1600 * 1200;
+  }
+}
+
+// Rough OV2640 JPEG size model: ~25 KB for VGA at quality 12
+static double frame_bytes(const AbrLevel &l)
+{
+  return pixels(l.framesize) / (double)l.quality;
+}
+
+// Sensor rate drops above SVGA
+static double sensor_fps(const AbrLevel &l)
+{
+  return l.framesize > 9 ? 12.5 : 25;
+}
+
+// Link bandwidth in bit/s over the run: good, then a weak spell, then middling
+static double bandwidth(double t, double total)
+{
+  double f = t / total;
+  if (f < 0.3)
+    return 12e6;
+  if (f < 0.6)
+    return 1.5e6;
+  return 5e6;
+}
+
+int bench_abr(int argc, char **argv)
+{
+  double total = opt_double(argc, argv, "seconds", 180);
+  double target = opt_double(argc, argv, "fps", 15);
+  double jitter = opt_double(argc, argv, "jitter", 0.15); // +/- share of bandwidth noise per frame
+  int start = opt_int(argc, argv, "start", 4);
+  int floor = opt_int(argc, argv, "quality", 15); // the preset's quality, no rung streams better
+
+  AdaptiveBitrate abr(ladder, sizeof(ladder) / sizeof(ladder[0]));
+  abr.configure(target, 2000);
+  abr.setCeiling(start);
+  abr.setQualityFloor(floor);
+  abr.setLevel(start);
+  srand(1);
+
+  printf("target %.1f fps, %.0f s simulated, ceiling rung %d, preset quality %d\n", target, total, start, floor);
+  printf("   t(s)  link(Mbit/s) rung framesize quality  fps  busy\n");
+  double t = 0, lastPrint = -10;
+  const void *client = &abr;
+  uint32_t frames = 0;
+  double fpsSum = 0;
+  uint8_t weakest = start, recovered = 0xFF; // worst rung overall, best one once the link came back
+  uint8_t bestQuality = 0xFF;
+  while (t < total)
+  {
+    AbrLevel l = abr.current();
+    if (l.quality < bestQuality)
+      bestQuality = l.quality;
+    double noise = 1 + jitter * (2.0 * rand() / RAND_MAX - 1);
+    double bw = bandwidth(t, total) * noise;
+    double send = frame_bytes(l) * 8 / bw;
+    double interval = send > 1 / sensor_fps(l) ? send : 1 / sensor_fps(l); // skip-to-latest pacing
+    t += interval;
+    frames++;
+    abr.frameSent(client, (size_t)frame_bytes(l), (uint32_t)(send * 1e6));
+    abr.tick((uint64_t)(t * 1e6));
+    if (abr.level() > weakest)
+      weakest = abr.level();
+    if (t >= total * 0.6 && abr.level() < recovered)
+      recovered = abr.level();
+    if (t - lastPrint >= 5)
+    {
+      lastPrint = t;
+      fpsSum += abr.lastFps();
+      printf("%7.1f %13.2f %4u %9u %7u %5.1f %4.0f%%\n", t, bandwidth(t, total) / 1e6, abr.level(),
+             abr.current().framesize, abr.current().quality, abr.lastFps(), abr.lastBusy() * 100);
+    }
+  }
+  printf("%u level changes, %.1f fps average delivered\n", abr.changes(), frames / total);
+  // The weak spell must push it down and the middling link must let it climb back part way
+  bool ok = weakest > start && recovered < weakest;
+  printf("weak spell down to rung %u, back up to rung %u after it: %s\n", weakest, recovered, ok ? "ok" : "FAILED");
+  bool kept = bestQuality >= floor;
+  printf("best quality streamed %u against the preset's %d: %s\n", bestQuality, floor, kept ? "ok" : "FAILED");
+  ok &= kept;
+  return ok ? 0 : 1;
+}
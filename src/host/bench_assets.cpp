@@ -0,0 +1,198 @@
+// Web pages from flash: bytes on the wire and time until a page can render, for the pages as
+// they used to go out (include/OTA.h and Dashboard.h: uncompressed, Connection: close, nothing
+// cacheable) against the gzipped assets with ETags. Link time is modelled from the measured
+// bytes and round trips; the exchanges themselves run against the server.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <EventServer.h>
+#include <StaticAsset.h>
+#include <WebAssets.h>
+#include "bench.h"
+#include "host_net.h"
+
+// Sizes of the old pages, same paths
+struct LegacyPage
+{
+  const char *path;
+  size_t len;
+};
+static const LegacyPage legacyPages[] = {{"/", 637}, {"/serverIndex", 967}, {"/dash", 1612}};
+#define JQUERY_BYTES 86659 // jquery-3.2.1.min.js, which the old update page loaded from a CDN
+
+static std::vector<uint8_t> g_plain; // stand-in bodies for the uncompressed pages
+
+static size_t legacy_len(const char *path)
+{
+  for (size_t i = 0; i < sizeof(legacyPages) / sizeof(legacyPages[0]); i++)
+    if (!strcmp(legacyPages[i].path, path))
+      return legacyPages[i].len;
+  return 0;
+}
+
+static void handle_asset(HttpConnection &conn)
+{
+  const StaticAsset *asset = findAsset(webAssets, WEB_ASSET_COUNT, conn.path());
+  if (asset)
+    sendAsset(conn, *asset);
+  else
+    conn.send(404, "text/plain", "");
+}
+
+// The old way: the whole page, uncompressed, and the connection closed behind it
+static void handle_legacy(HttpConnection &conn)
+{
+  conn.sendHeader("Connection", "close");
+  conn.send(200, "text/html", g_plain.data(), legacy_len(conn.path() + strlen("/legacy")));
+}
+
+struct Exchange
+{
+  int status;
+  std::string etag;
+  std::string body;
+  size_t wire; // head and body bytes received
+};
+
+static std::string header_value(const std::string &head, const char *name)
+{
+  std::string k = std::string("\r\n") + name + ": ";
+  const char *at = strcasestr(head.c_str(), k.c_str());
+  if (!at)
+    return "";
+  at += k.size();
+  return std::string(at, strstr(at, "\r\n") - at);
+}
+
+// One request on fd, the response read by its Content-Length so the connection can be reused
+static bool exchange(int fd, const char *path, const char *ifNoneMatch, Exchange *x)
+{
+  char req[256];
+  int n = snprintf(req, sizeof(req), "GET %s HTTP/1.1\r\nHost: cam\r\nAccept-Encoding: gzip\r\n%s%s%s\r\n", path,
+                   ifNoneMatch ? "If-None-Match: " : "", ifNoneMatch ? ifNoneMatch : "", ifNoneMatch ? "\r\n" : "");
+  if (!send_all(fd, req, n))
+    return false;
+  std::string in;
+  char buf[4096];
+  size_t headEnd;
+  while ((headEnd = in.find("\r\n\r\n")) == std::string::npos)
+  {
+    ssize_t got = recv(fd, buf, sizeof(buf), 0);
+    if (got <= 0)
+      return false;
+    in.append(buf, got);
+  }
+  std::string head = in.substr(0, headEnd + 2);
+  size_t len = atol(header_value(head, "Content-Length").c_str());
+  while (in.size() < headEnd + 4 + len)
+  {
+    ssize_t got = recv(fd, buf, sizeof(buf), 0);
+    if (got <= 0)
+      return false;
+    in.append(buf, got);
+  }
+  x->status = atoi(in.c_str() + 9);
+  x->etag = header_value(head, "ETag");
+  x->body = in.substr(headEnd + 4, len);
+  x->wire = headEnd + 4 + len;
+  return true;
+}
+
+struct Visit
+{
+  size_t wire;
+  int roundTrips;
+  int requests;
+  double serverMs;
+};
+
+static double link_ms(const Visit &v, double rttMs, double kBps)
+{
+  return v.roundTrips * rttMs + v.wire / (kBps * 1024) * 1000;
+}
+
+int bench_assets(int argc, char **argv)
+{
+  double rttMs = opt_double(argc, argv, "rtt-ms", 20);
+  double kBps = opt_double(argc, argv, "link-kbps", 100);
+  int rounds = opt_int(argc, argv, "rounds", 200);
+
+  g_plain.assign(4096, 'x');
+
+  HttpServer server;
+  for (size_t i = 0; i < WEB_ASSET_COUNT; i++)
+    server.on(webAssets[i].path, METHOD_GET, handle_asset);
+  server.onNotFound(handle_legacy);
+  server.begin(0);
+  uint16_t port = server.port();
+  std::atomic<bool> stop(false);
+  std::thread loop([&] { while (!stop) server.poll(50); });
+
+  printf("%-13s %9s %9s %9s %9s\n", "page", "old", "raw", "gzip", "vs old");
+  for (size_t i = 0; i < WEB_ASSET_COUNT; i++)
+    printf("%-13s %9zu %9zu %9zu %8.0f%%\n", webAssets[i].path, legacy_len(webAssets[i].path), webAssets[i].rawLen,
+           webAssets[i].len, 100.0 * webAssets[i].len / legacy_len(webAssets[i].path) - 100);
+
+  printf("\nlink %.0f KB/s, %.0f ms round trip; a new connection costs a round trip before the request's own\n",
+         kBps, rttMs);
+  printf("%-13s %-8s %10s %6s %11s %13s\n", "page", "visit", "bytes", "reqs", "server us", "render ms");
+  bool ok = true;
+  for (size_t i = 0; i < WEB_ASSET_COUNT; i++)
+  {
+    const StaticAsset &page = webAssets[i];
+    // Old: one connection per page, full size every time; the update page also needed jQuery
+    Visit legacy = {0, 0, 0, 0};
+    std::string legacyPath = std::string("/legacy") + page.path;
+    for (int r = 0; r < rounds; r++)
+    {
+      uint64_t t0 = now_us();
+      int fd = tcp_connect(port);
+      Exchange x;
+      ok &= exchange(fd, legacyPath.c_str(), NULL, &x);
+      tcp_close(fd);
+      legacy.serverMs += (now_us() - t0) / 1e3 / rounds;
+      legacy.wire = x.wire;
+    }
+    legacy.roundTrips = 2;
+    legacy.requests = 1;
+    printf("%-13s %-8s %10zu %6d %11.0f %13.1f\n", page.path, "before", legacy.wire, legacy.requests,
+           legacy.serverMs * 1e3, link_ms(legacy, rttMs, kBps));
+    if (!strcmp(page.path, "/serverIndex"))
+      printf("%-13s %-8s %10d %6s %11s %13s\n", "", "+ jQuery", JQUERY_BYTES, "1", "", "no internet: broken");
+
+    // New, first and repeat visit
+    for (int repeat = 0; repeat < 2; repeat++)
+    {
+      Visit v = {0, 0, 0, 0};
+      for (int r = 0; r < rounds; r++)
+      {
+        uint64_t t0 = now_us();
+        int fd = tcp_connect(port);
+        Exchange x;
+        ok &= exchange(fd, page.path, repeat ? page.etag : NULL, &x);
+        ok &= repeat ? x.status == 304 : x.status == 200 && x.etag == page.etag && x.body.size() == page.len;
+        tcp_close(fd);
+        v.serverMs += (now_us() - t0) / 1e3 / rounds;
+        v.wire = x.wire;
+      }
+      // Connection setup and the request, as before; the page is a single request
+      v.requests = 1;
+      v.roundTrips = 2;
+      printf("%-13s %-8s %10zu %6d %11.0f %13.1f\n", "", repeat ? "repeat" : "first", v.wire, v.requests,
+             v.serverMs * 1e3, link_ms(v, rttMs, kBps));
+    }
+  }
+  printf("\n%s\n", ok ? "ETags, 304s and gzip bodies as expected" : "UNEXPECTED RESPONSE");
+
+  stop = true;
+  server.wake();
+  loop.join();
+  server.stop();
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,189 @@
+// One viewer on a slow link next to fast viewers and a recording-style consumer: with
+// backpressure the slow stream skips frames while its socket is still full and gets the newest
+// one when it catches up, so its latency stays bounded and nobody else loses frames. The same
+// run without it shows what piles up in the socket instead. Per-client drops come from /metrics.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <EventServer.h>
+#include <Metrics.h>
+#include <MJPEGStreamer.h>
+#include <PipelineMetrics.h>
+#include "bench.h"
+#include "host_net.h"
+#include "host_stats.h"
+#include "synthetic_source.h"
+
+static MJPEGBroadcaster *g_broadcaster;
+
+static void handle_stream(HttpConnection &conn) { conn.stream(new MJPEGStreamer(*g_broadcaster)); }
+
+static void handle_metrics(HttpConnection &conn)
+{
+  std::string out;
+  PromWriter w(out);
+  writePipelineMetrics(w);
+  conn.sendCopy(200, "text/plain; version=0.0.4", out.data(), out.size());
+}
+
+static void wake(void *ctx) { ((HttpServer *)ctx)->wake(); }
+
+// Connection with a small receive window, the way a slow WiFi client looks from the device
+static int slow_connect(uint16_t port, int rcvbuf)
+{
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  if (connect(fd, (sockaddr *)&addr, sizeof(addr)) < 0)
+  {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static void slow_viewer(uint16_t port, uint32_t bytesPerSecond, const std::atomic<bool> *stop, std::vector<double> *latencyMs)
+{
+  int fd = slow_connect(port, 16 * 1024);
+  const char req[] = "GET /mjpeg HTTP/1.1\r\nHost: bench\r\n\r\n";
+  send_all(fd, req, sizeof(req) - 1);
+  SocketReader in(fd, stop, bytesPerSecond);
+  std::vector<uint8_t> frame;
+  while (!*stop && mjpeg_part(in, frame))
+  {
+    uint64_t captured = SyntheticSource::stamp(frame.data(), frame.size());
+    if (captured)
+      latencyMs->push_back((now_us() - captured) / 1000.0);
+  }
+  tcp_close(fd);
+}
+
+// Per-client drops as /metrics reports them, "a/b/c"
+static std::string client_drops(uint16_t port)
+{
+  int fd = tcp_connect(port);
+  const char req[] = "GET /metrics HTTP/1.1\r\nConnection: close\r\n\r\n";
+  send_all(fd, req, sizeof(req) - 1);
+  std::string body;
+  char buf[4096];
+  ssize_t n;
+  while ((n = recv(fd, buf, sizeof(buf), 0)) > 0)
+    body.append(buf, n);
+  tcp_close(fd);
+  std::string drops;
+  const char *series = "esp32cam_client_dropped_total{";
+  for (size_t at = body.find(series); at != std::string::npos; at = body.find(series, at + 1))
+  {
+    size_t value = body.find("} ", at);
+    if (value == std::string::npos)
+      break;
+    if (!drops.empty())
+      drops += "/";
+    drops += std::to_string(strtoul(body.c_str() + value + 2, NULL, 10));
+  }
+  return drops;
+}
+
+static bool run(bool backpressure, int viewers, double fps, size_t size, uint32_t slowRate, double seconds)
+{
+  MJPEGStreamer::backpressure = backpressure;
+  SyntheticSource source(size, fps, true);
+  MJPEGBroadcaster b(source);
+  g_broadcaster = &b;
+  HttpServer server;
+  server.on("/mjpeg", METHOD_GET, handle_stream);
+  server.on("/metrics", METHOD_GET, handle_metrics);
+  server.begin(0);
+  b.onPublish(wake, &server);
+
+  std::atomic<bool> stop(false), clientStop(false);
+  std::atomic<uint64_t> recorded(0);
+  uint64_t captured0 = pipelineMetrics.framesCaptured.value();
+  std::thread loop([&] { while (!stop) server.poll(50); });
+  std::thread producer([&] { while (!stop) b.captureOnce(); });
+  // Takes every frame the way the recorder's feeder does
+  std::thread recorder([&] {
+    b.attach();
+    uint32_t seq = b.latestSeq();
+    FrameRef frame;
+    while (!clientStop && b.acquire(frame, seq))
+    {
+      seq = frame.getSeq();
+      frame.reset();
+      recorded++;
+    }
+    b.detach();
+  });
+
+  std::vector<std::atomic<uint64_t> > frames(viewers);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < viewers; i++)
+  {
+    frames[i] = 0;
+    threads.push_back(std::thread(mjpeg_viewer, server.port(), &clientStop, &frames[i]));
+  }
+  std::vector<double> latency;
+  threads.push_back(std::thread(slow_viewer, server.port(), slowRate, &clientStop, &latency));
+
+  uint64_t start = now_us();
+  sleep_us((uint64_t)(seconds * 1e6));
+  std::string drops = client_drops(server.port());
+  clientStop = true;
+  double elapsed = (now_us() - start) / 1e6;
+  for (size_t i = 0; i < threads.size(); i++)
+    threads[i].join();
+  stop = true;
+  b.shutdown();
+  server.wake();
+  loop.join();
+  producer.join();
+  recorder.join();
+  server.stop();
+
+  double captureFps = (pipelineMetrics.framesCaptured.value() - captured0) / elapsed;
+  double slowest = 1e9;
+  for (int i = 0; i < viewers; i++)
+    slowest = frames[i] / elapsed < slowest ? frames[i] / elapsed : slowest;
+  double p50 = latency.empty() ? 0 : percentile(latency, 50), p99 = latency.empty() ? 0 : percentile(latency, 99);
+  printf("%-12s %8.1f %8.1f %9.1f %8.1f %9.0f %9.0f  %s\n", backpressure ? "backpressure" : "none", captureFps,
+         recorded / elapsed, slowest, latency.size() / elapsed, p50, p99, drops.c_str());
+
+  if (!backpressure)
+    return true;
+  // Others keep the capture rate; the slow stream lags by a few frames' transfer time at most
+  double bound = 4.0 * size / slowRate * 1000 + 2000 / fps;
+  bool ok = slowest >= 0.9 * captureFps && recorded / elapsed >= 0.95 * captureFps && !latency.empty() && p99 <= bound;
+  if (!ok)
+    printf("  FAILED: others have to keep %.1f fps and the slow stream's p99 stay under %.0f ms\n", captureFps, bound);
+  return ok;
+}
+
+int bench_backpressure(int argc, char **argv)
+{
+  int viewers = opt_int(argc, argv, "viewers", 3);
+  double fps = opt_double(argc, argv, "fps", 25);
+  size_t size = opt_int(argc, argv, "size", 30000);
+  uint32_t slowRate = opt_int(argc, argv, "slow-kbps", 2000) * 1000 / 8;
+  double seconds = opt_double(argc, argv, "seconds", 5);
+
+  printf("%d fast viewers, one at %u kbit/s, %.0f fps of %u byte frames\n", viewers, slowRate * 8 / 1000, fps,
+         (unsigned)size);
+  printf("%-12s %8s %8s %9s %8s %9s %9s  %s\n", "mode", "capture", "record", "fast min", "slow", "slow p50", "slow p99",
+         "drops per client");
+  bool ok = run(false, viewers, fps, size, slowRate, seconds);
+  ok &= run(true, viewers, fps, size, slowRate, seconds);
+  MJPEGStreamer::backpressure = true;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,121 @@
+// MJPEG fan-out: one synthetic capture producer, N loopback viewers, aggregate fps per viewer count
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <MJPEG_Streaming.h>
+#include <MJPEGBroadcaster.h>
+#include "bench.h"
+#include "host_net.h"
+#include "synthetic_source.h"
+
+// Same framing as handle_jpg_stream() on the device
+static void sender(MJPEGBroadcaster *b, int fd)
+{
+  FrameRef frame;
+  uint32_t lastSeq = 0;
+  char buf[32];
+  bool ok = send_all(fd, HEADER, hdrLen) && send_all(fd, BOUNDARY, bdrLen);
+  while (ok && b->acquire(frame, lastSeq))
+  {
+    lastSeq = frame.getSeq();
+    snprintf(buf, sizeof(buf), "%u\r\n\r\n", (unsigned)frame.getSize());
+    ok = send_all(fd, CTNTTYPE, cntLen) && send_all(fd, buf, strlen(buf)) &&
+         send_all(fd, frame.getBuf(), frame.getSize()) && send_all(fd, BOUNDARY, bdrLen);
+  }
+  frame.reset();
+  b->detach();
+}
+
+// Counts complete parts by spotting boundaries, carrying a tail across reads
+static void viewer(int fd, std::atomic<uint64_t> *frames, std::atomic<uint64_t> *bytes)
+{
+  static const char *marker = BOUNDARY + 2; // skip the leading CRLF
+  size_t mlen = strlen(marker);
+  std::vector<char> buf(65536 + mlen);
+  size_t carry = 0;
+  uint64_t seen = 0;
+  for (;;)
+  {
+    ssize_t n = recv(fd, buf.data() + carry, 65536, 0);
+    if (n <= 0)
+      break;
+    bytes->fetch_add(n);
+    size_t total = carry + n;
+    for (char *p = buf.data(); (p = (char *)memmem(p, buf.data() + total - p, marker, mlen)); p += mlen)
+      seen++;
+    carry = total < mlen - 1 ? total : mlen - 1;
+    memmove(buf.data(), buf.data() + total - carry, carry);
+    if (seen > 1)
+      frames->store(seen - 1); // the first boundary precedes the first frame
+  }
+}
+
+static void run_round(int viewers, double seconds, double fps, size_t size)
+{
+  SyntheticSource source(size, fps);
+  MJPEGBroadcaster b(source);
+  std::atomic<bool> stop(false);
+  std::thread producer([&] { while (!stop) b.captureOnce(); });
+
+  int lfd = tcp_listen(0);
+  uint16_t port = tcp_local_port(lfd);
+  std::vector<int> fds;
+  std::vector<std::thread> threads;
+  std::vector<std::atomic<uint64_t> > frames(viewers), bytes(viewers);
+  for (int i = 0; i < viewers; i++)
+  {
+    int c = tcp_connect(port);
+    int s = tcp_accept(lfd);
+    fds.push_back(c);
+    fds.push_back(s);
+    frames[i] = 0;
+    bytes[i] = 0;
+    b.attach();
+    threads.push_back(std::thread(sender, &b, s));
+    threads.push_back(std::thread(viewer, c, &frames[i], &bytes[i]));
+  }
+
+  uint64_t start = now_us();
+  uint32_t published0 = b.framesPublished();
+  sleep_us((uint64_t)(seconds * 1e6));
+  double elapsed = (now_us() - start) / 1e6;
+  uint32_t published = b.framesPublished() - published0;
+  uint64_t total = 0, totalBytes = 0, worst = ~0ULL;
+  for (int i = 0; i < viewers; i++)
+  {
+    total += frames[i];
+    totalBytes += bytes[i];
+    if (frames[i] < worst)
+      worst = frames[i];
+  }
+  printf("%7d %12.1f %14.1f %14.1f %10.2f\n", viewers, published / elapsed, total / elapsed,
+         worst / elapsed, totalBytes / elapsed / 1e6);
+
+  stop = true;
+  b.shutdown();
+  for (size_t i = 0; i < fds.size(); i++)
+    shutdown(fds[i], SHUT_RDWR);
+  for (size_t i = 0; i < threads.size(); i++)
+    threads[i].join();
+  producer.join();
+  for (size_t i = 0; i < fds.size(); i++)
+    tcp_close(fds[i]);
+  tcp_close(lfd);
+}
+
+int bench_broadcast(int argc, char **argv)
+{
+  int maxViewers = opt_int(argc, argv, "viewers", 8);
+  double seconds = opt_double(argc, argv, "seconds", 3);
+  double fps = opt_double(argc, argv, "fps", 25);
+  size_t size = opt_int(argc, argv, "size", 40000);
+
+  printf("sensor %.1f fps, %u byte frames, %.1f s per round\n", fps, (unsigned)size, seconds);
+  printf("viewers capture_fps delivered_fps min_viewer_fps   MB/s\n");
+  for (int v = 1; v <= maxViewers; v *= 2)
+    run_round(v, seconds, fps, size);
+  return 0;
+}
@@ -0,0 +1,354 @@
+// Delta OTA: patch size against the full image, patch generation and on-device apply speed,
+// then both pushed over a throttled link into /ota with the flash writing at chip speed,
+// and the refusals (patch for another image, corrupted patch) that keep a bad image off flash
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <EventServer.h>
+#include <OtaSession.h>
+#include <DeltaPatch.h>
+#include "bench.h"
+#include "delta_diff.h"
+#include "host_net.h"
+
+// The running image, read the way esp_partition_read() would
+class MemorySource : public OtaSource
+{
+public:
+  MemorySource(const std::vector<uint8_t> &image) : _image(image), _reads(0) {}
+  size_t size(void) { return _image.size(); }
+  bool read(size_t offset, uint8_t *buf, size_t len)
+  {
+    if (offset + len > _image.size())
+      return false;
+    memcpy(buf, _image.data() + offset, len);
+    _reads++;
+    return true;
+  }
+
+  const std::vector<uint8_t> &_image;
+  uint64_t _reads;
+};
+
+// Flash stand-in: memory, and when given chip timings a 4 KB sector erase and program per 4 KB
+class FlashTarget : public OtaTarget
+{
+public:
+  FlashTarget(double eraseMs, double kBps) : _eraseMs(eraseMs), _kBps(kBps), _began(false), _activated(false) {}
+  bool begin(size_t size)
+  {
+    _image.clear();
+    _image.reserve(size);
+    _began = true;
+    _activated = false;
+    return true;
+  }
+  bool write(const uint8_t *data, size_t len)
+  {
+    for (size_t i = 0; i < len; i++)
+    {
+      _image.push_back(data[i]);
+      if (_kBps > 0 && _image.size() % 4096 == 0)
+        sleep_us((uint64_t)(_eraseMs * 1000 + 4096 * 1e6 / (_kBps * 1024)));
+    }
+    return true;
+  }
+  bool end(void)
+  {
+    _activated = true;
+    return true;
+  }
+  void abort(void) {}
+
+  double _eraseMs;
+  double _kBps;
+  std::vector<uint8_t> _image;
+  bool _began;
+  bool _activated;
+};
+
+static OtaSession *g_ota;
+
+static void handle_ota(HttpConnection &conn) { otaRequest(*g_ota, conn); }
+static void upload_ota(HttpConnection &conn, const Upload &upload) { otaUpload(*g_ota, conn, upload); }
+static void wake(void *ctx) { ((HttpServer *)ctx)->wake(); }
+
+static std::vector<uint8_t> read_file(const char *path)
+{
+  std::vector<uint8_t> d;
+  FILE *f = fopen(path, "rb");
+  if (!f)
+    return d;
+  uint8_t chunk[65536];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+    d.insert(d.end(), chunk, chunk + n);
+  fclose(f);
+  return d;
+}
+
+static void put32(std::vector<uint8_t> &d, size_t at, uint32_t v)
+{
+  for (int i = 0; i < 4; i++)
+    d[at + i] = (uint8_t)(v >> (8 * i));
+}
+
+// Firmware-shaped test images: functions of instruction-like bytes with literal pools of
+// absolute addresses of other functions, then a string table. The new build adds and drops
+// functions and edits a few, so everything behind the first change moves and every pointer
+// to it changes, as it does between two real builds.
+struct Function
+{
+  std::vector<uint8_t> code;
+  std::vector<size_t> slots;   // offsets in code of 32-bit pointers
+  std::vector<size_t> targets; // function each slot points at
+};
+
+static uint32_t g_seed = 12345;
+static uint32_t rnd(void)
+{
+  g_seed = g_seed * 1103515245 + 12345;
+  return g_seed >> 8;
+}
+
+static Function make_function(size_t count)
+{
+  static const uint8_t opcodes[] = {0x36, 0x41, 0x0c, 0x1d, 0xf0, 0x81, 0xe0, 0x08, 0x22, 0xa2, 0x25, 0x06};
+  Function f;
+  size_t len = 64 + rnd() % 448;
+  while (f.code.size() < len)
+  {
+    f.code.push_back(opcodes[rnd() % sizeof(opcodes)]);
+    f.code.push_back((uint8_t)(rnd() % 16));
+    f.code.push_back((uint8_t)(rnd() % 4 ? 0 : rnd()));
+  }
+  for (int i = 0, pool = 1 + rnd() % 4; i < pool; i++)
+  {
+    f.slots.push_back(f.code.size());
+    f.targets.push_back(rnd() % count);
+    f.code.resize(f.code.size() + 4);
+  }
+  return f;
+}
+
+static std::vector<uint8_t> link_image(std::vector<Function> &fns, const std::vector<uint8_t> &strings)
+{
+  std::vector<size_t> addr(fns.size());
+  size_t at = 0;
+  for (size_t i = 0; i < fns.size(); i++)
+  {
+    addr[i] = at;
+    at += (fns[i].code.size() + 3) & ~3;
+  }
+  std::vector<uint8_t> image(at);
+  for (size_t i = 0; i < fns.size(); i++)
+  {
+    Function &f = fns[i];
+    for (size_t s = 0; s < f.slots.size(); s++)
+      put32(f.code, f.slots[s], 0x400D0000 + addr[f.targets[s] % fns.size()]);
+    memcpy(&image[addr[i]], f.code.data(), f.code.size());
+  }
+  image.insert(image.end(), strings.begin(), strings.end());
+  return image;
+}
+
+static void synth_images(size_t kb, std::vector<uint8_t> &old, std::vector<uint8_t> &neu)
+{
+  std::vector<Function> fns;
+  size_t count = kb * 1024 / 300;
+  for (size_t i = 0; i < count; i++)
+    fns.push_back(make_function(count));
+  std::vector<uint8_t> strings;
+  while (strings.size() < kb * 1024 / 10)
+  {
+    static const char *words[] = {"camera", "frame", "stream", "error: ", "%s %u\n", "OTA", "wifi", "buffer "};
+    const char *w = words[rnd() % 8];
+    strings.insert(strings.end(), w, w + strlen(w));
+    if (rnd() % 5 == 0)
+      strings.push_back(0);
+  }
+  old = link_image(fns, strings);
+
+  // The next build: new functions a third of the way in, one removed, a few edited
+  fns.insert(fns.begin() + count / 3, make_function(count));
+  fns.insert(fns.begin() + count / 3 + 1, make_function(count));
+  fns.erase(fns.begin() + count * 2 / 3);
+  for (int i = 0; i < 5; i++)
+  {
+    Function &f = fns[rnd() % fns.size()];
+    f.code[rnd() % f.slots[0]] ^= 0x5A;
+  }
+  const char *added = "motion: %u blocks\n";
+  strings.insert(strings.begin() + strings.size() / 2, added, added + strlen(added));
+  neu = link_image(fns, strings);
+}
+
+// The whole patch through a DeltaTarget in chunks as the session would hand them over
+static bool apply(const std::vector<uint8_t> &patch, OtaSource &running, FlashTarget &flash, const char **error)
+{
+  DeltaTarget target(flash, running);
+  target.begin(patch.size());
+  bool ok = true;
+  for (size_t at = 0; ok && at < patch.size(); at += OTA_WRITE_CHUNK)
+    ok = target.write(patch.data() + at, patch.size() - at < OTA_WRITE_CHUNK ? patch.size() - at : OTA_WRITE_CHUNK);
+  ok = ok && target.end();
+  if (!ok)
+    target.abort();
+  *error = ok ? "" : target.error();
+  return ok;
+}
+
+// POST body to /ota paced to the link speed, reply read to the end; returns the status
+static int post_paced(uint16_t port, const std::vector<uint8_t> &body, double linkKBps, std::string *reply)
+{
+  Sha256 sha;
+  uint8_t digest[SHA256_SIZE];
+  char hex[2 * SHA256_SIZE + 1];
+  sha.update(body.data(), body.size());
+  sha.finish(digest);
+  Sha256::toHex(digest, hex);
+
+  int fd = tcp_connect(port);
+  if (fd < 0)
+    return -1;
+  char head[256];
+  int n = snprintf(head, sizeof(head),
+                   "POST /ota?size=%zu&sha256=%s HTTP/1.1\r\nConnection: close\r\n"
+                   "Content-Type: application/octet-stream\r\nContent-Length: %zu\r\n\r\n",
+                   body.size(), hex, body.size());
+  send_all(fd, head, n);
+  uint64_t t0 = now_us();
+  for (size_t at = 0; at < body.size();)
+  {
+    size_t len = body.size() - at < 1024 ? body.size() - at : 1024;
+    if (!send_all(fd, body.data() + at, len))
+      break;
+    at += len;
+    uint64_t due = t0 + (uint64_t)(at * 1e6 / (linkKBps * 1024));
+    uint64_t now = now_us();
+    if (due > now)
+      sleep_us(due - now);
+  }
+  reply->clear();
+  char buf[4096];
+  ssize_t got;
+  while ((got = recv(fd, buf, sizeof(buf), 0)) > 0)
+    reply->append(buf, got);
+  tcp_close(fd);
+  return reply->size() > 12 ? atoi(reply->c_str() + 9) : -1;
+}
+
+// One upload into /ota: the session checks the upload's digest, the delta target the
+// rebuilt image's. Returns the reply status, seconds from request to reply.
+static int upload(const std::vector<uint8_t> &body, OtaSource &running, FlashTarget &flash, double linkKBps,
+                  std::string *reply, double *seconds)
+{
+  DeltaTarget target(flash, running);
+  OtaSession ota(target);
+  g_ota = &ota;
+  HttpServer server;
+  server.on("/ota", METHOD_GET, handle_ota);
+  server.on("/ota", METHOD_POST, handle_ota, upload_ota);
+  server.begin(0);
+  ota.begin();
+  ota.onChange(wake, &server);
+  std::atomic<bool> stop(false);
+  std::thread loop([&] { while (!stop) server.poll(50); });
+  std::thread writer([&] { ota.run(); });
+
+  uint64_t t0 = now_us();
+  int code = post_paced(server.port(), body, linkKBps, reply);
+  *seconds = (now_us() - t0) / 1e6;
+
+  stop = true;
+  ota.shutdown();
+  server.wake();
+  loop.join();
+  writer.join();
+  server.stop();
+  return code;
+}
+
+int bench_delta(int argc, char **argv)
+{
+  const char *oldPath = opt_str(argc, argv, "old", NULL);
+  const char *newPath = opt_str(argc, argv, "new", NULL);
+  const char *outPath = opt_str(argc, argv, "out", NULL);
+  size_t imageKB = opt_int(argc, argv, "image-kb", 1024);
+  double linkKBps = opt_double(argc, argv, "link-kbps", 64); // a weak WiFi link
+  double eraseMs = opt_double(argc, argv, "erase-ms", 45);
+  double flashKBps = opt_double(argc, argv, "flash-kbps", 400);
+
+  std::vector<uint8_t> old, neu;
+  if (oldPath && newPath)
+  {
+    old = read_file(oldPath);
+    neu = read_file(newPath);
+    if (old.empty() || neu.empty())
+    {
+      fprintf(stderr, "cannot read %s or %s\n", oldPath, newPath);
+      return 1;
+    }
+  }
+  else
+  {
+    synth_images(imageKB, old, neu);
+  }
+
+  uint64_t t0 = now_us();
+  std::vector<uint8_t> patch = delta_create(old, neu);
+  double genMs = (now_us() - t0) / 1e3;
+  printf("old %zu bytes, new %zu bytes, patch %zu bytes (%.1f%% of the image), generated in %.0f ms\n", old.size(),
+         neu.size(), patch.size(), 100.0 * patch.size() / neu.size(), genMs);
+  if (outPath)
+  {
+    FILE *f = fopen(outPath, "wb");
+    if (!f || fwrite(patch.data(), 1, patch.size(), f) != patch.size())
+      fprintf(stderr, "cannot write %s\n", outPath);
+    if (f)
+      fclose(f);
+  }
+
+  // Apply cost alone, flash writes free
+  MemorySource running(old);
+  FlashTarget memory(0, 0);
+  const char *error;
+  t0 = now_us();
+  bool ok = apply(patch, running, memory, &error);
+  double applyS = (now_us() - t0) / 1e6;
+  printf("apply: %s, %.1f MB/s rebuilt, %llu running image reads, %zu bytes of state\n",
+         ok && memory._activated && memory._image == neu ? "image identical" : "WRONG", neu.size() / applyS / 1e6,
+         (unsigned long long)running._reads, sizeof(DeltaTarget));
+
+  // Refusals: the patch on a device running something else, and a damaged patch
+  MemorySource other(neu);
+  memory._began = false;
+  ok = apply(patch, other, memory, &error);
+  printf("wrong base: %s (%s), flash %s\n", ok ? "APPLIED" : "refused", error, memory._began ? "TOUCHED" : "untouched");
+  std::vector<uint8_t> damaged(patch);
+  damaged[DELTA_HEADER_SIZE + (damaged.size() - DELTA_HEADER_SIZE) * 3 / 4] ^= 0x10;
+  ok = apply(damaged, running, memory, &error);
+  printf("corrupted patch: %s (%s), %s\n", ok ? "APPLIED" : "refused", error,
+         memory._activated ? "ACTIVATED" : "not activated");
+
+  // End to end at link and flash speed, each on a freshly booted device
+  const std::vector<uint8_t> *bodies[2] = {&neu, &patch};
+  const char *names[2] = {"full image", "patch"};
+  double secs[2];
+  for (int i = 0; i < 2; i++)
+  {
+    std::string reply;
+    FlashTarget flash(eraseMs, flashKBps);
+    int code = upload(*bodies[i], running, flash, linkKBps, &reply, &secs[i]);
+    printf("%-10s over %.0f KB/s: %7zu bytes sent, reply %d, %5.1f s, image %s\n", names[i], linkKBps,
+           bodies[i]->size(), code, secs[i], flash._activated && flash._image == neu ? "intact and activated" : "WRONG");
+  }
+  printf("patch saves %.1f%% of the bytes and %.1f s (%.0f%%); the flash still writes the whole image\n",
+         100.0 - 100.0 * patch.size() / neu.size(), secs[0] - secs[1], 100 * (secs[0] - secs[1]) / secs[0]);
+  return 0;
+}
@@ -0,0 +1,127 @@
+// Per-frame wire cost of the MJPEG framing: the old four-write loop vs gathered and chunked writes
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <MJPEG_Streaming.h>
+#include <EventServer.h>
+#include <MJPEGStreamer.h>
+#include "bench.h"
+#include "host_net.h"
+#include "synthetic_source.h"
+
+static MJPEGBroadcaster *g_broadcaster;
+static void handle_stream(HttpConnection &conn)
+{
+  char chunked[4] = "";
+  conn.arg("chunked", chunked, sizeof(chunked));
+  conn.stream(new MJPEGStreamer(*g_broadcaster, chunked[0] == '1'));
+}
+static void wake(void *ctx) { ((HttpServer *)ctx)->wake(); }
+
+static uint64_t drain(int fd, double seconds)
+{
+  uint64_t bytes = 0, start = now_us();
+  char buf[65536];
+  while (now_us() - start < seconds * 1e6)
+  {
+    ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    if (n <= 0)
+      break;
+    bytes += n;
+  }
+  return bytes;
+}
+
+static void print_row(const char *mode, const StreamStats &s, double seconds)
+{
+  if (!s.frames)
+    return;
+  printf("%-9s %9u %8.1f %14.1f %13.2f\n", mode, s.frames, s.frames / seconds,
+         (double)s.bytes / s.frames, (double)s.writes / s.frames);
+}
+
+// Replica of the original handle_jpg_stream() loop: CTNTTYPE, length, JPEG, BOUNDARY
+static void legacy(double seconds, double fps, size_t size)
+{
+  SyntheticSource source(size, fps);
+  int lfd = tcp_listen(0);
+  int c = tcp_connect(tcp_local_port(lfd));
+  int s = tcp_accept(lfd);
+  std::atomic<bool> stop(false);
+  StreamStats st = {0, 0, 0};
+  std::thread sender([&] {
+    char buf[32];
+    send_all(s, HEADER, hdrLen);
+    send_all(s, BOUNDARY, bdrLen);
+    while (!stop)
+    {
+      FrameRef f = source.capture();
+      int n = snprintf(buf, sizeof(buf), "%u\r\n\r\n", (unsigned)f.getSize());
+      if (!send_all(s, CTNTTYPE, cntLen) || !send_all(s, buf, n) || !send_all(s, f.getBuf(), f.getSize()) ||
+          !send_all(s, BOUNDARY, bdrLen))
+        break;
+      st.frames++;
+      st.writes += 4;
+      st.bytes += cntLen + n + f.getSize() + bdrLen;
+    }
+  });
+  drain(c, seconds);
+  stop = true;
+  tcp_close(c);
+  sender.join();
+  tcp_close(s);
+  tcp_close(lfd);
+  print_row("legacy", st, seconds);
+}
+
+static void evented(bool chunked, double seconds, double fps, size_t size)
+{
+  SyntheticSource source(size, fps);
+  MJPEGBroadcaster b(source);
+  g_broadcaster = &b;
+  HttpServer server;
+  server.on("/mjpeg", METHOD_GET, handle_stream);
+  server.begin(0);
+  b.onPublish(wake, &server);
+  StreamStats before = MJPEGStreamer::totals;
+
+  std::atomic<bool> stop(false);
+  std::thread loop([&] { while (!stop) server.poll(20); });
+  std::thread producer([&] { while (!stop) b.captureOnce(); });
+
+  int fd = tcp_connect(server.port());
+  const char *req = chunked ? "GET /mjpeg?chunked=1 HTTP/1.1\r\n\r\n" : "GET /mjpeg HTTP/1.1\r\n\r\n";
+  send_all(fd, req, strlen(req));
+  drain(fd, seconds);
+  tcp_close(fd);
+  while (server.connectionCount())
+    sleep_us(1000);
+
+  stop = true;
+  b.shutdown();
+  server.wake();
+  loop.join();
+  producer.join();
+  StreamStats st = MJPEGStreamer::totals;
+  st.frames -= before.frames;
+  st.bytes -= before.bytes;
+  st.writes -= before.writes;
+  print_row(chunked ? "chunked" : "gathered", st, seconds);
+}
+
+int bench_framing(int argc, char **argv)
+{
+  double seconds = opt_double(argc, argv, "seconds", 2);
+  double fps = opt_double(argc, argv, "fps", 0);
+  size_t size = opt_int(argc, argv, "size", 40000);
+
+  printf("%u byte frames, sensor %s\n", (unsigned)size, fps > 0 ? "paced" : "unpaced");
+  printf("mode         frames      fps bytes_per_frame writes/frame\n");
+  legacy(seconds, fps, size);
+  evented(false, seconds, fps, size);
+  evented(true, seconds, fps, size);
+  return 0;
+}
@@ -0,0 +1,126 @@
+// Event-driven server: MJPEG viewers and /jpg latency served concurrently from one loop
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <EventServer.h>
+#include <MJPEGStreamer.h>
+#include "bench.h"
+#include "host_net.h"
+#include "host_stats.h"
+#include "synthetic_source.h"
+
+static MJPEGBroadcaster *g_broadcaster;
+
+static void handle_stream(HttpConnection &conn) { conn.stream(new MJPEGStreamer(*g_broadcaster)); }
+static void handle_still(HttpConnection &conn) { conn.stream(new SnapshotStreamer(*g_broadcaster)); }
+static void handle_index(HttpConnection &conn) { conn.send(200, "text/html", "<html>ok</html>"); }
+static void wake(void *ctx) { ((HttpServer *)ctx)->wake(); }
+
+// Counts multipart boundaries on a /mjpeg connection
+void mjpeg_viewer(uint16_t port, std::atomic<bool> *stop, std::atomic<uint64_t> *frames)
+{
+  int fd = tcp_connect(port);
+  const char req[] = "GET /mjpeg HTTP/1.1\r\nHost: bench\r\n\r\n";
+  send_all(fd, req, sizeof(req) - 1);
+  const char *marker = "--123456789000000000000987654321";
+  size_t mlen = strlen(marker);
+  std::vector<char> buf(65536 + mlen);
+  size_t carry = 0;
+  uint64_t seen = 0;
+  while (!*stop)
+  {
+    ssize_t n = recv(fd, buf.data() + carry, 65536, 0);
+    if (n <= 0)
+      break;
+    size_t total = carry + n;
+    for (char *p = buf.data(); (p = (char *)memmem(p, buf.data() + total - p, marker, mlen)); p += mlen)
+      seen++;
+    carry = total < mlen - 1 ? total : mlen - 1;
+    memmove(buf.data(), buf.data() + total - carry, carry);
+    if (seen > 1)
+      frames->store(seen - 1);
+  }
+  tcp_close(fd);
+}
+
+// Time from connect to the last byte of a /jpg (or any) response
+static double fetch_ms(uint16_t port, const char *path)
+{
+  uint64_t t0 = now_us();
+  int fd = tcp_connect(port);
+  char req[128];
+  int n = snprintf(req, sizeof(req), "GET %s HTTP/1.1\r\nConnection: close\r\n\r\n", path);
+  send_all(fd, req, n);
+  char buf[65536];
+  while (recv(fd, buf, sizeof(buf), 0) > 0)
+    ;
+  tcp_close(fd);
+  return (now_us() - t0) / 1000.0;
+}
+
+static void run_round(int viewers, double seconds, double fps, size_t size)
+{
+  SyntheticSource source(size, fps);
+  MJPEGBroadcaster b(source);
+  g_broadcaster = &b;
+  HttpServer server;
+  server.on("/", METHOD_GET, handle_index);
+  server.on("/mjpeg", METHOD_GET, handle_stream);
+  server.on("/jpg", METHOD_GET, handle_still);
+  server.begin(0);
+  b.onPublish(wake, &server);
+
+  std::atomic<bool> stop(false);
+  std::thread loop([&] { while (!stop) server.poll(50); });
+  std::thread producer([&] { while (!stop) b.captureOnce(); });
+
+  std::vector<std::thread> threads;
+  std::vector<std::atomic<uint64_t> > frames(viewers);
+  for (int i = 0; i < viewers; i++)
+  {
+    frames[i] = 0;
+    threads.push_back(std::thread(mjpeg_viewer, server.port(), &stop, &frames[i]));
+  }
+
+  uint64_t start = now_us();
+  std::vector<double> still, page;
+  while (now_us() - start < seconds * 1e6)
+  {
+    still.push_back(fetch_ms(server.port(), "/jpg"));
+    page.push_back(fetch_ms(server.port(), "/"));
+    sleep_us(20000);
+  }
+  double elapsed = (now_us() - start) / 1e6;
+  uint64_t total = 0;
+  for (int i = 0; i < viewers; i++)
+    total += frames[i];
+
+  printf("%7d %13.1f %10.2f %10.2f %10.2f %10.2f\n", viewers, total / elapsed,
+         percentile(still, 50), percentile(still, 99), percentile(page, 50), percentile(page, 99));
+
+  stop = true;
+  b.shutdown();
+  server.wake();
+  loop.join();
+  producer.join();
+  server.stop();
+  for (size_t i = 0; i < threads.size(); i++)
+    threads[i].join();
+}
+
+int bench_http(int argc, char **argv)
+{
+  int maxViewers = opt_int(argc, argv, "viewers", 6);
+  double seconds = opt_double(argc, argv, "seconds", 3);
+  double fps = opt_double(argc, argv, "fps", 25);
+  size_t size = opt_int(argc, argv, "size", 40000);
+
+  printf("sensor %.1f fps, %u byte frames, %d connection slots\n", fps, (unsigned)size, EVS_MAX_CONNECTIONS);
+  printf("viewers delivered_fps  jpg_p50ms  jpg_p99ms page_p50ms page_p99ms\n");
+  for (int v = 0; v <= maxViewers; v = v ? v * 2 : 1)
+    run_round(v, seconds, fps, size);
+  return 0;
+}
@@ -0,0 +1,125 @@
+// Instrumentation cost per record, histogram accuracy, and a live /metrics scrape
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <EventServer.h>
+#include <MJPEGStreamer.h>
+#include <PipelineMetrics.h>
+#include "bench.h"
+#include "host_net.h"
+#include "host_stats.h"
+#include "synthetic_source.h"
+
+static MJPEGBroadcaster *g_broadcaster;
+
+static void handle_stream(HttpConnection &conn) { conn.stream(new MJPEGStreamer(*g_broadcaster)); }
+static void wake(void *ctx) { ((HttpServer *)ctx)->wake(); }
+
+static void handle_metrics(HttpConnection &conn)
+{
+  std::string out;
+  PromWriter w(out);
+  writePipelineMetrics(w);
+  conn.sendCopy(200, "text/plain; version=0.0.4", out.data(), out.size());
+}
+
+// ns per observe() with the given number of threads hammering the same histogram
+static double observe_ns(int threads, uint32_t perThread)
+{
+  Histogram h(LATENCY_BUCKETS_US, LATENCY_BUCKET_COUNT);
+  std::vector<std::thread> workers;
+  uint64_t t0 = now_us();
+  for (int t = 0; t < threads; t++)
+    workers.push_back(std::thread([&h, perThread, t] {
+      uint32_t x = 12345 + t;
+      for (uint32_t i = 0; i < perThread; i++)
+      {
+        x = x * 1103515245 + 12345;
+        h.observe((x >> 8) % 200000);
+      }
+    }));
+  for (size_t t = 0; t < workers.size(); t++)
+    workers[t].join();
+  return (now_us() - t0) * 1000.0 / perThread;
+}
+
+int bench_metrics(int argc, char **argv)
+{
+  uint32_t records = opt_int(argc, argv, "records", 5000000);
+  int viewers = opt_int(argc, argv, "viewers", 2);
+  double seconds = opt_double(argc, argv, "seconds", 2);
+
+  printf("record cost (%u observations per thread)\n", records);
+  for (int t = 1; t <= 4; t *= 2)
+    printf("  %d thread%s  %6.1f ns/observe\n", t, t > 1 ? "s" : " ", observe_ns(t, records));
+  Counter c;
+  uint64_t t0 = now_us();
+  for (uint32_t i = 0; i < records; i++)
+    c.add();
+  printf("  counter    %6.1f ns/add\n", (now_us() - t0) * 1000.0 / records);
+
+  // Bucketed percentiles against the exact ones, log-normal-ish latencies
+  Histogram h(LATENCY_BUCKETS_US, LATENCY_BUCKET_COUNT);
+  std::vector<double> exact;
+  srand(7);
+  for (int i = 0; i < 100000; i++)
+  {
+    double v = 2000;
+    for (int k = 0; k < 6; k++)
+      v *= 0.5 + (double)rand() / RAND_MAX;
+    h.observe((uint32_t)v);
+    exact.push_back(v);
+  }
+  printf("accuracy   exact    bucket bound\n");
+  for (float p = 50; p < 100; p = p < 90 ? p + 40 : p + 9)
+    printf("  p%-4.0f %8.0f us %8u us\n", p, percentile(exact, p), h.percentile(p));
+
+  // End to end: streams recording into the pipeline metrics, scraped over HTTP
+  SyntheticSource source(40000, 25);
+  MJPEGBroadcaster b(source);
+  g_broadcaster = &b;
+  HttpServer server;
+  server.on("/mjpeg", METHOD_GET, handle_stream);
+  server.on("/metrics", METHOD_GET, handle_metrics);
+  server.begin(0);
+  b.onPublish(wake, &server);
+  std::atomic<bool> stop(false);
+  std::thread loop([&] { while (!stop) server.poll(50); });
+  std::thread producer([&] { while (!stop) b.captureOnce(); });
+  std::vector<std::thread> threads;
+  std::vector<std::atomic<uint64_t> > frames(viewers);
+  for (int i = 0; i < viewers; i++)
+  {
+    frames[i] = 0;
+    threads.push_back(std::thread(mjpeg_viewer, server.port(), &stop, &frames[i]));
+  }
+  sleep_us((uint64_t)(seconds * 1e6));
+
+  int fd = tcp_connect(server.port());
+  const char req[] = "GET /metrics HTTP/1.1\r\nConnection: close\r\n\r\n";
+  send_all(fd, req, sizeof(req) - 1);
+  std::string reply;
+  char buf[4096];
+  ssize_t n;
+  while ((n = recv(fd, buf, sizeof(buf), 0)) > 0)
+    reply.append(buf, n);
+  tcp_close(fd);
+  size_t body = reply.find("\r\n\r\n");
+  printf("\n/metrics after %.1f s with %d viewers (%u bytes):\n%s", seconds, viewers,
+         (unsigned)(reply.size() - body - 4), reply.c_str() + body + 4);
+
+  stop = true;
+  b.shutdown();
+  server.wake();
+  loop.join();
+  producer.join();
+  server.stop();
+  for (size_t i = 0; i < threads.size(); i++)
+    threads[i].join();
+  return 0;
+}
@@ -0,0 +1,173 @@
+// Motion detection over a recorded clip: per-frame kernel cost, then stream fps with and
+// without the detector attached to the broadcaster
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <OV2640.h>
+#include <EventServer.h>
+#include <MJPEGStreamer.h>
+#include <MotionMonitor.h>
+#include "bench.h"
+#include "host_net.h"
+#include "host_stats.h"
+
+static MJPEGBroadcaster *g_broadcaster;
+
+static void handle_stream(HttpConnection &conn) { conn.stream(new MJPEGStreamer(*g_broadcaster)); }
+static void wake(void *ctx) { ((HttpServer *)ctx)->wake(); }
+
+// Byte-at-a-time version of the detector's difference/threshold/background pass, for comparison.
+// Kept out of the host's vector units, the LX6 has none.
+__attribute__((optimize("no-tree-vectorize"))) static uint32_t scalar_pass(const LumaGrid &g, uint8_t *bg, uint8_t *mask, uint8_t threshold, bool update)
+{
+  uint32_t changed = 0;
+  for (size_t i = 0; i < (size_t)g.width * g.height; i++)
+  {
+    uint8_t cur = g.cells[i] >> 1;
+    uint8_t diff = cur > bg[i] ? cur - bg[i] : bg[i] - cur;
+    mask[i] = diff > threshold ? 0x80 : 0;
+    changed += diff > threshold;
+    if (update)
+      bg[i] += (cur > bg[i]) - (cur < bg[i]);
+  }
+  return changed;
+}
+
+static bool kernels(const char *dir, int rounds)
+{
+  if (!replay_camera_open(dir, 0, false))
+    return false;
+  OV2640 cam;
+  camera_config_t config = esp32cam_aithinker_config;
+  config.fb_count = 1;
+  if (cam.init(config) != ESP_OK)
+    return false;
+  std::vector<std::vector<uint8_t> > clip;
+  for (;;)
+  {
+    FrameRef f = cam.capture(); // dropped before the next capture, there is only one buffer
+    if (!f)
+      break;
+    clip.push_back(std::vector<uint8_t>(f.getBuf(), f.getBuf() + f.getSize()));
+  }
+  esp_camera_deinit();
+
+  LumaExtractor extractor;
+  static LumaGrid grid;
+  static MotionDetector detector;
+  static uint8_t bg[LUMA_GRID_CELLS], mask[LUMA_GRID_CELLS];
+  std::vector<double> extractUs, detectUs, scalarUs;
+  uint32_t motionFrames = 0, lighting = 0, failures = 0, maxBlobs = 0;
+  for (int r = 0; r < rounds; r++)
+  {
+    detector.reset();
+    for (size_t i = 0; i < clip.size(); i++)
+    {
+      uint64_t t0 = now_us();
+      if (!extractor.extract(clip[i].data(), clip[i].size(), grid))
+      {
+        failures++;
+        continue;
+      }
+      uint64_t t1 = now_us();
+      MotionResult result;
+      detector.process(grid, result);
+      uint64_t t2 = now_us();
+      scalar_pass(grid, bg, mask, MOTION_THRESHOLD, i % MOTION_BG_PERIOD == 0);
+      uint64_t t3 = now_us();
+      extractUs.push_back(t1 - t0);
+      detectUs.push_back(t2 - t1);
+      scalarUs.push_back(t3 - t2);
+      if (r == 0)
+      {
+        motionFrames += result.motion;
+        lighting += result.lighting;
+        maxBlobs = result.blobs > maxBlobs ? result.blobs : maxBlobs;
+      }
+    }
+  }
+  printf("clip: %u frames, grid %ux%u (%u blocks per cell)\n", (unsigned)clip.size(), grid.width, grid.height,
+         grid.blocks);
+  printf("luma extract us   p50 %7.1f  p99 %7.1f\n", percentile(extractUs, 50), percentile(extractUs, 99));
+  printf("detect us (SWAR)  p50 %7.1f  p99 %7.1f  (diff/threshold/background + blobs)\n", percentile(detectUs, 50),
+         percentile(detectUs, 99));
+  printf("byte loop us      p50 %7.1f  p99 %7.1f  (diff/threshold/background only, no blobs)\n", percentile(scalarUs, 50),
+         percentile(scalarUs, 99));
+  printf("motion in %u of %u frames, up to %u blobs, %u lighting resets, %u decode failures\n", motionFrames,
+         (unsigned)clip.size(), maxBlobs, lighting, failures);
+  return true;
+}
+
+// Delivered fps per viewer over a looping replay, optionally with the monitor attached
+static void round(const char *dir, double fps, int viewers, double seconds, bool withMotion)
+{
+  replay_camera_open(dir, fps, true);
+  OV2640 cam;
+  if (cam.init(esp32cam_aithinker_config) != ESP_OK)
+    return;
+  MJPEGBroadcaster b(cam);
+  g_broadcaster = &b;
+  HttpServer server;
+  server.on("/mjpeg", METHOD_GET, handle_stream);
+  server.begin(0);
+  b.onPublish(wake, &server);
+  MotionMonitor monitor(b);
+
+  std::atomic<bool> stop(false);
+  std::thread loop([&] { while (!stop) server.poll(50); });
+  std::thread producer([&] { while (!stop) b.captureOnce(); });
+  std::thread detect;
+  uint64_t analysed = motionMetrics.framesAnalysed.value();
+  uint64_t skipped = motionMetrics.framesSkipped.value();
+  if (withMotion)
+    detect = std::thread([&] { monitor.run(); });
+  std::vector<std::atomic<uint64_t> > frames(viewers);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < viewers; i++)
+  {
+    frames[i] = 0;
+    threads.push_back(std::thread(mjpeg_viewer, server.port(), &stop, &frames[i]));
+  }
+  uint64_t start = now_us();
+  sleep_us((uint64_t)(seconds * 1e6));
+  stop = true;
+  double elapsed = (now_us() - start) / 1e6;
+  b.shutdown();
+  server.wake();
+  loop.join();
+  producer.join();
+  if (withMotion)
+    detect.join();
+  server.stop();
+  for (size_t i = 0; i < threads.size(); i++)
+    threads[i].join();
+  esp_camera_deinit();
+
+  uint64_t total = 0;
+  for (int i = 0; i < viewers; i++)
+    total += frames[i];
+  printf("%-14s %6.1f fps per viewer", withMotion ? "with motion" : "stream only", viewers ? total / elapsed / viewers : 0);
+  if (withMotion)
+    printf(", %.1f fps analysed, %llu skipped", (motionMetrics.framesAnalysed.value() - analysed) / elapsed,
+           (unsigned long long)(motionMetrics.framesSkipped.value() - skipped));
+  printf("\n");
+}
+
+int bench_motion(int argc, char **argv)
+{
+  const char *dir = opt_str(argc, argv, "dir", NULL);
+  double fps = opt_double(argc, argv, "fps", 25);
+  int viewers = opt_int(argc, argv, "viewers", 2);
+  double seconds = opt_double(argc, argv, "seconds", 5);
+  int rounds = opt_int(argc, argv, "rounds", 20);
+  if (!dir || !kernels(dir, rounds))
+  {
+    fprintf(stderr, "motion needs --dir=<directory with .jpg files>\n");
+    return 1;
+  }
+  round(dir, fps, viewers, seconds, false);
+  round(dir, fps, viewers, seconds, true);
+  return 0;
+}
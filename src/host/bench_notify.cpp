@@ -0,0 +1,266 @@
+// Notifier against a local stand-in webhook: interrupt-side post cost, coalescing and
+// event-to-delivery latency with failures and rate limiting on the server side
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <Notifier.h>
+#include <MJPEGBroadcaster.h>
+#include "bench.h"
+#include "host_net.h"
+#include "host_stats.h"
+#include "synthetic_source.h"
+
+struct Webhook
+{
+  int fd;
+  double failRate;      // share of requests answered 503
+  double limitRate;     // share answered 429 with Retry-After: 1
+  std::mutex lock;
+  std::vector<uint64_t> arrivals; // accepted messages
+  uint32_t requests;
+  uint32_t withFrame;
+  uint64_t bytes;
+};
+
+// One request per connection: read the head and Content-Length bytes, answer, close
+static void serve(Webhook *w)
+{
+  std::vector<char> buf(1 << 20);
+  for (;;)
+  {
+    int c = tcp_accept(w->fd);
+    if (c < 0)
+      break;
+    size_t got = 0, need = 0;
+    char *body = NULL;
+    for (;;)
+    {
+      ssize_t n = recv(c, buf.data() + got, buf.size() - got, 0);
+      if (n <= 0)
+        break;
+      got += n;
+      if (!body && (body = (char *)memmem(buf.data(), got, "\r\n\r\n", 4)))
+      {
+        body += 4;
+        const char *cl = (const char *)memmem(buf.data(), body - buf.data(), "Content-Length:", 15);
+        need = (body - buf.data()) + (cl ? strtoul(cl + 15, NULL, 10) : 0);
+      }
+      if (body && got >= need)
+        break;
+    }
+    double r = rand() / (double)RAND_MAX;
+    const char *reply = "HTTP/1.1 204 No Content\r\nConnection: close\r\n\r\n";
+    if (r < w->failRate)
+      reply = "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+    else if (r < w->failRate + w->limitRate)
+      reply = "HTTP/1.1 429 Too Many Requests\r\nRetry-After: 1\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+    {
+      std::lock_guard<std::mutex> guard(w->lock);
+      w->requests++;
+      w->bytes += got;
+      if (reply[9] == '2')
+      {
+        w->arrivals.push_back(now_us());
+        w->withFrame += memmem(buf.data(), got, "image/jpeg", 10) != NULL;
+      }
+    }
+    send_all(c, reply, strlen(reply));
+    tcp_close(c);
+  }
+}
+
+// HTTPClient stand-in: POST over loopback, status from the reply line
+class SocketTransport : public NotifyTransport
+{
+public:
+  SocketTransport(uint16_t port) : _port(port) {}
+  int post(const char *contentType, const std::string &body, uint32_t *retryAfter_ms)
+  {
+    int fd = tcp_connect(_port);
+    if (fd < 0)
+      return -1;
+    char head[256];
+    int n = snprintf(head, sizeof(head), "POST /webhook HTTP/1.1\r\nHost: bench\r\nContent-Type: %s\r\n"
+                     "Content-Length: %u\r\nConnection: close\r\n\r\n", contentType, (unsigned)body.size());
+    if (!send_all(fd, head, n) || !send_all(fd, body.data(), body.size()))
+    {
+      tcp_close(fd);
+      return -1;
+    }
+    char reply[512];
+    ssize_t got = recv(fd, reply, sizeof(reply) - 1, 0);
+    tcp_close(fd);
+    if (got < 12)
+      return -1;
+    reply[got] = 0;
+    const char *after = strstr(reply, "Retry-After:");
+    if (after)
+      *retryAfter_ms = strtoul(after + 12, NULL, 10) * 1000;
+    return atoi(reply + 9);
+  }
+
+private:
+  uint16_t _port;
+};
+
+static std::vector<uint8_t> g_jpeg;
+static FramePool *g_pool;
+
+static void no_release(void *ctx, void *opaque) {}
+
+static bool snapshot(FrameRef &out, void *ctx)
+{
+  out = g_pool->wrap(g_jpeg.data(), g_jpeg.size(), 640, 480, now_us(), NULL);
+  return out;
+}
+
+// Webhook that is down: every post fails after a short wait, like a timed-out request
+class DownTransport : public NotifyTransport
+{
+public:
+  DownTransport() : withFrame(0) {}
+  int post(const char *contentType, const std::string &body, uint32_t *retryAfter_ms)
+  {
+    withFrame += body.find("image/jpeg") != std::string::npos;
+    sleep_us(50000);
+    return 503;
+  }
+  uint32_t withFrame;
+};
+
+static bool latest_frame(FrameRef &out, void *ctx)
+{
+  return ((MJPEGBroadcaster *)ctx)->latest(out, NOTIFY_SNAPSHOT_MAX_MS);
+}
+
+// A motion event while the webhook is down, next to a stream on 2 frame buffers as the device
+// runs by default: the broadcaster holds one, so a snapshot kept through the retries would
+// stall capture until the batch is dropped
+static bool stream_while_down(size_t size, double fps)
+{
+  SyntheticSource source(size, fps, false, 2);
+  MJPEGBroadcaster b(source);
+  b.attach(); // a viewer, so the producer keeps capturing
+  std::atomic<bool> stop(false);
+  std::thread producer([&] { while (!stop) b.captureOnce(); });
+
+  DownTransport down;
+  Notifier n(down);
+  n.configure(0, 0, 200, NOTIFY_MAX_ATTEMPTS);
+  n.onSnapshot(latest_frame, &b);
+  std::thread worker([&] { n.run(); });
+  sleep_us(300000);
+
+  uint64_t dropped0 = notifyMetrics.dropped.value();
+  uint32_t seq0 = b.latestSeq();
+  uint64_t t0 = now_us();
+  n.post(NOTIFY_MOTION);
+  while (notifyMetrics.dropped.value() == dropped0 && now_us() - t0 < 10000000)
+    sleep_us(10000);
+  double seconds = (now_us() - t0) / 1e6;
+  double streamed = (b.latestSeq() - seq0) / seconds;
+
+  n.stop();
+  worker.join();
+  stop = true;
+  b.shutdown();
+  producer.join();
+  b.detach();
+
+  bool good = notifyMetrics.dropped.value() > dropped0 && down.withFrame == NOTIFY_MAX_ATTEMPTS && streamed >= fps * 0.8;
+  printf("webhook down, 2 frame buffers: %u attempts with a snapshot over %.1f s, stream %.1f of %.0f fps  %s\n",
+         down.withFrame, seconds, streamed, fps, good ? "ok" : "FAILED");
+  return good;
+}
+
+int bench_notify(int argc, char **argv)
+{
+  int bursts = opt_int(argc, argv, "bursts", 10);
+  int burstSize = opt_int(argc, argv, "burst-size", 8);
+  double gap = opt_double(argc, argv, "gap-ms", 700);
+  int coalesce = opt_int(argc, argv, "coalesce", 250);
+  int interval = opt_int(argc, argv, "interval", 1000);
+  bool withFrame = opt_int(argc, argv, "snapshot", 1) != 0;
+
+  Webhook w;
+  w.fd = tcp_listen(0);
+  w.failRate = opt_double(argc, argv, "fail", 0.1);
+  w.limitRate = opt_double(argc, argv, "limit", 0.05);
+  w.requests = w.withFrame = 0;
+  w.bytes = 0;
+  std::thread server(serve, &w);
+
+  g_jpeg.assign(opt_int(argc, argv, "size", 25000), 0x55);
+  g_jpeg[0] = 0xFF;
+  g_jpeg[1] = 0xD8;
+  FramePool pool(no_release, NULL);
+  g_pool = &pool;
+
+  SocketTransport transport(tcp_local_port(w.fd));
+  Notifier n(transport);
+  n.configure(coalesce, interval, 200, NOTIFY_MAX_ATTEMPTS);
+  if (withFrame)
+    n.onSnapshot(snapshot, NULL);
+  std::thread worker([&] { n.run(); });
+
+  // Bursts of "interrupts" a few hundred microseconds apart, like a bouncing PIR line
+  std::vector<uint64_t> starts;
+  std::vector<double> postUs;
+  for (int b = 0; b < bursts; b++)
+  {
+    starts.push_back(now_us());
+    for (int i = 0; i < burstSize; i++)
+    {
+      uint64_t t0 = now_us();
+      n.postFromISR(i % 3 ? NOTIFY_SENSOR : NOTIFY_MOTION);
+      postUs.push_back(now_us() - t0);
+      sleep_us(300);
+    }
+    sleep_us((uint64_t)(gap * 1000));
+  }
+  // Let retries and the rate limit play out
+  uint64_t deadline = now_us() + 10000000;
+  while (now_us() < deadline && notifyMetrics.events.value() < (uint64_t)bursts * burstSize)
+    sleep_us(10000);
+  while (now_us() < deadline)
+  {
+    sleep_us(50000);
+    std::lock_guard<std::mutex> guard(w.lock);
+    if (!w.arrivals.empty() && w.arrivals.back() >= starts.back())
+      break;
+  }
+  n.stop();
+  worker.join();
+  shutdown(w.fd, SHUT_RDWR);
+  server.join();
+  tcp_close(w.fd);
+
+  // Each burst is delivered by the first accepted message arriving after it started
+  std::vector<double> latency;
+  for (size_t b = 0; b < starts.size(); b++)
+    for (size_t a = 0; a < w.arrivals.size(); a++)
+      if (w.arrivals[a] >= starts[b])
+      {
+        latency.push_back((w.arrivals[a] - starts[b]) / 1000.0);
+        break;
+      }
+
+  uint64_t events = notifyMetrics.events.value();
+  uint64_t messages = notifyMetrics.messages.value();
+  printf("events %llu in %d bursts -> %llu messages (%.1f events each), %u requests, %llu failed, %llu dropped\n",
+         (unsigned long long)events, bursts, (unsigned long long)messages, messages ? (double)events / messages : 0,
+         w.requests, (unsigned long long)notifyMetrics.failures.value(), (unsigned long long)notifyMetrics.dropped.value());
+  printf("post from ISR us  p50 %.1f  p99 %.1f  max %.1f\n", percentile(postUs, 50), percentile(postUs, 99),
+         percentile(postUs, 100));
+  printf("burst to delivery ms  p50 %.1f  p90 %.1f  max %.1f  (%zu of %d bursts delivered)\n", percentile(latency, 50),
+         percentile(latency, 90), percentile(latency, 100), latency.size(), bursts);
+  printf("messages with a snapshot %u, %.1f KB sent\n", w.withFrame, w.bytes / 1024.0);
+  bool ok = stream_while_down(g_jpeg.size(), 25);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,214 @@
+// OLED status screen refreshes: I2C bytes and bus time per refresh with the whole framebuffer
+// sent each time (Adafruit_SSD1306::display()) against OledPanel's partial page updates, over
+// a mock bus that keeps the panel's RAM to check that what it shows matches the framebuffer
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <OledPanel.h>
+#include "bench.h"
+#include "host_net.h"
+
+#define WIDTH  128
+#define HEIGHT 64
+#define PAGES  (HEIGHT / OLED_PAGE_ROWS)
+
+// SSD1306 on I2C: counts bytes on the wire (address, control byte, payload per transfer of at
+// most the Wire buffer) and applies windowed writes to a copy of the panel's RAM
+class MockBus : public OledBus
+{
+public:
+  MockBus(size_t wireBuffer) : _wireBuffer(wireBuffer), _bytes(0), _transfers(0), _x0(0), _x1(WIDTH - 1),
+                               _p0(0), _p1(PAGES - 1), _x(0), _p(0), _pending(0)
+  {
+    memset(_ram, 0, sizeof(_ram));
+  }
+  bool commands(const uint8_t *cmd, size_t len)
+  {
+    count(len);
+    for (size_t i = 0; i < len; i++)
+      command(cmd[i]);
+    return true;
+  }
+  bool data(const uint8_t *data, size_t len)
+  {
+    count(len);
+    for (size_t i = 0; i < len; i++)
+    {
+      _ram[_p * WIDTH + _x] = data[i];
+      // Horizontal addressing: along the window's columns, then down its pages
+      if (_x++ == _x1)
+      {
+        _x = _x0;
+        _p = _p == _p1 ? _p0 : _p + 1;
+      }
+    }
+    return true;
+  }
+
+  size_t _wireBuffer;
+  uint64_t _bytes;
+  uint64_t _transfers;
+  uint8_t _ram[WIDTH * PAGES];
+
+private:
+  void count(size_t len)
+  {
+    size_t room = _wireBuffer - 1;
+    size_t n = (len + room - 1) / room;
+    _transfers += n;
+    _bytes += len + 2 * n; // address and control byte per transfer
+  }
+  void command(uint8_t b)
+  {
+    if (_pending)
+    {
+      _args[_argc++] = b;
+      if (_argc < 2)
+        return;
+      if (_pending == OLED_COLUMNADDR)
+      {
+        _x0 = _args[0];
+        _x1 = _args[1];
+        _x = _x0;
+      }
+      else
+      {
+        _p0 = _args[0] & (PAGES - 1);
+        _p1 = _args[1] < PAGES ? _args[1] : PAGES - 1;
+        _p = _p0;
+      }
+      _pending = 0;
+    }
+    else if (b == OLED_COLUMNADDR || b == OLED_PAGEADDR)
+    {
+      _pending = b;
+      _argc = 0;
+    }
+  }
+
+  uint8_t _x0, _x1, _p0, _p1, _x, _p;
+  uint8_t _pending;
+  uint8_t _args[2];
+  int _argc;
+};
+
+// What Adafruit_SSD1306::display() puts on the bus
+static void display(MockBus &bus, const uint8_t *frame)
+{
+  static const uint8_t window[] = {OLED_PAGEADDR, 0, 0xFF, OLED_COLUMNADDR, 0};
+  static const uint8_t lastColumn[] = {WIDTH - 1};
+  bus.commands(window, sizeof(window));
+  bus.commands(lastColumn, sizeof(lastColumn));
+  bus.data(frame, WIDTH * PAGES);
+}
+
+// Framebuffer drawing with the layout of lib/OLED: 6x8 cells, glyphs stand-ins derived from
+// the character so that different text lights different pixels
+static void pixel(uint8_t *frame, int x, int y)
+{
+  if (x >= 0 && x < WIDTH && y >= 0 && y < HEIGHT)
+    frame[(y / 8) * WIDTH + x] |= 1 << (y & 7);
+}
+
+static void text(uint8_t *frame, const std::string &s, int x, int y, int size)
+{
+  for (size_t i = 0; i < s.size(); i++)
+    for (int col = 0; col < 5; col++)
+    {
+      uint8_t bits = s[i] == ' ' ? 0 : (uint8_t)((s[i] * 2654435761u >> (col * 5)) & 0x7F);
+      for (int row = 0; row < 8; row++)
+        if (bits >> row & 1)
+          for (int dx = 0; dx < size; dx++)
+            for (int dy = 0; dy < size; dy++)
+              pixel(frame, x + (int)(i * 6 + col) * size + dx, y + row * size + dy);
+    }
+}
+
+static int centered(uint8_t *frame, const std::string &s, int y, int size)
+{
+  text(frame, s, (WIDTH - (int)s.size() * 6 * size) / 2, y, size);
+  return y + 8 * size;
+}
+
+static std::string split_align(const std::string &a, const std::string &b)
+{
+  if (a.size() + b.size() >= 20)
+    return "";
+  return a + std::string(21 - a.size() - b.size(), ' ') + b;
+}
+
+static void render(uint8_t *frame, int clients, int hours, int days, bool online)
+{
+  memset(frame, 0, WIDTH * PAGES);
+  int y = centered(frame, split_align("800x600", "esp32cam"), 0, 1);
+  for (int x = 0; x < WIDTH; x++)
+    pixel(frame, x, y + 2);
+  y = centered(frame, split_align("Clients:", std::to_string(clients)), y + 5, 1);
+  for (int x = 0; x < WIDTH; x++)
+    pixel(frame, x, y + 2);
+  y = centered(frame, split_align("Uptime:", days ? std::to_string(days) + " days" : std::to_string(hours) + " hours"),
+               y + 5, 1);
+  std::string status = online ? "ONLINE" : "OFFLINE";
+  centered(frame, status, (y + HEIGHT - 16) / 2, 2);
+}
+
+// Clock cycles: 9 per byte (8 bits and the ack) and about 2 per transfer for start and stop
+static double bus_ms(uint64_t bytes, uint64_t transfers, double khz)
+{
+  return (bytes * 9 + transfers * 2) / khz;
+}
+
+int bench_oled(int argc, char **argv)
+{
+  int refreshes = opt_int(argc, argv, "refreshes", 2880); // a day of 30 s refreshes
+  double khz = opt_double(argc, argv, "khz", 400);
+  size_t wireBuffer = opt_int(argc, argv, "wire-buffer", 128); // I2C_BUFFER_LENGTH on the ESP32
+
+  uint8_t frame[WIDTH * PAGES];
+  MockBus full(wireBuffer), partial(wireBuffer);
+  OledPanel panel(WIDTH, HEIGHT);
+  panel.begin();
+
+  // A day on the status screen: viewers come and go, the hours tick, the WiFi drops twice
+  uint32_t seed = 1;
+  int clients = 0, hours = 0, days = 0;
+  bool online = true;
+  int changed = 0, mismatches = 0;
+  uint64_t flushNs = 0, windows = 0, maxBytes = 0;
+  for (int i = 0; i < refreshes; i++)
+  {
+    seed = seed * 1103515245 + 12345;
+    if ((seed >> 16) % 20 == 0)
+      clients = clients && (seed >> 8) % 2 ? clients - 1 : clients + 1;
+    if (i && i % 120 == 0 && ++hours == 24)
+    {
+      hours = 0;
+      days++;
+    }
+    online = !(i % 1000 >= 500 && i % 1000 < 504);
+    render(frame, clients, hours, days, online);
+
+    display(full, frame);
+    uint64_t before = partial._bytes;
+    uint64_t t0 = now_us();
+    int sent = panel.flush(partial, frame);
+    flushNs += (now_us() - t0) * 1000;
+    windows += panel.windows();
+    changed += sent > 0;
+    if (partial._bytes - before > maxBytes && i)
+      maxBytes = partial._bytes - before;
+    mismatches += memcmp(partial._ram, frame, sizeof(frame)) != 0 || memcmp(full._ram, frame, sizeof(frame)) != 0;
+  }
+
+  printf("%d refreshes, %d changed the screen, panel RAM %s\n", refreshes, changed,
+         mismatches ? "DIFFERS from the framebuffer" : "matches the framebuffer after every refresh");
+  printf("full frame:     %7.1f bytes/refresh, %5.2f ms on the bus at %.0f kHz\n", (double)full._bytes / refreshes,
+         bus_ms(full._bytes, full._transfers, khz) / refreshes, khz);
+  printf("partial pages:  %7.1f bytes/refresh, %5.2f ms on the bus, %.2f windows, largest change after the first %llu bytes\n",
+         (double)partial._bytes / refreshes, bus_ms(partial._bytes, partial._transfers, khz) / refreshes,
+         (double)windows / refreshes, (unsigned long long)maxBytes);
+  printf("diffing cost %.2f us per refresh, %.1fx fewer bytes\n", flushNs / 1e3 / refreshes,
+         (double)full._bytes / (partial._bytes ? partial._bytes : 1));
+  return 0;
+}
@@ -0,0 +1,263 @@
+// OTA next to live viewers: upload throughput into a flash stand-in with the write speed of
+// the ESP32's SPI flash (sector erases included), viewer fps before, during and with the old inline flash writes,
+// a dropped connection resumed at the reported offset, and a corrupted image refused
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <EventServer.h>
+#include <MJPEGStreamer.h>
+#include <OtaSession.h>
+#include "bench.h"
+#include "host_net.h"
+#include "host_stats.h"
+#include "synthetic_source.h"
+
+// Flash stand-in: keeps the image in memory and, like Update, collects a 4 KB sector before
+// it erases and programs it, taking as long as the chip would
+class FlashTarget : public OtaTarget
+{
+public:
+  FlashTarget(double eraseMs, double kBps) : _eraseMs(eraseMs), _kBps(kBps), _active(false), _activated(false) {}
+  bool begin(size_t size)
+  {
+    _image.clear();
+    _image.reserve(size);
+    _active = true;
+    return true;
+  }
+  bool write(const uint8_t *data, size_t len)
+  {
+    for (size_t i = 0; i < len; i++)
+    {
+      _image.push_back(data[i]);
+      if (_image.size() % 4096 == 0)
+        sleep_us((uint64_t)(_eraseMs * 1000 + 4096 * 1e6 / (_kBps * 1024)));
+    }
+    return true;
+  }
+  bool end(void)
+  {
+    _active = false;
+    _activated = true;
+    return true;
+  }
+  void abort(void) { _active = false; }
+
+  double _eraseMs;
+  double _kBps;
+  std::vector<uint8_t> _image;
+  bool _active;
+  bool _activated;
+};
+
+static MJPEGBroadcaster *g_broadcaster;
+static OtaSession *g_ota;
+static FlashTarget *g_flash;
+
+static void handle_stream(HttpConnection &conn) { conn.stream(new MJPEGStreamer(*g_broadcaster)); }
+static void handle_ota(HttpConnection &conn) { otaRequest(*g_ota, conn); }
+static void upload_ota(HttpConnection &conn, const Upload &upload) { otaUpload(*g_ota, conn, upload); }
+static void wake(void *ctx) { ((HttpServer *)ctx)->wake(); }
+
+// What perform_update() used to do: the flash write inside the upload handler, on the loop
+static void handle_inline(HttpConnection &conn) { conn.send(200, "text/plain", "OK"); }
+static void upload_inline(HttpConnection &conn, const Upload &upload)
+{
+  if (upload.status == UPLOAD_START)
+    g_flash->begin(0);
+  else if (upload.status == UPLOAD_WRITE)
+    g_flash->write(upload.buf, upload.len);
+}
+
+// One request, the reply read to the end. dropAfter > 0 closes the socket after that many
+// body bytes instead, like a link going away mid-upload. Returns the status, 0 on a drop.
+static int request(uint16_t port, const char *method, const char *path, const uint8_t *body, size_t len,
+                   std::string *reply, size_t dropAfter = 0)
+{
+  int fd = tcp_connect(port);
+  if (fd < 0)
+    return -1;
+  char head[256];
+  int n = snprintf(head, sizeof(head),
+                   "%s %s HTTP/1.1\r\nConnection: close\r\nContent-Type: application/octet-stream\r\nContent-Length: %zu\r\n\r\n",
+                   method, path, len);
+  send_all(fd, head, n);
+  if (dropAfter)
+  {
+    send_all(fd, body, dropAfter);
+    tcp_close(fd);
+    return 0;
+  }
+  if (len && !send_all(fd, body, len))
+  {
+    tcp_close(fd);
+    return -1;
+  }
+  reply->clear();
+  char buf[4096];
+  ssize_t got;
+  while ((got = recv(fd, buf, sizeof(buf), 0)) > 0)
+    reply->append(buf, got);
+  tcp_close(fd);
+  return reply->size() > 12 ? atoi(reply->c_str() + 9) : -1;
+}
+
+static long json_num(const std::string &reply, const char *key)
+{
+  std::string k = std::string("\"") + key + "\":";
+  size_t at = reply.find(k);
+  return at == std::string::npos ? -1 : atol(reply.c_str() + at + k.size());
+}
+
+static std::string json_str(const std::string &reply, const char *key)
+{
+  std::string k = std::string("\"") + key + "\":\"";
+  size_t at = reply.find(k);
+  if (at == std::string::npos)
+    return "";
+  at += k.size();
+  return reply.substr(at, reply.find('"', at) - at);
+}
+
+// Frames all viewers got while fn ran, per viewer and second
+template <typename F>
+static double viewer_fps(std::vector<std::atomic<uint64_t> > &frames, F fn, double *seconds)
+{
+  uint64_t before = 0, after = 0;
+  for (size_t i = 0; i < frames.size(); i++)
+    before += frames[i];
+  uint64_t t0 = now_us();
+  fn();
+  *seconds = (now_us() - t0) / 1e6;
+  for (size_t i = 0; i < frames.size(); i++)
+    after += frames[i];
+  return frames.empty() ? 0 : (after - before) / *seconds / frames.size();
+}
+
+int bench_ota(int argc, char **argv)
+{
+  size_t imageKB = opt_int(argc, argv, "image-kb", 1024);
+  double eraseMs = opt_double(argc, argv, "erase-ms", 45); // typical 4 KB sector erase
+  double flashKBps = opt_double(argc, argv, "flash-kbps", 400); // page programming
+  size_t size = opt_int(argc, argv, "size", 25000);
+  double fps = opt_double(argc, argv, "fps", 25);
+  int viewers = opt_int(argc, argv, "viewers", 2);
+  double dropAt = opt_double(argc, argv, "drop-at", 0.4);
+
+  std::vector<uint8_t> image(imageKB * 1024);
+  for (size_t i = 0; i < image.size(); i++)
+    image[i] = (uint8_t)(i * 2654435761u >> 13);
+  Sha256 sha;
+  uint8_t digest[SHA256_SIZE];
+  char hex[2 * SHA256_SIZE + 1];
+  uint64_t h0 = now_us();
+  sha.update(image.data(), image.size());
+  sha.finish(digest);
+  Sha256::toHex(digest, hex);
+  printf("image %zu KB, sha256 %s (%.1f MB/s hashing)\n", imageKB, hex, image.size() / ((now_us() - h0) / 1e6) / 1e6);
+
+  SyntheticSource source(size, fps);
+  MJPEGBroadcaster b(source);
+  g_broadcaster = &b;
+  FlashTarget flash(eraseMs, flashKBps);
+  g_flash = &flash;
+  OtaSession ota(flash);
+  g_ota = &ota;
+  HttpServer server;
+  server.on("/mjpeg", METHOD_GET, handle_stream);
+  server.on("/ota", METHOD_GET, handle_ota);
+  server.on("/ota", METHOD_POST, handle_ota, upload_ota);
+  server.on("/inline", METHOD_POST, handle_inline, upload_inline);
+  server.begin(0);
+  b.onPublish(wake, &server);
+  ota.begin();
+  ota.onChange(wake, &server);
+  uint16_t port = server.port();
+
+  std::atomic<bool> stop(false);
+  std::thread loop([&] { while (!stop) server.poll(50); });
+  std::thread producer([&] { while (!stop) b.captureOnce(); });
+  std::thread writer([&] { ota.run(); });
+  std::vector<std::atomic<uint64_t> > frames(viewers);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < viewers; i++)
+  {
+    frames[i] = 0;
+    threads.push_back(std::thread(mjpeg_viewer, port, &stop, &frames[i]));
+  }
+  sleep_us(500000);
+
+  double secs;
+  double idle = viewer_fps(frames, [] { sleep_us(2000000); }, &secs);
+  printf("viewers, no update:          %5.1f fps per viewer\n", idle);
+
+  // The old way for comparison: every chunk's flash write holds up the event loop
+  std::string reply;
+  double inl = viewer_fps(frames, [&] { request(port, "POST", "/inline", image.data(), image.size(), &reply); }, &secs);
+  printf("inline flash writes:         %5.1f fps per viewer, upload %6.1f KB/s over %.1f s\n", inl,
+         image.size() / 1024.0 / secs, secs);
+
+  // Same bytes with one flipped: written out, but never activated
+  std::vector<uint8_t> corrupt(image);
+  corrupt[corrupt.size() / 2] ^= 1;
+  char path[160];
+  snprintf(path, sizeof(path), "/ota?size=%zu&sha256=%s", image.size(), hex);
+  int code = request(port, "POST", path, corrupt.data(), corrupt.size(), &reply);
+  printf("corrupted image:             reply %d, state %s (%s), %s\n", code, json_str(reply, "state").c_str(),
+         json_str(reply, "error").c_str(), flash._activated ? "ACTIVATED" : "not activated");
+
+  // Background writer; the link drops part way and the upload continues where the device
+  // says, after a try at a stale offset
+  long resumedAt = -1;
+  int staleCode = 0;
+  std::string stale;
+  double during = viewer_fps(frames, [&] {
+    size_t drop = dropAt > 0 && dropAt < 1 ? (size_t)(image.size() * dropAt) : 0;
+    code = request(port, "POST", path, image.data(), image.size(), &reply, drop);
+    if (code)
+      return;
+    // The device notices the drop once it has read (and flashed) what was sent before it
+    for (uint64_t t0 = now_us(); now_us() - t0 < 60000000;)
+    {
+      request(port, "GET", "/ota", NULL, 0, &reply);
+      if (json_str(reply, "state") == "paused")
+        break;
+      sleep_us(20000);
+    }
+    resumedAt = json_num(reply, "received");
+    char resume[sizeof(path) + 32];
+    snprintf(resume, sizeof(resume), "%s&offset=%ld", path, resumedAt / 2);
+    staleCode = request(port, "POST", resume, image.data() + resumedAt / 2, 4096, &stale);
+    snprintf(resume, sizeof(resume), "%s&offset=%ld", path, resumedAt);
+    code = request(port, "POST", resume, image.data() + resumedAt, image.size() - resumedAt, &reply);
+  }, &secs);
+  bool intact = flash._activated && flash._image == image;
+  printf("background writer:           %5.1f fps per viewer, upload %6.1f KB/s over %.1f s\n", during,
+         image.size() / 1024.0 / secs, secs);
+  printf("  dropped at %.0f%%; offset %ld refused with %d (%s, received %ld); resumed at %ld\n", dropAt * 100,
+         resumedAt / 2, staleCode, json_str(stale, "refused").c_str(), json_num(stale, "received"), resumedAt);
+  printf("  reply %d, state %s, %s, image %s\n", code, json_str(reply, "state").c_str(),
+         json_str(reply, "digest") == hex ? "digest matches" : "DIGEST DIFFERS", intact ? "intact and activated" : "WRONG");
+
+  printf("flash write us p50 <= %u p99 <= %u, reads gated %llu times, %llu resumes, %llu updates, %llu failures\n",
+         otaMetrics.write.percentile(50), otaMetrics.write.percentile(99),
+         (unsigned long long)otaMetrics.gated.value(), (unsigned long long)otaMetrics.resumes.value(),
+         (unsigned long long)otaMetrics.updates.value(), (unsigned long long)otaMetrics.failures.value());
+
+  stop = true;
+  b.shutdown();
+  ota.shutdown();
+  server.wake();
+  loop.join();
+  producer.join();
+  writer.join();
+  server.stop();
+  for (size_t i = 0; i < threads.size(); i++)
+    threads[i].join();
+  return 0;
+}
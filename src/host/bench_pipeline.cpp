@@ -0,0 +1,209 @@
+// Capture/send split: sustained fps, per-stage utilisation and capture-to-send latency with
+// both stages run serially on one thread (capture and event loop sharing core 1) against a
+// capture thread handing frames to a send thread through the FrameQueue (one core each).
+// Stage costs are timed waits standing in for the time each stage holds its core (the
+// driver's frame copy, the socket writes), so the result does not depend on how many cores
+// the host has; utilisation is that time over the run.
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <FrameQueue.h>
+#include <MJPEGBroadcaster.h>
+#include <PipelineMetrics.h>
+#include "bench.h"
+#include "host_net.h"
+#include "host_stats.h"
+#include "synthetic_source.h"
+
+// The sensor plus the CPU the capture stage spends on each frame
+class WorkSource : public FrameSource
+{
+public:
+  WorkSource(size_t size, double fps, uint64_t work_us) : _inner(size, fps), _work_us(work_us) {}
+  FrameRef capture(void)
+  {
+    FrameRef frame = _inner.capture();
+    sleep_us(_work_us);
+    busy_us += _work_us;
+    return frame;
+  }
+  bool drain(uint32_t timeout_ms) { return _inner.drain(timeout_ms); }
+
+  uint64_t busy_us = 0;
+
+private:
+  SyntheticSource _inner;
+  uint64_t _work_us;
+};
+
+// Wakes the send thread on a queued frame, as wake_server() does for the event loop
+struct Doorbell
+{
+  std::mutex lock;
+  std::condition_variable rung;
+  bool pending;
+
+  static void ring(void *ctx)
+  {
+    Doorbell *d = (Doorbell *)ctx;
+    std::lock_guard<std::mutex> guard(d->lock);
+    d->pending = true;
+    d->rung.notify_one();
+  }
+  void wait(uint32_t timeout_ms)
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    rung.wait_for(guard, std::chrono::milliseconds(timeout_ms), [this] { return pending; });
+    pending = false;
+  }
+};
+
+struct SendStage
+{
+  uint32_t lastSeq;
+  uint64_t sent;
+  uint64_t busy_us;
+  bool ordered;
+  std::vector<double> latency_ms;
+};
+
+// What the event loop does with a published frame: picks it up and writes it out
+static void send_latest(MJPEGBroadcaster &b, SendStage &s, uint64_t work_us)
+{
+  FrameRef frame;
+  if (!b.tryAcquire(frame, s.lastSeq))
+    return;
+  s.ordered &= frame.getSeq() > s.lastSeq && frame.getBuf()[0] == 0xFF && frame.getBuf()[1] == 0xD8;
+  s.lastSeq = frame.getSeq();
+  sleep_us(work_us);
+  s.busy_us += work_us;
+  s.latency_ms.push_back((now_us() - frame.getTimestamp()) / 1e3);
+  s.sent++;
+}
+
+static bool run(const char *label, int depth, double seconds, double fps, size_t size, uint64_t captureUs, uint64_t sendUs)
+{
+  WorkSource source(size, fps, captureUs);
+  MJPEGBroadcaster b(source);
+  FrameQueue queue(depth ? depth : 1);
+  Doorbell bell;
+  bell.pending = false;
+  if (depth)
+  {
+    b.pipeline(&queue);
+    b.onPublish(Doorbell::ring, &bell);
+  }
+  b.attach();
+
+  SendStage s = {0, 0, 0, true, std::vector<double>()};
+  uint64_t captured0 = pipelineMetrics.framesCaptured.value();
+  uint64_t dropped0 = pipelineMetrics.framesSuperseded.value();
+  std::atomic<bool> stop(false);
+  uint64_t start = now_us();
+  std::vector<std::thread> threads;
+  if (!depth)
+  {
+    // Serial: one thread captures, then sends what it captured
+    threads.push_back(std::thread([&] {
+      while (!stop)
+      {
+        b.captureOnce();
+        send_latest(b, s, sendUs);
+      }
+    }));
+  }
+  else
+  {
+    threads.push_back(std::thread([&] { while (!stop) b.captureOnce(); }));
+    threads.push_back(std::thread([&] {
+      while (!stop)
+      {
+        bell.wait(50);
+        while (b.publishQueued())
+          send_latest(b, s, sendUs);
+      }
+    }));
+  }
+  sleep_us((uint64_t)(seconds * 1e6));
+  stop = true;
+  double elapsed = (now_us() - start) / 1e6;
+  b.shutdown();
+  Doorbell::ring(&bell);
+  for (size_t i = 0; i < threads.size(); i++)
+    threads[i].join();
+  queue.clear();
+  bool drained = source.drain(1000);
+
+  double captured = pipelineMetrics.framesCaptured.value() - captured0;
+  uint64_t dropped = pipelineMetrics.framesSuperseded.value() - dropped0;
+  double p50 = percentile(s.latency_ms, 50), p99 = percentile(s.latency_ms, 99);
+  printf("%-14s %9.1f %9.1f %9.0f%% %8.0f%% %8llu %8.1f %8.1f  %s\n", label, captured / elapsed, s.sent / elapsed,
+         100 * source.busy_us / 1e6 / elapsed, 100 * s.busy_us / 1e6 / elapsed, (unsigned long long)dropped, p50, p99,
+         s.ordered && drained ? "ok" : !drained ? "BUFFERS LEAKED" : "OUT OF ORDER");
+  return s.ordered && drained;
+}
+
+// Hand-off cost: one thread pushing, one popping, every frame accounted for as popped or dropped
+static bool queue_cost(int depth, int frames)
+{
+  SyntheticSource source(64, 0);
+  FrameQueue queue(depth);
+  FrameRef frame = source.capture(); // the same handle over and over, only the queue is timed
+  std::atomic<bool> done(false);
+  uint64_t popped = 0;
+  std::thread consumer([&] {
+    FrameRef out;
+    for (;;)
+    {
+      if (queue.pop(out))
+        popped++;
+      else if (done)
+        break;
+      out.reset();
+    }
+  });
+  uint64_t t0 = now_us();
+  for (int i = 0; i < frames; i++)
+    queue.push(frame);
+  double ns = (now_us() - t0) * 1e3 / frames;
+  done = true;
+  consumer.join();
+  FrameRef left;
+  while (queue.pop(left))
+    popped++;
+  bool ok = popped + queue.dropped() == (uint64_t)frames;
+  printf("queue depth %d: %.0f ns per push across threads, %llu popped, %u dropped oldest, %s\n", depth, ns,
+         (unsigned long long)popped, queue.dropped(), ok ? "all accounted for" : "FRAMES LOST");
+  return ok;
+}
+
+int bench_pipeline(int argc, char **argv)
+{
+  double seconds = opt_double(argc, argv, "seconds", 2);
+  double fps = opt_double(argc, argv, "fps", 0); // sensor rate, 0 for as fast as the stages go
+  size_t size = opt_int(argc, argv, "size", 40000);
+  uint64_t captureUs = opt_int(argc, argv, "capture-us", 6000);
+  uint64_t sendUs = opt_int(argc, argv, "send-us", 9000);
+  int depth = opt_int(argc, argv, "depth", 2);
+
+  bool ok = true;
+  printf("capture %llu us, send %llu us per frame, sensor %s\n", (unsigned long long)captureUs,
+         (unsigned long long)sendUs, fps > 0 ? "paced" : "unpaced");
+  printf("%-14s %9s %9s %10s %9s %8s %8s %8s\n", "stages", "capt fps", "sent fps", "capt util", "send util",
+         "dropped", "p50 ms", "p99 ms");
+  ok &= run("serial", 0, seconds, fps, size, captureUs, sendUs);
+  ok &= run("queued, 1", 1, seconds, fps, size, captureUs, sendUs);
+  if (depth != 1)
+  {
+    char label[24];
+    snprintf(label, sizeof(label), "queued, %d", depth);
+    ok &= run(label, depth, seconds, fps, size, captureUs, sendUs);
+  }
+  printf("\n");
+  ok &= queue_cost(depth, 1000000);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,121 @@
+// Live reconfiguration: how long a preset switch stalls the streams, and whether they survive it
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <EventServer.h>
+#include <MJPEGStreamer.h>
+#include "bench.h"
+#include "host_net.h"
+#include "host_stats.h"
+#include "synthetic_source.h"
+
+static MJPEGBroadcaster *g_broadcaster;
+static SyntheticSource *g_source;
+static std::atomic<uint64_t> g_lastPublish;
+
+struct Switch
+{
+  uint32_t init_us; // stands in for esp_camera_deinit() + esp_camera_init()
+  uint64_t drain_us;
+  bool drained;
+  std::atomic<bool> done;
+};
+
+static void handle_stream(HttpConnection &conn) { conn.stream(new MJPEGStreamer(*g_broadcaster)); }
+
+static void published(void *ctx)
+{
+  g_lastPublish = now_us();
+  ((HttpServer *)ctx)->wake();
+}
+
+// Same shape as the firmware's run_reconfig(): drain, re-init, resume
+static void run_switch(void *ctx)
+{
+  Switch *s = (Switch *)ctx;
+  uint64_t t0 = now_us();
+  s->drained = g_source->drain(1000);
+  s->drain_us = now_us() - t0;
+  sleep_us(s->init_us);
+  s->done = true;
+}
+
+int bench_reconfig(int argc, char **argv)
+{
+  int viewers = opt_int(argc, argv, "viewers", 4);
+  int switches = opt_int(argc, argv, "switches", 20);
+  double initMs = opt_double(argc, argv, "init-ms", 150);
+  double fps = opt_double(argc, argv, "fps", 25);
+  size_t size = opt_int(argc, argv, "size", 40000);
+
+  SyntheticSource source(size, fps);
+  MJPEGBroadcaster b(source);
+  g_broadcaster = &b;
+  g_source = &source;
+  HttpServer server;
+  server.on("/mjpeg", METHOD_GET, handle_stream);
+  server.begin(0);
+  b.onPublish(published, &server);
+
+  std::atomic<bool> stop(false);
+  std::thread loop([&] { while (!stop) server.poll(50); });
+  std::thread producer([&] { while (!stop) b.captureOnce(); });
+  std::vector<std::thread> threads;
+  std::vector<std::atomic<uint64_t> > frames(viewers);
+  for (int i = 0; i < viewers; i++)
+  {
+    frames[i] = 0;
+    threads.push_back(std::thread(mjpeg_viewer, server.port(), &stop, &frames[i]));
+  }
+  sleep_us(500000);
+
+  printf("%d viewers, %.1f fps, %u byte frames, %.0f ms simulated driver re-init\n", viewers, fps, (unsigned)size, initMs);
+  std::vector<double> drain, total;
+  int failed = 0;
+  for (int i = 0; i < switches; i++)
+  {
+    Switch s;
+    s.init_us = (uint32_t)(initMs * 1000);
+    s.done = false;
+    uint64_t t0 = now_us();
+    if (!b.schedule(run_switch, &s))
+    {
+      failed++;
+      continue;
+    }
+    while (!s.done)
+      sleep_us(200);
+    // Switch time as a viewer sees it: request until the first frame with the new preset
+    while (g_lastPublish.load() < t0 + s.drain_us + s.init_us)
+      sleep_us(200);
+    if (!s.drained)
+      failed++;
+    drain.push_back(s.drain_us / 1000.0);
+    total.push_back((g_lastPublish.load() - t0) / 1000.0);
+    sleep_us(300000);
+  }
+
+  uint64_t before[64];
+  for (int i = 0; i < viewers && i < 64; i++)
+    before[i] = frames[i];
+  sleep_us(1000000);
+  int alive = 0;
+  for (int i = 0; i < viewers && i < 64; i++)
+    if (frames[i] > before[i])
+      alive++;
+
+  printf("drain_ms  p50 %7.2f  p99 %7.2f\n", percentile(drain, 50), percentile(drain, 99));
+  printf("total_ms  p50 %7.2f  p99 %7.2f  (request to first new frame)\n", percentile(total, 50), percentile(total, 99));
+  printf("%d/%d switches drained in time, %d/%d viewers still streaming\n", switches - failed, switches, alive, viewers);
+
+  stop = true;
+  b.shutdown();
+  server.wake();
+  loop.join();
+  producer.join();
+  server.stop();
+  for (size_t i = 0; i < threads.size(); i++)
+    threads[i].join();
+  return 0;
+}
@@ -0,0 +1,253 @@
+// AVI recording: raw writer throughput per buffer size on the local filesystem, a structural
+// check of every file written, and the full recorder next to live viewers with rolling files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <OV2640.h>
+#include <EventServer.h>
+#include <MJPEGStreamer.h>
+#include <Recorder.h>
+#include "bench.h"
+#include "host_net.h"
+#include "host_stats.h"
+#include "synthetic_source.h"
+
+static MJPEGBroadcaster *g_broadcaster;
+
+static void handle_stream(HttpConnection &conn) { conn.stream(new MJPEGStreamer(*g_broadcaster)); }
+static void wake(void *ctx) { ((HttpServer *)ctx)->wake(); }
+
+static uint32_t get32(const uint8_t *p) { return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24; }
+
+// What a player relies on: RIFF/movi/idx1 sizes, header totals, and every index entry
+// pointing at a 00dc chunk that holds a whole JPEG. Returns the frame count, -1 when broken.
+static long verify_avi(const char *path, double *fps)
+{
+  FILE *f = fopen(path, "rb");
+  if (!f)
+    return -1;
+  std::vector<uint8_t> d;
+  uint8_t chunk[65536];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+    d.insert(d.end(), chunk, chunk + n);
+  fclose(f);
+  const uint8_t *p = d.data();
+  if (d.size() < 520 || memcmp(p, "RIFF", 4) || get32(p + 4) != d.size() - 8 || memcmp(p + 8, "AVI ", 4))
+    return -1;
+  uint32_t frames = get32(p + 48);
+  *fps = get32(p + 32) ? 1e6 / get32(p + 32) : 0;
+  // Walk the top-level chunks to find movi and idx1
+  size_t movi = 0, idx = 0, idxLen = 0;
+  for (size_t off = 12; off + 8 <= d.size();)
+  {
+    uint32_t len = get32(p + off + 4);
+    if (!memcmp(p + off, "LIST", 4) && !memcmp(p + off + 8, "movi", 4))
+      movi = off + 8;
+    if (!memcmp(p + off, "idx1", 4))
+    {
+      idx = off + 8;
+      idxLen = len;
+    }
+    off += 8 + len + (len & 1);
+  }
+  if (!movi || !idx || idxLen != frames * 16 || get32(p + 140) != frames)
+    return -1;
+  for (uint32_t i = 0; i < frames; i++)
+  {
+    const uint8_t *e = p + idx + i * 16;
+    size_t at = movi + get32(e + 8);
+    uint32_t len = get32(e + 12);
+    if (memcmp(e, "00dc", 4) || at + 8 + len > idx || memcmp(p + at, "00dc", 4) || get32(p + at + 4) != len)
+      return -1;
+    const uint8_t *jpg = p + at + 8;
+    if (len < 4 || jpg[0] != 0xFF || jpg[1] != 0xD8 || jpg[len - 2] != 0xFF || jpg[len - 1] != 0xD9)
+      return -1;
+  }
+  return frames;
+}
+
+void load_frames(const char *dir, size_t size, std::vector<std::vector<uint8_t> > &clip)
+{
+  if (dir && replay_camera_open(dir, 0, false))
+  {
+    OV2640 cam;
+    camera_config_t config = esp32cam_aithinker_config;
+    config.fb_count = 1;
+    if (cam.init(config) == ESP_OK)
+    {
+      for (;;)
+      {
+        FrameRef f = cam.capture();
+        if (!f)
+          break;
+        clip.push_back(std::vector<uint8_t>(f.getBuf(), f.getBuf() + f.getSize()));
+      }
+    }
+    esp_camera_deinit();
+  }
+  if (!clip.empty())
+    return;
+  // JPEG-shaped filler, sizes +-20% around size
+  for (uint32_t i = 0; i < 32; i++)
+  {
+    std::vector<uint8_t> f(size * 8 / 10 + (i * 2654435761u >> 8) % (size * 4 / 10 + 1));
+    for (size_t j = 0; j < f.size(); j++)
+      f[j] = (uint8_t)(j * 31 + i);
+    f[0] = 0xFF, f[1] = 0xD8, f[f.size() - 2] = 0xFF, f[f.size() - 1] = 0xD9;
+    clip.push_back(f);
+  }
+}
+
+static void writer_rate(const std::vector<std::vector<uint8_t> > &clip, const char *out, size_t buffer, uint32_t frames)
+{
+  AviWriter w;
+  char path[128];
+  snprintf(path, sizeof(path), "%s/raw-%zu.avi", out, buffer);
+  if (!w.begin(buffer) || !w.open(path, 640, 480))
+  {
+    fprintf(stderr, "cannot write %s\n", path);
+    return;
+  }
+  std::vector<double> us;
+  uint64_t bytes = 0;
+  uint64_t t0 = now_us();
+  for (uint32_t i = 0; i < frames; i++)
+  {
+    const std::vector<uint8_t> &f = clip[i % clip.size()];
+    uint64_t s = now_us();
+    w.writeFrame(f.data(), f.size(), i * 40000ULL);
+    us.push_back(now_us() - s);
+    bytes += f.size();
+  }
+  bool closed = w.close();
+  double elapsed = (now_us() - t0) / 1e6;
+  double fps = 0;
+  long ok = verify_avi(path, &fps);
+  printf("buffer %6zu B: %6.1f MB/s, %6.0f frames/s, frame us p50 %6.1f p99 %7.1f max %7.1f, %s (%ld frames, %.1f fps)\n",
+         buffer, bytes / elapsed / 1e6, frames / elapsed, percentile(us, 50), percentile(us, 99),
+         percentile(us, 100), closed && ok == (long)frames ? "valid" : "BROKEN", ok, fps);
+  remove(path);
+}
+
+static void pipeline(const char *out, size_t size, double fps, int viewers, double seconds, uint32_t maxMB,
+                     uint32_t maxS)
+{
+  SyntheticSource source(size, fps);
+  MJPEGBroadcaster b(source);
+  g_broadcaster = &b;
+  HttpServer server;
+  server.on("/mjpeg", METHOD_GET, handle_stream);
+  server.begin(0);
+  b.onPublish(wake, &server);
+  Recorder rec(b);
+  rec.configure(maxMB, maxS);
+  if (!rec.begin(out))
+  {
+    fprintf(stderr, "cannot record to %s\n", out);
+    return;
+  }
+
+  std::atomic<bool> stop(false);
+  std::thread loop([&] { while (!stop) server.poll(50); });
+  std::thread producer([&] { while (!stop) b.captureOnce(); });
+  std::thread feeder([&] { rec.runFeeder(); });
+  std::thread writer([&] { rec.runWriter(); });
+  std::vector<std::atomic<uint64_t> > frames(viewers);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < viewers; i++)
+  {
+    frames[i] = 0;
+    threads.push_back(std::thread(mjpeg_viewer, server.port(), &stop, &frames[i]));
+  }
+  uint32_t published = b.framesPublished();
+  rec.start();
+  uint64_t start = now_us();
+  uint16_t maxQueued = 0;
+  while (now_us() - start < seconds * 1e6)
+  {
+    sleep_us(10000);
+    uint16_t q = rec.queued();
+    maxQueued = q > maxQueued ? q : maxQueued;
+  }
+  rec.stop();
+  published = b.framesPublished() - published;
+  double elapsed = (now_us() - start) / 1e6;
+  stop = true;
+  b.shutdown();
+  server.wake();
+  rec.shutdown();
+  loop.join();
+  producer.join();
+  feeder.join();
+  writer.join();
+  server.stop();
+  for (size_t i = 0; i < threads.size(); i++)
+    threads[i].join();
+
+  uint64_t total = 0;
+  for (int i = 0; i < viewers; i++)
+    total += frames[i];
+  printf("recording %.0f s at %.0f fps next to %d viewers: %.1f fps per viewer, %llu of %u frames written, %llu dropped, "
+         "queue peak %u\n", elapsed, fps, viewers, viewers ? total / elapsed / viewers : 0,
+         (unsigned long long)recordMetrics.frames.value(), published, (unsigned long long)recordMetrics.dropped.value(),
+         maxQueued);
+
+  // Check every file the recorder left behind
+  std::vector<std::string> names;
+  DIR *d = opendir(out);
+  for (struct dirent *e; d && (e = readdir(d));)
+  {
+    if (!strncmp(e->d_name, "rec", 3) && strstr(e->d_name, ".avi") && !strstr(e->d_name, ".idx"))
+      names.push_back(e->d_name);
+  }
+  if (d)
+    closedir(d);
+  std::sort(names.begin(), names.end());
+  long files = 0, broken = 0, inFiles = 0;
+  for (size_t i = 0; i < names.size(); i++)
+  {
+    const char *name = names[i].c_str();
+    std::string path = std::string(out) + "/" + name;
+    double fileFps = 0;
+    long n = verify_avi(path.c_str(), &fileFps);
+    struct stat st;
+    stat(path.c_str(), &st);
+    printf("  %s: %ld frames, %.1f MB, %.1f fps%s\n", name, n, st.st_size / 1e6, fileFps, n < 0 ? "  BROKEN" : "");
+    files++;
+    broken += n < 0;
+    inFiles += n > 0 ? n : 0;
+    remove(path.c_str());
+  }
+  printf("%ld files (%ld broken), %ld frames in them, write us p50 <= %u p99 <= %u\n", files, broken, inFiles,
+         recordMetrics.write.percentile(50), recordMetrics.write.percentile(99));
+}
+
+int bench_record(int argc, char **argv)
+{
+  const char *dir = opt_str(argc, argv, "dir", NULL);
+  const char *out = opt_str(argc, argv, "out", "/tmp/esp32cam-rec");
+  size_t size = opt_int(argc, argv, "size", 25000);
+  uint32_t frames = opt_int(argc, argv, "frames", 3000);
+  double fps = opt_double(argc, argv, "fps", 25);
+  int viewers = opt_int(argc, argv, "viewers", 2);
+  double seconds = opt_double(argc, argv, "seconds", 10);
+  uint32_t maxMB = opt_int(argc, argv, "max-mb", 2);
+  uint32_t maxS = opt_int(argc, argv, "max-s", REC_MAX_FILE_S);
+  mkdir(out, 0755);
+
+  std::vector<std::vector<uint8_t> > clip;
+  load_frames(dir, size, clip);
+  size_t buffers[] = {512, 4096, 32768, 131072};
+  for (size_t i = 0; i < sizeof(buffers) / sizeof(buffers[0]); i++)
+    writer_rate(clip, out, buffers[i], frames);
+  pipeline(out, size, fps, viewers, seconds, maxMB, maxS);
+  return 0;
+}
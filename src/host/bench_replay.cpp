@@ -0,0 +1,125 @@
+// Full streaming stack over a recorded clip: OV2640 on the replay camera, broadcaster,
+// event-driven server and MJPEG viewers on loopback sockets
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <OV2640.h>
+#include <EventServer.h>
+#include <MJPEGStreamer.h>
+#include <PipelineMetrics.h>
+#include "bench.h"
+#include "host_net.h"
+#include "host_stats.h"
+
+static MJPEGBroadcaster *g_broadcaster;
+static bool g_chunked;
+
+static void handle_stream(HttpConnection &conn) { conn.stream(new MJPEGStreamer(*g_broadcaster, g_chunked)); }
+static void handle_still(HttpConnection &conn) { conn.stream(new SnapshotStreamer(*g_broadcaster, 250)); }
+static void wake(void *ctx) { ((HttpServer *)ctx)->wake(); }
+
+struct ViewerLog
+{
+  uint64_t bytes;
+  std::vector<uint64_t> arrivals; // when each frame's boundary showed up
+};
+
+static void viewer(uint16_t port, std::atomic<bool> *stop, bool chunked, ViewerLog *log)
+{
+  int fd = tcp_connect(port);
+  char req[64];
+  int n = snprintf(req, sizeof(req), "GET /mjpeg%s HTTP/1.1\r\nHost: bench\r\n\r\n", chunked ? "?chunked=1" : "");
+  send_all(fd, req, n);
+  const char *marker = "--123456789000000000000987654321";
+  size_t mlen = strlen(marker);
+  std::vector<char> buf(65536 + mlen);
+  size_t carry = 0;
+  log->bytes = 0;
+  while (!*stop)
+  {
+    ssize_t got = recv(fd, buf.data() + carry, 65536, 0);
+    if (got <= 0)
+      break;
+    log->bytes += got;
+    size_t total = carry + got;
+    uint64_t now = now_us();
+    for (char *p = buf.data(); (p = (char *)memmem(p, buf.data() + total - p, marker, mlen)); p += mlen)
+      log->arrivals.push_back(now);
+    carry = total < mlen - 1 ? total : mlen - 1;
+    memmove(buf.data(), buf.data() + total - carry, carry);
+  }
+  tcp_close(fd);
+}
+
+int bench_replay(int argc, char **argv)
+{
+  const char *dir = opt_str(argc, argv, "dir", NULL);
+  double fps = opt_double(argc, argv, "fps", 25);
+  int viewers = opt_int(argc, argv, "viewers", 4);
+  double seconds = opt_double(argc, argv, "seconds", 5);
+  int fbCount = opt_int(argc, argv, "fb-count", 2);
+  g_chunked = opt_int(argc, argv, "chunked", 0) != 0;
+  if (!dir || !replay_camera_open(dir, fps, true))
+  {
+    fprintf(stderr, "replay needs --dir=<directory with .jpg files>\n");
+    return 1;
+  }
+
+  OV2640 cam;
+  camera_config_t config = esp32cam_aithinker_config;
+  config.fb_count = fbCount;
+  if (cam.init(config) != ESP_OK)
+    return 1;
+  MJPEGBroadcaster b(cam);
+  g_broadcaster = &b;
+  HttpServer server;
+  server.on("/mjpeg", METHOD_GET, handle_stream);
+  server.on("/jpg", METHOD_GET, handle_still);
+  server.begin(0);
+  b.onPublish(wake, &server);
+  printf("clip: %u files, %.1f KB average, replayed at %.1f fps with %d frame buffers\n", replay_camera_files(),
+         replay_camera_bytes() / 1024.0 / replay_camera_files(), fps, fbCount);
+
+  std::atomic<bool> stop(false);
+  std::thread loop([&] { while (!stop) server.poll(50); });
+  std::thread producer([&] { while (!stop) b.captureOnce(); });
+  std::vector<ViewerLog> logs(viewers);
+  std::vector<std::thread> threads;
+  uint32_t published = b.framesPublished();
+  uint64_t start = now_us();
+  for (int i = 0; i < viewers; i++)
+    threads.push_back(std::thread(viewer, server.port(), &stop, g_chunked, &logs[i]));
+  sleep_us((uint64_t)(seconds * 1e6));
+  stop = true;
+  double elapsed = (now_us() - start) / 1e6;
+  published = b.framesPublished() - published;
+  b.shutdown();
+  server.wake();
+  loop.join();
+  producer.join();
+  server.stop();
+  for (size_t i = 0; i < threads.size(); i++)
+    threads[i].join();
+
+  std::vector<double> gaps;
+  uint64_t frames = 0, bytes = 0;
+  for (int i = 0; i < viewers; i++)
+  {
+    ViewerLog &l = logs[i];
+    bytes += l.bytes;
+    if (l.arrivals.size() > 1)
+      frames += l.arrivals.size() - 1; // the first boundary precedes any frame
+    for (size_t f = 2; f < l.arrivals.size(); f++)
+      gaps.push_back((l.arrivals[f] - l.arrivals[f - 1]) / 1000.0);
+  }
+  printf("captured     %8.1f fps (capture wait p50 %.1f ms, p99 %.1f ms)\n", published / elapsed,
+         pipelineMetrics.captureWait.percentile(50) / 1000.0, pipelineMetrics.captureWait.percentile(99) / 1000.0);
+  printf("delivered    %8.1f fps total, %.1f fps per viewer\n", frames / elapsed, viewers ? frames / elapsed / viewers : 0);
+  printf("throughput   %8.2f MB/s total\n", bytes / elapsed / 1e6);
+  printf("frame gap ms  p50 %.2f  p90 %.2f  p99 %.2f  max %.2f\n", percentile(gaps, 50), percentile(gaps, 90),
+         percentile(gaps, 99), percentile(gaps, 100));
+  return 0;
+}
@@ -0,0 +1,226 @@
+// Event ring: sustained store rate and how much history an arena holds, then a triggered
+// clip exported over /clip while its post-trigger frames are still being captured
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <EventServer.h>
+#include <MJPEGStreamer.h>
+#include <EventClip.h>
+#include "bench.h"
+#include "host_net.h"
+#include "host_stats.h"
+#include "synthetic_source.h"
+
+static MJPEGBroadcaster *g_broadcaster;
+static FrameRing *g_ring;
+
+static void handle_stream(HttpConnection &conn) { conn.stream(new MJPEGStreamer(*g_broadcaster)); }
+static void wake(void *ctx) { ((HttpServer *)ctx)->wake(); }
+
+static void handle_clip(HttpConnection &conn)
+{
+  char pace[4] = "1";
+  conn.arg("pace", pace, sizeof(pace));
+  ClipStreamer *clip = new ClipStreamer(*g_ring, pace[0] != '0');
+  if (!clip->opened())
+  {
+    delete clip;
+    conn.send(404, "text/plain", "no clip");
+    return;
+  }
+  conn.stream(clip);
+}
+
+// Frame sizes like a VGA stream: base size +-20%, deterministic
+static size_t frame_size(size_t base, uint32_t i)
+{
+  return base * 8 / 10 + (i * 2654435761u >> 8) % (base * 4 / 10 + 1);
+}
+
+static void store_rate(size_t arenaKB, uint16_t maxFrames, size_t size, double fps, uint32_t frames, uint32_t pre_ms)
+{
+  FrameRing ring;
+  if (!ring.begin(arenaKB * 1024, maxFrames))
+    return;
+  ring.configure(pre_ms, RING_POST_MS, RING_HOLD_MS);
+  std::vector<uint8_t> src(size * 2);
+  for (size_t i = 0; i < src.size(); i++)
+    src[i] = (uint8_t)(i * 31);
+
+  uint64_t stored = 0, bytes = 0;
+  uint64_t step = (uint64_t)(1e6 / fps);
+  std::vector<double> us;
+  uint64_t t0 = now_us();
+  for (uint32_t i = 0; i < frames; i++)
+  {
+    size_t len = frame_size(size, i);
+    uint64_t s = now_us();
+    if (ring.store(src.data() + (i % 64), len, i * step))
+    {
+      stored++;
+      bytes += len;
+    }
+    us.push_back(now_us() - s);
+  }
+  double elapsed = (now_us() - t0) / 1e6;
+  printf("arena %zu KB, %u index entries, ~%zu B frames at %.0f fps, pre window %u ms\n", arenaKB, maxFrames, size,
+         fps, pre_ms);
+  printf("store us  p50 %.1f  p99 %.1f  max %.1f   sustained %.0f frames/s, %.1f MB/s\n", percentile(us, 50),
+         percentile(us, 99), percentile(us, 100), stored / elapsed, bytes / elapsed / 1e6);
+  printf("held: %u frames, %.1f s of history, %zu of %zu bytes in frames (%.1f%%), index %zu B\n", ring.frameCount(),
+         ring.spanMs() / 1000.0, ring.used(), ring.capacity(), 100.0 * ring.used() / ring.capacity(),
+         (size_t)maxFrames * (sizeof(uint32_t) * 2 + sizeof(uint64_t)));
+}
+
+// Two events within hold_ms, in virtual time: once the first clip is over and nobody reads it,
+// new frames take its space instead of being dropped, and the second clip is cut from them
+static bool second_trigger(size_t arenaKB, uint16_t maxFrames, size_t size, double fps, uint32_t pre_ms, uint32_t post_ms)
+{
+  FrameRing ring;
+  if (!ring.begin(arenaKB * 1024, maxFrames))
+    return false;
+  ring.configure(pre_ms, post_ms, RING_HOLD_MS);
+  std::vector<uint8_t> src(size);
+  uint64_t step = (uint64_t)(1e6 / fps);
+  uint64_t first_us = 5000000, second_us = 28000000, t = 0;
+  uint32_t i = 0, afterClip = 0, droppedAfter = 0;
+  uint64_t released = ringMetrics.released.value();
+  for (; t < second_us; t = ++i * step)
+  {
+    if (t == first_us - first_us % step)
+      ring.trigger();
+    bool stored = ring.store(src.data(), size, t);
+    if (t > first_us + post_ms * 1000ULL)
+    {
+      afterClip++;
+      droppedAfter += !stored;
+    }
+  }
+  ring.trigger();
+  RingFrame f;
+  bool opened = ring.openClip();
+  bool fresh = opened && ring.clipFrame(0, f) == CLIP_FRAME && f.timestamp_us + pre_ms * 1000ULL + step >= t;
+  if (opened)
+    ring.closeClip();
+  bool ok = !droppedAfter && fresh && ring.recording();
+  printf("second trigger %.0f s after the first (hold %u s): %u of %u frames dropped after the first clip, "
+         "second clip starts at %.2f s, %s, %llu clip released%s\n", (second_us - first_us) / 1e6, RING_HOLD_MS / 1000,
+         droppedAfter, afterClip, opened ? f.timestamp_us / 1e6 : 0, ring.recording() ? "recording" : "not recording",
+         (unsigned long long)(ringMetrics.released.value() - released), ok ? "" : "  FAILED");
+  return ok;
+}
+
+// Reads the clip, counting parts and noting when each arrived
+static void fetch_clip(uint16_t port, bool paced, std::vector<uint64_t> *arrivals, uint64_t *bytes)
+{
+  int fd = tcp_connect(port);
+  char req[64];
+  int n = snprintf(req, sizeof(req), "GET /clip?pace=%d HTTP/1.1\r\nHost: bench\r\n\r\n", paced);
+  send_all(fd, req, n);
+  const char *marker = "Content-Type: image/jpeg";
+  size_t mlen = strlen(marker);
+  std::vector<char> buf(65536 + mlen);
+  size_t carry = 0;
+  *bytes = 0;
+  for (;;)
+  {
+    ssize_t got = recv(fd, buf.data() + carry, 65536, 0);
+    if (got <= 0)
+      break;
+    *bytes += got;
+    size_t total = carry + got;
+    for (char *p = buf.data(); (p = (char *)memmem(p, buf.data() + total - p, marker, mlen)); p += mlen)
+      arrivals->push_back(now_us());
+    carry = total < mlen - 1 ? total : mlen - 1;
+    memmove(buf.data(), buf.data() + total - carry, carry);
+  }
+  tcp_close(fd);
+}
+
+static void event_clip(size_t arenaKB, uint16_t maxFrames, size_t size, double fps, uint32_t pre_ms, uint32_t post_ms,
+                       bool paced, int viewers)
+{
+  FrameRing ring;
+  if (!ring.begin(arenaKB * 1024, maxFrames))
+    return;
+  ring.configure(pre_ms, post_ms, RING_HOLD_MS);
+  g_ring = &ring;
+  SyntheticSource source(size, fps);
+  MJPEGBroadcaster b(source);
+  g_broadcaster = &b;
+  HttpServer server;
+  server.on("/mjpeg", METHOD_GET, handle_stream);
+  server.on("/clip", METHOD_GET, handle_clip);
+  server.begin(0);
+  b.onPublish(wake, &server);
+  ring.onClipFrame(wake, &server);
+  ClipRecorder recorder(b, ring);
+
+  std::atomic<bool> stop(false);
+  std::thread loop([&] { while (!stop) server.poll(50); });
+  std::thread producer([&] { while (!stop) b.captureOnce(); });
+  std::thread record([&] { recorder.run(); });
+  std::vector<std::atomic<uint64_t> > frames(viewers);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < viewers; i++)
+  {
+    frames[i] = 0;
+    threads.push_back(std::thread(mjpeg_viewer, server.port(), &stop, &frames[i]));
+  }
+
+  // Fill the pre window, trigger, and start the download right away
+  sleep_us((uint64_t)(pre_ms + 500) * 1000);
+  uint64_t triggered = now_us();
+  ring.trigger();
+  uint32_t pre = 0;
+  RingFrame f;
+  ring.openClip();
+  while (ring.clipFrame(pre, f) == CLIP_FRAME)
+    pre++;
+  ring.closeClip();
+  std::vector<uint64_t> arrivals;
+  uint64_t bytes;
+  fetch_clip(server.port(), paced, &arrivals, &bytes);
+  uint64_t done = now_us();
+
+  stop = true;
+  b.shutdown();
+  server.wake();
+  loop.join();
+  producer.join();
+  record.join();
+  server.stop();
+  for (size_t i = 0; i < threads.size(); i++)
+    threads[i].join();
+
+  printf("%s export: %zu frames (%u from before the trigger), %.1f KB in %.2f s, first frame after %.1f ms\n",
+         paced ? "paced" : "unpaced", arrivals.size(), pre, bytes / 1024.0,
+         (done - triggered) / 1e6, arrivals.empty() ? 0 : (arrivals[0] - triggered) / 1000.0);
+  printf("ring totals: %llu stored, %llu evicted, %llu dropped, %llu clips truncated, recorder skipped %u\n",
+         (unsigned long long)ringMetrics.frames.value(), (unsigned long long)ringMetrics.evicted.value(),
+         (unsigned long long)ringMetrics.dropped.value(), (unsigned long long)ringMetrics.truncated.value(),
+         recorder.skipped());
+}
+
+int bench_ring(int argc, char **argv)
+{
+  size_t arenaKB = opt_int(argc, argv, "arena-kb", RING_ARENA_BYTES / 1024);
+  uint16_t maxFrames = opt_int(argc, argv, "max-frames", RING_MAX_FRAMES);
+  size_t size = opt_int(argc, argv, "size", 25000);
+  double fps = opt_double(argc, argv, "fps", 15);
+  uint32_t pre = opt_int(argc, argv, "pre-ms", 2000);
+  uint32_t post = opt_int(argc, argv, "post-ms", 2000);
+  uint32_t frames = opt_int(argc, argv, "frames", 20000);
+  int viewers = opt_int(argc, argv, "viewers", 1);
+
+  store_rate(arenaKB, maxFrames, size, fps, frames, pre);
+  store_rate(arenaKB, maxFrames, size, fps, frames, 3600000); // no age limit: the arena alone bounds history
+  bool ok = second_trigger(1024, maxFrames, 20000, 25, 1000, 1000);
+  event_clip(arenaKB, maxFrames, size, fps, pre, post, false, viewers);
+  event_clip(arenaKB, maxFrames, size, fps, pre, post, true, viewers);
+  return ok ? 0 : 1;
+}
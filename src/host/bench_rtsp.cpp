@@ -0,0 +1,531 @@
+// RTSP next to /mjpeg over a recorded clip: a multipart viewer, then RTP/JPEG over UDP and
+// interleaved in the RTSP connection, each for a while on its own. The RTSP clients below
+// rebuild every frame from its packets the way RFC 2435 receivers do; the rebuilt JPEG has to
+// carry the original's scan byte for byte and decode to the same block means. Per transport:
+// frame rate, bytes handed to the socket per frame, and the server's busy time per frame.
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <map>
+#include <thread>
+#include <vector>
+#include <OV2640.h>
+#include <EventServer.h>
+#include <MJPEGStreamer.h>
+#include <PipelineMetrics.h>
+#include <RtspServer.h>
+#include <LumaGrid.h>
+#include <SocketCompat.h>
+#include "bench.h"
+#include "host_net.h"
+
+static MJPEGBroadcaster *g_broadcaster;
+
+static void handle_stream(HttpConnection &conn) { conn.stream(new MJPEGStreamer(*g_broadcaster)); }
+
+static void wake_both(void *ctx)
+{
+  void **servers = (void **)ctx;
+  ((HttpServer *)servers[0])->wake();
+  ((RtspServer *)servers[1])->wake();
+}
+
+static uint64_t fnv1a(const uint8_t *p, size_t len)
+{
+  uint64_t h = 1469598103934665603ull;
+  for (size_t i = 0; i < len; i++)
+    h = (h ^ p[i]) * 1099511628211ull;
+  return h;
+}
+
+// The clip's frames by scan hash, with their sizes and the block means they decode to
+struct Reference
+{
+  std::map<uint64_t, size_t> byScan;
+  std::vector<LumaGrid> grids;
+  std::vector<size_t> sizes;
+  uint64_t jpegBytes;
+  uint64_t scanBytes;
+};
+
+static bool load_reference(const char *dir, Reference &ref)
+{
+  if (!replay_camera_open(dir, 0, false))
+    return false;
+  OV2640 cam;
+  camera_config_t config = esp32cam_aithinker_config;
+  config.fb_count = 1;
+  if (cam.init(config) != ESP_OK)
+    return false;
+  LumaExtractor extractor;
+  ref.jpegBytes = ref.scanBytes = 0;
+  for (;;)
+  {
+    FrameRef f = cam.capture();
+    if (!f)
+      break;
+    RtpJpegFrame rf;
+    if (!rtpJpegParse(f.getBuf(), f.getSize(), rf))
+    {
+      fprintf(stderr, "frame %u: not something RTP/JPEG can carry\n", (unsigned)ref.grids.size());
+      esp_camera_deinit();
+      return false;
+    }
+    ref.grids.push_back(LumaGrid());
+    extractor.extract(f.getBuf(), f.getSize(), ref.grids.back());
+    ref.byScan[fnv1a(rf.scan, rf.scanLen)] = ref.grids.size() - 1;
+    ref.sizes.push_back(f.getSize());
+    ref.jpegBytes += f.getSize();
+    ref.scanBytes += rf.scanLen;
+  }
+  esp_camera_deinit();
+  return !ref.grids.empty();
+}
+
+// What a client got; wire and jpeg only count whole frames, so their difference is the
+// transport's own cost
+struct ClientStats
+{
+  uint64_t frames;
+  uint64_t wire;  // bytes received for those frames
+  uint64_t jpeg;  // the JPEGs they carried
+  uint64_t framesOk;
+  uint64_t framesBad; // scan or block means differ from the clip's
+  uint64_t framesLost; // a packet missing, the frame could not be rebuilt
+  uint64_t missingTables;
+  uint64_t tableUpdates;
+  uint64_t packets;
+  bool torndown;
+};
+
+// /mjpeg client that follows the parts' Content-Length
+static void multipart_client(uint16_t port, std::atomic<bool> *stop, ClientStats *stats)
+{
+  memset(stats, 0, sizeof(*stats));
+  int fd = tcp_connect(port);
+  const char req[] = "GET /mjpeg HTTP/1.1\r\nHost: bench\r\n\r\n";
+  send_all(fd, req, sizeof(req) - 1);
+  struct timeval tv = {0, 100000};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  std::string buf;
+  uint64_t consumed = 0, lastFrameEnd = 0;
+  size_t want = 0; // body bytes of the current part, 0 while reading its header
+  bool first = true;
+  char chunk[16384];
+  while (!*stop)
+  {
+    ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+    if (n < 0 && sock_would_block())
+      continue;
+    if (n <= 0)
+      break;
+    buf.append(chunk, n);
+    for (;;)
+    {
+      if (!want)
+      {
+        size_t end = buf.find("\r\n\r\n");
+        if (end == std::string::npos)
+          break;
+        const char *cl = strcasestr(buf.c_str(), "Content-Length:");
+        size_t len = cl && (size_t)(cl - buf.c_str()) < end ? strtoul(cl + 15, NULL, 10) : 0;
+        consumed += end + 4;
+        buf.erase(0, end + 4);
+        if (first)
+        {
+          first = false; // the response head, before any part
+          lastFrameEnd = consumed;
+          continue;
+        }
+        want = len;
+        if (!want)
+          continue;
+      }
+      if (buf.size() < want)
+        break;
+      consumed += want;
+      buf.erase(0, want);
+      stats->frames++;
+      stats->jpeg += want;
+      stats->wire += consumed - lastFrameEnd;
+      lastFrameEnd = consumed;
+      want = 0;
+    }
+  }
+  tcp_close(fd);
+  stats->framesOk = stats->frames;
+  stats->torndown = true;
+}
+
+// Reads one RTSP reply, skipping interleaved packets in front of it; the status code or -1
+static int read_reply(int fd, char *body, size_t bodyLen)
+{
+  std::string in;
+  char c;
+  for (;;)
+  {
+    if (in.empty())
+    {
+      if (recv(fd, &c, 1, 0) != 1)
+        return -1;
+      if (c == '$')
+      {
+        uint8_t h[3];
+        if (recv(fd, h, 3, MSG_WAITALL) != 3)
+          return -1;
+        std::vector<uint8_t> skip((h[1] << 8) | h[2]);
+        if (!skip.empty() && recv(fd, skip.data(), skip.size(), MSG_WAITALL) != (ssize_t)skip.size())
+          return -1;
+        continue;
+      }
+      in += c;
+      continue;
+    }
+    if (recv(fd, &c, 1, 0) != 1)
+      return -1;
+    in += c;
+    if (in.size() >= 4 && !in.compare(in.size() - 4, 4, "\r\n\r\n"))
+      break;
+  }
+  size_t length = 0;
+  const char *cl = strcasestr(in.c_str(), "Content-Length:");
+  if (cl)
+    length = strtoul(cl + 15, NULL, 10);
+  std::vector<char> content(length + 1);
+  if (length && recv(fd, content.data(), length, MSG_WAITALL) != (ssize_t)length)
+    return -1;
+  if (body)
+    snprintf(body, bodyLen, "%s%s", in.c_str(), content.data());
+  int code = 0;
+  sscanf(in.c_str(), "RTSP/1.0 %d", &code);
+  return code;
+}
+
+static int request(int fd, int cseq, const char *method, const char *url, const char *extra, char *reply, size_t len)
+{
+  char req[512];
+  int n = snprintf(req, sizeof(req), "%s %s RTSP/1.0\r\nCSeq: %d\r\nUser-Agent: bench\r\n%s\r\n", method, url, cseq,
+                   extra ? extra : "");
+  send_all(fd, req, n);
+  return read_reply(fd, reply, len);
+}
+
+// RFC 2435 receiver: collects a frame's packets and rebuilds the JPEG at the marker
+class Depacketizer
+{
+public:
+  Depacketizer(const Reference &ref, ClientStats &stats)
+      : _ref(ref), _stats(stats), _wire(0), _haveSeq(false), _broken(false)
+  {
+    memset(_known, 0, sizeof(_known));
+  }
+
+  // len is the RTP packet, wire what it took to receive it
+  void packet(const uint8_t *p, size_t len, size_t wire)
+  {
+    _stats.packets++;
+    _wire += wire;
+    if (len < 20 || (p[0] >> 6) != 2 || (p[1] & 0x7F) != RTP_JPEG_PAYLOAD_TYPE)
+    {
+      _broken = true;
+      return;
+    }
+    uint16_t seq = (p[2] << 8) | p[3];
+    if (_haveSeq && seq != (uint16_t)(_seq + 1))
+      _broken = true;
+    _seq = seq;
+    _haveSeq = true;
+    bool marker = p[1] & 0x80;
+    const uint8_t *j = p + 12, *end = p + len;
+    uint32_t offset = (j[1] << 16) | (j[2] << 8) | j[3];
+    uint8_t type = j[4], q = j[5];
+    uint16_t width = j[6] * 8, height = j[7] * 8;
+    j += 8;
+    uint16_t restart = 0;
+    if (type >= 64)
+    {
+      restart = (j[0] << 8) | j[1];
+      j += 4;
+    }
+    if (!offset)
+    {
+      _scan.clear();
+      if (q >= 128)
+      {
+        uint16_t tlen = (j[2] << 8) | j[3];
+        j += 4;
+        if (tlen == RTP_JPEG_TABLES_SIZE)
+        {
+          memcpy(_tables[q - 128], j, tlen);
+          _known[q - 128] = true;
+          _stats.tableUpdates++;
+          j += tlen;
+        }
+        else if (!_known[q - 128])
+        {
+          _stats.missingTables++;
+          _broken = true;
+        }
+      }
+      else
+        _broken = true; // the server never uses the scaled standard tables
+    }
+    if (offset != _scan.size())
+      _broken = true;
+    if (!_broken)
+      _scan.insert(_scan.end(), j, end);
+    if (!marker)
+      return;
+    if (_broken || q < 128)
+      _stats.framesLost++;
+    else
+      finish(type, width, height, _tables[q - 128], restart);
+    _scan.clear();
+    _wire = 0;
+    _broken = false;
+  }
+
+private:
+  void finish(uint8_t type, uint16_t width, uint16_t height, const uint8_t *tables, uint16_t restart)
+  {
+    std::map<uint64_t, size_t>::const_iterator it = _ref.byScan.find(fnv1a(_scan.data(), _scan.size()));
+    std::vector<uint8_t> jpg(RTP_JPEG_HEADERS_SIZE + _scan.size() + 2);
+    size_t n = rtpJpegHeaders(jpg.data(), type, width, height, tables, restart);
+    memcpy(jpg.data() + n, _scan.data(), _scan.size());
+    n += _scan.size();
+    jpg[n++] = 0xFF;
+    jpg[n++] = 0xD9;
+    if (it == _ref.byScan.end() || !_extractor.extract(jpg.data(), n, _grid))
+    {
+      _stats.framesBad++;
+      return;
+    }
+    const LumaGrid &want = _ref.grids[it->second];
+    bool same = _grid.width == want.width && _grid.height == want.height &&
+                !memcmp(_grid.cells, want.cells, (size_t)want.width * want.height);
+    if (!same)
+    {
+      _stats.framesBad++;
+      return;
+    }
+    _stats.framesOk++;
+    _stats.frames++;
+    _stats.wire += _wire;
+    _stats.jpeg += _ref.sizes[it->second];
+  }
+
+  const Reference &_ref;
+  ClientStats &_stats;
+  LumaExtractor _extractor;
+  LumaGrid _grid;
+  std::vector<uint8_t> _scan;
+  size_t _wire;
+  uint8_t _tables[128][RTP_JPEG_TABLES_SIZE];
+  bool _known[128];
+  uint16_t _seq;
+  bool _haveSeq;
+  bool _broken;
+};
+
+static void rtsp_client(uint16_t port, bool tcp, const Reference *ref, std::atomic<bool> *stop, ClientStats *stats)
+{
+  memset(stats, 0, sizeof(*stats));
+  Depacketizer depack(*ref, *stats);
+  int fd = tcp_connect(port);
+  char url[64], reply[2048], transport[128], session[32] = "";
+  snprintf(url, sizeof(url), "rtsp://127.0.0.1:%u/stream", port);
+  int cseq = 1;
+  int rtp = -1, rtcp = -1;
+  if (request(fd, cseq++, "OPTIONS", url, NULL, reply, sizeof(reply)) != 200 ||
+      request(fd, cseq++, "DESCRIBE", url, "Accept: application/sdp\r\n", reply, sizeof(reply)) != 200 ||
+      !strstr(reply, "m=video 0 RTP/AVP 26"))
+  {
+    fprintf(stderr, "rtsp: DESCRIBE failed\n");
+    tcp_close(fd);
+    return;
+  }
+  if (tcp)
+    snprintf(transport, sizeof(transport), "Transport: RTP/AVP/TCP;unicast;interleaved=0-1\r\n");
+  else
+  {
+    uint16_t ports[2];
+    int *fds[2] = {&rtp, &rtcp};
+    for (int i = 0; i < 2; i++)
+    {
+      *fds[i] = socket(AF_INET, SOCK_DGRAM, 0);
+      struct sockaddr_in addr;
+      memset(&addr, 0, sizeof(addr));
+      addr.sin_family = AF_INET;
+      addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+      socklen_t len = sizeof(addr);
+      bind(*fds[i], (struct sockaddr *)&addr, sizeof(addr));
+      getsockname(*fds[i], (struct sockaddr *)&addr, &len);
+      ports[i] = ntohs(addr.sin_port);
+    }
+    int big = 1 << 20;
+    setsockopt(rtp, SOL_SOCKET, SO_RCVBUF, &big, sizeof(big));
+    struct timeval tv = {0, 100000};
+    setsockopt(rtp, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    snprintf(transport, sizeof(transport), "Transport: RTP/AVP;unicast;client_port=%u-%u\r\n", ports[0], ports[1]);
+  }
+  char track[80], extra[160];
+  snprintf(track, sizeof(track), "%s/track1", url);
+  if (request(fd, cseq++, "SETUP", track, transport, reply, sizeof(reply)) != 200)
+  {
+    fprintf(stderr, "rtsp: SETUP refused\n");
+    tcp_close(fd);
+    return;
+  }
+  const char *s = strstr(reply, "Session: ");
+  if (s)
+    sscanf(s + 9, "%31[^;\r]", session);
+  snprintf(extra, sizeof(extra), "Session: %s\r\nRange: npt=0.000-\r\n", session);
+  if (request(fd, cseq++, "PLAY", url, extra, reply, sizeof(reply)) != 200)
+  {
+    fprintf(stderr, "rtsp: PLAY refused\n");
+    tcp_close(fd);
+    return;
+  }
+
+  std::vector<uint8_t> buf(65536);
+  if (tcp)
+  {
+    struct timeval tv = {0, 100000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    while (!*stop)
+    {
+      uint8_t h[4];
+      ssize_t n = recv(fd, h, 4, MSG_WAITALL);
+      if (n < 0 && sock_would_block())
+        continue;
+      if (n != 4 || h[0] != '$')
+        break;
+      size_t len = (h[2] << 8) | h[3];
+      if (recv(fd, buf.data(), len, MSG_WAITALL) != (ssize_t)len)
+        break;
+      if (h[1] == 0)
+        depack.packet(buf.data(), len, 4 + len);
+    }
+    struct timeval none = {0, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &none, sizeof(none));
+  }
+  else
+  {
+    while (!*stop)
+    {
+      ssize_t n = recv(rtp, buf.data(), buf.size(), 0);
+      if (n <= 0)
+        continue;
+      depack.packet(buf.data(), n, n);
+    }
+  }
+  // Interleaved packets still in flight come before the reply
+  snprintf(extra, sizeof(extra), "Session: %s\r\n", session);
+  stats->torndown = request(fd, cseq++, "TEARDOWN", url, extra, reply, sizeof(reply)) == 200;
+  tcp_close(fd);
+  sock_close(rtp);
+  sock_close(rtcp);
+}
+
+enum Transport
+{
+  MULTIPART,
+  RTP_UDP,
+  RTP_TCP
+};
+
+static bool run_phase(const char *dir, const Reference &ref, Transport transport, double fps, double seconds)
+{
+  static const char *names[] = {"mjpeg/http", "rtp/udp", "rtp/tcp"};
+  replay_camera_open(dir, fps, true);
+  OV2640 cam;
+  if (cam.init(esp32cam_aithinker_config) != ESP_OK)
+    return false;
+  MJPEGBroadcaster broadcaster(cam);
+  g_broadcaster = &broadcaster;
+  HttpServer http;
+  http.on("/mjpeg", METHOD_GET, handle_stream);
+  RtspServer rtsp(broadcaster);
+  if (!http.begin(0) || !rtsp.begin(0))
+    return false;
+  void *servers[2] = {&http, &rtsp};
+  broadcaster.onPublish(wake_both, servers);
+
+  PipelineMetrics &pm = pipelineMetrics;
+  uint64_t sent0 = transport == MULTIPART ? pm.framesSent.value() : rtspMetrics.framesSent.value();
+  uint64_t packets0 = rtspMetrics.packetsSent.value();
+  std::atomic<bool> stop(false), clientStop(false);
+  ClientStats stats;
+  memset(&stats, 0, sizeof(stats));
+  std::thread httpLoop([&] { while (!stop) http.poll(50); });
+  std::thread rtspLoop([&] { while (!stop) rtsp.poll(50); });
+  std::thread producer([&] { while (!stop) broadcaster.captureOnce(); });
+  std::thread client;
+  if (transport == MULTIPART)
+    client = std::thread(multipart_client, http.port(), &clientStop, &stats);
+  else
+    client = std::thread(rtsp_client, rtsp.port(), transport == RTP_TCP, &ref, &clientStop, &stats);
+  uint64_t busy0 = http.busyMicros() + rtsp.busyMicros();
+  uint64_t start = now_us();
+  sleep_us((uint64_t)(seconds * 1e6));
+  double elapsed = (now_us() - start) / 1e6;
+  uint64_t busy = http.busyMicros() + rtsp.busyMicros() - busy0;
+  uint64_t sent = (transport == MULTIPART ? pm.framesSent.value() : rtspMetrics.framesSent.value()) - sent0;
+  uint64_t packets = rtspMetrics.packetsSent.value() - packets0;
+  // The client's TEARDOWN still needs the loops
+  clientStop = true;
+  client.join();
+  stop = true;
+  broadcaster.shutdown();
+  http.wake();
+  rtsp.wake();
+  httpLoop.join();
+  rtspLoop.join();
+  producer.join();
+  http.stop();
+  rtsp.stop();
+  esp_camera_deinit();
+
+  uint64_t frames = stats.frames ? stats.frames : 1;
+  double perFrame = (double)stats.wire / frames;
+  double framing = (double)((int64_t)stats.wire - (int64_t)stats.jpeg) / frames;
+  double jpeg = (double)stats.jpeg / frames;
+  double perPacket = transport == MULTIPART ? 0 : (double)packets / (sent ? sent : 1);
+  // Rough IP cost on top: 28 bytes per datagram, 40 per full-sized TCP segment
+  double ip = transport == RTP_UDP ? 28 * perPacket : 40 * ((perFrame + 1459) / 1460);
+  printf("%-11s %6.1f %11.0f %+9.0f %+7.1f%% %+9.0f %+7.1f%% %8.1f %9.0f", names[transport], sent / elapsed, perFrame,
+         framing, 100 * framing / jpeg, framing + ip, 100 * (framing + ip) / jpeg, perPacket,
+         sent ? (double)busy / sent : 0);
+  bool ok = sent >= 0.9 * fps * elapsed && stats.frames;
+  if (transport != MULTIPART)
+  {
+    printf("   %llu ok, %llu bad, %llu lost, %llu table sends%s", (unsigned long long)stats.framesOk,
+           (unsigned long long)stats.framesBad, (unsigned long long)stats.framesLost,
+           (unsigned long long)stats.tableUpdates, stats.torndown ? "" : ", TEARDOWN failed");
+    // Loopback loses nothing; a frame cut off by the end of the run is all we allow
+    ok &= !stats.framesBad && !stats.missingTables && stats.framesLost <= 1 && stats.torndown;
+  }
+  printf("  %s\n", ok ? "ok" : "FAILED");
+  return ok;
+}
+
+int bench_rtsp(int argc, char **argv)
+{
+  const char *dir = opt_str(argc, argv, "dir", NULL);
+  double fps = opt_double(argc, argv, "fps", 25);
+  double seconds = opt_double(argc, argv, "seconds", 5);
+  Reference ref;
+  if (!dir || !load_reference(dir, ref))
+  {
+    fprintf(stderr, "rtsp needs --dir=<directory with .jpg files RTP/JPEG can carry>\n");
+    return 1;
+  }
+  printf("clip: %u frames, %.0f bytes of JPEG each, %.0f of them entropy-coded scan\n", (unsigned)ref.grids.size(),
+         (double)ref.jpegBytes / ref.grids.size(), (double)ref.scanBytes / ref.grids.size());
+  printf("%-11s %6s %11s %18s %18s %8s %9s\n", "transport", "fps", "bytes/frame", "framing vs JPEG", "+ est. IP",
+         "packets", "busy us");
+  bool ok = run_phase(dir, ref, MULTIPART, fps, seconds);
+  ok &= run_phase(dir, ref, RTP_UDP, fps, seconds);
+  ok &= run_phase(dir, ref, RTP_TCP, fps, seconds);
+  return ok ? 0 : 1;
+}
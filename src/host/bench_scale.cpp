@@ -0,0 +1,240 @@
+// Compressed-domain downscaling over a recorded clip: per-frame cost at 1/2, 1/4 and 1/8
+// against the bare entropy walk the motion detector already pays, output sizes, and the
+// result's block means against the original's; then a scaled tier streaming next to the
+// full-size stream, to see whether it keeps pace
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <OV2640.h>
+#include <EventServer.h>
+#include <MJPEGStreamer.h>
+#include <JpegScaler.h>
+#include <ScaledSource.h>
+#include <LumaGrid.h>
+#include "bench.h"
+#include "host_net.h"
+#include "host_stats.h"
+
+static MJPEGBroadcaster *g_full;
+static MJPEGBroadcaster *g_tier;
+
+static void handle_full(HttpConnection &conn) { conn.stream(new MJPEGStreamer(*g_full)); }
+static void handle_tier(HttpConnection &conn) { conn.stream(new MJPEGStreamer(*g_tier)); }
+static void wake(void *ctx) { ((HttpServer *)ctx)->wake(); }
+
+static bool load_clip(const char *dir, std::vector<std::vector<uint8_t> > &clip)
+{
+  if (!replay_camera_open(dir, 0, false))
+    return false;
+  OV2640 cam;
+  camera_config_t config = esp32cam_aithinker_config;
+  config.fb_count = 1;
+  if (cam.init(config) != ESP_OK)
+    return false;
+  for (;;)
+  {
+    FrameRef f = cam.capture(); // dropped before the next capture, there is only one buffer
+    if (!f)
+      break;
+    clip.push_back(std::vector<uint8_t>(f.getBuf(), f.getBuf() + f.getSize()));
+  }
+  esp_camera_deinit();
+  return !clip.empty();
+}
+
+// Mean absolute difference between the result's block means and the original's averaged over
+// the same area, in luma levels; -1 when the two grids do not line up on whole cells
+static double luma_error(const LumaGrid &orig, const LumaGrid &scaled, int shift)
+{
+  uint32_t span = (uint32_t)scaled.blocks << shift; // original blocks per scaled cell side
+  if (span % orig.blocks)
+    return -1;
+  uint32_t r = span / orig.blocks;
+  double sum = 0;
+  uint32_t cells = 0;
+  for (uint16_t y = 0; y < scaled.height; y++)
+  {
+    for (uint16_t x = 0; x < scaled.width; x++)
+    {
+      uint32_t acc = 0, n = 0;
+      for (uint32_t j = 0; j < r && y * r + j < orig.height; j++)
+        for (uint32_t i = 0; i < r && x * r + i < orig.width; i++, n++)
+          acc += orig.cells[(y * r + j) * orig.width + x * r + i];
+      if (!n)
+        continue;
+      double d = (double)acc / n - scaled.cells[y * scaled.width + x];
+      sum += d < 0 ? -d : d;
+      cells++;
+    }
+  }
+  return cells ? sum / cells : -1;
+}
+
+static bool kernels(const std::vector<std::vector<uint8_t> > &clip, int rounds, int quality)
+{
+  static LumaGrid orig, scaled;
+  LumaExtractor extractor;
+  JpegScaler scaler;
+  scaler.begin(JPEG_SCALE_MAX_WIDTH / 2);
+  scaler.setQuality(quality);
+  std::vector<uint8_t> out(256 * 1024);
+
+  std::vector<double> walkUs;
+  uint64_t inBytes = 0;
+  for (int r = 0; r < rounds; r++)
+  {
+    for (size_t i = 0; i < clip.size(); i++)
+    {
+      uint64_t t0 = now_us();
+      extractor.extract(clip[i].data(), clip[i].size(), orig);
+      walkUs.push_back(now_us() - t0);
+      if (!r)
+        inBytes += clip[i].size();
+    }
+  }
+  double walk50 = percentile(walkUs, 50);
+  extractor.extract(clip[0].data(), clip[0].size(), orig);
+  printf("clip: %u frames %ux%u blocks, %.0f bytes each; entropy walk alone (motion's luma extract) p50 %.0f us\n",
+         (unsigned)clip.size(), orig.width * orig.blocks, orig.height * orig.blocks, (double)inBytes / clip.size(),
+         walk50);
+  printf("%-6s %9s %9s %9s %8s %10s %7s %12s\n", "scale", "size", "p50 us", "p99 us", "x walk", "bytes", "ratio",
+         "luma err");
+
+  bool ok = true;
+  for (int shift = 1; shift <= 3; shift++)
+  {
+    std::vector<double> us;
+    uint64_t outBytes = 0;
+    uint32_t failures = 0;
+    double err = 0;
+    int errFrames = 0;
+    for (int r = 0; r < rounds; r++)
+    {
+      for (size_t i = 0; i < clip.size(); i++)
+      {
+        uint64_t t0 = now_us();
+        size_t n = scaler.scale(clip[i].data(), clip[i].size(), shift, out.data(), out.size());
+        us.push_back(now_us() - t0);
+        if (r)
+          continue;
+        if (!n)
+        {
+          failures++;
+          continue;
+        }
+        outBytes += n;
+        // The result has to be a JPEG the motion detector's parser takes, of the right size
+        if (!extractor.extract(clip[i].data(), clip[i].size(), orig) || !extractor.extract(out.data(), n, scaled))
+        {
+          failures++;
+          continue;
+        }
+        double e = luma_error(orig, scaled, shift);
+        if (e >= 0)
+        {
+          err += e;
+          errFrames++;
+        }
+      }
+    }
+    double p50 = percentile(us, 50), p99 = percentile(us, 99);
+    char size[16], errText[16];
+    snprintf(size, sizeof(size), "%ux%u", scaler.width(), scaler.height());
+    if (errFrames)
+      snprintf(errText, sizeof(errText), "%.2f", err / errFrames);
+    else
+      snprintf(errText, sizeof(errText), "-");
+    printf("1/%-4d %9s %9.0f %9.0f %8.2f %10.0f %6.1f%% %12s\n", 1 << shift, size, p50, p99, p50 / walk50,
+           (double)outBytes / clip.size(), 100.0 * outBytes / inBytes, errText);
+    bool good = !failures && (!errFrames || err / errFrames < 4);
+    if (!good)
+      printf("  FAILED: %u frames not scaled or unreadable, luma error %s\n", failures, errText);
+    ok &= good;
+  }
+  return ok;
+}
+
+// Full-size stream and a scaled tier cut from it, a viewer on each, the clip replayed at fps
+static bool keep_pace(const char *dir, double fps, double seconds, int shift, size_t capacity)
+{
+  replay_camera_open(dir, fps, true);
+  OV2640 cam;
+  if (cam.init(esp32cam_aithinker_config) != ESP_OK)
+    return false;
+  MJPEGBroadcaster full(cam);
+  ScaledSource source(full, shift);
+  if (!source.begin(capacity))
+    return false;
+  MJPEGBroadcaster tier(source);
+  tier.countCaptures(false);
+  g_full = &full;
+  g_tier = &tier;
+  HttpServer fullServer, tierServer;
+  fullServer.on("/mjpeg", METHOD_GET, handle_full);
+  tierServer.on("/mjpeg", METHOD_GET, handle_tier);
+  fullServer.begin(0);
+  tierServer.begin(0);
+  full.onPublish(wake, &fullServer);
+  tier.onPublish(wake, &tierServer);
+
+  uint64_t scaled0 = scaleMetrics.framesScaled.value();
+  uint64_t skipped0 = scaleMetrics.framesSkipped.value();
+  uint64_t failed0 = scaleMetrics.failures.value();
+  std::atomic<bool> stop(false);
+  std::atomic<uint64_t> fullFrames(0), tierFrames(0);
+  std::thread fullLoop([&] { while (!stop) fullServer.poll(50); });
+  std::thread tierLoop([&] { while (!stop) tierServer.poll(50); });
+  std::vector<std::thread> threads;
+  threads.push_back(std::thread([&] { while (!stop) full.captureOnce(); }));
+  threads.push_back(std::thread([&] { while (!stop) tier.captureOnce(); }));
+  threads.push_back(std::thread(mjpeg_viewer, fullServer.port(), &stop, &fullFrames));
+  threads.push_back(std::thread(mjpeg_viewer, tierServer.port(), &stop, &tierFrames));
+  uint64_t start = now_us();
+  sleep_us((uint64_t)(seconds * 1e6));
+  stop = true;
+  double elapsed = (now_us() - start) / 1e6;
+  fullServer.wake();
+  tierServer.wake();
+  fullLoop.join();
+  tierLoop.join();
+  // Closing the streams hands the tier's buffers back, a producer waiting for one can finish
+  fullServer.stop();
+  tierServer.stop();
+  tier.shutdown();
+  full.shutdown();
+  for (size_t i = 0; i < threads.size(); i++)
+    threads[i].join();
+  bool drained = source.drain(1000);
+  esp_camera_deinit();
+
+  double fullFps = fullFrames / elapsed, tierFps = tierFrames / elapsed;
+  uint64_t failed = scaleMetrics.failures.value() - failed0;
+  bool ok = tierFps >= 0.9 * fullFps && !failed && drained;
+  printf("1/%d tier at %.0f fps: full stream %.1f fps, tier %.1f fps, %llu scaled, %llu skipped, %llu failed  %s\n",
+         1 << shift, fps, fullFps, tierFps, (unsigned long long)(scaleMetrics.framesScaled.value() - scaled0),
+         (unsigned long long)(scaleMetrics.framesSkipped.value() - skipped0), (unsigned long long)failed,
+         ok ? "ok" : !drained ? "BUFFERS LEAKED" : "FALLING BEHIND");
+  return ok;
+}
+
+int bench_scale(int argc, char **argv)
+{
+  const char *dir = opt_str(argc, argv, "dir", NULL);
+  double fps = opt_double(argc, argv, "fps", 25);
+  double seconds = opt_double(argc, argv, "seconds", 5);
+  int rounds = opt_int(argc, argv, "rounds", 20);
+  int quality = opt_int(argc, argv, "quality", JPEG_SCALE_QUALITY);
+  std::vector<std::vector<uint8_t> > clip;
+  if (!dir || !load_clip(dir, clip))
+  {
+    fprintf(stderr, "scale needs --dir=<directory with .jpg files>\n");
+    return 1;
+  }
+  bool ok = kernels(clip, rounds, quality);
+  printf("\n");
+  ok &= keep_pace(dir, fps, seconds, 1, 64 * 1024);
+  ok &= keep_pace(dir, fps, seconds, 2, 32 * 1024);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,265 @@
+// Housekeeping scheduler on a virtual clock: behaviour checks (deadlines, long delays, cancel,
+// overruns, stale ids), then a month of the device's housekeeping against Task0Code's
+// delay(29000) loop, then the cost of the wheel operations on the real clock
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <Scheduler.h>
+#include "bench.h"
+#include "host_net.h"
+
+static uint64_t g_now; // virtual microseconds
+
+static uint64_t virtual_clock(void)
+{
+  return g_now;
+}
+
+// Sleeps the way the housekeeping task does: rounded up to the 1 ms RTOS tick, plus whatever
+// the wake-up costs
+static void sleep_for(uint64_t wait_us, uint64_t wake_us)
+{
+  g_now += (wait_us + 999) / 1000 * 1000 + wake_us;
+}
+
+struct Probe
+{
+  std::vector<uint64_t> at; // virtual time of each run
+  uint64_t cost_us;         // how long a run takes
+  Scheduler *sched;
+  SchedId self;
+  int cancelAfter;          // cancels itself after this many runs, 0 never
+};
+
+static void probe(void *ctx)
+{
+  Probe *p = (Probe *)ctx;
+  p->at.push_back(g_now);
+  g_now += p->cost_us;
+  if (p->cancelAfter && (int)p->at.size() == p->cancelAfter)
+    p->sched->cancel(p->self);
+}
+
+static void drive(Scheduler &s, uint64_t until_us, uint64_t wake_us)
+{
+  while (g_now < until_us)
+  {
+    uint64_t wait = s.runDue();
+    if (g_now >= until_us)
+      break; // the jobs ran past the end
+    if (g_now + wait > until_us)
+      wait = until_us - g_now;
+    sleep_for(wait, wake_us);
+  }
+  s.runDue();
+}
+
+static bool check(const char *what, bool ok)
+{
+  printf("  %-58s %s\n", what, ok ? "ok" : "FAILED");
+  return ok;
+}
+
+static bool behaviour(void)
+{
+  bool ok = true;
+  printf("behaviour, virtual clock, exact wake-ups:\n");
+  {
+    g_now = 1000000;
+    Scheduler s(virtual_clock);
+    Probe once = {std::vector<uint64_t>(), 0, &s, 0, 0};
+    s.after("once", 1500, probe, &once);
+    drive(s, g_now + 10000000, 0);
+    ok &= check("one-shot at 1.5 s runs once, on its deadline", once.at.size() == 1 && once.at[0] == 2500000);
+  }
+  {
+    g_now = 0;
+    Scheduler s(virtual_clock);
+    Probe tick = {std::vector<uint64_t>(), 20000, &s, 0, 0};
+    Probe hour = {std::vector<uint64_t>(), 0, &s, 0, 0};
+    s.every("tick", 30000, probe, &tick, 30000);
+    s.every("hour", 3600000, probe, &hour, 3600000);
+    drive(s, 86400000000ULL, 0);
+    bool phase = true;
+    for (size_t i = 0; i < tick.at.size(); i++)
+      phase &= tick.at[i] == (i + 1) * 30000000ULL;
+    ok &= check("30 s job over a day: 2880 runs, each on the 30 s grid", tick.at.size() == 2880 && phase);
+    phase = true;
+    for (size_t i = 0; i < hour.at.size(); i++)
+    {
+      // Shares its deadline with the 30 s job, so it may start once that one is done
+      uint64_t due = (i + 1) * 3600000000ULL;
+      phase &= hour.at[i] >= due && hour.at[i] <= due + tick.cost_us;
+    }
+    ok &= check("hourly job (5625 wheel turns): 24 runs, on time", hour.at.size() == 24 && phase);
+  }
+  {
+    g_now = 0;
+    Scheduler s(virtual_clock);
+    Probe never = {std::vector<uint64_t>(), 0, &s, 0, 0};
+    Probe three = {std::vector<uint64_t>(), 0, &s, 0, 3};
+    SchedId id = s.after("never", 5000, probe, &never);
+    three.self = s.every("three", 1000, probe, &three, 1000);
+    drive(s, 2000000, 0);
+    bool cancelled = s.cancel(id);
+    drive(s, 20000000, 0);
+    ok &= check("cancelled before its deadline: never runs", cancelled && never.at.empty());
+    ok &= check("periodic job cancelling itself from its run: 3 runs", three.at.size() == 3);
+    ok &= check("a stale id cancels nothing", !s.cancel(id) && !s.cancel(three.self));
+  }
+  {
+    g_now = 0;
+    Scheduler s(virtual_clock);
+    Probe slow = {std::vector<uint64_t>(), 0, &s, 0, 0};
+    SchedId id = s.every("slow", 1000, probe, &slow, 1000);
+    drive(s, 1500000, 0);
+    slow.cost_us = 2500000; // the next run takes 2.5 periods
+    drive(s, 2100000, 0);
+    slow.cost_us = 0;
+    drive(s, 10000000, 0);
+    SchedStats st;
+    s.stats(id, &st);
+    // Runs at 1, 2 (2.5 s long), then the 3 and 4 s deadlines are gone and it resumes at 5
+    ok &= check("2.5 s run of a 1 s job: 2 periods skipped, phase kept",
+                st.overruns == 2 && slow.at.size() == 8 && slow.at[2] == 5000000);
+  }
+  {
+    g_now = 0;
+    Scheduler s(virtual_clock);
+    Probe p = {std::vector<uint64_t>(), 0, &s, 0, 0};
+    int added = 0;
+    while (s.after("fill", 1000, probe, &p))
+      added++;
+    ok &= check("table full: the next job is refused", added == SCHED_MAX_JOBS);
+    drive(s, 2000000, 0);
+    ok &= check("every queued one-shot ran", (int)p.at.size() == SCHED_MAX_JOBS);
+  }
+  {
+    g_now = 0;
+    Scheduler s(virtual_clock);
+    Probe p = {std::vector<uint64_t>(), 0, &s, 0, 0};
+    s.every("p", 250, probe, &p, 250);
+    bool early = false;
+    // Wake-ups at odd times: never before a deadline, never more than one run per deadline
+    uint32_t seed = 7;
+    while (g_now < 60000000)
+    {
+      s.runDue();
+      seed = seed * 1103515245 + 12345;
+      g_now += (seed >> 16) % 37000;
+    }
+    for (size_t i = 0; i < p.at.size(); i++)
+      early |= p.at[i] < (i + 1) * 250000ULL;
+    ok &= check("random wake-ups: never early, never twice per deadline", !early && p.at.size() <= 240);
+  }
+  return ok;
+}
+
+// The housekeeping jobs as they run on the device, with their costs on the virtual clock
+struct Housekeeping
+{
+  uint64_t refreshes;
+  uint64_t lastRefresh;
+  uint64_t worstGap_us;  // between two screen refreshes
+};
+
+static Housekeeping g_hk;
+
+static void refresh_screen(void *ctx)
+{
+  // Hours and days are derived from the clock, there is no counter to drift
+  if (g_hk.refreshes && g_now - g_hk.lastRefresh > g_hk.worstGap_us)
+    g_hk.worstGap_us = g_now - g_hk.lastRefresh;
+  g_hk.lastRefresh = g_now;
+  g_hk.refreshes++;
+  g_now += 18000; // text layout and the I2C transfer of the changed pages
+}
+
+static void sample_utilisation(void *ctx)
+{
+  g_now += 300;
+}
+
+static void wifi_health(void *ctx)
+{
+  g_now += 800; // WiFi.status(), and WiFi.reconnect() returns before the association
+}
+
+static void month(int days)
+{
+  uint64_t end = (uint64_t)days * 86400000000ULL;
+
+  // Task0Code: body, then delay(29000); the hour counter only moves when a pass finds an hour
+  // since prevMillis, and restarts the hour from that pass
+  uint64_t now = 0, prev = 0, hours = 0, worstGap = 0, passes = 0, last = 0;
+  while (now < end)
+  {
+    if (now - prev >= 3600000000ULL)
+    {
+      prev = now;
+      hours++;
+    }
+    if (passes && now - last > worstGap)
+      worstGap = now - last;
+    last = now;
+    passes++;
+    now += 18000 + 29000000; // the refresh, then the delay
+  }
+  uint64_t behind = end / 3600000000ULL - hours;
+  printf("%-22s %9llu %11.1f %13llu h\n", "Task0Code delay loop", (unsigned long long)passes, worstGap / 1e6,
+         (unsigned long long)behind);
+
+  g_now = 0;
+  memset(&g_hk, 0, sizeof(g_hk));
+  Scheduler s(virtual_clock);
+  SchedId screen = s.every("oled", 30000, refresh_screen, NULL);
+  SchedId util = s.every("util", 5000, sample_utilisation, NULL);
+  SchedId wifi = s.every("wifi", 10000, wifi_health, NULL);
+  drive(s, end, 150); // 150 us to get back on a core after the wake-up
+  printf("%-22s %9llu %11.1f %13llu h\n", "scheduler", (unsigned long long)g_hk.refreshes, g_hk.worstGap_us / 1e6,
+         (unsigned long long)(end / 3600000000ULL - g_now / 3600000000ULL));
+
+  printf("\n%-9s %8s %9s %12s %12s\n", "job", "runs", "overruns", "max late ms", "max run ms");
+  SchedId ids[] = {screen, util, wifi};
+  const char *names[] = {"oled", "util", "wifi"};
+  for (int i = 0; i < 3; i++)
+  {
+    SchedStats st;
+    s.stats(ids[i], &st);
+    printf("%-9s %8u %9u %12.2f %12.2f\n", names[i], st.runs, st.overruns, st.maxLate_us / 1e3, st.maxRun_us / 1e3);
+  }
+  printf("lateness p50 <= %.2f ms, p99 <= %.2f ms over every run (histogram bucket bounds)\n",
+         s.lateness.percentile(50) / 1e3, s.lateness.percentile(99) / 1e3);
+}
+
+static void cost(int ops)
+{
+  Scheduler s;
+  Probe p = {std::vector<uint64_t>(), 0, &s, 0, 0};
+  for (int i = 0; i < SCHED_MAX_JOBS - 1; i++)
+    s.every("bg", 1000 + i * 997, probe, &p, 1000 + i * 997);
+  uint64_t t0 = now_us();
+  for (int i = 0; i < ops; i++)
+    s.cancel(s.after("op", (i * 7919) % 3600000, probe, &p));
+  double addCancel = (now_us() - t0) * 1e3 / ops;
+  t0 = now_us();
+  for (int i = 0; i < ops; i++)
+    s.runDue();
+  double idle = (now_us() - t0) * 1e3 / ops;
+  printf("add+cancel %.0f ns, runDue() with nothing due %.0f ns (%d jobs on the wheel, real clock)\n", addCancel, idle,
+         SCHED_MAX_JOBS - 1);
+}
+
+int bench_sched(int argc, char **argv)
+{
+  int days = opt_int(argc, argv, "days", 30);
+  int ops = opt_int(argc, argv, "ops", 1000000);
+
+  bool ok = behaviour();
+  printf("\n%d days of housekeeping: OLED every 30 s, utilisation every 5 s, WiFi check every 10 s\n", days);
+  printf("%-22s %9s %11s %15s\n", "", "refreshes", "worst gap s", "uptime behind");
+  month(days);
+  printf("\n");
+  cost(ops);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,147 @@
+// /jpg polling: latency, 200/304 split and sensor captures with and without the snapshot cache
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <EventServer.h>
+#include <MJPEGStreamer.h>
+#include "bench.h"
+#include "host_net.h"
+#include "host_stats.h"
+#include "synthetic_source.h"
+
+static MJPEGBroadcaster *g_broadcaster;
+static uint32_t g_maxAge;
+
+static void handle_stream(HttpConnection &conn) { conn.stream(new MJPEGStreamer(*g_broadcaster)); }
+static void handle_still(HttpConnection &conn) { conn.stream(new SnapshotStreamer(*g_broadcaster, g_maxAge)); }
+static void wake(void *ctx) { ((HttpServer *)ctx)->wake(); }
+
+// Reads one response off a keep-alive connection, returns the status code (0 on error)
+static int read_response(int fd, std::string &etag)
+{
+  std::string head;
+  char c;
+  while (head.size() < 4 || head.compare(head.size() - 4, 4, "\r\n\r\n"))
+  {
+    if (recv(fd, &c, 1, 0) != 1)
+      return 0;
+    head += c;
+  }
+  int code = atoi(head.c_str() + 9);
+  size_t length = 0;
+  const char *p = strcasestr(head.c_str(), "\r\nContent-Length:");
+  if (p)
+    length = strtoul(p + 17, NULL, 10);
+  p = strcasestr(head.c_str(), "\r\nETag:");
+  if (p)
+  {
+    p += 7;
+    while (*p == ' ')
+      p++;
+    etag.assign(p, strcspn(p, "\r"));
+  }
+  std::vector<char> body(65536);
+  while (length)
+  {
+    ssize_t n = recv(fd, body.data(), length < body.size() ? length : body.size(), 0);
+    if (n <= 0)
+      return 0;
+    length -= n;
+  }
+  return code;
+}
+
+static void run_case(int viewers, uint32_t maxAge, double pollHz, double seconds, double fps, size_t size)
+{
+  SyntheticSource source(size, fps);
+  MJPEGBroadcaster b(source);
+  g_broadcaster = &b;
+  g_maxAge = maxAge;
+  b.retain(maxAge);
+  HttpServer server;
+  server.on("/mjpeg", METHOD_GET, handle_stream);
+  server.on("/jpg", METHOD_GET, handle_still);
+  server.begin(0);
+  b.onPublish(wake, &server);
+
+  std::atomic<bool> stop(false);
+  std::thread loop([&] { while (!stop) server.poll(50); });
+  std::thread producer([&] { while (!stop) b.captureOnce(); });
+  std::vector<std::thread> threads;
+  std::vector<std::atomic<uint64_t> > frames(viewers);
+  for (int i = 0; i < viewers; i++)
+  {
+    frames[i] = 0;
+    threads.push_back(std::thread(mjpeg_viewer, server.port(), &stop, &frames[i]));
+  }
+  sleep_us(300000);
+
+  // One keep-alive poller revalidating with the last ETag, like an NVR
+  int fd = tcp_connect(server.port());
+  std::string etag;
+  std::vector<double> latency;
+  unsigned ok = 0, notModified = 0, errors = 0;
+  uint32_t captures = b.framesPublished();
+  uint64_t start = now_us(), period = (uint64_t)(1e6 / pollHz);
+  for (uint64_t due = start; now_us() - start < seconds * 1e6; due += period)
+  {
+    uint64_t now = now_us();
+    if (due > now)
+      sleep_us(due - now);
+    char req[160];
+    int n = etag.empty() ? snprintf(req, sizeof(req), "GET /jpg HTTP/1.1\r\nHost: bench\r\n\r\n")
+                         : snprintf(req, sizeof(req), "GET /jpg HTTP/1.1\r\nHost: bench\r\nIf-None-Match: %s\r\n\r\n", etag.c_str());
+    uint64_t t0 = now_us();
+    send_all(fd, req, n);
+    int code = read_response(fd, etag);
+    latency.push_back((now_us() - t0) / 1000.0);
+    if (code == 200)
+      ok++;
+    else if (code == 304)
+      notModified++;
+    else
+    {
+      errors++;
+      tcp_close(fd);
+      fd = tcp_connect(server.port());
+    }
+  }
+  captures = b.framesPublished() - captures;
+  tcp_close(fd);
+
+  printf("%7d %7u %10.2f %10.2f %6u %6u %6u %9u\n", viewers, maxAge, percentile(latency, 50), percentile(latency, 99),
+         ok, notModified, errors, captures);
+
+  stop = true;
+  b.shutdown();
+  server.wake();
+  loop.join();
+  producer.join();
+  server.stop();
+  for (size_t i = 0; i < threads.size(); i++)
+    threads[i].join();
+}
+
+int bench_snapshot(int argc, char **argv)
+{
+  double pollHz = opt_double(argc, argv, "poll-hz", 5);
+  double seconds = opt_double(argc, argv, "seconds", 4);
+  double fps = opt_double(argc, argv, "fps", 25);
+  size_t size = opt_int(argc, argv, "size", 40000);
+  uint32_t maxAge = opt_int(argc, argv, "max-age", 250);
+
+  printf("one keep-alive client polling /jpg at %.1f Hz with If-None-Match, sensor %.1f fps\n", pollHz, fps);
+  printf("viewers max_age    p50_ms     p99_ms    200    304 errors captures\n");
+  for (int viewers = 0; viewers <= 2; viewers += 2)
+  {
+    run_case(viewers, 0, pollHz, seconds, fps, size);
+    run_case(viewers, maxAge, pollHz, seconds, fps, size);
+  }
+  return 0;
+}
@@ -0,0 +1,229 @@
+// Status screen text: the String-based layout lib/OLED used (+= temporaries, the * padding
+// overload, a switch of String returns) against TextLine's fixed buffers. Counts heap
+// operations per refresh and compares the lines both produce.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <new>
+#include <string>
+#include <TextLayout.h>
+#include "bench.h"
+#include "host_net.h"
+
+#define COLUMNS 21 // MAX_CHARS of the 128x64 screen
+
+// Heap operations anywhere in the program; the benchmark looks at the difference around a loop
+static std::atomic<uint64_t> g_allocs(0);
+
+void *operator new(size_t size)
+{
+  g_allocs++;
+  void *p = malloc(size ? size : 1);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+// Arduino's String as far as the layout used it: a small inline buffer (11 characters on the
+// ESP32), otherwise a heap buffer grown by realloc to the exact length, copied on every copy
+class LegacyString
+{
+public:
+  LegacyString(const char *s = "") : _heap(NULL), _len(0), _cap(SSO) { _sso[0] = 0; concat(s, strlen(s)); }
+  LegacyString(unsigned v) : _heap(NULL), _len(0), _cap(SSO)
+  {
+    char b[12];
+    snprintf(b, sizeof(b), "%u", v);
+    _sso[0] = 0;
+    concat(b, strlen(b));
+  }
+  LegacyString(const LegacyString &o) : _heap(NULL), _len(0), _cap(SSO) { _sso[0] = 0; concat(o.c_str(), o._len); }
+  ~LegacyString() { free(_heap); }
+  LegacyString &operator=(const LegacyString &o)
+  {
+    if (this != &o)
+    {
+      _len = 0;
+      buf()[0] = 0;
+      concat(o.c_str(), o._len);
+    }
+    return *this;
+  }
+  LegacyString &operator+=(const LegacyString &o) { return concat(o.c_str(), o._len); }
+  LegacyString &operator+=(const char *s) { return concat(s, strlen(s)); }
+  const char *c_str(void) const { return _heap ? _heap : _sso; }
+  size_t length(void) const { return _len; }
+
+private:
+  enum { SSO = 11 };
+  char *buf(void) { return _heap ? _heap : _sso; }
+  LegacyString &concat(const char *s, size_t n)
+  {
+    if (_len + n > _cap)
+    {
+      char *grown = (char *)realloc(_heap, _len + n + 1);
+      g_allocs++;
+      if (!_heap)
+        memcpy(grown, _sso, _len + 1);
+      _heap = grown;
+      _cap = _len + n;
+    }
+    memcpy(buf() + _len, s, n);
+    _len += n;
+    buf()[_len] = 0;
+    return *this;
+  }
+
+  char *_heap;
+  char _sso[SSO + 1];
+  size_t _len;
+  size_t _cap;
+};
+
+static LegacyString operator+(const LegacyString &a, const LegacyString &b)
+{
+  LegacyString r(a);
+  r += b;
+  return r;
+}
+
+static LegacyString operator+(const LegacyString &a, const char *b)
+{
+  LegacyString r(a);
+  r += b;
+  return r;
+}
+
+// The old helpers, as they were
+static LegacyString operator*(LegacyString a, unsigned int b)
+{
+  LegacyString output = "";
+  while (b--)
+    output += a;
+  return output;
+}
+
+static LegacyString legacySplitAlign(LegacyString text1, LegacyString text2)
+{
+  if (text1.length() + text2.length() >= 20)
+    return "";
+  return LegacyString(text1 + LegacyString(" ") * (unsigned int)(21 - (text1.length() + text2.length())) + text2);
+}
+
+static LegacyString legacyResToText(uint8_t qualityPreset)
+{
+  switch (qualityPreset)
+  {
+  case 5: return "320x240";
+  case 8: return "640x480";
+  case 9: return "800x600";
+  case 10: return "1024x768";
+  case 11: return "1280x720";
+  case 12: return "1280x1024";
+  case 13: return "1600x1200";
+  default: return "HUH";
+  }
+}
+
+// One refresh's worth of lines, both ways; the lines are handed to check so the work isn't
+// optimised away
+struct Lines
+{
+  std::string header, clients, uptime;
+};
+
+static void legacy_refresh(uint8_t preset, const char *host, unsigned clients, unsigned hours, unsigned days, Lines *out)
+{
+  LegacyString h = legacySplitAlign(legacyResToText(preset), host);
+  LegacyString c = legacySplitAlign("Clients:", LegacyString(clients));
+  LegacyString u = legacySplitAlign("Uptime:", days ? LegacyString(days) + " days" : LegacyString(hours) + " hours");
+  if (out)
+  {
+    out->header = h.c_str();
+    out->clients = c.c_str();
+    out->uptime = u.c_str();
+  }
+}
+
+static void layout_refresh(uint8_t preset, const char *host, unsigned clients, unsigned hours, unsigned days, Lines *out)
+{
+  TextLine line(COLUMNS), value(COLUMNS);
+  const char *h = splitAlign(line, frameSizeText(preset), host);
+  if (out)
+    out->header = h;
+  value.append((uint32_t)clients);
+  const char *c = splitAlign(line, "Clients:", value.c_str());
+  if (out)
+    out->clients = c;
+  value.clear();
+  if (days)
+    value.append((uint32_t)days).append(" days");
+  else
+    value.append((uint32_t)hours).append(" hours");
+  const char *u = splitAlign(line, "Uptime:", value.c_str());
+  if (out)
+    out->uptime = u;
+}
+
+// Same line, or a line where the old code gave up (blank), or a real difference
+static void compare(const std::string &a, const std::string &b, int *same, int *better, int *worse)
+{
+  if (a == b)
+    ++*same;
+  else if (a.empty() && b.size() == COLUMNS)
+    ++*better;
+  else
+    ++*worse;
+}
+
+int bench_text(int argc, char **argv)
+{
+  int refreshes = opt_int(argc, argv, "refreshes", 200000);
+  static const char *hosts[] = {"esp32cam", "overwatch", "front-door-cam", "garage-camera-north"};
+  static const uint8_t presets[] = {5, 6, 8, 9, 10, 11, 12, 13};
+
+  // Output: every preset and host name, client counts and uptimes across their ranges
+  int same = 0, better = 0, worse = 0, renamed = 0;
+  std::string example;
+  for (size_t p = 0; p < sizeof(presets); p++)
+    for (size_t h = 0; h < sizeof(hosts) / sizeof(hosts[0]); h++)
+      for (unsigned v = 0; v < 2000; v += 7)
+      {
+        Lines a, b;
+        legacy_refresh(presets[p], hosts[h], v % 256, v % 24, v / 24, &a);
+        layout_refresh(presets[p], hosts[h], v % 256, v % 24, v / 24, &b);
+        if (legacyResToText(presets[p]).length() == 3 && strcmp(frameSizeText(presets[p]), "HUH"))
+          ++renamed; // the old switch only knew some of the sizes
+        else
+          compare(a.header, b.header, &same, &better, &worse);
+        compare(a.clients, b.clients, &same, &better, &worse);
+        compare(a.uptime, b.uptime, &same, &better, &worse);
+        if (a.header.empty() && example.empty())
+          example = "'" + b.header + "' where it was blank";
+      }
+  printf("lines identical %d, filled where the old layout left them blank %d, different %d\n", same, better, worse);
+  printf("  %d headers name a frame size the old table showed as HUH\n", renamed);
+  if (!example.empty())
+    printf("  e.g. %s\n", example.c_str());
+
+  // Heap traffic and time per refresh
+  uint64_t a0 = g_allocs, t0 = now_us();
+  for (int i = 0; i < refreshes; i++)
+    legacy_refresh(9, hosts[1], i % 5, i % 24, i / 2880, NULL);
+  uint64_t legacyAllocs = g_allocs - a0;
+  double legacyNs = (now_us() - t0) * 1e3 / refreshes;
+  a0 = g_allocs;
+  t0 = now_us();
+  for (int i = 0; i < refreshes; i++)
+    layout_refresh(9, hosts[1], i % 5, i % 24, i / 2880, NULL);
+  uint64_t layoutAllocs = g_allocs - a0;
+  double layoutNs = (now_us() - t0) * 1e3 / refreshes;
+  printf("String layout:  %6.2f heap operations and %6.0f ns per refresh\n", (double)legacyAllocs / refreshes, legacyNs);
+  printf("TextLine:       %6.2f heap operations and %6.0f ns per refresh, %zu bytes of stack per line\n",
+         (double)layoutAllocs / refreshes, layoutNs, sizeof(TextLine));
+  return worse ? 1 : 0;
+}
@@ -0,0 +1,294 @@
+// Time-lapse store on the local filesystem: bytes per stored frame and append cost with every
+// frame synced, frame lookup and time search as the index grows, recovery from a torn tail,
+// /timelapse.mjpeg played back unpaced and paced and checked byte for byte against the
+// originals, then frames taken from a live stream as streamed and with a framesize switch.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <EventServer.h>
+#include <MJPEGStreamer.h>
+#include <Timelapse.h>
+#include "bench.h"
+#include "host_net.h"
+#include "host_stats.h"
+#include "synthetic_source.h"
+
+#define EPOCH 1790000000u // first stored frame's time
+
+typedef std::vector<std::vector<uint8_t> > Clip;
+
+static TimelapseStore *g_store;
+static MJPEGBroadcaster *g_broadcaster;
+
+// Same arguments as the device's /timelapse.mjpeg
+static void handle_timelapse(HttpConnection &conn)
+{
+  char value[16];
+  uint32_t from = conn.arg("from", value, sizeof(value)) ? strtoul(value, NULL, 10) : 0;
+  uint32_t to = conn.arg("to", value, sizeof(value)) ? strtoul(value, NULL, 10) : 0;
+  float fps = conn.arg("fps", value, sizeof(value)) ? atof(value) : 0;
+  TimelapseStreamer *s = new TimelapseStreamer(*g_store, from, to, fps);
+  if (!s->opened())
+  {
+    delete s;
+    conn.send(404, "text/plain", "No time-lapse frames in that range.");
+    return;
+  }
+  conn.stream(s);
+}
+
+static void handle_stream(HttpConnection &conn) { conn.stream(new MJPEGStreamer(*g_broadcaster)); }
+
+static long file_size(const std::string &path)
+{
+  struct stat st;
+  return stat(path.c_str(), &st) ? -1 : st.st_size;
+}
+
+// Mean cost of a random entry() and find() at the store's current size (ns)
+static void lookups(TimelapseStore &store, uint32_t interval, uint32_t rounds, double *entryNs, double *findNs)
+{
+  uint32_t n = store.count();
+  TimelapseEntry e;
+  uint64_t s = now_us();
+  for (uint32_t i = 0; i < rounds; i++)
+    store.entry((i * 2654435761u) % n, e);
+  *entryNs = (now_us() - s) * 1000.0 / rounds;
+  s = now_us();
+  for (uint32_t i = 0; i < rounds; i++)
+    store.find(EPOCH + (i * 2654435761u) % n * interval);
+  *findNs = (now_us() - s) * 1000.0 / rounds;
+}
+
+static bool fill(TimelapseStore &store, const Clip &clip, const char *out, uint32_t frames, uint32_t interval)
+{
+  std::vector<double> us;
+  uint64_t jpeg = 0;
+  printf("%10s %12s %12s\n", "frames", "entry ns", "find ns");
+  for (uint32_t i = 0; i < frames; i++)
+  {
+    const std::vector<uint8_t> &f = clip[i % clip.size()];
+    uint64_t s = now_us();
+    if (!store.append(f.data(), f.size(), EPOCH + i * interval))
+    {
+      printf("  FAILED: append %u\n", i);
+      return false;
+    }
+    us.push_back(now_us() - s);
+    jpeg += f.size();
+    if (i + 1 == frames / 16 || i + 1 == frames / 4 || i + 1 == frames)
+    {
+      double entryNs, findNs;
+      lookups(store, interval, 20000, &entryNs, &findNs);
+      printf("%10u %12.0f %12.0f\n", i + 1, entryNs, findNs);
+    }
+  }
+  long data = file_size(std::string(out) + "/frames.bin"), index = file_size(std::string(out) + "/index.bin");
+  double perFrame = (double)(data + index) / frames, mean = (double)jpeg / frames;
+  printf("%u frames, mean JPEG %.0f B: %.1f B per frame on disk, index %.0f B (%.3f%%), %.1f MB per 30 days at one "
+         "every %u s\n", frames, mean, perFrame, (double)index / frames, 100.0 * (perFrame - mean) / mean,
+         perFrame * (30 * 86400.0 / interval) / 1e6, interval);
+  printf("append incl. sync: p50 %.0f us, p99 %.0f us, max %.0f us\n", percentile(us, 50), percentile(us, 99),
+         percentile(us, 100));
+  return data == (long)jpeg && index == (long)frames * TL_RECORD_SIZE;
+}
+
+// A torn record, then a record whose data never made it: each costs exactly that one frame
+static bool recover(TimelapseStore &store, const Clip &clip, const char *dir, uint32_t interval)
+{
+  uint32_t n = store.count();
+  TimelapseEntry last;
+  store.entry(n - 2, last);
+  store.close();
+  std::string index = std::string(dir) + "/index.bin", data = std::string(dir) + "/frames.bin";
+  bool ok = !truncate(index.c_str(), file_size(index) - 7) && store.open(dir) && store.count() == n - 1;
+  store.close();
+  ok &= !truncate(data.c_str(), last.offset + last.len - 100) && store.open(dir) && store.count() == n - 2;
+  // The lost frames go in again where they were
+  for (uint32_t i = n - 2; ok && i < n; i++)
+    ok = store.append(clip[i % clip.size()].data(), clip[i % clip.size()].size(), EPOCH + i * interval);
+  ok &= store.count() == n && store.bytes() == file_size(data);
+  printf("recovery: torn record and dangling record each dropped one frame, re-appended: %s\n", ok ? "ok" : "FAILED");
+  return ok;
+}
+
+// Plays a range and checks every frame against the clip; returns frames per second
+static double play(uint16_t port, const Clip &clip, uint32_t first, uint32_t last, uint32_t interval, double fps,
+                   bool *ok, double *mbps)
+{
+  char req[160];
+  snprintf(req, sizeof(req), "GET /timelapse.mjpeg?from=%u&to=%u&fps=%g HTTP/1.1\r\nHost: bench\r\n\r\n",
+           EPOCH + first * interval, EPOCH + last * interval, fps);
+  int fd = tcp_connect(port);
+  send_all(fd, req, strlen(req));
+  std::atomic<bool> stop(false);
+  SocketReader in(fd, &stop);
+  std::vector<uint8_t> frame;
+  uint32_t i = first;
+  uint64_t bytes = 0, start = now_us(), firstAt = 0;
+  *ok = true;
+  while (mjpeg_part(in, frame))
+  {
+    if (!firstAt)
+      firstAt = now_us();
+    *ok &= i <= last && frame == clip[i % clip.size()];
+    bytes += frame.size();
+    i++;
+  }
+  double elapsed = (now_us() - start) / 1e6;
+  tcp_close(fd);
+  *ok &= i == last + 1;
+  if (mbps)
+    *mbps = bytes / elapsed / 1e6;
+  // Paced: the first frame goes out at once, the rate is over the gaps between frames
+  return fps > 0 ? (i - first - 1) / ((now_us() - firstAt) / 1e6) : (i - first) / elapsed;
+}
+
+static bool playback(TimelapseStore &store, const Clip &clip, uint32_t interval, double playFps)
+{
+  g_store = &store;
+  HttpServer server;
+  server.on("/timelapse.mjpeg", METHOD_GET, handle_timelapse);
+  server.begin(0);
+  std::atomic<bool> stop(false);
+  // The device's loop also wakes on every published frame; 10 ms stands in for that when paced
+  std::thread loop([&] { while (!stop) server.poll(10); });
+
+  uint32_t n = store.count();
+  bool ok, all = true;
+  double mbps;
+  uint64_t served = timelapseMetrics.served.value();
+  double fps = play(server.port(), clip, 0, n - 1, interval, 0, &ok, &mbps);
+  printf("unpaced, all %u frames: %.0f frames/s, %.1f MB/s, %s\n", n, fps, mbps, ok ? "identical" : "MISMATCH");
+  all &= ok;
+  uint32_t a = n / 3, b = a + n / 5;
+  fps = play(server.port(), clip, a, b, interval, 0, &ok, &mbps);
+  printf("unpaced, frames %u-%u by time: %.0f frames/s, %.1f MB/s, %s\n", a, b, fps, mbps, ok ? "identical" : "MISMATCH");
+  all &= ok;
+  fps = play(server.port(), clip, a, a + 3 * (uint32_t)playFps, interval, playFps, &ok, NULL);
+  bool paced = fps > 0.9 * playFps && fps < 1.1 * playFps;
+  printf("paced at %.0f fps: %.2f fps, %s%s\n", playFps, fps, ok ? "identical" : "MISMATCH", paced ? "" : "  FAILED");
+  all &= ok && paced;
+  all &= timelapseMetrics.served.value() - served == n + (b - a + 1) + 3 * (uint32_t)playFps + 1;
+
+  stop = true;
+  server.wake();
+  loop.join();
+  server.stop();
+  return all;
+}
+
+static std::atomic<bool> g_switched(false);
+static std::atomic<uint32_t> g_switches(0);
+static std::atomic<uint32_t> g_leaked(0); // published while switched
+
+static void switch_size(bool timelapse, void *ctx)
+{
+  g_switched = timelapse;
+  g_switches++;
+}
+
+static void published(void *ctx)
+{
+  if (g_switched)
+    g_leaked++;
+  ((HttpServer *)ctx)->wake();
+}
+
+// Frames taken from a live 25 fps stream next to a viewer, triggered the way the scheduler does
+static bool capture(TimelapseStore &store, size_t size, double fps, uint32_t takes)
+{
+  SyntheticSource source(size, fps);
+  MJPEGBroadcaster b(source);
+  g_broadcaster = &b;
+  HttpServer server;
+  server.on("/mjpeg", METHOD_GET, handle_stream);
+  server.begin(0);
+  b.onPublish(published, &server);
+  Timelapse tl(b, source, store);
+  tl.begin(size + 1024);
+
+  std::atomic<bool> stop(false), viewerStop(false);
+  std::thread loop([&] { while (!stop) server.poll(50); });
+  std::thread producer([&] { while (!stop) b.captureOnce(); });
+  std::thread task([&] { tl.run(); });
+  std::atomic<uint64_t> frames(0);
+  std::thread viewer(mjpeg_viewer, server.port(), &viewerStop, &frames);
+  sleep_us(500000);
+
+  bool ok = true;
+  for (int switched = 0; switched < 2; switched++)
+  {
+    tl.onSwitch(switched ? switch_size : NULL, NULL);
+    uint32_t count = store.count();
+    uint64_t viewed = frames, start = now_us();
+    std::vector<double> ms;
+    for (uint32_t i = 0; i < takes; i++)
+    {
+      uint64_t done = timelapseMetrics.frames.value() + timelapseMetrics.failures.value(), s = now_us();
+      tl.trigger();
+      while (timelapseMetrics.frames.value() + timelapseMetrics.failures.value() == done)
+        sleep_us(500);
+      ms.push_back((now_us() - s) / 1000.0);
+      sleep_us(200000);
+    }
+    // What the viewer went without per frame taken: nothing as streamed, a few frame times switched
+    double lost = fps * (now_us() - start) / 1e6 - (frames - viewed);
+    double pauseMs = lost > 0 ? lost / takes * 1000 / fps : 0;
+    bool stored = store.count() == count + takes;
+    printf("%-12s take p50 %6.1f ms, max %6.1f ms, viewer paused %5.1f ms per take, %u stored, %u switches, "
+           "%u frames published while switched%s\n", switched ? "switched" : "as streamed", percentile(ms, 50),
+           percentile(ms, 100), pauseMs, store.count() - count, (unsigned)g_switches, (unsigned)g_leaked,
+           stored ? "" : "  FAILED");
+    double bound = (switched ? 2 * TL_SETTLE_FRAMES + 3 : 2) * 1000 / fps;
+    ok &= stored && !g_leaked && pauseMs <= bound && g_switches == (switched ? 2 * takes : 0);
+  }
+
+  viewerStop = true;
+  viewer.join();
+  stop = true;
+  tl.shutdown();
+  b.shutdown();
+  server.wake();
+  task.join();
+  loop.join();
+  producer.join();
+  server.stop();
+  return ok;
+}
+
+int bench_timelapse(int argc, char **argv)
+{
+  const char *dir = opt_str(argc, argv, "dir", NULL);
+  const char *out = opt_str(argc, argv, "out", "/tmp/esp32cam-timelapse");
+  size_t size = opt_int(argc, argv, "size", 40000);
+  uint32_t frames = opt_int(argc, argv, "frames", 2000);
+  uint32_t interval = opt_int(argc, argv, "interval", 30);
+  double playFps = opt_double(argc, argv, "play-fps", 10);
+  double fps = opt_double(argc, argv, "fps", 25);
+  uint32_t takes = opt_int(argc, argv, "takes", 10);
+
+  Clip clip;
+  load_frames(dir, size, clip);
+  TimelapseStore store;
+  if (!store.open(out) || !store.clear())
+  {
+    fprintf(stderr, "cannot open a store in %s\n", out);
+    return 1;
+  }
+  bool ok = fill(store, clip, out, frames, interval);
+  ok &= recover(store, clip, out, interval);
+  ok &= playback(store, clip, interval, playFps);
+  ok &= capture(store, size, fps, takes);
+  store.clear();
+  store.close();
+  if (!ok)
+    printf("FAILED\n");
+  return ok ? 0 : 1;
+}
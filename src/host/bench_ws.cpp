@@ -0,0 +1,373 @@
+// /ws against /mjpeg for glass-to-glass latency: scripted clients that take a fixed time to
+// "decode" every frame, fast and slow, measure capture-to-shown per frame. A slow /mjpeg reader
+// drains whatever the socket buffers hold, a /ws reader only ever has its window in flight.
+// Handshake and control frames are checked on the way.
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <EventServer.h>
+#include <WebSocket.h>
+#include <MJPEGStreamer.h>
+#include <WebSocketStreamer.h>
+#include "bench.h"
+#include "host_net.h"
+#include "host_stats.h"
+#include "synthetic_source.h"
+
+static MJPEGBroadcaster *g_broadcaster;
+
+static void handle_stream(HttpConnection &conn) { conn.stream(new MJPEGStreamer(*g_broadcaster)); }
+
+static void handle_ws(HttpConnection &conn)
+{
+  char accept[WS_ACCEPT_SIZE], arg[12];
+  if (!wsAccept(conn, accept))
+    return;
+  uint8_t inflight = conn.arg("inflight", arg, sizeof(arg)) ? WebSocketStreamer::inflightArg(arg) : WS_DEFAULT_INFLIGHT;
+  conn.stream(new WebSocketStreamer(*g_broadcaster, accept, inflight));
+}
+
+static void wake(void *ctx) { ((HttpServer *)ctx)->wake(); }
+
+// Client frames have to be masked
+static bool ws_send(int fd, WsOpcode opcode, const void *payload, size_t len)
+{
+  uint8_t frame[6 + WS_CONTROL_SIZE];
+  if (len > WS_CONTROL_SIZE)
+    return false;
+  uint8_t mask[4] = {(uint8_t)rand(), (uint8_t)rand(), (uint8_t)rand(), (uint8_t)rand()};
+  frame[0] = 0x80 | opcode;
+  frame[1] = 0x80 | (uint8_t)len;
+  memcpy(frame + 2, mask, 4);
+  for (size_t i = 0; i < len; i++)
+    frame[6 + i] = ((const uint8_t *)payload)[i] ^ mask[i & 3];
+  return send_all(fd, frame, 6 + len);
+}
+
+// Server frame header; payload length in len
+static bool ws_frame(SocketReader &in, uint8_t &opcode, uint64_t &len)
+{
+  uint8_t h[8];
+  if (!in.read(h, 2))
+    return false;
+  opcode = h[0] & 0x0F;
+  len = h[1] & 0x7F;
+  if (h[1] & 0x80)
+    return false; // servers never mask
+  int ext = len == 126 ? 2 : len == 127 ? 8 : 0;
+  if (ext)
+  {
+    if (!in.read(h, ext))
+      return false;
+    len = 0;
+    for (int i = 0; i < ext; i++)
+      len = len << 8 | h[i];
+  }
+  return true;
+}
+
+static uint64_t get_be(const uint8_t *p, int bytes)
+{
+  uint64_t v = 0;
+  for (int i = 0; i < bytes; i++)
+    v = v << 8 | p[i];
+  return v;
+}
+
+// RFC 6455's own example key, so the accept value is known
+static const char SAMPLE_KEY[] = "dGhlIHNhbXBsZSBub25jZQ==";
+static const char SAMPLE_ACCEPT[] = "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=";
+
+static int ws_open(uint16_t port, const char *path, std::string &response, SocketReader **reader,
+                   const std::atomic<bool> *stop)
+{
+  int fd = tcp_connect(port);
+  char req[256];
+  int n = snprintf(req, sizeof(req),
+                   "GET %s HTTP/1.1\r\nHost: bench\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                   "Sec-WebSocket-Key: %s\r\nSec-WebSocket-Version: 13\r\n\r\n",
+                   path, SAMPLE_KEY);
+  send_all(fd, req, n);
+  *reader = new SocketReader(fd, stop);
+  if (!(*reader)->until("\r\n\r\n", response))
+    response.clear();
+  return fd;
+}
+
+struct ClientResult
+{
+  std::vector<double> latencyMs; // capture until the frame was "shown"
+  uint64_t frames;
+  bool ok;
+};
+
+// Takes decode_ms per frame, then acknowledges it
+static void ws_client(uint16_t port, int inflight, double decode_ms, const std::atomic<bool> *stop, ClientResult *r)
+{
+  char path[32];
+  snprintf(path, sizeof(path), "/ws?inflight=%d", inflight);
+  std::string response;
+  SocketReader *in;
+  int fd = ws_open(port, path, response, &in, stop);
+  r->frames = 0;
+  r->ok = response.find(" 101 ") != std::string::npos && response.find(SAMPLE_ACCEPT) != std::string::npos;
+  std::vector<uint8_t> payload;
+  while (r->ok && !*stop)
+  {
+    uint8_t opcode;
+    uint64_t len;
+    if (!ws_frame(*in, opcode, len))
+      break;
+    if (opcode != WS_BINARY || len < WS_FRAME_HEADER)
+    {
+      r->ok = in->skip(len) && opcode == WS_PONG;
+      continue;
+    }
+    payload.resize(len);
+    if (!in->read(payload.data(), len))
+      break;
+    uint32_t seq = (uint32_t)get_be(payload.data(), 4);
+    uint64_t captured = get_be(payload.data() + 4, 8);
+    if (SyntheticSource::stamp(payload.data() + WS_FRAME_HEADER, len - WS_FRAME_HEADER) != captured)
+      r->ok = false; // the header has to describe the JPEG it carries
+    sleep_us((uint64_t)(decode_ms * 1000));
+    r->latencyMs.push_back((now_us() - captured) / 1000.0);
+    r->frames++;
+    char ack[12];
+    ws_send(fd, WS_TEXT, ack, snprintf(ack, sizeof(ack), "%u", (unsigned)seq));
+  }
+  delete in;
+  tcp_close(fd);
+}
+
+// Next multipart part's body
+bool mjpeg_part(SocketReader &in, std::vector<uint8_t> &frame)
+{
+  std::string head;
+  for (;;)
+  {
+    if (!in.until("\r\n\r\n", head))
+      return false;
+    const char *cl = strstr(head.c_str(), "Content-Length: ");
+    if (!cl)
+      continue; // the response head, or the boundary line before the first part
+    frame.resize(strtoul(cl + 16, NULL, 10));
+    return in.read(frame.data(), frame.size());
+  }
+}
+
+static void mjpeg_client(uint16_t port, int inflight, double decode_ms, const std::atomic<bool> *stop, ClientResult *r)
+{
+  int fd = tcp_connect(port);
+  const char req[] = "GET /mjpeg HTTP/1.1\r\nHost: bench\r\n\r\n";
+  send_all(fd, req, sizeof(req) - 1);
+  SocketReader in(fd, stop);
+  r->frames = 0;
+  r->ok = true;
+  std::vector<uint8_t> frame;
+  while (!*stop && mjpeg_part(in, frame))
+  {
+    uint64_t captured = SyntheticSource::stamp(frame.data(), frame.size());
+    if (!captured)
+      continue;
+    sleep_us((uint64_t)(decode_ms * 1000));
+    r->latencyMs.push_back((now_us() - captured) / 1000.0);
+    r->frames++;
+  }
+  tcp_close(fd);
+}
+
+typedef void (*Client)(uint16_t port, int inflight, double decode_ms, const std::atomic<bool> *stop, ClientResult *r);
+
+// One stream under test next to `others` fast /ws viewers; returns the p99 latency
+static double run(const char *name, Client client, int inflight, double decode_ms, int others, double fps, size_t size,
+                  double seconds, bool *ok)
+{
+  SyntheticSource source(size, fps, true);
+  MJPEGBroadcaster b(source);
+  g_broadcaster = &b;
+  HttpServer server;
+  server.on("/mjpeg", METHOD_GET, handle_stream);
+  server.on("/ws", METHOD_GET, handle_ws);
+  server.begin(0);
+  b.onPublish(wake, &server);
+
+  std::atomic<bool> stop(false), clientStop(false);
+  std::thread loop([&] { while (!stop) server.poll(50); });
+  std::thread producer([&] { while (!stop) b.captureOnce(); });
+
+  std::vector<ClientResult> results(1 + others);
+  std::vector<std::thread> threads;
+  threads.push_back(std::thread(client, server.port(), inflight, decode_ms, &clientStop, &results[0]));
+  for (int i = 0; i < others; i++)
+    threads.push_back(std::thread(ws_client, server.port(), WS_DEFAULT_INFLIGHT, 2.0, &clientStop, &results[1 + i]));
+  uint64_t start = now_us();
+  sleep_us((uint64_t)(seconds * 1e6));
+  clientStop = true;
+  double elapsed = (now_us() - start) / 1e6;
+  for (size_t i = 0; i < threads.size(); i++)
+    threads[i].join();
+  stop = true;
+  b.shutdown();
+  server.wake();
+  loop.join();
+  producer.join();
+  server.stop();
+
+  ClientResult &r = results[0];
+  bool good = r.ok && r.frames > 0;
+  for (int i = 0; i < others; i++)
+    good &= results[1 + i].ok;
+  std::vector<double> &l = r.latencyMs;
+  double p50 = l.empty() ? 0 : percentile(l, 50), p99 = l.empty() ? 0 : percentile(l, 99);
+  double last = l.empty() ? 0 : l.back();
+  char label[32];
+  snprintf(label, sizeof(label), inflight ? "%s, %d in flight" : "%s", name, inflight);
+  printf("%-22s %9.0f %8.1f %9.1f %9.1f %9.1f%s\n", label, decode_ms, r.frames / elapsed, p50, p99, last,
+         good ? "" : "  FAILED");
+  *ok &= good;
+  return p99;
+}
+
+// Pings, a close, and a frame the server has to refuse
+static bool protocol(double fps, size_t size)
+{
+  SyntheticSource source(size, fps, true);
+  MJPEGBroadcaster b(source);
+  g_broadcaster = &b;
+  HttpServer server;
+  server.on("/ws", METHOD_GET, handle_ws);
+  server.begin(0);
+  b.onPublish(wake, &server);
+  std::atomic<bool> stop(false);
+  std::thread loop([&] { while (!stop) server.poll(50); });
+  std::thread producer([&] { while (!stop) b.captureOnce(); });
+
+  bool ok = true;
+  std::atomic<bool> never(false);
+  // ?inflight= values clamp instead of wrapping into uint8_t; 0 only when asked for
+  {
+    static const struct
+    {
+      const char *arg;
+      uint8_t window;
+    } cases[] = {{"0", 0}, {"1", 1}, {"4", 4}, {"8", 8}, {"9", WS_MAX_INFLIGHT}, {"256", WS_MAX_INFLIGHT},
+                 {"-3", 1}, {"", WS_DEFAULT_INFLIGHT}, {"two", WS_DEFAULT_INFLIGHT}};
+    bool good = true;
+    for (const auto &c : cases)
+      good &= WebSocketStreamer::inflightArg(c.arg) == c.window;
+    printf("inflight argument: %s\n", good ? "clamped, ok" : "FAILED");
+    ok &= good;
+  }
+  // No upgrade headers: a plain 400
+  {
+    int fd = tcp_connect(server.port());
+    const char req[] = "GET /ws HTTP/1.1\r\nHost: bench\r\n\r\n";
+    send_all(fd, req, sizeof(req) - 1);
+    SocketReader in(fd, &never);
+    std::string response;
+    bool good = in.until("\r\n\r\n", response) && response.find(" 400 ") != std::string::npos;
+    printf("plain GET /ws: %s\n", good ? "400, ok" : "FAILED");
+    ok &= good;
+    tcp_close(fd);
+  }
+  // Ping answered with the same payload, between frames; then a close answered with a close
+  {
+    std::string response;
+    SocketReader *in;
+    int fd = ws_open(server.port(), "/ws?inflight=0", response, &in, &never);
+    ws_send(fd, WS_PING, "bench", 5);
+    bool pong = false, closed = false;
+    uint8_t opcode;
+    uint64_t len;
+    std::vector<uint8_t> payload;
+    for (int frames = 0; frames < 50 && !closed && ws_frame(*in, opcode, len); frames++)
+    {
+      payload.resize(len);
+      if (!in->read(payload.data(), len))
+        break;
+      if (opcode == WS_PONG)
+      {
+        pong = len == 5 && !memcmp(payload.data(), "bench", 5);
+        uint8_t code[2] = {WS_CLOSE_NORMAL >> 8, WS_CLOSE_NORMAL & 0xFF};
+        ws_send(fd, WS_CLOSE, code, 2);
+      }
+      closed = opcode == WS_CLOSE && len == 2 && get_be(payload.data(), 2) == WS_CLOSE_NORMAL;
+    }
+    bool good = response.find(SAMPLE_ACCEPT) != std::string::npos && pong && closed;
+    printf("ping/pong and close: %s\n", good ? "ok" : "FAILED");
+    ok &= good;
+    delete in;
+    tcp_close(fd);
+  }
+  // An unmasked client frame is a protocol error, answered with close 1002
+  {
+    std::string response;
+    SocketReader *in;
+    int fd = ws_open(server.port(), "/ws?inflight=1", response, &in, &never);
+    uint64_t errors0 = wsMetrics.protocolErrors.value();
+    const uint8_t bad[] = {0x81, 0x01, '1'};
+    send_all(fd, bad, sizeof(bad));
+    bool refused = false;
+    uint8_t opcode;
+    uint64_t len;
+    std::vector<uint8_t> payload;
+    for (int frames = 0; frames < 50 && !refused && ws_frame(*in, opcode, len); frames++)
+    {
+      payload.resize(len);
+      if (!in->read(payload.data(), len))
+        break;
+      refused = opcode == WS_CLOSE && len == 2 && get_be(payload.data(), 2) == WS_CLOSE_PROTOCOL;
+    }
+    bool good = refused && wsMetrics.protocolErrors.value() > errors0;
+    printf("unmasked client frame: %s\n", good ? "closed with 1002, ok" : "FAILED");
+    ok &= good;
+    delete in;
+    tcp_close(fd);
+  }
+
+  stop = true;
+  b.shutdown();
+  server.wake();
+  loop.join();
+  producer.join();
+  server.stop();
+  return ok;
+}
+
+int bench_ws(int argc, char **argv)
+{
+  double fps = opt_double(argc, argv, "fps", 25);
+  size_t size = opt_int(argc, argv, "size", 30000);
+  double seconds = opt_double(argc, argv, "seconds", 4);
+  double slow = opt_double(argc, argv, "decode", 100); // ms per frame for the slow reader
+  int others = opt_int(argc, argv, "viewers", 2);
+
+  bool ok = protocol(fps, size);
+  printf("\n%.0f fps, %u byte frames, %d other /ws viewers\n", fps, (unsigned)size, others);
+  printf("%-22s %9s %8s %9s %9s %9s\n", "stream", "decode ms", "fps", "p50 ms", "p99 ms", "last ms");
+  run("mjpeg", mjpeg_client, 0, 2, others, fps, size, seconds, &ok);
+  run("ws", ws_client, 1, 2, others, fps, size, seconds, &ok);
+  run("ws", ws_client, 2, 2, others, fps, size, seconds, &ok);
+  double mjpeg = run("mjpeg", mjpeg_client, 0, slow, others, fps, size, seconds, &ok);
+  for (int inflight = 1; inflight <= 4; inflight *= 2)
+  {
+    double p99 = run("ws", ws_client, inflight, slow, others, fps, size, seconds, &ok);
+    // Bounded: what is in flight, one decode ahead of it and a frame interval of slack
+    double bound = (inflight + 1) * slow + 2000.0 / fps;
+    if (p99 > bound)
+    {
+      printf("  FAILED: p99 %.0f ms over the %.0f ms the window allows\n", p99, bound);
+      ok = false;
+    }
+  }
+  printf("slow reader: /mjpeg p99 %.0f ms, its socket buffers hold the backlog\n", mjpeg);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,173 @@
+#include "delta_diff.h"
+#include <string.h>
+#include <DeltaPatch.h>
+
+#define WINDOW     8
+#define HASH_BITS  20
+#define CANDIDATES 32 // chain entries tried per position
+#define MIN_MATCH  16 // shorter matches cost more as an add than as literals
+#define GIVE_UP    64 // an extension stops once it scores this much below its best
+
+static uint32_t window_hash(const uint8_t *p)
+{
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return (uint32_t)((v * 0x9E3779B97F4A7C15ull) >> (64 - HASH_BITS));
+}
+
+static void put_varint(std::vector<uint8_t> &out, uint64_t v)
+{
+  while (v >= 0x80)
+  {
+    out.push_back((uint8_t)(v | 0x80));
+    v >>= 7;
+  }
+  out.push_back((uint8_t)v);
+}
+
+static void put32(std::vector<uint8_t> &out, uint32_t v)
+{
+  for (int i = 0; i < 4; i++)
+    out.push_back((uint8_t)(v >> (8 * i)));
+}
+
+static void put_sha(std::vector<uint8_t> &out, const std::vector<uint8_t> &data)
+{
+  Sha256 sha;
+  uint8_t digest[SHA256_SIZE];
+  sha.update(data.data(), data.size());
+  sha.finish(digest);
+  out.insert(out.end(), digest, digest + SHA256_SIZE);
+}
+
+// How far old[o..] can stand in for neu[n..], allowing differences while at least half the
+// bytes match. Returns the length with the best score (twice the matches less the length).
+static size_t extend(const std::vector<uint8_t> &old, size_t o, const std::vector<uint8_t> &neu, size_t n)
+{
+  long score = 0, best = 0;
+  size_t bestLen = 0;
+  for (size_t i = 0; o + i < old.size() && n + i < neu.size(); i++)
+  {
+    score += old[o + i] == neu[n + i] ? 1 : -1;
+    if (score > best)
+    {
+      best = score;
+      bestLen = i + 1;
+    }
+    else if (score < best - GIVE_UP)
+    {
+      break;
+    }
+  }
+  return bestLen;
+}
+
+static void emit_insert(std::vector<uint8_t> &out, const std::vector<uint8_t> &neu, size_t from, size_t to)
+{
+  if (from == to)
+    return;
+  out.push_back(DELTA_OP_INSERT);
+  put_varint(out, to - from);
+  out.insert(out.end(), neu.begin() + from, neu.begin() + to);
+}
+
+static void emit_add(std::vector<uint8_t> &out, const std::vector<uint8_t> &old, size_t o,
+                     const std::vector<uint8_t> &neu, size_t n, size_t len, size_t nextOld)
+{
+  out.push_back(DELTA_OP_ADD);
+  int64_t rel = (int64_t)o - (int64_t)nextOld;
+  put_varint(out, (uint64_t)((rel << 1) ^ (rel >> 63)));
+  put_varint(out, len);
+  size_t i = 0;
+  while (i < len)
+  {
+    size_t same = 0;
+    while (i + same < len && old[o + i + same] == neu[n + i + same])
+      same++;
+    put_varint(out, same);
+    i += same;
+    if (i == len)
+      break;
+    // A changed run swallows unchanged gaps too short to pay for their own triple
+    size_t end = i;
+    while (end < len)
+    {
+      if (old[o + end] != neu[n + end])
+      {
+        end++;
+        continue;
+      }
+      size_t gap = 0;
+      while (end + gap < len && old[o + end + gap] == neu[n + end + gap])
+        gap++;
+      if (gap >= 3 || end + gap == len)
+        break;
+      end += gap;
+    }
+    put_varint(out, end - i);
+    for (; i < end; i++)
+      out.push_back((uint8_t)(neu[n + i] - old[o + i]));
+  }
+}
+
+std::vector<uint8_t> delta_create(const std::vector<uint8_t> &old, const std::vector<uint8_t> &neu)
+{
+  std::vector<uint8_t> out;
+  for (int i = 0; i < 4; i++)
+    out.push_back(DELTA_MAGIC[i]);
+  put32(out, old.size());
+  put_sha(out, old);
+  put32(out, neu.size());
+  put_sha(out, neu);
+
+  // Chains of old positions per window hash, most recent first
+  std::vector<int32_t> head((size_t)1 << HASH_BITS, -1);
+  std::vector<int32_t> prev(old.size(), -1);
+  for (size_t i = 0; i + WINDOW <= old.size(); i++)
+  {
+    uint32_t h = window_hash(&old[i]);
+    prev[i] = head[h];
+    head[h] = (int32_t)i;
+  }
+
+  size_t n = 0, literal = 0, nextOld = 0;
+  int64_t lastDelta = 0; // old - new position of the last match, tried first
+  while (n < neu.size())
+  {
+    size_t bestLen = 0, bestOld = 0;
+    int64_t guess = (int64_t)n + lastDelta;
+    if (guess >= 0 && (size_t)guess < old.size())
+    {
+      bestLen = extend(old, guess, neu, n);
+      bestOld = guess;
+    }
+    if (n + WINDOW <= neu.size())
+    {
+      int tries = CANDIDATES;
+      for (int32_t c = head[window_hash(&neu[n])]; c >= 0 && tries--; c = prev[c])
+      {
+        if (memcmp(&old[c], &neu[n], WINDOW))
+          continue;
+        size_t len = extend(old, c, neu, n);
+        if (len > bestLen)
+        {
+          bestLen = len;
+          bestOld = c;
+        }
+      }
+    }
+    if (bestLen < MIN_MATCH)
+    {
+      n++;
+      continue;
+    }
+    emit_insert(out, neu, literal, n);
+    emit_add(out, old, bestOld, neu, n, bestLen, nextOld);
+    lastDelta = (int64_t)bestOld - (int64_t)n;
+    nextOld = bestOld + bestLen;
+    n += bestLen;
+    literal = n;
+  }
+  emit_insert(out, neu, literal, n);
+  return out;
+}
@@ -0,0 +1,12 @@
+#ifndef DELTA_DIFF_H_
+#define DELTA_DIFF_H_
+
+#include <stdint.h>
+#include <vector>
+
+// Builds a patch in the DeltaPatch.h format that turns old into neu. Matches are found
+// through a hash of 8-byte windows of old and grown bsdiff-style past small differences, so
+// code that moved and had its addresses shifted becomes a mostly-zero difference.
+std::vector<uint8_t> delta_create(const std::vector<uint8_t> &old, const std::vector<uint8_t> &neu);
+
+#endif // DELTA_DIFF_H_
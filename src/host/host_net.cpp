@@ -0,0 +1,194 @@
+#include "host_net.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <string.h>
+
+int tcp_listen(uint16_t port)
+{
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0)
+    return -1;
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  if (bind(fd, (sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 64) < 0)
+  {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+uint16_t tcp_local_port(int fd)
+{
+  sockaddr_in addr;
+  socklen_t len = sizeof(addr);
+  if (getsockname(fd, (sockaddr *)&addr, &len) < 0)
+    return 0;
+  return ntohs(addr.sin_port);
+}
+
+int tcp_connect(uint16_t port)
+{
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0)
+    return -1;
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  if (connect(fd, (sockaddr *)&addr, sizeof(addr)) < 0)
+  {
+    close(fd);
+    return -1;
+  }
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  return fd;
+}
+
+int tcp_accept(int fd)
+{
+  int c = accept(fd, NULL, NULL);
+  if (c >= 0)
+  {
+    int one = 1;
+    setsockopt(c, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  }
+  return c;
+}
+
+bool send_all(int fd, const void *data, size_t len)
+{
+  const uint8_t *p = (const uint8_t *)data;
+  while (len)
+  {
+    ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+void tcp_close(int fd)
+{
+  if (fd >= 0)
+  {
+    shutdown(fd, SHUT_RDWR);
+    close(fd);
+  }
+}
+
+uint64_t now_us(void)
+{
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+void sleep_us(uint64_t us)
+{
+  timespec ts;
+  ts.tv_sec = us / 1000000ULL;
+  ts.tv_nsec = (us % 1000000ULL) * 1000;
+  while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+    ;
+}
+
+SocketReader::SocketReader(int fd, const std::atomic<bool> *stop, uint32_t bytesPerSecond)
+    : _fd(fd), _stop(stop), _rate(bytesPerSecond), _due(0), _start(0), _end(0), _buf(256 * 1024)
+{
+  timeval tv = {0, 100000};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+
+bool SocketReader::read(void *out, size_t n)
+{
+  while (_end - _start < n)
+    if (!fill())
+      return false;
+  memcpy(out, _buf.data() + _start, n);
+  _start += n;
+  return true;
+}
+
+bool SocketReader::skip(size_t n)
+{
+  while (n)
+  {
+    if (_start == _end && !fill())
+      return false;
+    size_t k = _end - _start < n ? _end - _start : n;
+    _start += k;
+    n -= k;
+  }
+  return true;
+}
+
+bool SocketReader::until(const char *delim, std::string &out)
+{
+  size_t dlen = strlen(delim);
+  for (;;)
+  {
+    const char *base = (const char *)_buf.data();
+    const char *p = (const char *)memmem(base + _start, _end - _start, delim, dlen);
+    if (p)
+    {
+      out.assign(base + _start, p + dlen);
+      _start = p + dlen - base;
+      return true;
+    }
+    if (!fill())
+      return false;
+  }
+}
+
+bool SocketReader::fill(void)
+{
+  if (_start == _end)
+    _start = _end = 0;
+  if (_end == _buf.size())
+  {
+    memmove(_buf.data(), _buf.data() + _start, _end - _start);
+    _end -= _start;
+    _start = 0;
+  }
+  // A slow link delivers a few KB at a time, paced
+  size_t room = _buf.size() - _end;
+  if (_rate)
+  {
+    if (room > 4096)
+      room = 4096;
+    uint64_t now = now_us();
+    if (_due > now)
+      sleep_us(_due - now);
+  }
+  while (!*_stop)
+  {
+    ssize_t n = recv(_fd, _buf.data() + _end, room, 0);
+    if (n > 0)
+    {
+      _end += n;
+      if (_rate)
+        _due = (_due > now_us() ? _due : now_us()) + (uint64_t)n * 1000000 / _rate;
+      return true;
+    }
+    if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+      return false;
+  }
+  return false;
+}
@@ -0,0 +1,44 @@
+#ifndef HOST_NET_H_
+#define HOST_NET_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+// Thin POSIX socket helpers for the loopback benchmarks
+int tcp_listen(uint16_t port); // 0 picks an ephemeral port
+uint16_t tcp_local_port(int fd);
+int tcp_connect(uint16_t port);
+int tcp_accept(int fd);
+bool send_all(int fd, const void *data, size_t len);
+void tcp_close(int fd);
+
+uint64_t now_us(void); // monotonic
+void sleep_us(uint64_t us);
+
+// Buffered reads off a connected socket that give up once stop is set. A client on a slow
+// link reads at most bytesPerSecond; give it a small receive buffer (before connecting) too,
+// or the kernel soaks up what the link would have held back.
+class SocketReader
+{
+public:
+  SocketReader(int fd, const std::atomic<bool> *stop, uint32_t bytesPerSecond = 0);
+
+  bool read(void *out, size_t n);
+  bool skip(size_t n);
+  bool until(const char *delim, std::string &out); // everything up to and including delim
+
+private:
+  bool fill(void);
+
+  int _fd;
+  const std::atomic<bool> *_stop;
+  uint32_t _rate;
+  uint64_t _due; // rate limit: when the next read may happen
+  size_t _start, _end;
+  std::vector<uint8_t> _buf;
+};
+
+#endif // HOST_NET_H_
@@ -0,0 +1,17 @@
+#ifndef HOST_STATS_H_
+#define HOST_STATS_H_
+
+#include <algorithm>
+#include <vector>
+
+// p in [0, 100]; sorts the samples in place
+static inline double percentile(std::vector<double> &samples, double p)
+{
+  if (samples.empty())
+    return 0;
+  std::sort(samples.begin(), samples.end());
+  size_t i = (size_t)(p / 100.0 * (samples.size() - 1) + 0.5);
+  return samples[i];
+}
+
+#endif // HOST_STATS_H_
@@ -0,0 +1,77 @@
+// Host benchmark runner for the streaming stack: program <benchmark> [--option=value ...]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+
+struct Benchmark
+{
+  const char *name;
+  int (*run)(int argc, char **argv);
+  const char *help;
+};
+
+static const Benchmark benchmarks[] = {
+  {"replay", bench_replay, "recorded JPEG clip through OV2640, broadcaster and server (--dir --fps --viewers --seconds --fb-count --chunked)"},
+  {"broadcast", bench_broadcast, "MJPEG fan-out fps as viewers are added (--viewers --seconds --fps --size)"},
+  {"http", bench_http, "event-driven server: stream scaling and /jpg, / latency under load (--viewers --seconds --fps --size)"},
+  {"framing", bench_framing, "bytes and socket writes per MJPEG frame: legacy, gathered, chunked (--seconds --fps --size)"},
+  {"abr", bench_abr, "bitrate controller on a simulated link in virtual time (--seconds --fps --jitter --start --quality)"},
+  {"reconfig", bench_reconfig, "live preset switch time with streams attached (--viewers --switches --init-ms --fps --size)"},
+  {"snapshot", bench_snapshot, "/jpg polling latency and captures, fresh vs latest-frame cache (--poll-hz --max-age --seconds --fps --size)"},
+  {"metrics", bench_metrics, "histogram/counter record cost, bucket accuracy and a live /metrics scrape (--records --viewers --seconds)"},
+  {"motion", bench_motion, "luma extraction and detection cost over a clip, stream fps with detection on (--dir --fps --viewers --seconds --rounds)"},
+  {"notify", bench_notify, "webhook notifier against a local stand-in: post cost, coalescing, delivery latency, a 2-buffer stream while the webhook is down (--bursts --burst-size --gap-ms --coalesce --interval --fail --limit --snapshot)"},
+  {"ring", bench_ring, "event ring store rate and history held, then a triggered /clip export (--arena-kb --max-frames --size --fps --pre-ms --post-ms)"},
+  {"record", bench_record, "AVI writer MB/s per buffer size, file validation, recorder next to viewers (--dir --out --frames --fps --viewers --seconds --max-mb)"},
+  {"ota", bench_ota, "OTA upload KB/s and viewer fps vs inline flash writes, drop and resume, corrupted image (--image-kb --erase-ms --flash-kbps --viewers --drop-at)"},
+  {"delta", bench_delta, "delta OTA: patch size and generation, apply MB/s, full image vs patch over a slow link, refusals (--old --new --out --image-kb --link-kbps --erase-ms --flash-kbps)"},
+  {"oled", bench_oled, "status screen refreshes: I2C bytes and bus time, full frame vs partial page updates (--refreshes --khz --wire-buffer)"},
+  {"text", bench_text, "status screen text layout: heap operations and ns per refresh, String vs fixed buffers, output compared (--refreshes)"},
+  {"assets", bench_assets, "embedded pages: gzip sizes, bytes and modelled render time before/first/repeat visit (--rtt-ms --link-kbps --rounds)"},
+  {"pipeline", bench_pipeline, "capture and send serially vs on two threads through the frame queue: fps, stage utilisation, latency, drops (--capture-us --send-us --depth --fps --seconds --size)"},
+  {"sched", bench_sched, "housekeeping scheduler on a virtual clock: behaviour checks, a month against the Task0Code delay loop, wheel op cost (--days --ops)"},
+  {"scale", bench_scale, "compressed-domain JPEG downscaling on a clip: cost at 1/2, 1/4, 1/8 vs the entropy walk, sizes, luma error, then a scaled tier next to the full stream (--dir --rounds --quality --fps --seconds)"},
+  {"rtsp", bench_rtsp, "RTSP server next to /mjpeg on a clip: RTP/JPEG over UDP and interleaved TCP rebuilt and checked against the clip, bytes and server time per frame vs multipart (--dir --fps --seconds)"},
+  {"ws", bench_ws, "/ws against /mjpeg for glass-to-glass latency with fast and slow scripted readers, acknowledged frames in flight 1, 2, 4; handshake, ping and close checked (--fps --size --seconds --decode --viewers)"},
+  {"backpressure", bench_backpressure, "one /mjpeg viewer on a slow link next to fast viewers and a recording consumer, with and without skipping frames while its socket is backed up: fps, slow-stream latency, per-client drops (--viewers --fps --size --slow-kbps --seconds)"},
+  {"timelapse", bench_timelapse, "time-lapse store on the local filesystem: bytes per frame, synced append cost, O(1) lookup and time search as the index grows, torn-tail recovery, /timelapse.mjpeg playback unpaced and paced checked byte for byte, frames taken from a live stream with and without a framesize switch (--dir --out --frames --size --interval --play-fps --fps --takes)"},
+};
+
+const char *opt_str(int argc, char **argv, const char *name, const char *fallback)
+{
+  size_t n = strlen(name);
+  for (int i = 0; i < argc; i++)
+  {
+    const char *a = argv[i];
+    if (!strncmp(a, "--", 2) && !strncmp(a + 2, name, n) && a[2 + n] == '=')
+      return a + 3 + n;
+  }
+  return fallback;
+}
+
+long opt_int(int argc, char **argv, const char *name, long fallback)
+{
+  const char *v = opt_str(argc, argv, name, NULL);
+  return v ? strtol(v, NULL, 0) : fallback;
+}
+
+double opt_double(int argc, char **argv, const char *name, double fallback)
+{
+  const char *v = opt_str(argc, argv, name, NULL);
+  return v ? strtod(v, NULL) : fallback;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc >= 2)
+  {
+    for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++)
+      if (!strcmp(argv[1], benchmarks[i].name))
+        return benchmarks[i].run(argc - 2, argv + 2);
+  }
+  fprintf(stderr, "usage: %s <benchmark> [--option=value ...]\n", argv[0]);
+  for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++)
+    fprintf(stderr, "  %-12s %s\n", benchmarks[i].name, benchmarks[i].help);
+  return 2;
+}
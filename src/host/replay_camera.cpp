@@ -0,0 +1,219 @@
+// esp32-camera replacement for the native env: replays a directory of JPEG files
+#include <esp_camera.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "host_net.h"
+
+#define REPLAY_MAX_FB 4
+
+struct ReplayFile
+{
+  std::vector<uint8_t> data;
+  uint16_t width;
+  uint16_t height;
+};
+
+static std::vector<ReplayFile> files;
+static double replayFps = 25;
+static bool replayLoop = true;
+static size_t nextFile = 0;
+static uint64_t dueUs = 0;
+
+static std::mutex replayLock;
+static std::condition_variable returned;
+static camera_fb_t fbs[REPLAY_MAX_FB];
+static bool fbBusy[REPLAY_MAX_FB];
+static size_t fbCount = 0;
+static bool initialised = false;
+static sensor_t sensor;
+
+// Width and height from the first SOFn marker
+static void jpeg_dimensions(const std::vector<uint8_t> &d, uint16_t &w, uint16_t &h)
+{
+  w = h = 0;
+  size_t i = 2;
+  while (i + 9 < d.size())
+  {
+    if (d[i] != 0xFF)
+    {
+      i++;
+      continue;
+    }
+    uint8_t marker = d[i + 1];
+    if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+    {
+      h = (d[i + 5] << 8) | d[i + 6];
+      w = (d[i + 7] << 8) | d[i + 8];
+      return;
+    }
+    if (marker == 0xD8 || marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7) || marker == 0xFF)
+    {
+      i += (marker == 0xFF) ? 1 : 2;
+      continue;
+    }
+    i += 2 + ((d[i + 2] << 8) | d[i + 3]);
+  }
+}
+
+static bool load_file(const std::string &path, ReplayFile &f)
+{
+  FILE *fp = fopen(path.c_str(), "rb");
+  if (!fp)
+    return false;
+  fseek(fp, 0, SEEK_END);
+  long size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  f.data.resize(size > 0 ? size : 0);
+  bool ok = size > 4 && fread(f.data.data(), 1, size, fp) == (size_t)size && f.data[0] == 0xFF && f.data[1] == 0xD8;
+  fclose(fp);
+  if (ok)
+    jpeg_dimensions(f.data, f.width, f.height);
+  return ok;
+}
+
+bool replay_camera_open(const char *dir, double fps, bool loop)
+{
+  DIR *d = opendir(dir);
+  if (!d)
+    return false;
+  std::vector<std::string> names;
+  for (struct dirent *e; (e = readdir(d));)
+  {
+    const char *ext = strrchr(e->d_name, '.');
+    if (ext && (!strcasecmp(ext, ".jpg") || !strcasecmp(ext, ".jpeg")))
+      names.push_back(e->d_name);
+  }
+  closedir(d);
+  std::sort(names.begin(), names.end());
+
+  std::lock_guard<std::mutex> guard(replayLock);
+  files.clear();
+  for (size_t i = 0; i < names.size(); i++)
+  {
+    ReplayFile f;
+    if (load_file(std::string(dir) + "/" + names[i], f))
+      files.push_back(f);
+  }
+  replayFps = fps;
+  replayLoop = loop;
+  nextFile = 0;
+  dueUs = 0;
+  return !files.empty();
+}
+
+uint32_t replay_camera_files(void)
+{
+  return files.size();
+}
+
+uint64_t replay_camera_bytes(void)
+{
+  uint64_t total = 0;
+  for (size_t i = 0; i < files.size(); i++)
+    total += files[i].data.size();
+  return total;
+}
+
+bool replay_camera_finished(void)
+{
+  std::lock_guard<std::mutex> guard(replayLock);
+  return !replayLoop && nextFile >= files.size();
+}
+
+static int set_framesize(sensor_t *s, framesize_t framesize)
+{
+  s->framesize = framesize;
+  return 0;
+}
+
+static int set_quality(sensor_t *s, int quality)
+{
+  s->quality = quality;
+  return 0;
+}
+
+esp_err_t esp_camera_init(const camera_config_t *config)
+{
+  std::lock_guard<std::mutex> guard(replayLock);
+  if (files.empty())
+    return ESP_ERR_NOT_FOUND;
+  if (initialised)
+    return ESP_ERR_INVALID_STATE;
+  if (config->pixel_format != PIXFORMAT_JPEG || config->fb_count < 1 || config->fb_count > REPLAY_MAX_FB)
+    return ESP_ERR_INVALID_ARG;
+  fbCount = config->fb_count;
+  for (size_t i = 0; i < REPLAY_MAX_FB; i++)
+    fbBusy[i] = false;
+  sensor.framesize = config->frame_size;
+  sensor.quality = config->jpeg_quality;
+  sensor.set_framesize = set_framesize;
+  sensor.set_quality = set_quality;
+  initialised = true;
+  return ESP_OK;
+}
+
+esp_err_t esp_camera_deinit(void)
+{
+  std::lock_guard<std::mutex> guard(replayLock);
+  initialised = false;
+  returned.notify_all();
+  return ESP_OK;
+}
+
+camera_fb_t *esp_camera_fb_get(void)
+{
+  // Sensor pacing first, like the driver waiting for the next VSYNC
+  uint64_t now = now_us();
+  uint64_t interval = replayFps > 0 ? (uint64_t)(1e6 / replayFps) : 0;
+  if (dueUs > now)
+    sleep_us(dueUs - now);
+  dueUs = (dueUs > now ? dueUs : now) + interval;
+
+  std::unique_lock<std::mutex> guard(replayLock);
+  size_t slot = 0;
+  for (;;)
+  {
+    if (!initialised || (!replayLoop && nextFile >= files.size()))
+      return NULL;
+    for (slot = 0; slot < fbCount && fbBusy[slot]; slot++)
+      ;
+    if (slot < fbCount)
+      break;
+    returned.wait(guard);
+  }
+  const ReplayFile &f = files[nextFile % files.size()];
+  nextFile = replayLoop ? (nextFile + 1) % files.size() : nextFile + 1;
+
+  camera_fb_t &fb = fbs[slot];
+  fbBusy[slot] = true;
+  fb.buf = (uint8_t *)f.data.data(); // the clip stays loaded, no copy needed
+  fb.len = f.data.size();
+  fb.width = f.width;
+  fb.height = f.height;
+  fb.format = PIXFORMAT_JPEG;
+  uint64_t ts = now_us();
+  fb.timestamp.tv_sec = ts / 1000000;
+  fb.timestamp.tv_usec = ts % 1000000;
+  return &fb;
+}
+
+void esp_camera_fb_return(camera_fb_t *fb)
+{
+  std::lock_guard<std::mutex> guard(replayLock);
+  size_t slot = fb - fbs;
+  if (slot < REPLAY_MAX_FB)
+    fbBusy[slot] = false;
+  returned.notify_all();
+}
+
+sensor_t *esp_camera_sensor_get(void)
+{
+  return initialised ? &sensor : NULL;
+}
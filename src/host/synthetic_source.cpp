@@ -0,0 +1,66 @@
+#include "synthetic_source.h"
+#include "host_net.h"
+#include <string.h>
+
+SyntheticSource::SyntheticSource(size_t frameSize, double fps, bool stamped, unsigned buffers) : _pool(release, this)
+{
+  if (frameSize < 12)
+    frameSize = 12;
+  _buffers = buffers < 1 ? 1 : buffers > SYNTHETIC_BUFFERS ? SYNTHETIC_BUFFERS : buffers;
+  for (unsigned i = 0; i < SYNTHETIC_BUFFERS; i++)
+  {
+    std::vector<uint8_t> &f = _frames[i];
+    f.resize(frameSize);
+    for (size_t j = 0; j < frameSize; j++)
+      f[j] = (uint8_t)(j * 31 + i); // never produces the multipart boundary
+    f[0] = 0xFF; f[1] = 0xD8;                         // SOI
+    f[frameSize - 2] = 0xFF; f[frameSize - 1] = 0xD9; // EOI
+    _busy[i] = false;
+  }
+  _interval_us = fps > 0 ? (uint64_t)(1000000.0 / fps) : 0;
+  _due_us = 0;
+  _stamped = stamped;
+}
+
+FrameRef SyntheticSource::capture(void)
+{
+  uint64_t now = now_us();
+  if (_due_us > now)
+    sleep_us(_due_us - now);
+  _due_us = (_due_us > now ? _due_us : now) + _interval_us;
+
+  unsigned i = 0;
+  {
+    std::unique_lock<std::mutex> guard(_lock);
+    for (;;)
+    {
+      for (i = 0; i < _buffers && _busy[i]; i++)
+        ;
+      if (i < _buffers)
+        break;
+      _returned.wait(guard);
+    }
+    _busy[i] = true;
+  }
+  std::vector<uint8_t> &f = _frames[i];
+  uint64_t ts = now_us();
+  if (_stamped)
+    memcpy(f.data() + 2, &ts, sizeof(ts));
+  return _pool.wrap(f.data(), f.size(), 640, 480, ts, &_busy[i]);
+}
+
+uint64_t SyntheticSource::stamp(const uint8_t *frame, size_t len)
+{
+  uint64_t ts = 0;
+  if (len >= 2 + sizeof(ts))
+    memcpy(&ts, frame + 2, sizeof(ts));
+  return ts;
+}
+
+void SyntheticSource::release(void *ctx, void *opaque)
+{
+  SyntheticSource *self = (SyntheticSource *)ctx;
+  std::lock_guard<std::mutex> guard(self->_lock);
+  *(bool *)opaque = false;
+  self->_returned.notify_all();
+}
@@ -0,0 +1,38 @@
+#ifndef SYNTHETIC_SOURCE_H_
+#define SYNTHETIC_SOURCE_H_
+
+#include <FrameRef.h>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+#define SYNTHETIC_BUFFERS 3 // default and most; the device streams with fb_count 2
+
+// Stands in for the sensor: fixed-size JPEG-shaped frames paced at a target rate. Like the
+// driver it owns a small set of buffers and blocks in capture() while all of them are out.
+// stamped frames carry their capture time (now_us()) in bytes 2..9, for clients that measure
+// latency on streams without per-frame metadata. buffers is capped at SYNTHETIC_BUFFERS.
+class SyntheticSource : public FrameSource
+{
+public:
+  SyntheticSource(size_t frameSize, double fps, bool stamped = false, unsigned buffers = SYNTHETIC_BUFFERS);
+  FrameRef capture(void);
+  bool drain(uint32_t timeout_ms) { return _pool.drain(timeout_ms); }
+  // Capture time of a stamped frame as a client received it, 0 when it is too short
+  static uint64_t stamp(const uint8_t *frame, size_t len);
+
+private:
+  static void release(void *ctx, void *opaque);
+
+  std::vector<uint8_t> _frames[SYNTHETIC_BUFFERS];
+  bool _busy[SYNTHETIC_BUFFERS];
+  unsigned _buffers;
+  std::mutex _lock;
+  std::condition_variable _returned;
+  uint64_t _interval_us;
+  uint64_t _due_us;
+  bool _stamped;
+  FramePool _pool;
+};
+
+#endif // SYNTHETIC_SOURCE_H_
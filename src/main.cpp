@@ -2,17 +2,37 @@
 #include <Arduino.h>
 #include <WiFi.h>
 #include <WiFiClient.h>
-#include <WebServer.h>
+#include <EventServer.h>
 #include <ESPmDNS.h>
 #include <HTTPClient.h>
+#include <Preferences.h>
+#include <atomic>
 // Camera libraries
 #include <OV2640.h>
 #include <MJPEG_Streaming.h>
+#include <MJPEGBroadcaster.h>
+#include <MJPEGStreamer.h>
+#include <WebSocketStreamer.h>
+#include <AdaptiveBitrate.h>
+#include <PipelineMetrics.h>
+#include <MotionMonitor.h>
+#include <Notifier.h>
+#include <EventClip.h>
+#include <Recorder.h>
+#include <Timelapse.h>
+#include <Scheduler.h>
+#include <ScaledSource.h>
+#include <RtspServer.h>
 // #include "soc/soc.h" //disable brownout problems
 // #include "soc/rtc_cntl_reg.h"  //disable brownout problems
 // OTA update libraries
 #include <Update.h>
-#include <OTA.h> // default login is admin:admin
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include <OtaSession.h>
+#include <DeltaPatch.h>
+// Login, update and dashboard pages, gzipped from web/ at build time (default login is admin:admin)
+#include <WebAssets.h>
 // SSD1306 Libraries
 #include <SPI.h>
 #include <Wire.h>
@@ -30,8 +50,19 @@
 #define SDA           15 // SDA Pin
 #define SCL           14 // SCL Pin
 
+// Recording to the SD slot in 1-bit mode (GPIO 2, 14, 15). The slot shares GPIO 14/15 with the
+// OLED wiring above, so move the display to other pins before enabling this.
+// #define SD_RECORDING
+#ifdef SD_RECORDING
+  #include <SD_MMC.h>
+  #define RECORD_DIR "/sdcard/rec"
+  #define TIMELAPSE_DIR "/sdcard/timelapse"
+#endif
+
 // I2C connection with SSD1306
 Adafruit_SSD1306 display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, OLED_RESET);
+// Refreshes go out as partial page updates of what changed, on the same bus
+WireOledBus oledBus(Wire, 0x3C);
 
 // Uncomment to turn serial output into a yapper
 #define DEBUG
@@ -46,12 +77,20 @@ Adafruit_SSD1306 display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, OLED_RESET);
 // Secret header file
 #include <secret.h>
 
-// Reset-surviving definition for camera resolution, potentially to be shifted to an SD card/EEPROM instead
-// TODO: Add function to control this using a dropdown on a web page
-RTC_NOINIT_ATTR uint8_t qualityPreset = 8; // default = VGA
+// Camera preset, changed live through /reconfig (or the /dash page) and persisted to NVS
+struct CameraPreset
+{
+  uint8_t framesize; // framesize_t
+  uint8_t quality;   // jpeg_quality, 0-63 (lower is better)
+  uint8_t fbCount;
+};
+CameraPreset preset = {FRAMESIZE_VGA, 12, 2}; // default until a stored preset is loaded
+Preferences prefs;
 /*
-  Possible values (lowest to highest resolution possible, corresponding to the enum framesize_t:
+  Possible framesize values (lowest to highest resolution possible, corresponding to the enum framesize_t:
     5  FRAMESIZE_QVGA,     // 320x240
+    6  FRAMESIZE_CIF,      // 400x296
+    7  FRAMESIZE_HVGA,     // 480x320
     8  FRAMESIZE_VGA,      // 640x480
     9  FRAMESIZE_SVGA,     // 800x600
     10 FRAMESIZE_XGA,      // 1024x768
@@ -61,19 +100,24 @@ RTC_NOINIT_ATTR uint8_t qualityPreset = 8; // default = VGA
 */
 
 
-// Uptime counter (TODO: Upgrade to a web synced clock)
-uint8_t uptimeHours = 0;
-uint16_t uptimeDays = 0;
-unsigned long prevMillis;
-
-// Client counter
+// Client counter (mirrors the broadcaster's count for the OLED)
 uint8_t clientCount = 0;
 
 // Wifi status code
 // uint8_t wifiStatus = 0;
 
-// Task running on same core as system tasks for future additions
-TaskHandle_t Task0;
+// Periodic and one-shot housekeeping, one task on core 0 sleeping until the next deadline
+// (program sched: jitter and overruns on a virtual clock)
+Scheduler housekeeping;
+TaskHandle_t HousekeepingTask;
+#define OLED_REFRESH_MS   30000
+#define UTIL_SAMPLE_MS    5000
+#define WIFI_CHECK_MS     10000
+#define WIFI_RECONNECT_MS 30000 // disconnected this long before reconnect() is asked for
+// Stage utilisation over the last sample window, written by the housekeeping task
+std::atomic<uint16_t> captureUtilPermille(0);
+std::atomic<uint16_t> transmitUtilPermille(0);
+Counter wifiReconnects;
 
 // Hostname for MDNS responder
 const char* host = "esp32cam";
@@ -81,8 +125,172 @@ const char* host = "esp32cam";
 // Camera object
 OV2640 cam;
 
-// Common webserver for both OTA updates and camera access
-WebServer server(80);
+// Single capture producer shared by every MJPEG client and still request
+MJPEGBroadcaster broadcaster(cam);
+TaskHandle_t CaptureTask;
+// Capture on core 0 hands frames to the event loop on core 1 through this queue. One frame:
+// the newest replaces one still waiting, a deeper queue only holds more of the driver's
+// buffers and adds latency (program pipeline --depth=2)
+FrameQueue frameQueue(1);
+// /jpg answers from the latest frame while it is younger than this (override with ?max_age=ms,
+// up to JPG_MAX_AGE_LIMIT_MS)
+#define JPG_MAX_AGE_MS 250
+#define JPG_MAX_AGE_LIMIT_MS 60000
+
+// Adaptive bitrate: frame rate the controller tries to hold for the slowest viewer
+#define ABR_TARGET_FPS 15
+#define ABR_WINDOW_MS  2000
+// Ladder from best to cheapest; the controller never climbs above the preset's framesize,
+// nor streams at a better quality than the preset's
+const AbrLevel abrLadder[] = {
+  {FRAMESIZE_UXGA, 12}, {FRAMESIZE_SXGA, 12}, {FRAMESIZE_HD, 12}, {FRAMESIZE_XGA, 12},
+  {FRAMESIZE_SVGA, 12}, {FRAMESIZE_SVGA, 18}, {FRAMESIZE_VGA, 12}, {FRAMESIZE_VGA, 18},
+  {FRAMESIZE_VGA, 25},  {FRAMESIZE_HVGA, 15}, {FRAMESIZE_QVGA, 12}, {FRAMESIZE_QVGA, 20}
+};
+AdaptiveBitrate abr(abrLadder, sizeof(abrLadder) / sizeof(abrLadder[0]));
+
+// Feeds every full-size stream's per-frame wire cost into the controller; a viewer on a
+// scaled tier chose the cheap stream and does not get to lower everyone else's
+class BitrateObserver : public StreamObserver
+{
+public:
+  void frameSent(const void *stream, size_t bytes, uint32_t busy_us)
+  {
+    if (&((const MJPEGStreamer *)stream)->broadcaster() == &broadcaster)
+      abr.frameSent(stream, bytes, busy_us);
+  }
+  void streamClosed(const void *stream) { abr.clientGone(stream); }
+};
+BitrateObserver bitrateObserver;
+
+// Scaled tiers cut from the captured frames in the compressed domain (program scale): half
+// size for /mjpeg?tier=low, a quarter for /thumb. Each has its own producer on core 0 that
+// only runs while the tier has clients; buffers in PSRAM, sized for a UXGA capture's scale
+#define TIER_LOW_BYTES   (48 * 1024)
+#define TIER_THUMB_BYTES (16 * 1024)
+ScaledSource lowSource(broadcaster, 1);
+MJPEGBroadcaster lowTier(lowSource);
+TaskHandle_t LowTierTask = NULL;
+ScaledSource thumbSource(broadcaster, 2);
+MJPEGBroadcaster thumbTier(thumbSource);
+TaskHandle_t ThumbTierTask = NULL;
+
+// Software motion detection on the frames being captured anyway, on core 0 next to housekeeping
+#define MOTION_COOLDOWN_MS 30000 // at most one notification per this long
+MotionMonitor motion(broadcaster);
+TaskHandle_t MotionTask;
+
+// Webhook POSTs, made from the notifier's worker task
+class WebhookTransport : public NotifyTransport
+{
+public:
+  int post(const char *contentType, const std::string &body, uint32_t *retryAfter_ms);
+};
+WebhookTransport webhook;
+// Interrupts and the motion task only queue events, the worker batches and delivers them
+Notifier notifier(webhook);
+TaskHandle_t NotifyTask;
+
+// The last few seconds of frames in PSRAM; every event batch cuts a clip from it for /clip
+FrameRing eventRing;
+ClipRecorder clipRecorder(broadcaster, eventRing);
+TaskHandle_t ClipTask = NULL;
+
+#ifdef SD_RECORDING
+// AVI recording: a feeder copies frames into a PSRAM queue, a writer drains it to the card
+Recorder recorder(broadcaster);
+TaskHandle_t RecordFeedTask;
+TaskHandle_t RecordWriteTask;
+
+// Time-lapse: one frame per interval into an append-only store on the card, taken on a task of
+// its own when the housekeeping job says it is due, played back by time at /timelapse.mjpeg
+// (program timelapse). Frames can have a framesize of their own, up to the preset's.
+#define TIMELAPSE_PLAY_FPS     10
+#define TIMELAPSE_MAX_FPS      30
+#define TIMELAPSE_MAX_INTERVAL 86400
+struct TimelapseConfig
+{
+  uint32_t interval_s;
+  uint8_t framesize; // framesize_t, 0 takes frames as streamed
+  uint8_t active;
+};
+TimelapseConfig timelapseConfig = {30, 0, 0}; // persisted to NVS, so a time-lapse survives restarts
+TimelapseStore timelapseStore;
+Timelapse timelapse(broadcaster, cam, timelapseStore);
+TaskHandle_t TimelapseTask = NULL;
+SchedId timelapseJob = 0;
+#endif
+
+// Common event-driven webserver for both OTA updates and camera access
+HttpServer server;
+
+// RTSP for recorders that ingest it natively: the same frames as /mjpeg, as RTP/JPEG over UDP
+// or interleaved in the RTSP connection (program rtsp). Its own loop, also on core 1
+#define RTSP_RTP_PORT 6970 // RTP, RTCP on the port above
+RtspServer rtsp(broadcaster);
+TaskHandle_t RtspTask = NULL;
+
+// Firmware images go through Arduino's Update class, from a writer task of their own
+class UpdateTarget : public OtaTarget
+{
+public:
+  bool begin(size_t size) { return Update.begin(size ? size : UPDATE_SIZE_UNKNOWN); }
+  bool write(const uint8_t *data, size_t len) { return Update.write((uint8_t *)data, len) == len; }
+  bool end(void) { return Update.end(true); }
+  void abort(void) { Update.abort(); }
+  const char *error(void) { return Update.errorString(); }
+};
+UpdateTarget updateTarget;
+// The app partition we booted from, the base delta patches are built against
+class RunningImage : public OtaSource
+{
+public:
+  size_t size(void) { return esp_ota_get_running_partition()->size; }
+  bool read(size_t offset, uint8_t *buf, size_t len)
+  {
+    return esp_partition_read(esp_ota_get_running_partition(), offset, buf, len) == ESP_OK;
+  }
+};
+RunningImage runningImage;
+// Full images pass straight to Update, patches are rebuilt against the running image on the way
+DeltaTarget deltaTarget(updateTarget, runningImage);
+// Uploads only copy into its buffer on the event loop, so streams keep going during an update
+OtaSession ota(deltaTarget);
+TaskHandle_t OtaTask;
+
+// Once an image is verified, the restart waits this long so the reply can leave
+#define UPDATE_RESTART_MS 1000
+
+// A /reconfig request, run on the capture task between two frames. Shared by the task and
+// the pending HTTP reply, whichever lets go last frees it.
+#define RECONFIG_DRAIN_MS 1000
+struct ReconfigJob
+{
+  CameraPreset preset;
+  uint64_t requested; // esp_timer_get_time() when the request came in
+  uint32_t drainMs;
+  uint32_t applyMs;
+  uint32_t totalMs;
+  bool reinit;
+  bool persisted;
+  esp_err_t err;
+  std::atomic<bool> done;
+  std::atomic<uint8_t> refs;
+};
+
+// Holds the /reconfig response until the switch is over
+class ReconfigReply : public Streamer
+{
+public:
+  ReconfigReply(ReconfigJob *job) : _job(job), _sent(false) {}
+  ~ReconfigReply();
+  bool ready(void) { return _sent || _job->done; }
+  bool pump(HttpConnection &conn);
+
+private:
+  ReconfigJob *_job;
+  bool _sent;
+};
 
 //////////////////////////
 // Function definitions //
@@ -95,30 +303,75 @@ void LED_indicate(int code);
 // void IRAM_ATTR softRestart(); // (simple test function, can be used for more reasonable actions)
 
 // Sensor trigger function(s)
-// void IRAM_ATTR postNotification(); // Current posts to a discord webhook, can do anything though
+void IRAM_ATTR sensorTriggered(); // Queues a webhook notification (currently a discord webhook, can do anything though)
+
+// Notifications and motion detection
+void notify_task(void * pvParameters);
+bool notify_snapshot(FrameRef &out, void * ctx);
+void motion_task(void * pvParameters);
+void motion_detected(const MotionResult &result, void * ctx);
+void clip_task(void * pvParameters);
+#ifdef SD_RECORDING
+void record_feed_task(void * pvParameters);
+void record_write_task(void * pvParameters);
+void report_recording(HttpConnection &conn);
+void modify_recording(HttpConnection &conn);
+void timelapse_task(void * pvParameters);
+void timelapse_due(void * ctx);
+void switch_timelapse(bool on, void * ctx);
+void apply_timelapse(void);
+void load_timelapse(void);
+bool save_timelapse(void);
+void report_timelapse(HttpConnection &conn);
+void modify_timelapse(HttpConnection &conn);
+void handle_timelapse(HttpConnection &conn);
+#endif
 
 // Web Server handler/render functions
-void handleNotFound();
+void handleNotFound(HttpConnection &conn);
+void serve_asset(HttpConnection &conn);
 
 // OTA Updates
 
-void render_login_page(void);
-void render_update_page(void);
-void perform_update(void);
-void finish_update(void);
+void perform_update(HttpConnection &conn, const Upload &upload);
+void finish_update(HttpConnection &conn);
+void ota_task(void * pvParameters);
+void check_update(void);
 
 // MJPEG Streaming
 
-camera_config_t camera_config_helper(uint8_t qualityPreset); // Mode variable: 0 = photo, 1 = video
-void handle_jpg(void);
-void handle_jpg_stream(void);
+camera_config_t camera_config_helper(const CameraPreset &p);
+void handle_jpg(HttpConnection &conn);
+void handle_jpg_stream(HttpConnection &conn);
+void handle_ws(HttpConnection &conn);
+void handle_thumb(HttpConnection &conn);
+void tier_task(void * pvParameters);
+void handle_metrics(HttpConnection &conn);
+void handle_clip(HttpConnection &conn);
+void capture_task(void * pvParameters);
+void wake_server(void * ctx);
+void wake_streams(void * ctx);
+void rtsp_task(void * pvParameters);
+void apply_stream_level(const AbrLevel &level, void * ctx);
+void setup_bitrate_control(const CameraPreset &p);
+void align_bitrate_control(const CameraPreset &p);
 
-// Skeleton code for on-the-fly quality and resolution tweaking
-// void render_dashboard(void);
-// void modify_config(void);
+// On-the-fly quality and resolution changes
+void report_config(HttpConnection &conn);
+void modify_config(HttpConnection &conn);
+void run_reconfig(void * ctx);
+void release_reconfig(ReconfigJob *job);
+bool parse_number(const char *text, long lo, long hi, long &out);
+bool preset_valid(const CameraPreset &p);
+void load_preset(void);
+bool save_preset(const CameraPreset &p);
 
-// Hand smaller tasks to the system core
-void Task0Code(void * pvParameters);
+// Housekeeping jobs, all run by the one task on the system core
+void housekeeping_task(void * pvParameters);
+void refresh_oled(void * ctx);
+void sample_utilisation(void * ctx);
+void check_wifi(void * ctx);
+void restart_now(void * ctx);
 
 //////////////////////////
 //         Setup        //
@@ -142,7 +395,7 @@ void setup(void)
   // Define pin mode(s) for sensors and assign an interrupt function to them
   #ifdef SENSOR1
   pinMode(SENSOR1, INPUT);
-  attachInterrupt(SENSOR1, postNotification, CHANGE);
+  attachInterrupt(SENSOR1, sensorTriggered, CHANGE);
   #endif
 
   // initialize OLED display with I2C address 0x3C
@@ -158,7 +411,8 @@ void setup(void)
 
   delay(1000); // Breathing room
 
-  if (!cam.init(camera_config_helper(qualityPreset)))
+  load_preset();
+  if (cam.init(camera_config_helper(preset)) != ESP_OK)
   {
     #ifdef DEBUG
       Serial.println("Camera failed to initialize.");
@@ -181,6 +435,8 @@ void setup(void)
     delay(500);
   }
   // wifiStatus = 1;
+  // Wall clock (UTC) for Last-Modified and time-lapse frame times
+  configTime(0, 0, "pool.ntp.org");
   LED_indicate(0);
   #ifdef DEBUG
     Serial.println();
@@ -195,25 +451,115 @@ void setup(void)
 
   server.onNotFound(handleNotFound);
   // OTA Update pages (login on index, upload page upon login, update page upon upload)
-  server.on("/", HTTP_GET, render_login_page);
-  server.on("/serverIndex", HTTP_GET, render_update_page);
-  server.on("/update", HTTP_POST, finish_update, perform_update);
+  server.on("/", METHOD_GET, serve_asset);
+  server.on("/serverIndex", METHOD_GET, serve_asset);
+  server.on("/update", METHOD_POST, finish_update, perform_update);
+  // Resumable, SHA-256 verified uploads (POST /ota?size=N&sha256=HEX[&offset=K], raw body) and progress.
+  // /update and /ota take a full image or a delta patch against the running one (program delta --out=).
+  server.on("/ota", METHOD_GET, finish_update);
+  server.on("/ota", METHOD_POST, finish_update, perform_update);
   // On-the-fly quality and config updates
-  // server.on("/dash", HTTP_GET, render_dashboard);
-  // server.on("/reconfig", HTTP_POST, modify_config);
+  server.on("/dash", METHOD_GET, serve_asset);
+  server.on("/reconfig", METHOD_GET, report_config);
+  server.on("/reconfig", METHOD_POST, modify_config);
   // MJPEG Streaming Server pages (Stream and Still)
-  server.on("/mjpeg", HTTP_GET, handle_jpg_stream);
-  server.on("/jpg", HTTP_GET, handle_jpg);
-
-  //create a task that will be executed in the Task1code() function, with priority 1 and executed on core 0
-  xTaskCreatePinnedToCore(
-                    Task0Code,   /* Task function. */
-                    "Task0",     /* name of task. */
-                    10000,       /* Stack size of task */
-                    NULL,        /* parameter of the task */
-                    1,           /* priority of the task */
-                    &Task0,      /* Task handle to keep track of created task */
-                    0);          /* pin task to core 0 */                  
+  server.on("/mjpeg", METHOD_GET, handle_jpg_stream);
+  server.on("/jpg", METHOD_GET, handle_jpg);
+  server.on("/thumb", METHOD_GET, handle_thumb);
+  // Frames as binary WebSocket messages, acknowledged by the client (?inflight=N, ?tier=low)
+  server.on("/ws", METHOD_GET, handle_ws);
+  // Pre/post-event clip as MJPEG (?trigger=1 cuts one now, ?pace=0 skips real-time pacing)
+  server.on("/clip", METHOD_GET, handle_clip);
+  #ifdef SD_RECORDING
+  // Recording control (POST /record?on=1 or ?on=0) and status
+  server.on("/record", METHOD_GET, report_recording);
+  server.on("/record", METHOD_POST, modify_recording);
+  // Time-lapse control (POST /timelapse?on=1&interval=30&framesize=10, ?clear=1) and status, and
+  // playback by unix time (/timelapse.mjpeg?from=&to=&fps=, fps=0 as fast as the link allows)
+  server.on("/timelapse", METHOD_GET, report_timelapse);
+  server.on("/timelapse", METHOD_POST, modify_timelapse);
+  server.on("/timelapse.mjpeg", METHOD_GET, handle_timelapse);
+  #endif
+  // Prometheus scrape target
+  server.on("/metrics", METHOD_GET, handle_metrics);
+  // New frames wake the event loop so streams go out without waiting for a poll timeout
+  broadcaster.onPublish(wake_streams, NULL);
+  broadcaster.pipeline(&frameQueue);
+  // Keep the last frame around for polling /jpg clients even without a stream
+  broadcaster.retain(JPG_MAX_AGE_MS);
+  setup_bitrate_control(preset);
+
+  // Screen, utilisation and WiFi jobs stay in phase with boot; the screen is drawn below first
+  housekeeping.every("oled", OLED_REFRESH_MS, refresh_oled, NULL, OLED_REFRESH_MS);
+  housekeeping.every("util", UTIL_SAMPLE_MS, sample_utilisation, NULL, UTIL_SAMPLE_MS);
+  housekeeping.every("wifi", WIFI_CHECK_MS, check_wifi, NULL, WIFI_CHECK_MS);
+  xTaskCreatePinnedToCore(housekeeping_task, "Housekeeping", 10000, NULL, 1, &HousekeepingTask, 0);
+  // Flash writes for OTA; each 4 KB chunk stalls the caches briefly, never the event loop
+  if (ota.begin())
+  {
+    ota.onChange(wake_server, NULL);
+    xTaskCreatePinnedToCore(ota_task, "OTA", 4096, NULL, 1, &OtaTask, 0);
+  }
+  // Single capture producer, idles until the first client attaches. On core 0 next to the
+  // camera driver's own task, so core 1 is left to the event loop sending the frames
+  xTaskCreatePinnedToCore(capture_task, "Capture", 4096, NULL, 2, &CaptureTask, 0);
+  // Scaled tiers, readers of the broadcaster like any other; the sensor is only counted once
+  if (lowSource.begin(TIER_LOW_BYTES) && thumbSource.begin(TIER_THUMB_BYTES))
+  {
+    lowTier.countCaptures(false);
+    lowTier.onPublish(wake_server, NULL);
+    thumbTier.countCaptures(false);
+    thumbTier.onPublish(wake_server, NULL);
+    thumbTier.retain(JPG_MAX_AGE_MS);
+    xTaskCreatePinnedToCore(tier_task, "LowTier", 4096, &lowTier, 1, &LowTierTask, 0);
+    xTaskCreatePinnedToCore(tier_task, "ThumbTier", 4096, &thumbTier, 1, &ThumbTierTask, 0);
+  }
+  #ifdef DEBUG
+  else
+    Serial.println("No PSRAM for the scaled tiers, /thumb and tier=low disabled.");
+  #endif
+  // Webhook worker next to the other housekeeping on core 0, HTTPClient wants a roomy stack
+  notifier.setName(host);
+  notifier.onSnapshot(notify_snapshot, NULL);
+  xTaskCreatePinnedToCore(notify_task, "Notify", 8192, NULL, 1, &NotifyTask, 0);
+  // Motion detection counts as a client, so the producer keeps capturing with nobody watching
+  motion.setCooldown(MOTION_COOLDOWN_MS);
+  motion.onMotion(motion_detected, NULL);
+  xTaskCreatePinnedToCore(motion_task, "Motion", 4096, NULL, 1, &MotionTask, 0);
+  // Event ring, another broadcaster reader on core 0; clip frames wake the server for /clip
+  if (eventRing.begin(RING_ARENA_BYTES, RING_MAX_FRAMES))
+  {
+    eventRing.onClipFrame(wake_server, NULL);
+    xTaskCreatePinnedToCore(clip_task, "Clip", 4096, NULL, 1, &ClipTask, 0);
+  }
+  #ifdef DEBUG
+  else
+    Serial.println("No PSRAM for the event ring, clips disabled.");
+  #endif
+  #ifdef SD_RECORDING
+  // Card writes get a task of their own so a slow card only ever backs up the queue
+  bool card = SD_MMC.begin("/sdcard", true);
+  if (card && recorder.begin(RECORD_DIR))
+  {
+    xTaskCreatePinnedToCore(record_feed_task, "RecFeed", 4096, NULL, 1, &RecordFeedTask, 0);
+    xTaskCreatePinnedToCore(record_write_task, "RecWrite", 6144, NULL, 1, &RecordWriteTask, 0);
+  }
+  #ifdef DEBUG
+  else
+    Serial.println("SD card not mounted, recording disabled.");
+  #endif
+  // Same for time-lapse frames; a stored schedule picks up where it was before the restart
+  if (card && timelapseStore.open(TIMELAPSE_DIR) && timelapse.begin())
+  {
+    xTaskCreatePinnedToCore(timelapse_task, "Timelapse", 4096, NULL, 1, &TimelapseTask, 0);
+    load_timelapse();
+    apply_timelapse();
+  }
+  #ifdef DEBUG
+  else
+    Serial.println("No SD card or PSRAM for the time-lapse store, time-lapse disabled.");
+  #endif
+  #endif
   delay(500);
   #ifdef DEBUG
     Serial.println("Setup complete.");
@@ -229,17 +575,29 @@ void setup(void)
   display.clearDisplay(); // clear display
   display.setTextColor(WHITE);
   // Push the screen constants to the custom OLED library
-  initializeDisplay(SCREEN_WIDTH, SCREEN_HEIGHT, MAX_CHARS);
+  initializeDisplay(SCREEN_WIDTH, SCREEN_HEIGHT, MAX_CHARS, &oledBus);
   // Render the static and dynamic parts of the display
-  renderStaticProperties(display, qualityPreset, host);
-  updateStats(display, clientCount, uptimeHours, uptimeDays, WiFi.status() == WL_CONNECTED);
+  renderStaticProperties(display, preset.framesize, host);
+  updateStats(display, clientCount, 0, 0, WiFi.status() == WL_CONNECTED);
   #ifdef DEBUG
     Serial.println("SSD1306 initial rendering complete.");
   #endif
 
   delay(1000); // Breathing room
 
-  server.begin();
+  if (!server.begin(80))
+  {
+    #ifdef DEBUG
+      Serial.println("Failed to open the HTTP listening socket.");
+    #endif
+    LED_indicate(1);
+  }
+  if (rtsp.begin(RTSP_PORT, RTSP_RTP_PORT))
+    xTaskCreatePinnedToCore(rtsp_task, "RTSP", 4096, NULL, 1, &RtspTask, 1);
+  #ifdef DEBUG
+  else
+    Serial.println("Failed to open the RTSP listening socket.");
+  #endif
   #ifdef DEBUG
     Serial.println("Server configured and ready for requests.");
   #endif
@@ -249,164 +607,372 @@ void setup(void)
 // Function Definitions //
 //////////////////////////
 
-void Task0Code(void * pvParameters)
+void housekeeping_task(void * pvParameters)
 {
-  // Every 1h update the hours (and days) counters
-  unsigned long timeDiff = millis() - prevMillis;
-  if (timeDiff >= 3600000)
+  housekeeping.run();
+  vTaskDelete(NULL);
+}
+
+void refresh_oled(void * ctx)
+{
+  // Derived from the clock on every refresh, so late or skipped runs never lose uptime
+  uint32_t hours = esp_timer_get_time() / 3600000000ULL;
+  uint8_t attached = broadcaster.clientCount();
+  uint8_t readers = ClipTask ? 2 : 1; // the motion detector and the clip recorder
+  #ifdef SD_RECORDING
+  readers += recorder.active();
+  #endif
+  clientCount = attached > readers ? attached - readers : 0;
+  updateStats(display, clientCount, hours % 24, hours / 24, WiFi.status() == WL_CONNECTED);
+}
+
+// Share of the last window each stage held its core: capture on core 0, the event loop on core 1
+void sample_utilisation(void * ctx)
+{
+  static uint64_t lastAt = 0, lastCapture = 0, lastTransmit = 0;
+  uint64_t now = esp_timer_get_time();
+  uint64_t capture = pipelineMetrics.captureBusy.value();
+  uint64_t transmit = server.busyMicros() + rtsp.busyMicros();
+  if (lastAt)
   {
-    prevMillis = millis();
-    uptimeHours++;
-    if (uptimeHours >= 24)
-    {
-      uptimeHours = 0;
-      uptimeDays++;
-    }
+    uint64_t window = now - lastAt;
+    captureUtilPermille = (capture - lastCapture) * 1000 / window;
+    transmitUtilPermille = (transmit - lastTransmit) * 1000 / window;
   }
-  // Update the display with the new stats
-  updateStats(display, clientCount, uptimeHours, uptimeDays, WiFi.status() == WL_CONNECTED);
-  delay(29000); // Let core 0 breathe
-  // vTaskDelete(NULL); // Nuke this task from core 0
+  lastAt = now;
+  lastCapture = capture;
+  lastTransmit = transmit;
+}
+
+// The driver retries on its own for a while; a link still down after WIFI_RECONNECT_MS gets
+// an explicit reconnect, which returns before the association so the task is not held up
+void check_wifi(void * ctx)
+{
+  static uint64_t downSince = 0;
+  if (WiFi.status() == WL_CONNECTED)
+  {
+    downSince = 0;
+    return;
+  }
+  uint64_t now = esp_timer_get_time();
+  if (!downSince)
+    downSince = now;
+  else if (now - downSince >= WIFI_RECONNECT_MS * 1000ULL)
+  {
+    #ifdef DEBUG
+      Serial.println("WiFi down, reconnecting.");
+    #endif
+    WiFi.reconnect();
+    wifiReconnects.add();
+    downSince = now;
+  }
+}
+
+void restart_now(void * ctx)
+{
+  ESP.restart();
 }
 
 // Main loop automatically assigned to core 1
 void loop(void)
 {
-  server.handleClient();
-  delay(1);
+  // Send stage: the capture task's frame goes out to the streams in this poll()
+  broadcaster.publishQueued();
+  // Sleeps in select() until a socket or a new frame needs attention
+  server.poll(100);
+  abr.tick(esp_timer_get_time());
+  check_update();
+}
+
+void wake_server(void * ctx)
+{
+  server.wake();
+}
+
+// A published frame goes out on both the HTTP and the RTSP loop
+void wake_streams(void * ctx)
+{
+  server.wake();
+  rtsp.wake();
+}
+
+void rtsp_task(void * pvParameters)
+{
+  for (;;)
+    rtsp.poll(100);
+}
+
+void setup_bitrate_control(const CameraPreset &p)
+{
+  abr.configure(ABR_TARGET_FPS, ABR_WINDOW_MS);
+  align_bitrate_control(p);
+  abr.onApply(apply_stream_level, NULL);
+  MJPEGStreamer::observer = &bitrateObserver;
 }
 
-void render_login_page(void)
+// The preset's framesize is both the starting rung and the ceiling, its quality the best any
+// rung streams at. The starting rung goes to the sensor right away, so what /reconfig and the
+// metrics report as the stream's level is what the sensor runs
+void align_bitrate_control(const CameraPreset &p)
 {
-  server.sendHeader("Connection", "close");
-  server.send(200, "text/html", loginIndex);
+  uint8_t levels = sizeof(abrLadder) / sizeof(abrLadder[0]);
+  uint8_t ceiling = 0;
+  while (ceiling < levels - 1 && abrLadder[ceiling].framesize > p.framesize)
+    ceiling++;
+  abr.setCeiling(ceiling);
+  abr.setQualityFloor(p.quality);
+  abr.setLevel(ceiling);
+  apply_stream_level(abr.current(), NULL);
+}
+
+void apply_stream_level(const AbrLevel &level, void * ctx)
+{
+  sensor_t *s = esp_camera_sensor_get();
+  if (!s)
+    return;
+  s->set_framesize(s, (framesize_t)level.framesize);
+  s->set_quality(s, level.quality);
   #ifdef DEBUG
-    Serial.println("Login page rendered.");
+    Serial.printf("Bitrate control: framesize %u, quality %u (%.1f fps, link %.0f%% busy)\n",
+                  level.framesize, level.quality, abr.lastFps(), abr.lastBusy() * 100);
   #endif
 }
 
-void render_update_page(void)
+// Both /update (the multipart form) and /ota; the reply waits until the image is on flash and checked
+void finish_update(HttpConnection &conn)
+{
+  otaRequest(ota, conn);
+}
+
+void perform_update(HttpConnection &conn, const Upload &upload)
 {
-  server.sendHeader("Connection", "close");
-  server.send(200, "text/html", serverIndex);
   #ifdef DEBUG
-    Serial.println("Update page rendered.");
+    if (upload.status == UPLOAD_START)
+      Serial.printf("Update: %s\n", upload.filename[0] ? upload.filename : conn.query());
+    else if (upload.status == UPLOAD_ABORTED)
+      Serial.printf("Update upload interrupted after %u bytes.\n", upload.totalSize);
   #endif
+  otaUpload(ota, conn, upload);
 }
 
-void finish_update(void)
+void ota_task(void * pvParameters)
 {
-  server.sendHeader("Connection", "close");
-  server.send(200, "text/plain", (Update.hasError()) ? "FAIL" : "OK");
-  ESP.restart();
+  ota.run();
+  vTaskDelete(NULL);
 }
 
-void perform_update(void)
+// Restart into a verified image once its reply has had time to leave; a failed one only
+// lights the LED (LED_indicate() blinks with delay(), which would hold up the event loop)
+void check_update(void)
 {
-  HTTPUpload& upload = server.upload();
-  if (upload.status == UPLOAD_FILE_START)
+  static OtaState seen = OTA_IDLE;
+  OtaState state = ota.state();
+  if (state == seen)
+    return;
+  seen = state;
+  if (state == OTA_DONE)
+  {
+    housekeeping.after("restart", UPDATE_RESTART_MS, restart_now, NULL);
+    #ifdef DEBUG
+      Serial.println("Update verified.\nRebooting...");
+    #endif
+  }
+  else if (state == OTA_FAILED)
   {
+    digitalWrite(ONBOARD_LED, LOW); // on, contrary to how it looks
     #ifdef DEBUG
-      Serial.printf("Update: %s\n", upload.filename.c_str());
+      char json[400];
+      ota.status(json, sizeof(json));
+      Serial.printf("Update failed: %s\n", json);
     #endif
-    if (!Update.begin(UPDATE_SIZE_UNKNOWN))
-    {
-      LED_indicate(1);
-      //start with max available size
-      #ifdef DEBUG
-        Update.printError(Serial);
-      #endif
-    }
-  } else if (upload.status == UPLOAD_FILE_WRITE) {
-    /* flashing firmware to ESP*/
-    if (Update.write(upload.buf, upload.currentSize) != upload.currentSize)
-    {
-      LED_indicate(1);
-      #ifdef DEBUG
-        Update.printError(Serial);
-      #endif
-    }
-  } else if (upload.status == UPLOAD_FILE_END) {
-    if (Update.end(true))
-    {
-      LED_indicate(0);
-      // true to set the size to the current progress
-      #ifdef DEBUG
-        Serial.printf("Update Success: %u\nRebooting...\n", upload.totalSize);
-      #endif
-    }
-    else
-    {
-      LED_indicate(1);
-      #ifdef DEBUG
-        Update.printError(Serial);
-      #endif
-    }
-  }
-}
-
-void handle_jpg_stream(void)
-{
-  char buf[32];
-  int s;
-
-  WiFiClient client = server.client();
-
-  client.write(HEADER, hdrLen);
-  client.write(BOUNDARY, bdrLen);
-
-  clientCount = 1;
+  }
+  else if (state == OTA_RECEIVING)
+  {
+    digitalWrite(ONBOARD_LED, HIGH);
+  }
+}
+
+void capture_task(void * pvParameters)
+{
+  for (;;)
+    broadcaster.captureOnce();
+}
+
+// Producer of a scaled tier, idles in captureOnce() while the tier has no clients
+void tier_task(void * pvParameters)
+{
+  MJPEGBroadcaster *tier = (MJPEGBroadcaster *)pvParameters;
+  for (;;)
+    tier->captureOnce();
+}
+
+void handle_jpg_stream(HttpConnection &conn)
+{
+  // /mjpeg?chunked=1 wraps the multipart body in Transfer-Encoding: chunked
+  char chunked[4] = "";
+  conn.arg("chunked", chunked, sizeof(chunked));
+  // /mjpeg?tier=low is the half-size stream, for phones and slow links
+  char tier[8] = "";
+  conn.arg("tier", tier, sizeof(tier));
+  bool low = !strcmp(tier, "low") && LowTierTask;
+  // The event loop pumps the stream from here on, so other requests keep being served
+  conn.stream(new MJPEGStreamer(low ? lowTier : broadcaster, chunked[0] == '1'));
   #ifdef DEBUG
-    Serial.printf("Client count updated to %d\n", clientCount);
+    Serial.printf("Client count updated to %d\n", broadcaster.clientCount());
     Serial.println("Serving MJPEG stream to a new client now.");
+    const StreamStats &t = MJPEGStreamer::totals;
+    if (t.frames)
+      Serial.printf("Streamed so far: %u frames, %llu bytes/frame, %.2f writes/frame\n",
+                    t.frames, t.bytes / t.frames, (float)t.writes / t.frames);
+  #endif
+}
+
+void handle_ws(HttpConnection &conn)
+{
+  char accept[WS_ACCEPT_SIZE];
+  if (!wsAccept(conn, accept))
+    return;
+  // How many frames the client may have unacknowledged, 0 leaves the pacing to TCP
+  char inflight[12];
+  uint8_t window = conn.arg("inflight", inflight, sizeof(inflight)) ? WebSocketStreamer::inflightArg(inflight)
+                                                                    : WS_DEFAULT_INFLIGHT;
+  char tier[8] = "";
+  conn.arg("tier", tier, sizeof(tier));
+  bool low = !strcmp(tier, "low") && LowTierTask;
+  conn.stream(new WebSocketStreamer(low ? lowTier : broadcaster, accept, window));
+  #ifdef DEBUG
+    Serial.printf("WebSocket client with %u frames in flight, %u sessions open\n", window, WebSocketStreamer::live());
   #endif
+}
 
-  while (true)
+void handle_jpg(HttpConnection &conn)
+{
+  // Served from the latest frame when it is recent enough, otherwise once a fresh one is published
+  char maxAge[12];
+  long age = JPG_MAX_AGE_MS;
+  if (conn.arg("max_age", maxAge, sizeof(maxAge)) && !parse_number(maxAge, 0, JPG_MAX_AGE_LIMIT_MS, age))
+  {
+    conn.send(400, "text/plain", "max_age must be 0-60000 ms.");
+    return;
+  }
+  conn.stream(new SnapshotStreamer(broadcaster, age));
+  #ifdef DEBUG
+    Serial.printf("JPEG requested (%u cached, %u captured so far).\n", SnapshotStreamer::hits, SnapshotStreamer::misses);
+  #endif
+}
+
+void handle_thumb(HttpConnection &conn)
+{
+  if (!ThumbTierTask)
   {
-    if (!client.connected())
-    {
-      clientCount = 0;
-      #ifdef DEBUG
-        Serial.printf("Client count updated to %d\n", clientCount);
-        Serial.println("Clients disconnected, MJPEG stream killed.");
-      #endif
-      break;
-    }
-    cam.run();
-    s = cam.getSize();
-    client.write(CTNTTYPE, cntLen);
-    sprintf( buf, "%d\r\n\r\n", s );
-    client.write(buf, strlen(buf));
-    client.write((char *)cam.getfb(), s);
-    client.write(BOUNDARY, bdrLen);
+    conn.send(503, "text/plain", "No scaled tiers without PSRAM.");
+    return;
   }
+  // Same caching as /jpg, from the quarter-size tier
+  conn.stream(new SnapshotStreamer(thumbTier, JPG_MAX_AGE_MS));
 }
 
-void handle_jpg(void)
+void handle_metrics(HttpConnection &conn)
 {
-  WiFiClient client = server.client();
+  std::string out;
+  out.reserve(6144);
+  PromWriter w(out);
+  writePipelineMetrics(w);
+  writeMotionMetrics(w);
+  writeNotifyMetrics(w);
+  writeRingMetrics(w);
+  writeOtaMetrics(w);
+  writeSchedulerMetrics(w, housekeeping);
+  writeScaleMetrics(w);
+  writeRtspMetrics(w);
+  writeWebSocketMetrics(w);
+  #ifdef SD_RECORDING
+  writeRecordMetrics(w);
+  w.gauge("esp32cam_record_active", "Recording to the SD card", recorder.active());
+  w.gauge("esp32cam_record_queue_frames", "Frames waiting for the SD card", recorder.queued());
+  w.gauge("esp32cam_record_queue_bytes", "Bytes waiting for the SD card", recorder.queuedBytes());
+  writeTimelapseMetrics(w);
+  w.gauge("esp32cam_timelapse_active", "Time-lapse capture running", timelapseJob != 0);
+  w.gauge("esp32cam_timelapse_stored_frames", "Frames in the time-lapse store", timelapseStore.count());
+  w.gauge("esp32cam_timelapse_store_bytes", "Frame data in the time-lapse store", timelapseStore.bytes());
+  #endif
+  w.gauge("esp32cam_ring_used_bytes", "Frame bytes held in the event ring", eventRing.used());
+  w.gauge("esp32cam_ring_capacity_bytes", "Event ring arena available for frames", eventRing.capacity());
+  w.gauge("esp32cam_ring_frames", "Frames held in the event ring", eventRing.frameCount());
+  w.gauge("esp32cam_ring_span_seconds", "History held in the event ring", eventRing.spanMs() / 1e3);
+  w.gauge("esp32cam_stream_clients", "Clients attached to the broadcaster (streams and pending stills)", broadcaster.clientCount());
+  w.gauge("esp32cam_tier_clients", "Clients attached to the scaled tiers", lowTier.clientCount() + thumbTier.clientCount());
+  w.gauge("esp32cam_rtsp_clients", "Open RTSP connections", rtsp.clientCount());
+  w.gauge("esp32cam_rtsp_playing", "RTSP sessions currently playing", rtsp.playingCount());
+  w.gauge("esp32cam_http_connections", "Open HTTP connections", server.connectionCount());
+  w.counter("esp32cam_transmit_busy_seconds_total", "Time the event loop spent serving and sending, outside select()",
+            server.busyMicros() / 1e6);
+  w.gauge("esp32cam_capture_utilisation_ratio", "Share of the last sample window the capture stage held core 0",
+          captureUtilPermille / 1e3);
+  w.gauge("esp32cam_transmit_utilisation_ratio", "Share of the last sample window the HTTP and RTSP loops held core 1",
+          transmitUtilPermille / 1e3);
+  w.gauge("esp32cam_stream_framesize", "Framesize the bitrate controller currently streams at (framesize_t)", abr.current().framesize);
+  w.gauge("esp32cam_stream_quality", "JPEG quality the bitrate controller currently streams at", abr.current().quality);
+  w.counter("esp32cam_bitrate_changes_total", "Bitrate controller level changes", abr.changes());
+  w.gauge("esp32cam_heap_free_bytes", "Free internal heap", ESP.getFreeHeap());
+  w.gauge("esp32cam_heap_min_free_bytes", "Lowest free internal heap since boot", ESP.getMinFreeHeap());
+  w.gauge("esp32cam_heap_max_alloc_bytes", "Largest allocatable internal heap block", ESP.getMaxAllocHeap());
+  w.gauge("esp32cam_psram_free_bytes", "Free PSRAM", ESP.getFreePsram());
+  w.gauge("esp32cam_wifi_rssi_dbm", "WiFi signal strength", WiFi.RSSI());
+  w.counter("esp32cam_wifi_reconnects_total", "Reconnects the WiFi check asked for after a sustained outage", wifiReconnects.value());
+  w.gauge("esp32cam_uptime_seconds", "Time since boot", esp_timer_get_time() / 1e6);
+  conn.sendCopy(200, "text/plain; version=0.0.4", out.data(), out.size());
+}
 
-  if (!client.connected()) return;
-  cam.run(); delay(100); cam.run(); // double capture to dump buffer
-  client.write(JHEADER, jhdLen);
-  client.write((char *)cam.getfb(), cam.getSize());
+void handle_clip(HttpConnection &conn)
+{
+  char value[4] = "";
+  if (conn.arg("trigger", value, sizeof(value)) && value[0] == '1')
+    eventRing.trigger();
+  value[0] = 0;
+  conn.arg("pace", value, sizeof(value));
+  ClipStreamer *clip = new ClipStreamer(eventRing, value[0] != '0');
+  if (!clip->opened())
+  {
+    delete clip;
+    conn.send(404, "text/plain", "No event clip recorded.");
+    return;
+  }
+  // Still recording clips are followed until their post-trigger window closes
+  conn.stream(clip);
+  #ifdef DEBUG
+    Serial.printf("Serving the event clip (%s).\n", eventRing.recording() ? "still recording" : "complete");
+  #endif
+}
 
+// Pages and the files they reference, from flash; the asset table decides by path
+void serve_asset(HttpConnection &conn)
+{
+  const StaticAsset *asset = findAsset(webAssets, WEB_ASSET_COUNT, conn.path());
+  if (!asset)
+  {
+    handleNotFound(conn);
+    return;
+  }
+  sendAsset(conn, *asset);
   #ifdef DEBUG
-    Serial.println("JPEG posted.");
+    Serial.printf("Served %s.\n", asset->path);
   #endif
 }
 
-void handleNotFound()
+void handleNotFound(HttpConnection &conn)
 {
-  String message = "Server is running!\n\n";
-  message += "URI: ";
-  message += server.uri();
-  message += "\nMethod: ";
-  message += (server.method() == HTTP_GET) ? "GET" : "POST";
-  message += "\nArguments: ";
-  message += server.args();
-  message += "\n";
-  server.send(200, "text / plain", message);
+  // Stylesheets and the like have no routes of their own
+  const StaticAsset *asset = findAsset(webAssets, WEB_ASSET_COUNT, conn.path());
+  if (asset && conn.method() == METHOD_GET)
+  {
+    sendAsset(conn, *asset);
+    return;
+  }
+  char message[192];
+  int len = snprintf(message, sizeof(message), "Server is running!\n\nURI: %s\nMethod: %s\nArguments: %d\n",
+                     conn.path(), (conn.method() == METHOD_GET) ? "GET" : "POST", conn.argCount());
+  conn.sendCopy(200, "text/plain", message, len);
   #ifdef DEBUG
     Serial.println("Serving 404 page.");
   #endif
@@ -445,45 +1011,442 @@ void IRAM_ATTR softRestart() {
   ESP.restart();
 }
 
-void IRAM_ATTR postNotification()
+void IRAM_ATTR sensorTriggered()
+{
+  notifier.postFromISR(NOTIFY_SENSOR);
+}
+
+void notify_task(void * pvParameters)
+{
+  notifier.run();
+  vTaskDelete(NULL);
+}
+
+// Runs as each new event batch opens: cut a clip around the event, attach the latest
+// streamed frame when there is a recent one
+bool notify_snapshot(FrameRef &out, void * ctx)
+{
+  eventRing.trigger();
+  return broadcaster.latest(out, NOTIFY_SNAPSHOT_MAX_MS);
+}
+
+void clip_task(void * pvParameters)
+{
+  clipRecorder.run();
+  vTaskDelete(NULL);
+}
+
+void motion_task(void * pvParameters)
+{
+  motion.run();
+  vTaskDelete(NULL);
+}
+
+void motion_detected(const MotionResult &result, void * ctx)
+{
+  #ifdef DEBUG
+    Serial.printf("Motion: %u regions, largest %u of %u cells\n", result.blobs, result.largest, result.cells);
+  #endif
+  notifier.post(NOTIFY_MOTION);
+}
+
+#ifdef SD_RECORDING
+void record_feed_task(void * pvParameters)
+{
+  recorder.runFeeder();
+  vTaskDelete(NULL);
+}
+
+void record_write_task(void * pvParameters)
+{
+  recorder.runWriter();
+  vTaskDelete(NULL);
+}
+
+void report_recording(HttpConnection &conn)
+{
+  char file[96], json[224];
+  uint64_t bytes;
+  recorder.file(file, sizeof(file), &bytes);
+  int len = snprintf(json, sizeof(json), "{\"recording\":%s,\"file\":\"%s\",\"file_bytes\":%llu,\"queued\":%u,\"free_bytes\":%llu}",
+                     recorder.active() ? "true" : "false", file, (unsigned long long)bytes, recorder.queued(),
+                     (unsigned long long)(SD_MMC.totalBytes() - SD_MMC.usedBytes()));
+  conn.sendCopy(200, "application/json", json, len);
+}
+
+void modify_recording(HttpConnection &conn)
 {
+  char on[4];
+  if (!conn.arg("on", on, sizeof(on)))
+  {
+    conn.send(400, "application/json", "{\"ok\":false,\"error\":\"missing on=0|1\"}");
+    return;
+  }
+  if (on[0] == '1')
+    recorder.start();
+  else
+    recorder.stop(); // the file is finished once the queue drains
+  #ifdef DEBUG
+    Serial.printf("Recording %s.\n", recorder.active() ? "started" : "stopped");
+  #endif
+  report_recording(conn);
+}
+
+void timelapse_task(void * pvParameters)
+{
+  timelapse.run();
+  vTaskDelete(NULL);
+}
+
+// Housekeeping job: only hands the frame to the time-lapse task, the card never holds up the others
+void timelapse_due(void * ctx)
+{
+  timelapse.trigger();
+}
+
+// Time-lapse frames at their own framesize, on the capture task between two stream frames
+void switch_timelapse(bool on, void * ctx)
+{
+  if (on)
+  {
+    // Keep the bitrate controller off the sensor, streams hand their frames back on their next pump
+    abr.setEnabled(false);
+    wake_streams(NULL);
+  }
+  sensor_t *s = esp_camera_sensor_get();
+  // The frame buffers were sized for the preset, a reconfiguration since may have shrunk them
+  uint8_t framesize = timelapseConfig.framesize < preset.framesize ? timelapseConfig.framesize : preset.framesize;
+  if (s)
+    s->set_framesize(s, (framesize_t)(on ? framesize : abr.current().framesize));
+  if (!on)
+    abr.setEnabled(true);
+}
+
+// Starts, restarts or stops the periodic job from timelapseConfig; a started one takes its first frame right away
+void apply_timelapse(void)
+{
+  if (timelapseJob)
+    housekeeping.cancel(timelapseJob);
+  timelapseJob = 0;
+  timelapse.onSwitch(timelapseConfig.framesize ? switch_timelapse : NULL, NULL);
+  if (timelapseConfig.active)
+    timelapseJob = housekeeping.every("timelapse", timelapseConfig.interval_s * 1000, timelapse_due, NULL);
+}
+
+void load_timelapse(void)
+{
+  TimelapseConfig stored;
+  prefs.begin("timelapse", true);
+  size_t len = prefs.getBytes("config", &stored, sizeof(stored));
+  prefs.end();
+  if (len == sizeof(stored) && stored.interval_s >= 1 && stored.interval_s <= TIMELAPSE_MAX_INTERVAL)
+    timelapseConfig = stored;
   #ifdef DEBUG
-    Serial.println("Attempting to perform HTTP POST request to webhook.");
+    Serial.printf("Time-lapse: %s, every %u s, framesize %u, %u frames stored\n", timelapseConfig.active ? "on" : "off",
+                  timelapseConfig.interval_s, timelapseConfig.framesize, timelapseStore.count());
   #endif
-  // Use common Wifi client
-  WiFiClient client = server.client();
+}
+
+bool save_timelapse(void)
+{
+  if (!prefs.begin("timelapse", false))
+    return false;
+  bool ok = prefs.putBytes("config", &timelapseConfig, sizeof(timelapseConfig)) == sizeof(timelapseConfig);
+  prefs.end();
+  return ok;
+}
+
+void report_timelapse(HttpConnection &conn)
+{
+  if (!TimelapseTask)
+  {
+    conn.send(503, "application/json", "{\"ok\":false,\"error\":\"no time-lapse store\"}");
+    return;
+  }
+  TimelapseEntry first = {0, 0, 0}, last = {0, 0, 0};
+  uint32_t frames = timelapseStore.count();
+  if (frames)
+  {
+    timelapseStore.entry(0, first);
+    timelapseStore.entry(frames - 1, last);
+  }
+  char json[256];
+  int len = snprintf(json, sizeof(json),
+                     "{\"active\":%s,\"interval_s\":%u,\"framesize\":%u,\"frames\":%u,\"bytes\":%u,\"first\":%u,"
+                     "\"last\":%u,\"full\":%s,\"free_bytes\":%llu}",
+                     timelapseJob ? "true" : "false", timelapseConfig.interval_s, timelapseConfig.framesize, frames,
+                     timelapseStore.bytes(), first.time, last.time, timelapseStore.full() ? "true" : "false",
+                     (unsigned long long)(SD_MMC.totalBytes() - SD_MMC.usedBytes()));
+  conn.sendCopy(200, "application/json", json, len);
+}
+
+void modify_timelapse(HttpConnection &conn)
+{
+  if (!TimelapseTask)
+  {
+    report_timelapse(conn);
+    return;
+  }
+  // Anything left out keeps its current value
+  TimelapseConfig next = timelapseConfig;
+  char value[12];
+  if (conn.arg("on", value, sizeof(value)))
+    next.active = value[0] == '1';
+  long interval = next.interval_s, framesize = next.framesize;
+  // Range-checked before narrowing, so e.g. framesize=265 cannot wrap into a valid 9
+  bool parsed = (!conn.arg("interval", value, sizeof(value)) || parse_number(value, 1, TIMELAPSE_MAX_INTERVAL, interval)) &&
+                (!conn.arg("framesize", value, sizeof(value)) || parse_number(value, 0, UINT8_MAX, framesize));
+  next.interval_s = interval;
+  next.framesize = framesize;
+  if (!parsed || next.interval_s < 1 || next.interval_s > TIMELAPSE_MAX_INTERVAL ||
+      (next.framesize && (next.framesize < FRAMESIZE_QVGA || next.framesize > preset.framesize)))
+  {
+    conn.send(400, "application/json", "{\"ok\":false,\"error\":\"invalid interval or framesize\"}");
+    return;
+  }
+  if (conn.arg("clear", value, sizeof(value)) && value[0] == '1')
+    timelapseStore.clear();
+  timelapseConfig = next;
+  save_timelapse();
+  apply_timelapse();
+  #ifdef DEBUG
+    Serial.printf("Time-lapse %s, every %u s, framesize %u.\n", timelapseJob ? "running" : "stopped",
+                  timelapseConfig.interval_s, timelapseConfig.framesize);
+  #endif
+  report_timelapse(conn);
+}
+
+void handle_timelapse(HttpConnection &conn)
+{
+  if (!TimelapseTask)
+  {
+    conn.send(503, "text/plain", "No time-lapse store.");
+    return;
+  }
+  // Unix times, either end left out is open; frames are read off the card as the link drains
+  char value[16];
+  long from = 0, to = 0;
+  float fps = TIMELAPSE_PLAY_FPS;
+  bool parsed = (!conn.arg("from", value, sizeof(value)) || parse_number(value, 0, INT32_MAX, from)) &&
+                (!conn.arg("to", value, sizeof(value)) || parse_number(value, 0, INT32_MAX, to));
+  if (parsed && conn.arg("fps", value, sizeof(value)))
+  {
+    // 0 plays as fast as the link takes it; the range check also turns away NaN
+    char *end;
+    fps = strtof(value, &end);
+    parsed = end != value && !*end && (fps == 0 || (fps >= 0.01f && fps <= TIMELAPSE_MAX_FPS));
+  }
+  if (!parsed)
+  {
+    conn.send(400, "text/plain", "Invalid from, to or fps.");
+    return;
+  }
+  TimelapseStreamer *playback = new TimelapseStreamer(timelapseStore, from, to, fps);
+  if (!playback->opened())
+  {
+    delete playback;
+    conn.send(404, "text/plain", "No time-lapse frames in that range.");
+    return;
+  }
+  conn.stream(playback);
+  #ifdef DEBUG
+    Serial.printf("Playing back %u time-lapse frames at %.1f fps.\n", playback->frames(), fps);
+  #endif
+}
+#endif
+
+int WebhookTransport::post(const char *contentType, const std::string &body, uint32_t *retryAfter_ms)
+{
+  #ifdef DEBUG
+    Serial.printf("Attempting to perform HTTP POST request to webhook (%u bytes).\n", body.size());
+  #endif
+  // Use a dedicated Wifi client
+  WiFiClient client;
   // Generate a temporary HTTP client
   HTTPClient http;
   http.begin(client, webhookURL);
-  http.addHeader("Content-Type", "application/json");
-  String message = "{ \"content\": \"This is where message content goes\", \"embeds\": null, \"username\": \"usernamedisplayed\", \"attachments\": [] }";
+  http.addHeader("Content-Type", contentType);
+  const char *keep[] = {"Retry-After"};
+  http.collectHeaders(keep, 1);
   // Perform POST request, grab response code, discard HTTP client
-  int httpResponseCode = http.POST(message);
+  int httpResponseCode = http.POST((uint8_t *)body.data(), body.size());
+  if (httpResponseCode == 429 && http.hasHeader("Retry-After"))
+    *retryAfter_ms = http.header("Retry-After").toFloat() * 1000;
   #ifdef DEBUG
     Serial.print("HTTP Response code: ");
     Serial.println(httpResponseCode);
   #endif
   http.end();
+  return httpResponseCode;
 }
 
-/*
-void render_dashboard(void)
+void report_config(HttpConnection &conn)
 {
-  server.sendHeader("Connection", "close");
-  const char* dashboardIndex = "";
-  server.send(200, "text/html", dashboardIndex);
+  char json[128];
+  AbrLevel stream = abr.current();
+  int len = snprintf(json, sizeof(json),
+                     "{\"framesize\":%u,\"quality\":%u,\"fb_count\":%u,\"stream_framesize\":%u,\"stream_quality\":%u}",
+                     preset.framesize, preset.quality, preset.fbCount, stream.framesize, stream.quality);
+  conn.sendCopy(200, "application/json", json, len);
+}
+
+void modify_config(HttpConnection &conn)
+{
+  // Anything left out keeps its current value
+  CameraPreset next = preset;
+  char value[12];
+  long framesize = next.framesize, quality = next.quality, fbCount = next.fbCount;
+  // Range-checked before narrowing, so e.g. framesize=264 cannot wrap into a valid 8
+  bool parsed = (!conn.arg("framesize", value, sizeof(value)) || parse_number(value, 0, UINT8_MAX, framesize)) &&
+                (!conn.arg("quality", value, sizeof(value)) || parse_number(value, 0, UINT8_MAX, quality)) &&
+                (!conn.arg("fb_count", value, sizeof(value)) || parse_number(value, 0, UINT8_MAX, fbCount));
+  next.framesize = framesize;
+  next.quality = quality;
+  next.fbCount = fbCount;
+  if (!parsed || !preset_valid(next))
+  {
+    conn.send(400, "application/json", "{\"ok\":false,\"error\":\"invalid preset\"}");
+    return;
+  }
+
+  ReconfigJob *job = new ReconfigJob();
+  job->preset = next;
+  job->requested = esp_timer_get_time();
+  job->drainMs = job->applyMs = job->totalMs = 0;
+  job->reinit = job->persisted = false;
+  job->err = ESP_OK;
+  job->done = false;
+  job->refs = 2;
+  if (!broadcaster.schedule(run_reconfig, job))
+  {
+    delete job;
+    conn.send(409, "application/json", "{\"ok\":false,\"error\":\"reconfiguration in progress\"}");
+    return;
+  }
+  // The capture task picks the job up between two frames, the loop keeps serving meanwhile
+  conn.stream(new ReconfigReply(job));
   #ifdef DEBUG
-    Serial.println("Dashboard page rendered.");
+    Serial.printf("Reconfiguration requested: framesize %u, quality %u, %u frame buffers\n",
+                  next.framesize, next.quality, next.fbCount);
   #endif
 }
 
-void modify_config(void)
+void run_reconfig(void * ctx)
 {
-  String postData = server.arg(server.args() - 1);
+  ReconfigJob *job = (ReconfigJob *)ctx;
+  uint64_t start = esp_timer_get_time();
+  // Keep the bitrate controller off the sensor, streams hand their frames back on their next pump
+  abr.setEnabled(false);
+  server.wake();
+  if (!cam.drain(RECONFIG_DRAIN_MS))
+  {
+    job->err = ESP_ERR_TIMEOUT;
+  }
+  else
+  {
+    uint64_t drained = esp_timer_get_time();
+    job->drainMs = (drained - start) / 1000;
+    job->err = cam.reconfigure(camera_config_helper(job->preset), &job->reinit);
+    job->applyMs = (esp_timer_get_time() - drained) / 1000;
+  }
+  if (job->err == ESP_OK)
+  {
+    preset = job->preset;
+    align_bitrate_control(preset);
+  }
+  abr.setEnabled(true);
+  job->totalMs = (esp_timer_get_time() - job->requested) / 1000;
+  if (job->err == ESP_OK)
+    job->persisted = save_preset(preset);
+  #ifdef DEBUG
+    Serial.printf("Reconfiguration %s after %u ms (drain %u ms, %s %u ms)\n", job->err == ESP_OK ? "done" : "failed",
+                  job->totalMs, job->drainMs, job->reinit ? "reinit" : "live", job->applyMs);
+  #endif
+  job->done = true;
+  server.wake();
+  release_reconfig(job);
+}
+
+void release_reconfig(ReconfigJob *job)
+{
+  if (--job->refs == 0)
+    delete job;
+}
+
+ReconfigReply::~ReconfigReply()
+{
+  release_reconfig(_job);
+}
+
+bool ReconfigReply::pump(HttpConnection &conn)
+{
+  if (_sent)
+    return false;
+  char json[192];
+  int len;
+  int code = 200;
+  if (_job->err == ESP_OK)
+    len = snprintf(json, sizeof(json),
+                   "{\"ok\":true,\"framesize\":%u,\"quality\":%u,\"fb_count\":%u,\"mode\":\"%s\","
+                   "\"drain_ms\":%u,\"apply_ms\":%u,\"total_ms\":%u,\"persisted\":%s}",
+                   _job->preset.framesize, _job->preset.quality, _job->preset.fbCount, _job->reinit ? "reinit" : "live",
+                   _job->drainMs, _job->applyMs, _job->totalMs, _job->persisted ? "true" : "false");
+  else
+  {
+    code = 503;
+    len = snprintf(json, sizeof(json), "{\"ok\":false,\"error\":\"%s\",\"total_ms\":%u}",
+                   _job->err == ESP_ERR_TIMEOUT ? "frames still in use" : "camera rejected the preset", _job->totalMs);
+  }
+  conn.sendCopy(code, "application/json", json, len);
+  _sent = true;
+  return true;
+}
+
+// A whole decimal number within [lo, hi] and nothing else; out is left alone otherwise.
+// strtol saturates on overflow, which lands outside any range used here
+bool parse_number(const char *text, long lo, long hi, long &out)
+{
+  char *end;
+  long v = strtol(text, &end, 10);
+  if (end == text || *end || v < lo || v > hi)
+    return false;
+  out = v;
+  return true;
+}
+
+bool preset_valid(const CameraPreset &p)
+{
+  // Below quality 4 the OV2640 overflows its JPEG buffers; PSRAM comfortably holds 3 buffers
+  return p.framesize >= FRAMESIZE_QVGA && p.framesize <= FRAMESIZE_UXGA &&
+         p.quality >= 4 && p.quality <= 63 &&
+         p.fbCount >= 1 && p.fbCount <= 3;
+}
+
+// RTC memory is garbage on a cold boot, NVS keeps the last validated preset
+void load_preset(void)
+{
+  CameraPreset stored;
+  prefs.begin("camera", true);
+  size_t len = prefs.getBytes("preset", &stored, sizeof(stored));
+  prefs.end();
+  if (len == sizeof(stored) && preset_valid(stored))
+    preset = stored;
+  #ifdef DEBUG
+    Serial.printf("Camera preset: framesize %u, quality %u, %u frame buffers (%s)\n",
+                  preset.framesize, preset.quality, preset.fbCount, len == sizeof(stored) ? "stored" : "default");
+  #endif
+}
+
+bool save_preset(const CameraPreset &p)
+{
+  if (!prefs.begin("camera", false))
+    return false;
+  bool ok = prefs.putBytes("preset", &p, sizeof(p)) == sizeof(p);
+  prefs.end();
+  return ok;
 }
-*/
 
-camera_config_t camera_config_helper(uint8_t qualityPreset)
+camera_config_t camera_config_helper(const CameraPreset &p)
 {
   camera_config_t config;
   config.ledc_channel = LEDC_CHANNEL_0;
@@ -508,10 +1471,10 @@ camera_config_t camera_config_helper(uint8_t qualityPreset)
   config.pixel_format = PIXFORMAT_JPEG;
 
   /* Reference paste */
-  config.frame_size = (framesize_t) qualityPreset;
+  config.frame_size = (framesize_t) p.framesize;
   // config.frame_size = FRAMESIZE_VGA;
-  config.jpeg_quality = 12;
+  config.jpeg_quality = p.quality;
   // config.jpeg_quality = 12;
-  config.fb_count = 2;
+  config.fb_count = p.fbCount;
   return config;
 }
\ No newline at end of file
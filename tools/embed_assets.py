@@ -0,0 +1,78 @@
+# Embeds web/ into include/WebAssets.h as gzip-compressed arrays with strong ETags, so the
+# pages are served straight from flash. Runs before every PlatformIO build (extra_scripts),
+# or by hand: python tools/embed_assets.py
+#
+# {{file}} in a page is replaced by that file from web/, so every page is one request; each
+# page pulls in only the stylesheets it uses.
+import gzip
+import hashlib
+import os
+import re
+
+# Source file, URL, content type
+ASSETS = [
+    ("login.html", "/", "text/html"),
+    ("update.html", "/serverIndex", "text/html"),
+    ("dash.html", "/dash", "text/html"),
+]
+
+
+def minify(text):
+    # Comments, indentation and blank lines only, the rest is left to gzip
+    text = re.sub(r"<!--.*?-->", "", text, flags=re.S)
+    lines = (line.strip() for line in text.splitlines())
+    return "\n".join(line for line in lines if line and not line.startswith("//")) + "\n"
+
+
+def minify_css(text):
+    text = re.sub(r"\s+", " ", text)
+    return re.sub(r" ?([{}:;,]) ?", r"\1", text).replace(";}", "}").strip()
+
+
+def generate(root):
+    web = os.path.join(root, "web")
+    out = os.path.join(root, "include", "WebAssets.h")
+    sources = [os.path.join(web, f) for f in os.listdir(web)] + [os.path.join(root, "tools", "embed_assets.py")]
+    if os.path.exists(out) and all(os.path.getmtime(s) <= os.path.getmtime(out) for s in sources):
+        return
+
+    def include(match):
+        name = match.group(1)
+        with open(os.path.join(web, name), encoding="utf-8") as f:
+            text = f.read()
+        return minify_css(text) if name.endswith(".css") else minify(text).strip()
+
+    arrays = []
+    entries = []
+    for name, path, ctype in ASSETS:
+        with open(os.path.join(web, name), encoding="utf-8") as f:
+            text = minify(f.read())
+        text = re.sub(r"\{\{([^}/]+)\}\}", include, text)
+        raw = text.encode("utf-8")
+        # mtime 0 keeps the output, and so the ETag, the same for the same input
+        packed = gzip.compress(raw, compresslevel=9, mtime=0)
+        etag = hashlib.sha256(raw).hexdigest()[:16]
+        ident = "asset_" + re.sub(r"\W", "_", name)
+        body = ",\n".join(
+            "  " + ",".join("0x%02x" % b for b in packed[i:i + 20]) for i in range(0, len(packed), 20))
+        arrays.append("static const uint8_t %s[] = {\n%s};\n" % (ident, body))
+        entries.append('  {"%s", "%s", %s, sizeof(%s), %d, "\\"%s\\""},' %
+                       (path, ctype, ident, ident, len(raw), etag))
+
+    header = (
+        "// Generated by tools/embed_assets.py from web/, do not edit\n"
+        "#ifndef WEB_ASSETS_H_\n#define WEB_ASSETS_H_\n\n#include <StaticAsset.h>\n\n"
+        + "\n".join(arrays)
+        + "\nstatic const StaticAsset webAssets[] = {\n" + "\n".join(entries) + "\n};\n"
+        + "#define WEB_ASSET_COUNT (sizeof(webAssets) / sizeof(webAssets[0]))\n\n#endif // WEB_ASSETS_H_\n")
+    with open(out, "w", encoding="utf-8") as f:
+        f.write(header)
+    print("embed_assets: %s, %d assets" % (out, len(ASSETS)))
+
+
+try:
+    Import("env")  # noqa: F821 (run as a PlatformIO pre: script)
+    root = env.subst("$PROJECT_DIR")  # noqa: F821
+except NameError:
+    root = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+generate(root)